@@ -839,6 +839,8 @@ void CL_InitCGame( void ) {
 	mapname = Info_ValueForKey( info, "mapname" );
 	Com_sprintf( cl.mapname, sizeof( cl.mapname ), "maps/%s.bsp", mapname );
 
+	FS_BeginMapLoad( mapname );
+
 	// allow vertex lighting for in-game elements
 	re.VertexLighting( true );
 
@@ -878,6 +880,8 @@ void CL_InitCGame( void ) {
 	// on the card even if the driver does deferred loading
 	re.EndRegistration();
 
+	FS_EndMapLoad();
+
 	// make sure everything is paged in
 	if (!Sys_LowPhysicalMemory()) {
 		Com_TouchMemory();
@@ -3354,6 +3354,9 @@ static void CL_InitRef( void ) {
 	rimp.Error = Com_Error;
 	rimp.Milliseconds = CL_ScaledMilliseconds;
 	rimp.Microseconds = Sys_Microseconds;
+	rimp.traceActive = &com_traceActive;
+	rimp.TraceBegin = Com_TraceBegin;
+	rimp.TraceEnd = Com_TraceEnd;
 	rimp.Malloc = CL_RefMalloc;
 	rimp.FreeAll = CL_RefFreeAll;
 	rimp.Free = Z_Free;
@@ -3375,6 +3378,8 @@ static void CL_InitRef( void ) {
 	rimp.FS_ListFiles = FS_ListFiles;
 	//rimp.FS_FileIsInPAK = FS_FileIsInPAK;
 	rimp.FS_FileExists = FS_FileExists;
+	rimp.FS_ReadFileAsync = FS_ReadFileAsync;
+	rimp.FS_FinishAsyncReads = FS_FinishAsyncReads;
 
 	rimp.Cvar_Get = Cvar_Get;
 	rimp.Cvar_Set = Cvar_Set;
@@ -57,6 +57,7 @@ int			c_traces, c_brush_traces, c_patch_traces;
 
 
 static byte *cmod_base;
+static bool cmod_mapped;		// cmod_base points to a read-only file mapping
 
 #ifndef BSPC
 cvar_t		*cm_noAreas;
@@ -302,8 +303,15 @@ static void CMod_LoadLeafs( const lump_t *l )
 			cm.numAreas = out->area + 1;
 	}
 
+	if ( cm.numAreas > MAX_MAP_AREAS )
+		Com_Error( ERR_DROP, "%s: MAX_MAP_AREAS exceeded", __func__ );
+
 	cm.areas = Hunk_Alloc( cm.numAreas * sizeof( *cm.areas ), h_high );
 	cm.areaPortals = Hunk_Alloc( cm.numAreas * cm.numAreas * sizeof( *cm.areaPortals ), h_high );
+
+	// rows are padded to 32 bits, extra row is used for invalid areas
+	cm.areaBytes = ( ( cm.numAreas + 31 ) & ~31 ) >> 3;
+	cm.areaConnections = Hunk_Alloc( ( cm.numAreas + 1 ) * cm.areaBytes, h_high );
 }
 
 
@@ -482,6 +490,7 @@ CMod_LoadVisibility
 #define	VIS_HEADER	8
 static void CMod_LoadVisibility( const lump_t *l ) {
 	int		len;
+	int		i, rowBytes;
 	byte	*buf;
 
 	len = l->filelen;
@@ -493,11 +502,28 @@ static void CMod_LoadVisibility( const lump_t *l ) {
 	}
 	buf = cmod_base + l->fileofs;
 
+	if ( len < VIS_HEADER )
+		Com_Error( ERR_DROP, "%s: funny lump size", __func__ );
+
 	cm.vised = true;
-	cm.visibility = Hunk_Alloc( len, h_high );
 	cm.numClusters = LittleLong( ((int *)buf)[0] );
-	cm.clusterBytes = LittleLong( ((int *)buf)[1] );
-	Com_Memcpy (cm.visibility, buf + VIS_HEADER, len - VIS_HEADER );
+	rowBytes = LittleLong( ((int *)buf)[1] );
+
+	if ( cm.numClusters < 0 || rowBytes < 0 || ( rowBytes && cm.numClusters > ( len - VIS_HEADER ) / rowBytes ) )
+		Com_Error( ERR_DROP, "%s: funny lump size", __func__ );
+
+	// keep rows 64-bit aligned so they can be tested a word at a time
+	cm.clusterBytes = PAD( rowBytes, sizeof( uint64_t ) );
+
+	cm.visibility = Hunk_Alloc( cm.numClusters * cm.clusterBytes, h_high );
+
+	if ( cm.clusterBytes == rowBytes ) {
+		Com_Memcpy( cm.visibility, buf + VIS_HEADER, cm.numClusters * rowBytes );
+	} else {
+		for ( i = 0; i < cm.numClusters; i++ ) {
+			Com_Memcpy( cm.visibility + i * cm.clusterBytes, buf + VIS_HEADER + i * rowBytes, rowBytes );
+		}
+	}
 }
 
 //==================================================================
@@ -645,14 +671,26 @@ void CM_LoadMap( const char *name, bool clientload, int *checksum ) {
 	// load the file
 	//
 #ifndef BSPC
-	length = FS_ReadFile( name, &buf );
+	// map it to avoid reading the whole file into a temporary buffer,
+	// every lump is still copied out and the mapping is released at the end
+	length = FS_MapFile( name, &buf );
+	cmod_mapped = ( buf != NULL );
+	if ( !cmod_mapped ) {
+		length = FS_ReadFile( name, &buf );
+	}
 #else
 	length = LoadQuakeFile( (quakefile_t *) name, &buf );
+	cmod_mapped = false;
 #endif
 
 	if ( !buf ) {
 		Com_Error( ERR_DROP, "%s: couldn't load %s", __func__, name );
 	}
+	if ( cmod_mapped ) {
+		// released with CM_ClearMap() if loading fails
+		cm.mapData = buf;
+		cm.mapLength = length;
+	}
 	if ( length < sizeof( dheader_t ) ) {
 		Com_Error( ERR_DROP, "%s: %s has truncated header", __func__, name );
 	}
@@ -695,7 +733,16 @@ void CM_LoadMap( const char *name, bool clientload, int *checksum ) {
 	CMod_CheckLeafBrushes();
 
 	// we are NOT freeing the file, because it is cached for the ref
-	FS_FreeFile( buf );
+	if ( !cmod_mapped ) {
+		FS_FreeFile( buf );
+	} else {
+		// all lumps are copied, do not keep the pak mapped while map is running
+		// as it may be rewritten in place
+		FS_UnmapFile( buf, length );
+		cm.mapData = NULL;
+		cm.mapLength = 0;
+	}
+	cmod_base = NULL;
 
 	CM_InitBoxHull();
 
@@ -714,6 +761,12 @@ CM_ClearMap
 ==================
 */
 void CM_ClearMap( void ) {
+#ifndef BSPC
+	CM_StopRecord();
+	if ( cm.mapData ) {
+		FS_UnmapFile( cm.mapData, cm.mapLength );
+	}
+#endif
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
 }
@@ -855,6 +908,10 @@ Capsules are handled differently though.
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
 
+	if ( cm_recordFile != FS_INVALID_HANDLE ) {
+		CM_RecordTempBoxModel( mins, maxs, capsule );
+	}
+
 	VectorCopy( mins, box_model.mins );
 	VectorCopy( maxs, box_model.maxs );
 
@@ -154,7 +154,7 @@ typedef struct {
 	cbrush_t	*brushes;
 
 	int			numClusters;
-	int			clusterBytes;
+	int			clusterBytes;	// row size, padded to 64 bits
 	byte		*visibility;
 	bool		vised;			// if false, visibility is just a single cluster of ffs
 
@@ -164,11 +164,17 @@ typedef struct {
 	int			numAreas;
 	cArea_t		*areas;
 	int			*areaPortals;	// [ numAreas*numAreas ] reference counts
+	int			areaBytes;		// size of a single areaConnections row
+	byte		*areaConnections;	// [ (numAreas+1)*areaBytes ] reachability bits, last row is empty
 
 	int			numSurfaces;
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
+	void		*mapData;				// read-only file mapping, only while CM_LoadMap runs
+	int			mapLength;
+
 	int			floodvalid;
+	int			floodnum;					// last assigned flood number
 	int			checkcount;					// incremented on each trace
 
 	unsigned int checksum;
@@ -234,6 +240,36 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle );
 bool CM_BoundsIntersect( const vec3_t mins, const vec3_t maxs, const vec3_t mins2, const vec3_t maxs2 );
 bool CM_BoundsIntersectPoint( const vec3_t mins, const vec3_t maxs, const vec3_t point );
 
+// cm_trace.c
+
+typedef enum {
+	TT_POSITION,	// start equals end, tested in place
+	TT_POINT,		// zero sized sweep
+	TT_BOX,			// axial bounding box sweep
+	TT_CAPSULE		// capsule sweep or any sweep against the capsule model
+} traceType_t;
+
+traceType_t CM_TraceType( const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs, clipHandle_t model, bool capsule );
+
+// cm_record.c
+
+typedef enum {
+	CMR_TEMPBOXMODEL,
+	CMR_BOXTRACE,
+	CMR_TRANSFORMEDBOXTRACE,
+	CMR_POINTCONTENTS,
+	CMR_NUM_TYPES
+} cmRecordType_t;
+
+extern	fileHandle_t	cm_recordFile;
+
+void CM_RecordTempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule );
+void CM_RecordTrace( cmRecordType_t type, const trace_t *results, const vec3_t start, const vec3_t end,
+						const vec3_t mins, const vec3_t maxs, clipHandle_t model, int brushmask,
+						const vec3_t origin, const vec3_t angles, bool capsule );
+void CM_RecordPointContents( const vec3_t p, clipHandle_t model, int contents );
+void CM_StopRecord( void );
+
 // cm_patch.c
 
 struct patchCollide_s	*CM_GeneratePatchCollide( int width, int height, vec3_t *points );
@@ -23,6 +23,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qfiles.h"
 
 
+void		CM_Init( void );
 void		CM_LoadMap( const char *name, bool clientload, int *checksum);
 void		CM_ClearMap( void );
 clipHandle_t CM_InlineModel( int index );		// 0 = world, 1 + are bmodels
@@ -47,6 +48,7 @@ void		CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 						const vec3_t origin, const vec3_t angles, bool capsule );
 
 byte		*CM_ClusterPVS (int cluster);
+bool		CM_ClusterRangeVisible( const byte *pvs, int first, int last );
 
 int			CM_PointLeafnum( const vec3_t p );
 
@@ -60,6 +62,7 @@ int			CM_LeafArea (int leafnum);
 
 void		CM_AdjustAreaPortalState( int area1, int area2, bool open );
 bool		CM_AreasConnected( int area1, int area2 );
+const byte	*CM_ConnectedAreas( int area );
 
 int			CM_WriteAreaBits( byte *buffer, int area );
 
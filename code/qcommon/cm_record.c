@@ -0,0 +1,671 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+#include "cm_local.h"
+
+/*
+===============================================================================
+
+COLLISION CALL RECORDING AND REPLAY
+
+"cm_record <name>" logs every CM_TempBoxModel, CM_BoxTrace,
+CM_TransformedBoxTrace and CM_PointContents call together with its result
+to traces/<name>.trc until "cm_stoprecord" or the next map change.
+
+"cm_replay <name> [passes]" loads the recorded map and runs the log against
+the collision model: the first pass times every call and compares results
+with the recorded ones, the following passes measure throughput and report
+the fastest pass per call type as "best ns".
+
+The log is written in native byte order, it is meant to be replayed by the
+same kind of machine that recorded it.
+
+===============================================================================
+*/
+
+#define CM_RECORD_IDENT		(('R'<<24)+('T'<<16)+('M'<<8)+'C')
+#define CM_RECORD_VERSION	1
+
+#define CM_RECORD_DIR		"traces"
+#define CM_RECORD_EXT		".trc"
+
+#define MAX_REPLAY_PASSES	100
+#define MAX_REPORTED_MISMATCHES	8
+
+typedef struct {
+	int		ident;
+	int		version;
+	int		checksum;
+	char	mapname[MAX_QPATH];
+} cmRecordHeader_t;
+
+typedef struct {
+	int		type;			// cmRecordType_t
+	int		model;
+	int		brushmask;
+	int		capsule;
+	vec3_t	start;			// point for CMR_POINTCONTENTS
+	vec3_t	end;
+	vec3_t	mins;
+	vec3_t	maxs;
+	vec3_t	origin;
+	vec3_t	angles;
+
+	// results
+	int		allsolid;
+	int		startsolid;
+	float	fraction;
+	vec3_t	endpos;
+	vec3_t	normal;
+	float	dist;
+	int		surfaceFlags;
+	int		contents;
+} cmRecord_t;
+
+// latency histogram: exact below 32ns, then 16 sub-buckets per power of two
+#define LATENCY_SUB_BITS	4
+#define LATENCY_SUBS		(1<<LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS		1024
+
+typedef struct {
+	int		calls;
+	int		mismatches;
+	int64_t	totalTime;
+	int64_t	maxTime;
+	int64_t	passTime;		// throughput pass being measured
+	int64_t	bestPassTime;	// fastest throughput pass
+	int		histogram[LATENCY_BUCKETS];
+} cmReplayStats_t;
+
+// replay statistics are kept per CM_Trace code path rather than per entry point
+typedef enum {
+	RC_TEMPBOX,
+	RC_POINT,
+	RC_BOX,
+	RC_CAPSULE,
+	RC_POSITION,
+	RC_CONTENTS,
+	RC_NUM_CATEGORIES
+} cmReplayCategory_t;
+
+static const char *cm_replayCategoryNames[ RC_NUM_CATEGORIES ] = {
+	"tempbox",
+	"point",
+	"box",
+	"capsule",
+	"position",
+	"contents"
+};
+
+fileHandle_t	cm_recordFile = FS_INVALID_HANDLE;
+static int		cm_recordCount;
+
+
+/*
+===============================================================================
+
+RECORDING
+
+===============================================================================
+*/
+
+/*
+==================
+CM_WriteRecord
+==================
+*/
+static void CM_WriteRecord( const cmRecord_t *r ) {
+	if ( FS_Write( r, sizeof( *r ), cm_recordFile ) != sizeof( *r ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to write collision record, stopped recording\n" );
+		CM_StopRecord();
+		return;
+	}
+	cm_recordCount++;
+}
+
+
+/*
+==================
+CM_RecordTempBoxModel
+==================
+*/
+void CM_RecordTempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+	cmRecord_t r;
+
+	Com_Memset( &r, 0, sizeof( r ) );
+	r.type = CMR_TEMPBOXMODEL;
+	r.capsule = capsule;
+	VectorCopy( mins, r.mins );
+	VectorCopy( maxs, r.maxs );
+
+	CM_WriteRecord( &r );
+}
+
+
+/*
+==================
+CM_RecordTrace
+==================
+*/
+void CM_RecordTrace( cmRecordType_t type, const trace_t *results, const vec3_t start, const vec3_t end,
+						const vec3_t mins, const vec3_t maxs, clipHandle_t model, int brushmask,
+						const vec3_t origin, const vec3_t angles, bool capsule ) {
+	cmRecord_t r;
+
+	Com_Memset( &r, 0, sizeof( r ) );
+	r.type = type;
+	r.model = model;
+	r.brushmask = brushmask;
+	r.capsule = capsule;
+	VectorCopy( start, r.start );
+	VectorCopy( end, r.end );
+	if ( mins ) {
+		VectorCopy( mins, r.mins );
+	}
+	if ( maxs ) {
+		VectorCopy( maxs, r.maxs );
+	}
+	if ( origin ) {
+		VectorCopy( origin, r.origin );
+	}
+	if ( angles ) {
+		VectorCopy( angles, r.angles );
+	}
+
+	r.allsolid = results->allsolid;
+	r.startsolid = results->startsolid;
+	r.fraction = results->fraction;
+	VectorCopy( results->endpos, r.endpos );
+	VectorCopy( results->plane.normal, r.normal );
+	r.dist = results->plane.dist;
+	r.surfaceFlags = results->surfaceFlags;
+	r.contents = results->contents;
+
+	CM_WriteRecord( &r );
+}
+
+
+/*
+==================
+CM_RecordPointContents
+==================
+*/
+void CM_RecordPointContents( const vec3_t p, clipHandle_t model, int contents ) {
+	cmRecord_t r;
+
+	Com_Memset( &r, 0, sizeof( r ) );
+	r.type = CMR_POINTCONTENTS;
+	r.model = model;
+	VectorCopy( p, r.start );
+	r.contents = contents;
+
+	CM_WriteRecord( &r );
+}
+
+
+/*
+==================
+CM_StopRecord
+==================
+*/
+void CM_StopRecord( void ) {
+	if ( cm_recordFile == FS_INVALID_HANDLE ) {
+		return;
+	}
+
+	FS_FCloseFile( cm_recordFile );
+	cm_recordFile = FS_INVALID_HANDLE;
+
+	Com_Printf( "Stopped collision recording, %i calls written.\n", cm_recordCount );
+}
+
+
+/*
+==================
+CM_Record_f
+==================
+*/
+static void CM_Record_f( void ) {
+	cmRecordHeader_t header;
+	char name[MAX_QPATH];
+
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "usage: %s <name>\n", Cmd_Argv( 0 ) );
+		return;
+	}
+
+	if ( cm_recordFile != FS_INVALID_HANDLE ) {
+		Com_Printf( "Already recording collision calls.\n" );
+		return;
+	}
+
+	if ( !cm.name[0] ) {
+		Com_Printf( "No map loaded.\n" );
+		return;
+	}
+
+	Com_sprintf( name, sizeof( name ), CM_RECORD_DIR "/%s", Cmd_Argv( 1 ) );
+	COM_DefaultExtension( name, sizeof( name ), CM_RECORD_EXT );
+
+	cm_recordFile = FS_FOpenFileWrite( name );
+	if ( cm_recordFile == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open %s\n", name );
+		return;
+	}
+
+	Com_Memset( &header, 0, sizeof( header ) );
+	header.ident = CM_RECORD_IDENT;
+	header.version = CM_RECORD_VERSION;
+	header.checksum = cm.checksum;
+	Q_strncpyz( header.mapname, cm.name, sizeof( header.mapname ) );
+	FS_Write( &header, sizeof( header ), cm_recordFile );
+
+	cm_recordCount = 0;
+
+	Com_Printf( "Recording collision calls for %s to %s.\n", cm.name, name );
+}
+
+
+/*
+===============================================================================
+
+REPLAY
+
+===============================================================================
+*/
+
+/*
+==================
+CM_LatencyBucket
+==================
+*/
+static int CM_LatencyBucket( int64_t ns ) {
+	int shift;
+
+	if ( ns < 2 * LATENCY_SUBS ) {
+		return ns < 0 ? 0 : (int)ns;
+	}
+
+	shift = 0;
+	while ( ns >= 2 * LATENCY_SUBS ) {
+		ns >>= 1;
+		shift++;
+	}
+
+	// ns is in [LATENCY_SUBS, 2*LATENCY_SUBS) now
+	if ( shift >= ( LATENCY_BUCKETS >> LATENCY_SUB_BITS ) - 1 ) {
+		return LATENCY_BUCKETS - 1;
+	}
+
+	return ( shift << LATENCY_SUB_BITS ) + (int)ns;
+}
+
+
+/*
+==================
+CM_LatencyBucketValue
+
+Lower bound of the bucket in nanoseconds
+==================
+*/
+static int64_t CM_LatencyBucketValue( int bucket ) {
+	int shift;
+
+	if ( bucket < 2 * LATENCY_SUBS ) {
+		return bucket;
+	}
+
+	shift = bucket >> LATENCY_SUB_BITS;
+
+	return (int64_t)( LATENCY_SUBS + ( bucket & ( LATENCY_SUBS - 1 ) ) ) << ( shift - 1 );
+}
+
+
+/*
+==================
+CM_LatencyPercentile
+==================
+*/
+static int64_t CM_LatencyPercentile( const cmReplayStats_t *stats, int percent ) {
+	int64_t target, sum;
+	int i;
+
+	target = ( (int64_t)stats->calls * percent + 99 ) / 100;
+	sum = 0;
+
+	for ( i = 0; i < LATENCY_BUCKETS; i++ ) {
+		sum += stats->histogram[i];
+		if ( sum >= target ) {
+			return CM_LatencyBucketValue( i );
+		}
+	}
+
+	return stats->maxTime;
+}
+
+
+/*
+==================
+CM_ReplayCategory
+==================
+*/
+static cmReplayCategory_t CM_ReplayCategory( const cmRecord_t *r ) {
+	if ( r->type == CMR_TEMPBOXMODEL ) {
+		return RC_TEMPBOX;
+	}
+	if ( r->type == CMR_POINTCONTENTS ) {
+		return RC_CONTENTS;
+	}
+	switch ( CM_TraceType( r->start, r->end, r->mins, r->maxs, r->model, r->capsule ) ) {
+	case TT_POSITION:
+		return RC_POSITION;
+	case TT_POINT:
+		return RC_POINT;
+	case TT_CAPSULE:
+		return RC_CAPSULE;
+	default:
+		return RC_BOX;
+	}
+}
+
+
+/*
+==================
+CM_ReplayCall
+==================
+*/
+static void CM_ReplayCall( const cmRecord_t *r, trace_t *trace ) {
+	switch ( r->type ) {
+	case CMR_TEMPBOXMODEL:
+		CM_TempBoxModel( r->mins, r->maxs, r->capsule );
+		break;
+	case CMR_BOXTRACE:
+		CM_BoxTrace( trace, r->start, r->end, r->mins, r->maxs, r->model, r->brushmask, r->capsule );
+		break;
+	case CMR_TRANSFORMEDBOXTRACE:
+		CM_TransformedBoxTrace( trace, r->start, r->end, r->mins, r->maxs, r->model, r->brushmask,
+			r->origin, r->angles, r->capsule );
+		break;
+	case CMR_POINTCONTENTS:
+		trace->contents = CM_PointContents( r->start, r->model );
+		break;
+	}
+}
+
+
+/*
+==================
+CM_ReplayMismatch
+==================
+*/
+static bool CM_ReplayMismatch( const cmRecord_t *r, const trace_t *trace ) {
+	switch ( r->type ) {
+	case CMR_BOXTRACE:
+	case CMR_TRANSFORMEDBOXTRACE:
+		return r->allsolid != trace->allsolid
+			|| r->startsolid != trace->startsolid
+			|| r->fraction != trace->fraction
+			|| !VectorCompare( r->endpos, trace->endpos )
+			|| !VectorCompare( r->normal, trace->plane.normal )
+			|| r->dist != trace->plane.dist
+			|| r->surfaceFlags != trace->surfaceFlags
+			|| r->contents != trace->contents;
+	case CMR_POINTCONTENTS:
+		return r->contents != trace->contents;
+	default:
+		return false;
+	}
+}
+
+
+/*
+==================
+CM_ValidRecords
+==================
+*/
+static bool CM_ValidRecords( const cmRecord_t *records, int count ) {
+	const cmRecord_t *r;
+	int i;
+
+	for ( i = 0, r = records; i < count; i++, r++ ) {
+		if ( (unsigned)r->type >= CMR_NUM_TYPES ) {
+			Com_Printf( "Bad record type %i at %i.\n", r->type, i );
+			return false;
+		}
+		if ( r->type == CMR_TEMPBOXMODEL ) {
+			continue;
+		}
+		if ( r->model == BOX_MODEL_HANDLE ) {
+			continue;
+		}
+		if ( r->model < 0 || r->model >= cm.numSubModels ) {
+			Com_Printf( "Bad model handle %i at %i.\n", r->model, i );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/*
+==================
+CM_Replay_f
+==================
+*/
+static void CM_Replay_f( void ) {
+	static cmReplayStats_t stats[ RC_NUM_CATEGORIES ];
+	cmRecordHeader_t header;
+	const cmRecord_t *records, *r;
+	byte *categories;
+	char name[MAX_QPATH];
+	fileHandle_t f;
+	void *buffer;
+	bool mapped;
+	trace_t trace;
+	int64_t start, passStart, t, best, total;
+	int length, count, calls, mismatches;
+	int passes, pass, i, category;
+	int checksum;
+
+	if ( Cmd_Argc() < 2 || Cmd_Argc() > 3 ) {
+		Com_Printf( "usage: %s <name> [passes]\n", Cmd_Argv( 0 ) );
+		return;
+	}
+
+	if ( cm_recordFile != FS_INVALID_HANDLE ) {
+		Com_Printf( "Can't replay while recording.\n" );
+		return;
+	}
+
+	passes = 1;
+	if ( Cmd_Argc() == 3 ) {
+		passes = atoi( Cmd_Argv( 2 ) );
+		if ( passes < 1 || passes > MAX_REPLAY_PASSES ) {
+			Com_Printf( "passes must be within [1..%i]\n", MAX_REPLAY_PASSES );
+			return;
+		}
+	}
+
+	Com_sprintf( name, sizeof( name ), CM_RECORD_DIR "/%s", Cmd_Argv( 1 ) );
+	COM_DefaultExtension( name, sizeof( name ), CM_RECORD_EXT );
+
+	// header first, the map must be in place before the log is touched
+	length = FS_FOpenFileRead( name, &f, true );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( "Couldn't open %s\n", name );
+		return;
+	}
+	Com_Memset( &header, 0, sizeof( header ) );
+	FS_Read( &header, sizeof( header ), f );
+	FS_FCloseFile( f );
+
+	if ( header.ident != CM_RECORD_IDENT || header.version != CM_RECORD_VERSION ) {
+		Com_Printf( "%s is not a version %i collision record.\n", name, CM_RECORD_VERSION );
+		return;
+	}
+	header.mapname[ sizeof( header.mapname ) - 1 ] = '\0';
+
+	if ( length < (int)sizeof( header ) || ( length - sizeof( header ) ) % sizeof( cmRecord_t ) ) {
+		Com_Printf( "%s has unexpected size %i.\n", name, length );
+		return;
+	}
+
+	if ( Q_stricmp( cm.name, header.mapname ) ) {
+		// only a dedicated server without a running map can switch collision models freely
+		if ( !com_dedicated->integer || com_sv_running->integer ) {
+			Com_Printf( "%s was recorded on %s, load that map first.\n", name, header.mapname );
+			return;
+		}
+		CM_LoadMap( header.mapname, false, &checksum );
+	}
+
+	if ( cm.checksum != (unsigned int)header.checksum ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %s checksum differs from the recorded one, expect mismatches.\n", cm.name );
+	}
+
+	length = FS_MapFile( name, &buffer );
+	mapped = ( buffer != NULL );
+	if ( !mapped ) {
+		length = FS_ReadFile( name, &buffer );
+		if ( !buffer ) {
+			Com_Printf( "Couldn't read %s\n", name );
+			return;
+		}
+	}
+
+	records = (const cmRecord_t *)( (const byte *)buffer + sizeof( header ) );
+	count = ( length - (int)sizeof( header ) ) / (int)sizeof( cmRecord_t );
+
+	if ( !CM_ValidRecords( records, count ) ) {
+		if ( mapped )
+			FS_UnmapFile( buffer, length );
+		else
+			FS_FreeFile( buffer );
+		return;
+	}
+
+	Com_Printf( "Replaying %i collision calls on %s, %i pass%s.\n", count, cm.name, passes, passes > 1 ? "es" : "" );
+
+	categories = Z_Malloc( count );
+
+	// verification pass, every call timed separately
+	Com_Memset( stats, 0, sizeof( stats ) );
+	Com_Memset( &trace, 0, sizeof( trace ) );
+	for ( i = 0, r = records; i < count; i++, r++ ) {
+		start = Sys_Nanoseconds();
+		CM_ReplayCall( r, &trace );
+		t = Sys_Nanoseconds() - start;
+
+		category = CM_ReplayCategory( r );
+		categories[ i ] = category;
+		stats[ category ].calls++;
+		stats[ category ].totalTime += t;
+		if ( t > stats[ category ].maxTime ) {
+			stats[ category ].maxTime = t;
+		}
+		stats[ category ].histogram[ CM_LatencyBucket( t ) ]++;
+
+		if ( CM_ReplayMismatch( r, &trace ) ) {
+			if ( stats[ category ].mismatches++ < MAX_REPORTED_MISMATCHES ) {
+				Com_Printf( "mismatch at %i (%s): fraction %f/%f contents %i/%i allsolid %i/%i startsolid %i/%i\n",
+					i, cm_replayCategoryNames[ category ], r->fraction, trace.fraction, r->contents, trace.contents,
+					r->allsolid, trace.allsolid, r->startsolid, trace.startsolid );
+			}
+		}
+	}
+
+	// throughput passes, warm caches, every call timed for its category
+	best = 0;
+	total = 0;
+	for ( pass = 0; pass < passes; pass++ ) {
+		for ( category = 0; category < RC_NUM_CATEGORIES; category++ ) {
+			stats[ category ].passTime = 0;
+		}
+		t = Sys_Nanoseconds();
+		passStart = t;
+		for ( i = 0, r = records; i < count; i++, r++ ) {
+			start = t;
+			CM_ReplayCall( r, &trace );
+			t = Sys_Nanoseconds();
+			stats[ categories[ i ] ].passTime += t - start;
+		}
+		t -= passStart;
+		total += t;
+		if ( !best || t < best ) {
+			best = t;
+		}
+		for ( category = 0; category < RC_NUM_CATEGORIES; category++ ) {
+			if ( !stats[ category ].bestPassTime || stats[ category ].passTime < stats[ category ].bestPassTime ) {
+				stats[ category ].bestPassTime = stats[ category ].passTime;
+			}
+		}
+	}
+
+	Z_Free( categories );
+
+	if ( mapped )
+		FS_UnmapFile( buffer, length );
+	else
+		FS_FreeFile( buffer );
+
+	Com_Printf( "%-12s %9s %8s %8s %8s %8s %9s %8s %10s\n", "type", "calls", "avg ns", "p50", "p90", "p99", "max", "best ns", "mismatch" );
+
+	calls = 0;
+	mismatches = 0;
+	for ( category = 0; category < RC_NUM_CATEGORIES; category++ ) {
+		const cmReplayStats_t *s = &stats[ category ];
+		if ( !s->calls ) {
+			continue;
+		}
+		Com_Printf( "%-12s %9i %8i %8i %8i %8i %9i %8i %10i\n", cm_replayCategoryNames[ category ], s->calls,
+			(int)( s->totalTime / s->calls ),
+			(int)CM_LatencyPercentile( s, 50 ), (int)CM_LatencyPercentile( s, 90 ),
+			(int)CM_LatencyPercentile( s, 99 ), (int)s->maxTime, (int)( s->bestPassTime / s->calls ), s->mismatches );
+		if ( category != RC_TEMPBOX ) {
+			calls += s->calls;
+		}
+		mismatches += s->mismatches;
+	}
+
+	if ( best > 0 ) {
+		Com_Printf( "%i calls: best pass %.3f msec (%.0f calls/sec), average %.3f msec\n", calls,
+			best / 1000000.0, calls * 1e9 / best, total / 1000000.0 / passes );
+	}
+
+	if ( mismatches ) {
+		Com_Printf( S_COLOR_YELLOW "%i results differ from the recording.\n", mismatches );
+	} else {
+		Com_Printf( "All results match the recording.\n" );
+	}
+}
+
+
+/*
+==================
+CM_Init
+==================
+*/
+void CM_Init( void ) {
+	Cmd_AddCommand( "cm_record", CM_Record_f );
+	Cmd_AddCommand( "cm_stoprecord", CM_StopRecord );
+	Cmd_AddCommand( "cm_replay", CM_Replay_f );
+}
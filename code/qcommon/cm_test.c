@@ -269,6 +269,10 @@ int CM_PointContents( const vec3_t p, clipHandle_t model ) {
 		}
 	}
 
+	if ( cm_recordFile != FS_INVALID_HANDLE ) {
+		CM_RecordPointContents( p, model, contents );
+	}
+
 	return contents;
 }
 
@@ -322,6 +326,57 @@ byte	*CM_ClusterPVS (int cluster) {
 }
 
 
+/*
+=================
+CM_ClusterRangeVisible
+
+Returns true if any cluster in [first, last] is set in the pvs row.
+PVS rows are 64-bit aligned so the middle of the span is tested a word at a time,
+byte order of the bits is kept so this works on any endianness
+=================
+*/
+bool CM_ClusterRangeVisible( const byte *pvs, int first, int last ) {
+	const uint64_t *words;
+
+	if ( first < 0 ) {
+		first = 0;
+	}
+
+	for ( ; first <= last && ( first & 7 ); first++ ) {
+		if ( pvs[ first >> 3 ] & ( 1 << ( first & 7 ) ) ) {
+			return true;
+		}
+	}
+
+	for ( ; first + 7 <= last && ( first & 63 ); first += 8 ) {
+		if ( pvs[ first >> 3 ] ) {
+			return true;
+		}
+	}
+
+	words = (const uint64_t *)pvs;
+	for ( ; first + 63 <= last; first += 64 ) {
+		if ( words[ first >> 6 ] ) {
+			return true;
+		}
+	}
+
+	for ( ; first + 7 <= last; first += 8 ) {
+		if ( pvs[ first >> 3 ] ) {
+			return true;
+		}
+	}
+
+	for ( ; first <= last; first++ ) {
+		if ( pvs[ first >> 3 ] & ( 1 << ( first & 7 ) ) ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 
 /*
 ===============================================================================
@@ -331,7 +386,7 @@ AREAPORTALS
 ===============================================================================
 */
 
-static void CM_FloodArea_r( int areaNum, int floodnum) {
+static void CM_FloodArea_r( int areaNum, int floodnum, byte *bits ) {
 	int		i;
 	cArea_t *area;
 	int		*con;
@@ -346,44 +401,105 @@ static void CM_FloodArea_r( int areaNum, int floodnum) {
 
 	area->floodnum = floodnum;
 	area->floodvalid = cm.floodvalid;
+	bits[ areaNum >> 3 ] |= 1 << ( areaNum & 7 );
 	con = cm.areaPortals + areaNum * cm.numAreas;
 	for ( i=0 ; i < cm.numAreas  ; i++ ) {
 		if ( con[i] > 0 ) {
-			CM_FloodArea_r( i, floodnum );
+			CM_FloodArea_r( i, floodnum, bits );
 		}
 	}
 }
 
+
 /*
 ====================
-CM_FloodAreaConnections
+CM_FloodAreaSet
 
+Reflood all areas in the set and rebuild their connection rows,
+set must be closed under the current portal connections
 ====================
 */
-void	CM_FloodAreaConnections( void ) {
-	int		i;
-	cArea_t	*area;
-	int		floodnum;
+static void CM_FloodAreaSet( const byte *set ) {
+	byte	areas[ MAX_MAP_AREA_BYTES ];
+	byte	bits[ MAX_MAP_AREA_BYTES ];
+	int		i, j;
+
+	// set may point to one of the rows we are going to rebuild
+	Com_Memcpy( areas, set, cm.areaBytes );
 
 	// all current floods are now invalid
 	cm.floodvalid++;
-	floodnum = 0;
 
-	for (i = 0 ; i < cm.numAreas ; i++) {
-		area = &cm.areas[i];
-		if (area->floodvalid == cm.floodvalid) {
+	for ( i = 0; i < cm.numAreas; i++ ) {
+		if ( !( areas[ i >> 3 ] & ( 1 << ( i & 7 ) ) ) ) {
+			continue;
+		}
+		if ( cm.areas[i].floodvalid == cm.floodvalid ) {
 			continue;		// already flooded into
 		}
-		floodnum++;
-		CM_FloodArea_r (i, floodnum);
+		Com_Memset( bits, 0, cm.areaBytes );
+		CM_FloodArea_r( i, ++cm.floodnum, bits );
+		// every member of the flood shares the same row
+		for ( j = i; j < cm.numAreas; j++ ) {
+			if ( bits[ j >> 3 ] & ( 1 << ( j & 7 ) ) ) {
+				Com_Memcpy( cm.areaConnections + j * cm.areaBytes, bits, cm.areaBytes );
+			}
+		}
 	}
+}
+
+
+/*
+====================
+CM_FloodAreaConnections
 
+====================
+*/
+void	CM_FloodAreaConnections( void ) {
+	byte	all[ MAX_MAP_AREA_BYTES ];
+
+	Com_Memset( all, 255, sizeof( all ) );
+
+	cm.floodnum = 0;
+
+	CM_FloodAreaSet( all );
+}
+
+
+/*
+====================
+CM_MergeAreaFloods
+
+Joins two disconnected floods after opening a portal between them
+====================
+*/
+static void CM_MergeAreaFloods( int area1, int area2 ) {
+	byte	bits[ MAX_MAP_AREA_BYTES ];
+	const byte *row1, *row2;
+	int		floodnum;
+	int		i;
+
+	row1 = cm.areaConnections + area1 * cm.areaBytes;
+	row2 = cm.areaConnections + area2 * cm.areaBytes;
+	for ( i = 0; i < cm.areaBytes; i++ ) {
+		bits[i] = row1[i] | row2[i];
+	}
+
+	floodnum = cm.areas[ area1 ].floodnum;
+	for ( i = 0; i < cm.numAreas; i++ ) {
+		if ( bits[ i >> 3 ] & ( 1 << ( i & 7 ) ) ) {
+			cm.areas[i].floodnum = floodnum;
+			Com_Memcpy( cm.areaConnections + i * cm.areaBytes, bits, cm.areaBytes );
+		}
+	}
 }
 
+
 /*
 ====================
 CM_AdjustAreaPortalState
 
+Only the floods touched by the portal are updated
 ====================
 */
 void	CM_AdjustAreaPortalState( int area1, int area2, bool open ) {
@@ -398,17 +514,23 @@ void	CM_AdjustAreaPortalState( int area1, int area2, bool open ) {
 	if ( open ) {
 		cm.areaPortals[ area1 * cm.numAreas + area2 ]++;
 		cm.areaPortals[ area2 * cm.numAreas + area1 ]++;
+		if ( cm.areas[ area1 ].floodnum != cm.areas[ area2 ].floodnum ) {
+			CM_MergeAreaFloods( area1, area2 );
+		}
 	} else {
 		cm.areaPortals[ area1 * cm.numAreas + area2 ]--;
 		cm.areaPortals[ area2 * cm.numAreas + area1 ]--;
 		if ( cm.areaPortals[ area2 * cm.numAreas + area1 ] < 0 ) {
 			Com_Error (ERR_DROP, "CM_AdjustAreaPortalState: negative reference count");
 		}
+		if ( cm.areaPortals[ area2 * cm.numAreas + area1 ] == 0 ) {
+			// flood may split, reflood just its own areas
+			CM_FloodAreaSet( cm.areaConnections + area1 * cm.areaBytes );
+		}
 	}
-
-	CM_FloodAreaConnections ();
 }
 
+
 /*
 ====================
 CM_AreasConnected
@@ -430,13 +552,41 @@ bool	CM_AreasConnected( int area1, int area2 ) {
 		Com_Error (ERR_DROP, "area >= cm.numAreas");
 	}
 
-	if (cm.areas[area1].floodnum == cm.areas[area2].floodnum) {
+	if ( cm.areaConnections[ area1 * cm.areaBytes + ( area2 >> 3 ) ] & ( 1 << ( area2 & 7 ) ) ) {
 		return true;
 	}
 	return false;
 }
 
 
+/*
+====================
+CM_ConnectedAreas
+
+Returns a bit vector of all the areas that are in the same flood
+as the area parameter, or NULL if all areas should be treated as connected.
+Invalid areas are not connected to anything.
+====================
+*/
+const byte *CM_ConnectedAreas( int area ) {
+#ifndef BSPC
+	if ( cm_noAreas->integer ) {
+		return NULL;
+	}
+#endif
+
+	if ( area < 0 ) {
+		return cm.areaConnections + cm.numAreas * cm.areaBytes;
+	}
+
+	if ( area >= cm.numAreas ) {
+		Com_Error( ERR_DROP, "area >= cm.numAreas" );
+	}
+
+	return cm.areaConnections + area * cm.areaBytes;
+}
+
+
 /*
 =================
 CM_WriteAreaBits
@@ -453,8 +603,8 @@ This is used to cull non-visible entities from snapshots
 */
 int CM_WriteAreaBits (byte *buffer, int area)
 {
+	const byte *bits;
 	int		i;
-	int		floodnum;
 	int		bytes;
 
 	bytes = (cm.numAreas+7)>>3;
@@ -469,11 +619,9 @@ int CM_WriteAreaBits (byte *buffer, int area)
 	}
 	else
 	{
-		floodnum = cm.areas[area].floodnum;
-		for (i=0 ; i<cm.numAreas ; i++)
-		{
-			if (cm.areas[i].floodnum == floodnum || area == -1)
-				buffer[i>>3] |= 1<<(i&7);
+		bits = cm.areaConnections + area * cm.areaBytes;
+		for ( i = 0; i < bytes; i++ ) {
+			buffer[i] |= bits[i];
 		}
 	}
 
@@ -28,6 +28,17 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 //#define CAPSULE_DEBUG
 
+// CM_Trace picks a sweep variant (traceType_t) once per trace, the tree walk
+// and the brush test are compiled once per variant with it as a constant so
+// the inner loops don't test tw->isPoint and tw->sphere.use over and over again
+#if defined( _MSC_VER )
+#define CM_TRACE_INLINE __forceinline
+#elif defined( __GNUC__ )
+#define CM_TRACE_INLINE ID_INLINE __attribute__((always_inline))
+#else
+#define CM_TRACE_INLINE ID_INLINE
+#endif
+
 /*
 ===============================================================================
 
@@ -472,9 +483,11 @@ static void CM_TraceThroughPatch( traceWork_t *tw, const cPatch_t *patch ) {
 /*
 ================
 CM_TraceThroughBrush
+
+Points need no plane expansion, capsules expand planes by the radius
 ================
 */
-static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
+static CM_TRACE_INLINE void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush, const traceType_t type ) {
 	int			i;
 	cplane_t	*plane, *clipplane;
 	double		dist;
@@ -502,7 +515,7 @@ static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
 
 	leadside = NULL;
 
-	if ( tw->sphere.use ) {
+	if ( type == TT_CAPSULE ) {
 		//
 		// compare the trace against all planes of the brush
 		// find the latest time the trace crosses a plane towards the interior
@@ -580,7 +593,11 @@ static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
 			plane = side->plane;
 
 			// adjust the plane distance appropriately for mins/maxs
-			dist = plane->dist - DotProductDP( tw->offsets[ plane->signbits ], plane->normal );
+			if ( type == TT_POINT ) {
+				dist = plane->dist;
+			} else {
+				dist = plane->dist - DotProductDP( tw->offsets[ plane->signbits ], plane->normal );
+			}
 
 			d1 = DotProductDP( tw->start, plane->normal ) - dist;
 			d2 = DotProductDP( tw->end, plane->normal ) - dist;
@@ -659,10 +676,10 @@ static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
 
 /*
 ================
-CM_TraceThroughLeaf
+CM_TraceThroughLeafType
 ================
 */
-static void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
+static CM_TRACE_INLINE void CM_TraceThroughLeafType( traceWork_t *tw, const cLeaf_t *leaf, const traceType_t type ) {
 	int			k;
 	int			brushnum;
 	cbrush_t	*b;
@@ -687,7 +704,7 @@ static void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 			continue;
 		}
 
-		CM_TraceThroughBrush( tw, b );
+		CM_TraceThroughBrush( tw, b, type );
 		if ( !tw->trace.fraction ) {
 			return;
 		}
@@ -721,6 +738,64 @@ static void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 	}
 }
 
+
+static void CM_TraceThroughLeafPoint( traceWork_t *tw, const cLeaf_t *leaf ) {
+	CM_TraceThroughLeafType( tw, leaf, TT_POINT );
+}
+
+static void CM_TraceThroughLeafBox( traceWork_t *tw, const cLeaf_t *leaf ) {
+	CM_TraceThroughLeafType( tw, leaf, TT_BOX );
+}
+
+static void CM_TraceThroughLeafCapsule( traceWork_t *tw, const cLeaf_t *leaf ) {
+	CM_TraceThroughLeafType( tw, leaf, TT_CAPSULE );
+}
+
+
+/*
+================
+CM_SweepType
+
+Variant of the tree walk and brush test for the trace, the capsule
+may come from the model rather than from the trace itself
+================
+*/
+static traceType_t CM_SweepType( const traceWork_t *tw ) {
+	if ( tw->sphere.use ) {
+		// zero sized capsule does the same math as a point
+		if ( tw->isPoint && tw->sphere.radius == 0 && tw->sphere.halfheight == 0 ) {
+			return TT_POINT;
+		}
+		return TT_CAPSULE;
+	}
+	if ( tw->isPoint ) {
+		return TT_POINT;
+	}
+	return TT_BOX;
+}
+
+
+/*
+================
+CM_TraceThroughLeaf
+
+Single leaf of an inline or temporary box model
+================
+*/
+static void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
+	switch ( CM_SweepType( tw ) ) {
+	case TT_POINT:
+		CM_TraceThroughLeafPoint( tw, leaf );
+		break;
+	case TT_CAPSULE:
+		CM_TraceThroughLeafCapsule( tw, leaf );
+		break;
+	default:
+		CM_TraceThroughLeafBox( tw, leaf );
+		break;
+	}
+}
+
 #define RADIUS_EPSILON		1.0f
 
 /*
@@ -1021,121 +1096,222 @@ static void CM_TraceBoundingBoxThroughCapsule( traceWork_t *tw, clipHandle_t mod
 
 //=========================================================================================
 
+static void CM_TraceThroughTreePoint( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 );
+static void CM_TraceThroughTreeBox( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 );
+static void CM_TraceThroughTreeCapsule( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 );
+
 /*
 ==================
-CM_TraceThroughTree
+CM_TraceThroughTreeType
 
 Traverse all the contacted leafs from the start to the end position.
 If the trace is a point, they will be exactly in order, but for larger
 trace volumes it is possible to hit something in a later leaf with
 a smaller intercept fraction.
+Nodes the trace doesn't cross and the far side of crossed ones are
+walked in a loop, only the near side of a crossed node recurses.
 ==================
 */
-static void CM_TraceThroughTree( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 ) {
+static CM_TRACE_INLINE void CM_TraceThroughTreeType( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t start, const vec3_t p2, const traceType_t type ) {
 	cNode_t		*node;
 	cplane_t	*plane;
 	double		t1, t2, offset;
 	float		frac, frac2;
 	float		idist;
-	vec3_t		mid;
+	vec3_t		p1, mid;
 	int			side;
 	float		midf;
 
-	if (tw->trace.fraction <= p1f) {
-		return;		// already hit something nearer
-	}
+	VectorCopy( start, p1 );
 
-	// if < 0, we are in a leaf node
-	if (num < 0) {
-		CM_TraceThroughLeaf( tw, &cm.leafs[-1-num] );
-		return;
-	}
+	for ( ;; ) {
+		if (tw->trace.fraction <= p1f) {
+			return;		// already hit something nearer
+		}
 
-	//
-	// find the point distances to the separating plane
-	// and the offset for the size of the box
-	//
-	node = cm.nodes + num;
-	plane = node->plane;
-
-	// adjust the plane distance appropriately for mins/maxs
-	if ( plane->type < 3 ) {
-		t1 = p1[plane->type] - plane->dist;
-		t2 = p2[plane->type] - plane->dist;
-		offset = tw->extents[plane->type];
-	} else {
-		t1 = DotProductDP( plane->normal, p1 ) - plane->dist;
-		t2 = DotProductDP( plane->normal, p2 ) - plane->dist;
-		if ( tw->isPoint ) {
-			offset = 0;
+		// if < 0, we are in a leaf node
+		if (num < 0) {
+			if ( type == TT_POINT ) {
+				CM_TraceThroughLeafPoint( tw, &cm.leafs[-1-num] );
+			} else if ( type == TT_BOX ) {
+				CM_TraceThroughLeafBox( tw, &cm.leafs[-1-num] );
+			} else {
+				CM_TraceThroughLeafCapsule( tw, &cm.leafs[-1-num] );
+			}
+			return;
+		}
+
+		//
+		// find the point distances to the separating plane
+		// and the offset for the size of the box
+		//
+		node = cm.nodes + num;
+		plane = node->plane;
+
+		// adjust the plane distance appropriately for mins/maxs
+		if ( plane->type < 3 ) {
+			t1 = p1[plane->type] - plane->dist;
+			t2 = p2[plane->type] - plane->dist;
+			if ( type == TT_POINT ) {
+				offset = 0;
+			} else {
+				offset = tw->extents[plane->type];
+			}
 		} else {
-			// this is silly
-			offset = 2048;
+			t1 = DotProductDP( plane->normal, p1 ) - plane->dist;
+			t2 = DotProductDP( plane->normal, p2 ) - plane->dist;
+			if ( type == TT_POINT || tw->isPoint ) {
+				offset = 0;
+			} else {
+				// this is silly
+				offset = 2048;
+			}
 		}
-	}
 
-	// see which sides we need to consider
-	if ( t1 >= offset + 1 && t2 >= offset + 1 ) {
-		CM_TraceThroughTree( tw, node->children[0], p1f, p2f, p1, p2 );
-		return;
-	}
-	if ( t1 < -offset - 1 && t2 < -offset - 1 ) {
-		CM_TraceThroughTree( tw, node->children[1], p1f, p2f, p1, p2 );
-		return;
-	}
+		// see which sides we need to consider
+		if ( t1 >= offset + 1 && t2 >= offset + 1 ) {
+			num = node->children[0];
+			continue;
+		}
+		if ( t1 < -offset - 1 && t2 < -offset - 1 ) {
+			num = node->children[1];
+			continue;
+		}
 
-	// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
-	if ( t1 < t2 ) {
-		idist = 1.0/(t1-t2);
-		side = 1;
-		frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
-		frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
-	} else if (t1 > t2) {
-		idist = 1.0/(t1-t2);
-		side = 0;
-		frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
-		frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
-	} else {
-		side = 0;
-		frac = 1;
-		frac2 = 0;
-	}
+		// put the crosspoint SURFACE_CLIP_EPSILON pixels on the near side
+		if ( t1 < t2 ) {
+			idist = 1.0/(t1-t2);
+			side = 1;
+			frac2 = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+			frac = (t1 - offset + SURFACE_CLIP_EPSILON)*idist;
+		} else if (t1 > t2) {
+			idist = 1.0/(t1-t2);
+			side = 0;
+			frac2 = (t1 - offset - SURFACE_CLIP_EPSILON)*idist;
+			frac = (t1 + offset + SURFACE_CLIP_EPSILON)*idist;
+		} else {
+			side = 0;
+			frac = 1;
+			frac2 = 0;
+		}
 
-	// move up to the node
-	if ( frac < 0 ) {
-		frac = 0;
-	} else if ( frac > 1 ) {
-		frac = 1;
-	}
+		// move up to the node
+		if ( frac < 0 ) {
+			frac = 0;
+		} else if ( frac > 1 ) {
+			frac = 1;
+		}
+
+		midf = p1f + (p2f - p1f)*frac;
+
+		mid[0] = p1[0] + frac*(p2[0] - p1[0]);
+		mid[1] = p1[1] + frac*(p2[1] - p1[1]);
+		mid[2] = p1[2] + frac*(p2[2] - p1[2]);
 
-	midf = p1f + (p2f - p1f)*frac;
+		if ( type == TT_POINT ) {
+			CM_TraceThroughTreePoint( tw, node->children[side], p1f, midf, p1, mid );
+		} else if ( type == TT_BOX ) {
+			CM_TraceThroughTreeBox( tw, node->children[side], p1f, midf, p1, mid );
+		} else {
+			CM_TraceThroughTreeCapsule( tw, node->children[side], p1f, midf, p1, mid );
+		}
+
+		// go past the node
+		if ( frac2 < 0 ) {
+			frac2 = 0;
+		} else if ( frac2 > 1 ) {
+			frac2 = 1;
+		}
 
-	mid[0] = p1[0] + frac*(p2[0] - p1[0]);
-	mid[1] = p1[1] + frac*(p2[1] - p1[1]);
-	mid[2] = p1[2] + frac*(p2[2] - p1[2]);
+		midf = p1f + (p2f - p1f)*frac2;
 
-	CM_TraceThroughTree( tw, node->children[side], p1f, midf, p1, mid );
+		mid[0] = p1[0] + frac2*(p2[0] - p1[0]);
+		mid[1] = p1[1] + frac2*(p2[1] - p1[1]);
+		mid[2] = p1[2] + frac2*(p2[2] - p1[2]);
 
-	// go past the node
-	if ( frac2 < 0 ) {
-		frac2 = 0;
-	} else if ( frac2 > 1 ) {
-		frac2 = 1;
+		num = node->children[side^1];
+		p1f = midf;
+		VectorCopy( mid, p1 );
 	}
+}
+
 
-	midf = p1f + (p2f - p1f)*frac2;
+static void CM_TraceThroughTreePoint( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 ) {
+	CM_TraceThroughTreeType( tw, num, p1f, p2f, p1, p2, TT_POINT );
+}
 
-	mid[0] = p1[0] + frac2*(p2[0] - p1[0]);
-	mid[1] = p1[1] + frac2*(p2[1] - p1[1]);
-	mid[2] = p1[2] + frac2*(p2[2] - p1[2]);
+static void CM_TraceThroughTreeBox( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 ) {
+	CM_TraceThroughTreeType( tw, num, p1f, p2f, p1, p2, TT_BOX );
+}
 
-	CM_TraceThroughTree( tw, node->children[side^1], midf, p2f, mid, p2 );
+static void CM_TraceThroughTreeCapsule( traceWork_t *tw, int num, float p1f, float p2f, const vec3_t p1, const vec3_t p2 ) {
+	CM_TraceThroughTreeType( tw, num, p1f, p2f, p1, p2, TT_CAPSULE );
 }
 
 
 //======================================================================
 
 
+/*
+==================
+CM_IsPositionTest
+==================
+*/
+static ID_INLINE bool CM_IsPositionTest( const vec3_t start, const vec3_t end ) {
+	return start[0] == end[0] && start[1] == end[1] && start[2] == end[2];
+}
+
+
+/*
+==================
+CM_IsPointSize
+
+size is the symmetric mins of the trace
+==================
+*/
+static ID_INLINE bool CM_IsPointSize( const vec3_t size ) {
+	return size[0] == 0 && size[1] == 0 && size[2] == 0;
+}
+
+
+/*
+==================
+CM_TraceType
+
+Tells which path CM_Trace takes for a sweep, uses the same tests
+==================
+*/
+traceType_t CM_TraceType( const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs, clipHandle_t model, bool capsule ) {
+	vec3_t size;
+	float offset;
+	int i;
+
+	if ( CM_IsPositionTest( start, end ) ) {
+		return TT_POSITION;
+	}
+
+	if ( model == CAPSULE_MODEL_HANDLE ) {
+		return TT_CAPSULE;
+	}
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		offset = ( mins[i] + maxs[i] ) * 0.5;
+		size[i] = mins[i] - offset;
+	}
+
+	// zero sized capsules take the point walk, like in CM_SweepType
+	if ( CM_IsPointSize( size ) ) {
+		return TT_POINT;
+	}
+
+	if ( capsule ) {
+		return TT_CAPSULE;
+	}
+
+	return TT_BOX;
+}
+
+
 /*
 ==================
 CM_Trace
@@ -1262,7 +1438,7 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 	//
 	// check for position test special case
 	//
-	if (start[0] == end[0] && start[1] == end[1] && start[2] == end[2]) {
+	if ( CM_IsPositionTest( start, end ) ) {
 		if ( model ) {
 #ifdef ALWAYS_BBOX_VS_BBOX // FIXME - compile time flag?
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
@@ -1294,7 +1470,7 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 		//
 		// check for point special case
 		//
-		if ( tw.size[0][0] == 0 && tw.size[0][1] == 0 && tw.size[0][2] == 0 ) {
+		if ( CM_IsPointSize( tw.size[0] ) ) {
 			tw.isPoint = true;
 			VectorClear( tw.extents );
 		} else {
@@ -1332,7 +1508,17 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 				CM_TraceThroughLeaf( &tw, &cmod->leaf );
 			}
 		} else {
-			CM_TraceThroughTree( &tw, 0, 0, 1, tw.start, tw.end );
+			switch ( CM_SweepType( &tw ) ) {
+			case TT_POINT:
+				CM_TraceThroughTreePoint( &tw, 0, 0, 1, tw.start, tw.end );
+				break;
+			case TT_CAPSULE:
+				CM_TraceThroughTreeCapsule( &tw, 0, 0, 1, tw.start, tw.end );
+				break;
+			default:
+				CM_TraceThroughTreeBox( &tw, 0, 0, 1, tw.start, tw.end );
+				break;
+			}
 		}
 	}
 
@@ -1363,6 +1549,15 @@ CM_BoxTrace
 void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						const vec3_t mins, const vec3_t maxs,
 						clipHandle_t model, int brushmask, bool capsule ) {
+	if ( cm_recordFile != FS_INVALID_HANDLE ) {
+		trace_t trace;
+		// results may overlap the arguments in vm memory
+		CM_Trace( &trace, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
+		CM_RecordTrace( CMR_BOXTRACE, &trace, start, end, mins, maxs, model, brushmask, NULL, NULL, capsule );
+		*results = trace;
+		return;
+	}
+
 	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
 }
 
@@ -1464,5 +1659,9 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 	trace.endpos[1] = start[1] + trace.fraction * (end[1] - start[1]);
 	trace.endpos[2] = start[2] + trace.fraction * (end[2] - start[2]);
 
+	if ( cm_recordFile != FS_INVALID_HANDLE ) {
+		CM_RecordTrace( CMR_TRANSFORMEDBOXTRACE, &trace, start, end, mins, maxs, model, brushmask, origin, angles, capsule );
+	}
+
 	*results = trace;
 }
@@ -56,7 +56,6 @@ static jmp_buf abortframe;	// an ERR_DROP occurred, exit the entire frame
 
 int		CPU_Flags = 0;
 
-static fileHandle_t logfile = FS_INVALID_HANDLE;
 static fileHandle_t com_journalFile = FS_INVALID_HANDLE ; // events are written here
 fileHandle_t com_journalDataFile = FS_INVALID_HANDLE; // config files are written here
 
@@ -75,6 +74,7 @@ cvar_t	*com_maxfpsUnfocused;
 cvar_t	*com_yieldCPU;
 cvar_t	*com_timedemo;
 #endif
+static cvar_t *com_frameSpin;
 #ifdef USE_AFFINITY_MASK
 cvar_t	*com_affinityMask;
 #endif
@@ -123,6 +123,15 @@ static char com_errorMessage[ MAXPRINTMSG ];
 
 static void Com_Shutdown( void );
 static void Com_WriteConfig_f( void );
+static void Com_FrameTimes_f( void );
+static void Com_Trace_f( void );
+static void Com_ServerRecord_f( void );
+static void Com_ServerStopRecord_f( void );
+static void Com_ServerReplay_f( void );
+static void Com_StopServerJournal( void );
+static void Com_RecordPacket( const netadr_t *from, const msg_t *msg );
+static void Com_RecordCommand( const char *text );
+static int Com_CompareInts( const void *a, const void *b );
 void CIN_CloseAllVideos( void );
 
 //============================================================================
@@ -158,6 +167,287 @@ void Com_EndRedirect( void )
 }
 
 
+/*
+==============================================================================
+
+						CONSOLE LOG
+
+Console output is copied into a ring and written to qconsole.log by a
+background thread in batches, so a flood of prints can't stall the main
+thread on disk. The writer is woken once per frame or when the ring is
+getting full. When the ring is full new messages are dropped and
+counted, the count is logged once there is room again.
+
+==============================================================================
+*/
+
+#define LOG_RING_SIZE	( 256 * 1024 )	// must be power of two
+#define LOG_WAKE_SIZE	( LOG_RING_SIZE / 4 )
+#define LOG_FLUSH_WAIT	2000			// msec
+
+typedef struct {
+	FILE		*file;
+	bool		sync;				// flush after every batch
+	char		*ring;
+	volatile int head;				// bytes queued, only advanced by main thread
+	volatile int tail;				// bytes written, only advanced by writer
+	volatile int waiting;			// writer is about to sleep
+	volatile int quit;
+	void		*wake;
+	void		*thread;
+	int			dropped;			// since last notice
+} logWriter_t;
+
+static logWriter_t logWriter;
+
+
+static void Com_LogWake( void )
+{
+	if ( Sys_AtomicLoad( &logWriter.waiting ) && Sys_AtomicCompareSwap( &logWriter.waiting, 1, 0 ) ) {
+		Sys_PostSemaphore( logWriter.wake );
+	}
+}
+
+
+/*
+=================
+Com_LogThread
+=================
+*/
+static void Com_LogThread( void *arg )
+{
+	unsigned head, tail, start, len;
+
+	tail = logWriter.tail;
+
+	for ( ;; ) {
+		head = Sys_AtomicLoad( &logWriter.head );
+
+		if ( head == tail ) {
+			if ( Sys_AtomicLoad( &logWriter.quit ) )
+				break;
+			Sys_AtomicStore( &logWriter.waiting, 1 );
+			// something may have been queued meanwhile
+			if ( (unsigned)Sys_AtomicLoad( &logWriter.head ) != tail || Sys_AtomicLoad( &logWriter.quit ) ) {
+				if ( Sys_AtomicCompareSwap( &logWriter.waiting, 1, 0 ) )
+					continue;
+				// producer took the flag and posted already
+			}
+			Sys_WaitSemaphore( logWriter.wake );
+			continue;
+		}
+
+		// everything queued so far, in at most two pieces
+		start = tail & ( LOG_RING_SIZE - 1 );
+		len = head - tail;
+		if ( start + len > LOG_RING_SIZE ) {
+			fwrite( logWriter.ring + start, 1, LOG_RING_SIZE - start, logWriter.file );
+			fwrite( logWriter.ring, 1, len - ( LOG_RING_SIZE - start ), logWriter.file );
+		} else {
+			fwrite( logWriter.ring + start, 1, len, logWriter.file );
+		}
+
+		if ( logWriter.sync )
+			fflush( logWriter.file );
+
+		tail = head;
+		Sys_AtomicStore( &logWriter.tail, tail );
+	}
+}
+
+
+/*
+=================
+Com_LogOpen
+=================
+*/
+static bool Com_LogOpen( const char *filename, bool append, bool sync )
+{
+	logWriter.file = FS_OpenHomeFile( filename, append );
+	if ( logWriter.file == NULL )
+		return false;
+
+	logWriter.sync = sync;
+	logWriter.head = logWriter.tail = 0;
+	logWriter.waiting = logWriter.quit = 0;
+	logWriter.dropped = 0;
+
+	logWriter.ring = malloc( LOG_RING_SIZE );
+	logWriter.wake = logWriter.ring ? Sys_CreateSemaphore() : NULL;
+	logWriter.thread = logWriter.wake ? Sys_CreateThread( Com_LogThread, NULL ) : NULL;
+
+	if ( logWriter.thread == NULL ) {
+		// write from main thread then
+		if ( logWriter.wake )
+			Sys_DestroySemaphore( logWriter.wake );
+		free( logWriter.ring );
+		logWriter.ring = NULL;
+		logWriter.wake = NULL;
+		if ( sync ) {
+			// force it to not buffer so we get valid
+			// data even if we are crashing
+			setvbuf( logWriter.file, NULL, _IONBF, 0 );
+		}
+	}
+
+	return true;
+}
+
+
+static unsigned Com_LogCopy( unsigned head, const char *text, unsigned len )
+{
+	unsigned start, n;
+
+	start = head & ( LOG_RING_SIZE - 1 );
+	n = MIN( len, LOG_RING_SIZE - start );
+	memcpy( logWriter.ring + start, text, n );
+	memcpy( logWriter.ring, text + n, len - n );
+
+	return head + len;
+}
+
+
+/*
+=================
+Com_LogWrite
+
+Queues text for the log file, with wait set blocks while the ring
+is full instead of dropping it, for large dumps from commands
+=================
+*/
+static void Com_LogWrite( const char *text, int len, bool wait )
+{
+	char notice[ 64 ];
+	unsigned head, space;
+	int noticeLen, msec;
+
+	if ( logWriter.file == NULL )
+		return;
+
+	if ( logWriter.thread == NULL ) {
+		fwrite( text, 1, len, logWriter.file );
+		return;
+	}
+
+	if ( len > LOG_RING_SIZE ) {
+		len = LOG_RING_SIZE;
+	}
+
+	noticeLen = 0;
+	if ( logWriter.dropped ) {
+		noticeLen = Com_sprintf( notice, sizeof( notice ), "[%i console messages dropped]\n", logWriter.dropped );
+	}
+
+	head = logWriter.head;
+	space = LOG_RING_SIZE - ( head - (unsigned)Sys_AtomicLoad( &logWriter.tail ) );
+
+	for ( msec = 0; wait && space < (unsigned)( noticeLen + len ) && msec < LOG_FLUSH_WAIT; msec++ ) {
+		Com_LogWake();
+		Sys_Sleep( 1 );
+		space = LOG_RING_SIZE - ( head - (unsigned)Sys_AtomicLoad( &logWriter.tail ) );
+	}
+
+	if ( space < (unsigned)( noticeLen + len ) ) {
+		logWriter.dropped++;
+		return;
+	}
+
+	if ( noticeLen ) {
+		logWriter.dropped = 0;
+		head = Com_LogCopy( head, notice, noticeLen );
+	}
+
+	head = Com_LogCopy( head, text, len );
+
+	Sys_AtomicStore( &logWriter.head, head );
+
+	if ( head - (unsigned)Sys_AtomicLoad( &logWriter.tail ) >= LOG_WAKE_SIZE ) {
+		Com_LogWake();
+	}
+}
+
+
+/*
+=================
+Com_LogKick
+
+Gets the writer going on whatever was queued during the frame
+=================
+*/
+static void Com_LogKick( void )
+{
+	if ( logWriter.thread && (unsigned)Sys_AtomicLoad( &logWriter.tail ) != logWriter.head ) {
+		Com_LogWake();
+	}
+}
+
+
+/*
+=================
+Com_LogFlush
+
+Waits until everything queued is on disk, also called on
+fatal errors and signals before the process exits
+=================
+*/
+void Com_LogFlush( void )
+{
+	int msec;
+
+	if ( logWriter.file == NULL )
+		return;
+
+	if ( logWriter.thread ) {
+		// writer may be stuck on a dead disk, don't hang forever
+		for ( msec = 0; Sys_AtomicLoad( &logWriter.tail ) != logWriter.head && msec < LOG_FLUSH_WAIT; msec++ ) {
+			Com_LogWake();
+			Sys_Sleep( 1 );
+		}
+		if ( Sys_AtomicLoad( &logWriter.tail ) != logWriter.head )
+			return;
+	}
+
+	fflush( logWriter.file );
+}
+
+
+/*
+=================
+Com_LogClose
+=================
+*/
+static void Com_LogClose( void )
+{
+	if ( logWriter.file == NULL )
+		return;
+
+	if ( logWriter.dropped ) {
+		// nothing else will come to carry the notice
+		Com_LogWrite( "", 0, true );
+	}
+
+	Com_LogFlush();
+
+	if ( logWriter.thread ) {
+		if ( Sys_AtomicLoad( &logWriter.tail ) != logWriter.head ) {
+			// can't close file under the writer
+			return;
+		}
+		Sys_AtomicStore( &logWriter.quit, 1 );
+		Com_LogWake();
+		Sys_JoinThread( logWriter.thread );
+		Sys_DestroySemaphore( logWriter.wake );
+		free( logWriter.ring );
+		logWriter.thread = NULL;
+		logWriter.wake = NULL;
+		logWriter.ring = NULL;
+	}
+
+	fclose( logWriter.file );
+	logWriter.file = NULL;
+}
+
+
 /*
 =============
 Com_Printf
@@ -206,7 +496,7 @@ void FORMAT_PRINTF(1, 2) QDECL Com_Printf( const char *fmt, ... ) {
 	if ( com_logfile && com_logfile->integer ) {
 		// TTimo: only open the qconsole.log if the filesystem is in an initialized state
 		//   also, avoid recursing in the qconsole.log opening (i.e. if fs_debug is on)
-		if ( logfile == FS_INVALID_HANDLE && FS_Initialized() && !opening_qconsole ) {
+		if ( logWriter.file == NULL && FS_Initialized() && !opening_qconsole ) {
 			const char *logName = "qconsole.log";
 			int mode;
 
@@ -214,12 +504,7 @@ void FORMAT_PRINTF(1, 2) QDECL Com_Printf( const char *fmt, ... ) {
 
 			mode = com_logfile->integer - 1;
 
-			if ( mode & 2 )
-				logfile = FS_FOpenFileAppend( logName );
-			else
-				logfile = FS_FOpenFileWrite( logName );
-
-			if ( logfile != FS_INVALID_HANDLE ) {
+			if ( Com_LogOpen( logName, ( mode & 2 ) != 0, ( mode & 1 ) != 0 ) ) {
 				struct tm *newtime;
 				time_t aclock;
 				char timestr[32];
@@ -229,12 +514,6 @@ void FORMAT_PRINTF(1, 2) QDECL Com_Printf( const char *fmt, ... ) {
 				strftime( timestr, sizeof( timestr ), "%a %b %d %X %Y", newtime );
 
 				Com_Printf( "logfile opened on %s\n", timestr );
-
-				if ( mode & 1 ) {
-					// force it to not buffer so we get valid
-					// data even if we are crashing
-					FS_ForceFlush( logfile );
-				}
 			} else {
 				Com_Printf( S_COLOR_YELLOW "Opening %s failed!\n", logName );
 				Cvar_Set( "logfile", "0" );
@@ -242,9 +521,7 @@ void FORMAT_PRINTF(1, 2) QDECL Com_Printf( const char *fmt, ... ) {
 
 			opening_qconsole = false;
 		}
-		if ( logfile != FS_INVALID_HANDLE && FS_Initialized() ) {
-			FS_Write( msg, len, logfile );
-		}
+		Com_LogWrite( msg, len, false );
 	}
 }
 
@@ -350,12 +627,14 @@ void NORETURN FORMAT_PRINTF(2, 3) QDECL Com_Error( errorParm_t code, const char
 
 		// make sure we can get at our local stuff
 		FS_PureServerSetLoadedPaks( "", "" );
+		FS_CancelMapLoad();
 		com_errorEntered = false;
 
 		Q_longjmp( abortframe, 1 );
 	} else if ( code == ERR_DROP ) {
 		Com_Printf( "********************\nERROR: %s\n********************\n",
 			com_errorMessage );
+		Com_LogFlush();
 		VM_Forced_Unload_Start();
 		SV_Shutdown( va( "Server crashed: %s",  com_errorMessage ) );
 		Com_EndRedirect();
@@ -366,6 +645,7 @@ void NORETURN FORMAT_PRINTF(2, 3) QDECL Com_Error( errorParm_t code, const char
 		VM_Forced_Unload_Done();
 
 		FS_PureServerSetLoadedPaks( "", "" );
+		FS_CancelMapLoad();
 		com_errorEntered = false;
 
 		Q_longjmp( abortframe, 1 );
@@ -938,6 +1218,41 @@ int64_t Sys_Microseconds( void )
 }
 
 
+/*
+================
+Sys_Nanoseconds
+
+Monotonic, for fine grained profiling only
+================
+*/
+int64_t Sys_Nanoseconds( void )
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER curr;
+
+	if ( !freq.QuadPart )
+	{
+		QueryPerformanceFrequency( &freq );
+		if ( !freq.QuadPart )
+		{
+			return Sys_Microseconds() * 1000LL; // fallback
+		}
+	}
+
+	QueryPerformanceCounter( &curr );
+
+	// split to avoid overflow of counter * 1e9
+	return ( curr.QuadPart / freq.QuadPart ) * 1000000000LL + ( ( curr.QuadPart % freq.QuadPart ) * 1000000000LL ) / freq.QuadPart;
+#else
+	struct timespec curr;
+	clock_gettime( CLOCK_MONOTONIC, &curr );
+
+	return (int64_t)curr.tv_sec * 1000000000LL + (int64_t)curr.tv_nsec;
+#endif
+}
+
+
 /*
 ==============================================================================
 
@@ -974,6 +1289,10 @@ all big things are allocated on the hunk.
 #define USE_STATIC_TAGS
 #define USE_TRASH_TEST
 
+#ifndef ZONE_DEBUG
+#define USE_ZONE_SLABS
+#endif
+
 #ifdef ZONE_DEBUG
 typedef struct zonedebug_s {
 	const char *label;
@@ -1018,6 +1337,9 @@ typedef struct memzone_s {
 
 static int minfragment = MINFRAGMENT; // may be adjusted at runtime
 
+// number of allocations served by the zone heap, for meminfo
+static unsigned int zoneAllocs;
+
 // main zone for all "dynamic" memory allocation
 static memzone_t *mainzone;
 
@@ -1300,2876 +1622,5680 @@ static void MergeBlock( memblock_t *curr_free, const memblock_t *next )
 
 
 /*
-========================
-Z_Free
-========================
+==============================================================================
+
+						ALLOCATION PROFILING
+
+While enabled with "memprofile start" every zone allocation is recorded
+in a pointer keyed table together with its call site and time, so frees
+can be matched to sites and lifetimes measured. Nothing is done for
+allocations made while profiling is stopped, the only cost is passing
+the call site to Z_TagMalloc.
+
+Profiler tables are malloc()'ed to stay out of the zone statistics.
+==============================================================================
 */
-void Z_Free( void *ptr ) {
-	memblock_t	*block, *other;
-	memzone_t *zone;
 
-	if (!ptr) {
-		Com_Error( ERR_DROP, "Z_Free: NULL pointer" );
-	}
+#define MAX_PROFILE_SITES	8192 // hash table size, power of two
+
+typedef struct allocSite_s {
+	const char	*file;
+	int			line;
+	memtag_t	tag;
+	unsigned int allocs;
+	unsigned int frees;
+	int64_t		bytes;
+	int64_t		lifetime;	// of freed blocks, in usec
+	int			liveBytes;
+	int			peakBytes;
+} allocSite_t;
+
+typedef struct liveAlloc_s {
+	const void	*ptr;
+	int			size;
+	int			site;
+	int64_t		time;
+} liveAlloc_t;
 
-	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
-	if (block->id != ZONEID) {
-		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
-	}
+typedef struct {
+	bool		active;
+	int64_t		startTime;
+	int64_t		stopTime;
+	allocSite_t	*sites;
+	int			numSites;
+	unsigned int lostSites;
+	allocSite_t	tags[ TAG_COUNT ];
+	allocSite_t	total;
+	liveAlloc_t	*live;
+	int			liveMask;
+	int			numLive;
+} memProfile_t;
+
+static memProfile_t memProfile;
+
+
+static unsigned int Z_ProfileHash( const void *ptr )
+{
+	uint64_t h = (uint64_t)(intptr_t)ptr * 0x9E3779B97F4A7C15ULL;
+	return (unsigned int)( h >> 32 );
+}
 
-	if (block->tag == TAG_FREE) {
-		Com_Error( ERR_FATAL, "Z_Free: freed a freed pointer" );
-	}
 
-	// if static memory
-#ifdef USE_STATIC_TAGS
-	if (block->tag == TAG_STATIC) {
-		return;
+static void Z_ProfileCountAlloc( allocSite_t *st, int size )
+{
+	st->allocs++;
+	st->bytes += size;
+	st->liveBytes += size;
+	if ( st->liveBytes > st->peakBytes ) {
+		st->peakBytes = st->liveBytes;
 	}
-#endif
+}
 
-	// check the memory trash tester
-#ifdef USE_TRASH_TEST
-	if ( *(int *)((byte *)block + block->size - 4 ) != ZONEID ) {
-		Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
-	}
-#endif
 
-	if ( block->tag == TAG_SMALL ) {
-		zone = smallzone;
-	} else {
-		zone = mainzone;
-	}
+static void Z_ProfileCountFree( allocSite_t *st, int size, int64_t lifetime )
+{
+	st->frees++;
+	st->liveBytes -= size;
+	st->lifetime += lifetime;
+}
 
-	zone->used -= block->size;
 
-	// set the block to something that should cause problems
-	// if it is referenced...
-	Com_Memset( ptr, 0xaa, block->size - sizeof( *block ) );
+static int Z_ProfileSite( const char *file, int line, memtag_t tag )
+{
+	allocSite_t *site;
+	unsigned int i;
 
-	block->tag = TAG_FREE; // mark as free
-	block->id = ZONEID;
+	i = ( Z_ProfileHash( file ) ^ ( line * 2654435761U ) ^ tag ) & ( MAX_PROFILE_SITES - 1 );
+	for ( ;; ) {
+		site = &memProfile.sites[ i ];
+		if ( site->file == NULL ) {
+			// keep one slot empty to terminate the search
+			if ( memProfile.numSites >= MAX_PROFILE_SITES - 1 ) {
+				memProfile.lostSites++;
+				return -1;
+			}
+			site->file = file;
+			site->line = line;
+			site->tag = tag;
+			memProfile.numSites++;
+			return i;
+		}
+		if ( site->file == file && site->line == line && site->tag == tag ) {
+			return i;
+		}
+		i = ( i + 1 ) & ( MAX_PROFILE_SITES - 1 );
+	}
+}
 
-	other = block->prev;
-	if ( other->tag == TAG_FREE ) {
-#ifdef USE_MULTI_SEGMENT
-		RemoveFree( other );
-#endif
-		// merge with previous free block
-		MergeBlock( other, block );
-#ifndef USE_MULTI_SEGMENT
-		if ( block == zone->rover ) {
-			zone->rover = other;
+
+static liveAlloc_t *Z_ProfileFindLive( const void *ptr )
+{
+	liveAlloc_t *la;
+	unsigned int i;
+
+	i = Z_ProfileHash( ptr ) & memProfile.liveMask;
+	for ( ;; ) {
+		la = &memProfile.live[ i ];
+		if ( la->ptr == ptr || la->ptr == NULL ) {
+			return la;
 		}
-#endif
-		block = other;
+		i = ( i + 1 ) & memProfile.liveMask;
 	}
+}
 
-#ifndef USE_MULTI_SEGMENT
-	zone->rover = block;
-#endif
 
-	other = block->next;
-	if ( other->tag == TAG_FREE ) {
-#ifdef USE_MULTI_SEGMENT
-		RemoveFree( other );
-#endif
-		// merge the next free block onto the end
-		MergeBlock( block, other );
+static void Z_ProfileGrowLive( void )
+{
+	liveAlloc_t *old, *la;
+	int i, oldSize;
+
+	old = memProfile.live;
+	oldSize = old ? memProfile.liveMask + 1 : 0;
+
+	memProfile.live = calloc( oldSize ? oldSize * 2 : 65536, sizeof( liveAlloc_t ) );
+	if ( memProfile.live == NULL ) {
+		Com_Error( ERR_FATAL, "memprofile: out of memory" );
 	}
+	memProfile.liveMask = ( oldSize ? oldSize * 2 : 65536 ) - 1;
 
-#ifdef USE_MULTI_SEGMENT
-	InsertFree( zone, block );
-#endif
+	for ( i = 0; i < oldSize; i++ ) {
+		if ( old[ i ].ptr ) {
+			la = Z_ProfileFindLive( old[ i ].ptr );
+			*la = old[ i ];
+		}
+	}
+
+	free( old );
 }
 
 
 /*
 ================
-Z_FreeTags
+Z_ProfileFree
 ================
 */
-int Z_FreeTags( memtag_t tag ) {
-	int			count;
-	memzone_t	*zone;
-	memblock_t	*block, *freed;
+static void Z_ProfileFree( const void *ptr )
+{
+	liveAlloc_t *la, *next;
+	int64_t lifetime;
+	unsigned int i, j, k;
 
-	if ( tag == TAG_STATIC ) {
-		Com_Error( ERR_FATAL, "Z_FreeTags( TAG_STATIC )" );
-		return 0;
-	} else if ( tag == TAG_SMALL ) {
-		zone = smallzone;
-	} else {
-		zone = mainzone;
+	la = Z_ProfileFindLive( ptr );
+	if ( la->ptr == NULL ) {
+		return; // allocated before profiling started
 	}
 
-	count = 0;
-	for ( block = zone->blocklist.next ; ; ) {
-		if ( block->tag == tag && block->id == ZONEID ) {
-			if ( block->prev->tag == TAG_FREE )
-				freed = block->prev;  // current block will be merged with previous
-			else
-				freed = block; // will leave in place
-			Z_Free( (void*)( block + 1 ) );
-			block = freed;
-			count++;
+	lifetime = Sys_Microseconds() - la->time;
+	if ( la->site >= 0 ) {
+		Z_ProfileCountFree( &memProfile.sites[ la->site ], la->size, lifetime );
+		Z_ProfileCountFree( &memProfile.tags[ memProfile.sites[ la->site ].tag ], la->size, lifetime );
+	}
+	Z_ProfileCountFree( &memProfile.total, la->size, lifetime );
+
+	// backward shift deletion, keeps probe sequences intact without tombstones
+	i = la - memProfile.live;
+	j = i;
+	for ( ;; ) {
+		j = ( j + 1 ) & memProfile.liveMask;
+		next = &memProfile.live[ j ];
+		if ( next->ptr == NULL ) {
+			break;
 		}
-		if ( block->next == &zone->blocklist ) {
-			break;	// all blocks have been hit
+		k = Z_ProfileHash( next->ptr ) & memProfile.liveMask;
+		if ( ( j > i && ( k <= i || k > j ) ) || ( j < i && ( k <= i && k > j ) ) ) {
+			memProfile.live[ i ] = *next;
+			i = j;
 		}
-		block = block->next;
 	}
-
-	return count;
+	memProfile.live[ i ].ptr = NULL;
+	memProfile.numLive--;
 }
 
 
 /*
 ================
-Z_TagMalloc
+Z_ProfileAlloc
 ================
 */
-#ifdef ZONE_DEBUG
-void *Z_TagMallocDebug( int size, memtag_t tag, char *label, char *file, int line ) {
-	int		allocSize;
-#else
-void *Z_TagMalloc( int size, memtag_t tag ) {
-#endif
-	int		extra;
-#ifndef USE_MULTI_SEGMENT
-	memblock_t	*start, *rover;
-#endif
-	memblock_t *base;
-	memzone_t *zone;
+static void Z_ProfileAlloc( const void *ptr, int size, memtag_t tag, const char *file, int line )
+{
+	liveAlloc_t *la;
+	int site;
 
-	if ( tag == TAG_FREE ) {
-		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use with TAG_FREE" );
+	if ( memProfile.numLive * 2 >= memProfile.liveMask ) {
+		Z_ProfileGrowLive();
 	}
 
-	if ( tag == TAG_SMALL ) {
-		zone = smallzone;
-	} else {
-		zone = mainzone;
+	la = Z_ProfileFindLive( ptr );
+	if ( la->ptr ) {
+		// should never happen but anyway
+		Z_ProfileFree( ptr );
+		la = Z_ProfileFindLive( ptr );
 	}
 
-#ifdef ZONE_DEBUG
-	allocSize = size;
-#endif
-
-#ifdef USE_MULTI_SEGMENT
-	if ( size < (sizeof( freeblock_t ) ) ) {
-		size = (sizeof( freeblock_t ) );
+	site = Z_ProfileSite( file, line, tag );
+	if ( site >= 0 ) {
+		Z_ProfileCountAlloc( &memProfile.sites[ site ], size );
 	}
-#endif
+	Z_ProfileCountAlloc( &memProfile.tags[ tag ], size );
+	Z_ProfileCountAlloc( &memProfile.total, size );
 
-	//
-	// scan through the block list looking for the first free block
-	// of sufficient size
-	//
-	size += sizeof( *base );	// account for size of block header
-#ifdef USE_TRASH_TEST
-	size += 4;					// space for memory trash tester
-#endif
+	la->ptr = ptr;
+	la->size = size;
+	la->site = site;
+	la->time = Sys_Microseconds();
+	memProfile.numLive++;
+}
 
-	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
 
-#ifdef USE_MULTI_SEGMENT
-	base = SearchFree( zone, size );
+#ifdef USE_ZONE_SLABS
+/*
+==============================================================================
 
-	RemoveFree( base );
-#else
+						SLAB ALLOCATOR
 
-	base = rover = zone->rover;
-	start = base->prev;
+Small allocations are served from 8K pages cut into equal slots, one
+size class and one tag per page, so both allocation and release are O(1)
+and Z_FreeTags() can drop whole pages. A page goes back to the common
+pool as soon as its last slot is freed.
 
-	do {
-		if ( rover == start ) {
-			// scanned all the way around the list
-#ifdef ZONE_DEBUG
-			Z_LogHeap();
-			Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone: %s, line: %d (%s)",
-								size, zone == smallzone ? "small" : "main", file, line, label );
+Pages come from 1M chunks allocated on demand; once MAX_SLAB_CHUNKS are
+in use further small requests simply fall through to the zone.
+==============================================================================
+*/
+
+#define SLAB_PAGE_SHIFT		13
+#define SLAB_PAGE_SIZE		(1<<SLAB_PAGE_SHIFT)
+#define SLAB_CHUNK_PAGES	128
+#define SLAB_CHUNK_SIZE		(SLAB_PAGE_SIZE*SLAB_CHUNK_PAGES)
+#define MAX_SLAB_CHUNKS		64
+
+#define SLAB_GRANULE		16
+#define MAX_SLAB_SIZE		512
+#define SLAB_CLASSES		16
+#define SLAB_MAX_SLOTS		(SLAB_PAGE_SIZE/SLAB_GRANULE)
+
+#ifdef USE_TRASH_TEST
+#define SLAB_TRASH_SIZE		4
 #else
-			Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
-								size, zone == smallzone ? "small" : "main" );
-#endif
-			return NULL;
-		}
-		if ( rover->tag != TAG_FREE ) {
-			base = rover = rover->next;
-		} else {
-			rover = rover->next;
-		}
-	} while (base->tag != TAG_FREE || base->size < size);
+#define SLAB_TRASH_SIZE		0
 #endif
 
-	//
-	// found a block big enough
-	//
-	extra = base->size - size;
-	if ( extra >= minfragment ) {
-		memblock_t *fragment;
-		// there will be a free fragment after the allocated block
-		fragment = (memblock_t *)( (byte *)base + size );
-		fragment->size = extra;
-		fragment->tag = TAG_FREE; // free block
-		fragment->id = ZONEID;
-		fragment->prev = base;
-		fragment->next = base->next;
-		fragment->next->prev = fragment;
-		base->next = fragment;
-		base->size = size;
-#ifdef USE_MULTI_SEGMENT
-		InsertFree( zone, fragment );
-#endif
+typedef struct slabPage_s {
+	struct slabPage_s *next, *prev;
+	void		*freeList;	// released slots
+	byte		*data;
+	int			size;		// slot size
+	int			sizeClass;
+	int			numSlots;
+	int			numUsed;
+	int			numFresh;	// slots handed out at least once
+	memtag_t	tag;		// TAG_FREE while in the page pool
+	uint32_t	used[ SLAB_MAX_SLOTS / 32 ];
+} slabPage_t;
+
+typedef struct slabChunk_s {
+	void		*mem;		// as returned by calloc()
+	byte		*base;		// first page, aligned to SLAB_PAGE_SIZE
+	slabPage_t	pages[ SLAB_CHUNK_PAGES ];
+} slabChunk_t;
+
+static const int slabSizes[ SLAB_CLASSES ] = {
+	16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512
+};
+
+static byte slabClass[ MAX_SLAB_SIZE / SLAB_GRANULE + 1 ];
+
+static slabChunk_t *slabChunks[ MAX_SLAB_CHUNKS ]; // sorted by base address
+static int slabNumChunks;
+
+static slabPage_t *slabFreePages;
+
+// pages with free slots come first, full pages are kept at the tail
+static slabPage_t *slabPages[ TAG_COUNT ][ SLAB_CLASSES ];
+
+typedef struct {
+	unsigned int allocs[ SLAB_CLASSES ];
+	int		pages[ SLAB_CLASSES ];
+	int		objects[ SLAB_CLASSES ];
+	int		tagBytes[ TAG_COUNT ];
+	int		freePages;
+} slabStats_t;
+
+static slabStats_t slabStats;
+
+
+static void Slab_Init( void )
+{
+	int i, c;
+
+	for ( i = 0, c = 0; i < ARRAY_LEN( slabClass ); i++ ) {
+		while ( slabSizes[ c ] < i * SLAB_GRANULE )
+			c++;
+		slabClass[ i ] = c;
 	}
+}
 
-#ifndef USE_MULTI_SEGMENT
-	zone->rover = base->next;	// next allocation will start looking here
-#endif
-	zone->used += base->size;
 
-	base->tag = tag;			// no longer a free block
-	base->id = ZONEID;
+static void Slab_Unlink( slabPage_t **list, slabPage_t *page )
+{
+	if ( page->next == page ) {
+		*list = NULL;
+	} else {
+		page->prev->next = page->next;
+		page->next->prev = page->prev;
+		if ( *list == page ) {
+			*list = page->next;
+		}
+	}
+}
 
-#ifdef ZONE_DEBUG
-	base->d.label = label;
-	base->d.file = file;
-	base->d.line = line;
-	base->d.allocSize = allocSize;
-#endif
 
-#ifdef USE_TRASH_TEST
-	// marker for memory trash testing
-	*(int *)((byte *)base + base->size - 4) = ZONEID;
-#endif
+static void Slab_LinkFront( slabPage_t **list, slabPage_t *page )
+{
+	slabPage_t *head = *list;
 
-	return (void *) ( base + 1 );
+	if ( head == NULL ) {
+		page->next = page->prev = page;
+	} else {
+		page->next = head;
+		page->prev = head->prev;
+		head->prev->next = page;
+		head->prev = page;
+	}
+
+	*list = page;
 }
 
 
 /*
-========================
-Z_Malloc
-========================
+================
+Slab_NewChunk
+
+Adds SLAB_CHUNK_PAGES pages to the page pool
+================
 */
-#ifdef ZONE_DEBUG
-void *Z_MallocDebug( int size, char *label, char *file, int line ) {
-#else
-void *Z_Malloc( int size ) {
-#endif
-	void	*buf;
+static bool Slab_NewChunk( void )
+{
+	slabChunk_t *chunk;
+	int i;
 
-  //Z_CheckHeap ();	// DEBUG
+	if ( slabNumChunks >= MAX_SLAB_CHUNKS ) {
+		return false;
+	}
 
-#ifdef ZONE_DEBUG
-	buf = Z_TagMallocDebug( size, TAG_GENERAL, label, file, line );
-#else
-	buf = Z_TagMalloc( size, TAG_GENERAL );
-#endif
-	Com_Memset( buf, 0, size );
+	chunk = calloc( 1, sizeof( *chunk ) );
+	if ( chunk == NULL ) {
+		return false;
+	}
 
-	return buf;
+	chunk->mem = calloc( SLAB_CHUNK_SIZE + SLAB_PAGE_SIZE - 1, 1 );
+	if ( chunk->mem == NULL ) {
+		free( chunk );
+		return false;
+	}
+	chunk->base = PADP( chunk->mem, SLAB_PAGE_SIZE );
+
+	for ( i = SLAB_CHUNK_PAGES - 1; i >= 0; i-- ) {
+		chunk->pages[ i ].data = chunk->base + i * SLAB_PAGE_SIZE;
+		chunk->pages[ i ].tag = TAG_FREE;
+		chunk->pages[ i ].next = slabFreePages;
+		slabFreePages = &chunk->pages[ i ];
+	}
+	slabStats.freePages += SLAB_CHUNK_PAGES;
+
+	// keep chunks sorted for Slab_FindPage()
+	for ( i = slabNumChunks; i > 0 && slabChunks[ i - 1 ]->base > chunk->base; i-- ) {
+		slabChunks[ i ] = slabChunks[ i - 1 ];
+	}
+	slabChunks[ i ] = chunk;
+	slabNumChunks++;
+
+	return true;
 }
 
 
-/*
-========================
-S_Malloc
-========================
-*/
-#ifdef ZONE_DEBUG
-void *S_MallocDebug( int size, char *label, char *file, int line ) {
-	return Z_TagMallocDebug( size, TAG_SMALL, label, file, line );
+static slabPage_t *Slab_FindPage( const byte *ptr )
+{
+	const slabChunk_t *chunk;
+	int lo, hi, mid;
+
+	lo = 0;
+	hi = slabNumChunks - 1;
+	while ( lo <= hi ) {
+		mid = ( lo + hi ) >> 1;
+		chunk = slabChunks[ mid ];
+		if ( ptr < chunk->base ) {
+			hi = mid - 1;
+		} else if ( ptr >= chunk->base + SLAB_CHUNK_SIZE ) {
+			lo = mid + 1;
+		} else {
+			return (slabPage_t *) &chunk->pages[ ( ptr - chunk->base ) >> SLAB_PAGE_SHIFT ];
+		}
+	}
+
+	return NULL;
 }
-#else
-void *S_Malloc( int size ) {
-	return Z_TagMalloc( size, TAG_SMALL );
+
+
+static void Slab_ReleasePage( slabPage_t *page )
+{
+	slabStats.pages[ page->sizeClass ]--;
+	slabStats.freePages++;
+
+	page->tag = TAG_FREE;
+	page->next = slabFreePages;
+	slabFreePages = page;
 }
-#endif
 
 
 /*
-========================
-Z_CheckHeap
-========================
+================
+Z_SlabAlloc
+
+Returns NULL if the request should be served by the zone
+================
 */
-static void Z_CheckHeap( void ) {
-	const memblock_t *block;
-	const memzone_t *zone;
+static void *Z_SlabAlloc( int size, memtag_t tag )
+{
+	slabPage_t **list, *page;
+	byte *ptr;
+	int c, n;
 
-	zone =  mainzone;
-	for ( block = zone->blocklist.next ; ; ) {
-		if ( block->next == &zone->blocklist ) {
-			break;	// all blocks have been hit
-		}
-		if ( (byte *)block + block->size != (byte *)block->next) {
-#ifdef USE_MULTI_SEGMENT
-			const memblock_t *next = block->next;
-			if ( next->size == 0 && next->id == -ZONEID && next->tag == TAG_GENERAL ) {
-				block = next; // new zone segment
-			} else
-#endif
-			Com_Error( ERR_FATAL, "Z_CheckHeap: block size does not touch the next block" );
-		}
-		if ( block->next->prev != block) {
-			Com_Error( ERR_FATAL, "Z_CheckHeap: next block doesn't have proper back link" );
-		}
-		if ( block->tag == TAG_FREE && block->next->tag == TAG_FREE ) {
-			Com_Error( ERR_FATAL, "Z_CheckHeap: two consecutive free blocks" );
+	c = slabClass[ ( size + SLAB_GRANULE - 1 ) / SLAB_GRANULE ];
+	list = &slabPages[ tag ][ c ];
+	page = *list;
+
+	if ( page == NULL || page->numUsed == page->numSlots ) {
+		if ( slabFreePages == NULL && !Slab_NewChunk() ) {
+			return NULL;
 		}
-		block = block->next;
+		page = slabFreePages;
+		slabFreePages = page->next;
+		slabStats.freePages--;
+		slabStats.pages[ c ]++;
+
+		page->freeList = NULL;
+		page->size = slabSizes[ c ];
+		page->sizeClass = c;
+		page->numSlots = SLAB_PAGE_SIZE / page->size;
+		page->numUsed = 0;
+		page->numFresh = 0;
+		page->tag = tag;
+		Com_Memset( page->used, 0, sizeof( page->used ) );
+
+		Slab_LinkFront( list, page );
+	}
+
+	if ( page->freeList ) {
+		ptr = page->freeList;
+		page->freeList = *(void **)ptr;
+		n = (int)( ptr - page->data ) / page->size;
+	} else {
+		n = page->numFresh++;
+		ptr = page->data + n * page->size;
 	}
-}
 
+	page->used[ n >> 5 ] |= 1U << ( n & 31 );
 
-/*
-========================
-Z_LogZoneHeap
-========================
-*/
-static void Z_LogZoneHeap( memzone_t *zone, const char *name ) {
-#ifdef ZONE_DEBUG
-	char dump[32], *ptr;
-	int  i, j;
+	if ( ++page->numUsed == page->numSlots ) {
+		*list = page->next; // move to the tail
+	}
+
+	slabStats.allocs[ c ]++;
+	slabStats.objects[ c ]++;
+	slabStats.tagBytes[ tag ] += page->size;
+
+#ifdef USE_TRASH_TEST
+	*(int *)( ptr + page->size - 4 ) = ZONEID;
 #endif
-	memblock_t	*block;
-	char		buf[4096];
-	int size, allocSize, numBlocks;
-	int len;
-
-	if ( logfile == FS_INVALID_HANDLE || !FS_Initialized() )
-		return;
-
-	size = numBlocks = 0;
-#ifdef ZONE_DEBUG
-	allocSize = 0;
-#endif
-	len = Com_sprintf( buf, sizeof(buf), "\r\n================\r\n%s log\r\n================\r\n", name );
-	FS_Write( buf, len, logfile );
-	for ( block = zone->blocklist.next ; ; ) {
-		if ( block->tag != TAG_FREE ) {
-#ifdef ZONE_DEBUG
-			ptr = ((char *) block) + sizeof(memblock_t);
-			j = 0;
-			for (i = 0; i < 20 && i < block->d.allocSize; i++) {
-				if (ptr[i] >= 32 && ptr[i] < 127) {
-					dump[j++] = ptr[i];
-				}
-				else {
-					dump[j++] = '_';
-				}
-			}
-			dump[j] = '\0';
-			len = Com_sprintf(buf, sizeof(buf), "size = %8d: %s, line: %d (%s) [%s]\r\n", block->d.allocSize, block->d.file, block->d.line, block->d.label, dump);
-			FS_Write( buf, len, logfile );
-			allocSize += block->d.allocSize;
-#endif
-			size += block->size;
-			numBlocks++;
-		}
-		if ( block->next == &zone->blocklist ) {
-			break; // all blocks have been hit
-		}
-		block = block->next;
-	}
-#ifdef ZONE_DEBUG
-	// subtract debug memory
-	size -= numBlocks * sizeof(zonedebug_t);
-#else
-	allocSize = numBlocks * sizeof(memblock_t); // + 32 bit alignment
-#endif
-	len = Com_sprintf( buf, sizeof( buf ), "%d %s memory in %d blocks\r\n", size, name, numBlocks );
-	FS_Write( buf, len, logfile );
-	len = Com_sprintf( buf, sizeof( buf ), "%d %s memory overhead\r\n", size - allocSize, name );
-	FS_Write( buf, len, logfile );
-	FS_Flush( logfile );
-}
 
-
-/*
-========================
-Z_LogHeap
-========================
-*/
-void Z_LogHeap( void ) {
-	Z_LogZoneHeap( mainzone, "MAIN" );
-	Z_LogZoneHeap( smallzone, "SMALL" );
+	return ptr;
 }
 
-#ifdef USE_STATIC_TAGS
-
-// static mem blocks to reduce a lot of small zone overhead
-typedef struct memstatic_s {
-	memblock_t b;
-	byte mem[2];
-} memstatic_t;
 
-#define MEM_STATIC(chr) { { NULL, NULL, PAD(sizeof(memstatic_t),4), TAG_STATIC, ZONEID }, {chr,'\0'} }
+static void Slab_CheckSlot( const slabPage_t *page, const byte *ptr, int *slot )
+{
+	int offset, n;
 
-static const memstatic_t emptystring =
-	MEM_STATIC( '\0' );
+	if ( page->tag == TAG_FREE ) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
+	}
 
-static const memstatic_t numberstring[] = {
-	MEM_STATIC( '0' ),
-	MEM_STATIC( '1' ),
-	MEM_STATIC( '2' ),
-	MEM_STATIC( '3' ),
-	MEM_STATIC( '4' ),
-	MEM_STATIC( '5' ),
-	MEM_STATIC( '6' ),
-	MEM_STATIC( '7' ),
-	MEM_STATIC( '8' ),
-	MEM_STATIC( '9' )
-};
-#endif // USE_STATIC_TAGS
+	offset = (int)( ptr - page->data );
+	n = offset / page->size;
 
-/*
-========================
-CopyString
+	if ( n >= page->numFresh || n * page->size != offset ) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
+	}
 
- NOTE:	never write over the memory CopyString returns because
-		memory from a memstatic_t might be returned
-========================
-*/
-char *CopyString( const char *in ) {
-	char *out;
-#ifdef USE_STATIC_TAGS
-	if ( in[0] == '\0' ) {
-		return ((char *)&emptystring) + sizeof(memblock_t);
+	if ( ( page->used[ n >> 5 ] & ( 1U << ( n & 31 ) ) ) == 0 ) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a freed pointer" );
 	}
-	else if ( in[0] >= '0' && in[0] <= '9' && in[1] == '\0' ) {
-		return ((char *)&numberstring[in[0]-'0']) + sizeof(memblock_t);
+
+#ifdef USE_TRASH_TEST
+	if ( *(const int *)( ptr + page->size - 4 ) != ZONEID ) {
+		Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
 	}
 #endif
-	out = S_Malloc( strlen( in ) + 1 );
-	strcpy( out, in );
-	return out;
+
+	*slot = n;
 }
 
 
 /*
-==============================================================================
+================
+Z_SlabFree
 
-Goals:
-	reproducible without history effects -- no out of memory errors on weird map to map changes
-	allow restarting of the client without fragmentation
-	minimize total pages in use at run time
-	minimize total pages needed during load time
+Returns false if pointer doesn't belong to the slab allocator
+================
+*/
+static bool Z_SlabFree( void *ptr )
+{
+	slabPage_t *page;
+	slabPage_t **list;
+	int n;
 
-  Single block of memory with stack allocators coming from both ends towards the middle.
+	page = Slab_FindPage( ptr );
+	if ( page == NULL ) {
+		return false;
+	}
 
-  One side is designated the temporary memory allocator.
+	Slab_CheckSlot( page, ptr, &n );
 
-  Temporary memory can be allocated and freed in any order.
+	// set the slot to something that should cause problems
+	// if it is referenced...
+	Com_Memset( ptr, 0xaa, page->size );
 
-  A highwater mark is kept of the most in use at any time.
+	page->used[ n >> 5 ] &= ~( 1U << ( n & 31 ) );
+	*(void **)ptr = page->freeList;
+	page->freeList = ptr;
 
-  When there is no temporary memory allocated, the permanent and temp sides
-  can be switched, allowing the already touched temp memory to be used for
-  permanent storage.
+	slabStats.objects[ page->sizeClass ]--;
+	slabStats.tagBytes[ page->tag ] -= page->size;
 
-  Temp memory must never be allocated on two ends at once, or fragmentation
-  could occur.
+	list = &slabPages[ page->tag ][ page->sizeClass ];
 
-  If we have any in-use temp memory, additional temp allocations must come from
-  that side.
+	if ( --page->numUsed == 0 ) {
+		Slab_Unlink( list, page );
+		Slab_ReleasePage( page );
+	} else if ( page->numUsed == page->numSlots - 1 && *list != page ) {
+		// was full, move to the head
+		Slab_Unlink( list, page );
+		Slab_LinkFront( list, page );
+	}
 
-  If not, we can choose to make either side the new temp side and push future
-  permanent allocations to the other side.  Permanent allocations should be
-  kept on the side that has the current greatest wasted highwater mark.
+	return true;
+}
 
-==============================================================================
+
+/*
+================
+Z_SlabFreeTags
+================
 */
+static int Z_SlabFreeTags( memtag_t tag )
+{
+	slabPage_t *page;
+	int c, n, slot, count;
 
+	count = 0;
+	for ( c = 0; c < SLAB_CLASSES; c++ ) {
+		while ( ( page = slabPages[ tag ][ c ] ) != NULL ) {
+			for ( n = 0; n < page->numFresh; n++ ) {
+				if ( page->used[ n >> 5 ] & ( 1U << ( n & 31 ) ) ) {
+					Slab_CheckSlot( page, page->data + n * page->size, &slot );
+					if ( memProfile.active ) {
+						Z_ProfileFree( page->data + n * page->size );
+					}
+				}
+			}
+			Com_Memset( page->data, 0xaa, page->numFresh * page->size );
+			count += page->numUsed;
+			slabStats.objects[ c ] -= page->numUsed;
+			slabStats.tagBytes[ tag ] -= page->numUsed * page->size;
+			Slab_Unlink( &slabPages[ tag ][ c ], page );
+			Slab_ReleasePage( page );
+		}
+	}
 
-#define	HUNK_MAGIC	0x89537892
-#define	HUNK_FREE_MAGIC	0x89537893
+	return count;
+}
+#endif // USE_ZONE_SLABS
 
-typedef struct {
-	unsigned int magic;
-	unsigned int size;
-} hunkHeader_t;
 
-typedef struct {
-	int		mark;
-	int		permanent;
-	int		temp;
-	int		tempHighwater;
-} hunkUsed_t;
+/*
+========================
+Z_Free
+========================
+*/
+void Z_Free( void *ptr ) {
+	memblock_t	*block, *other;
+	memzone_t *zone;
 
-typedef struct hunkblock_s {
-	int size;
-	byte printed;
-	struct hunkblock_s *next;
-	const char *label;
-	const char *file;
-	int line;
-} hunkblock_t;
+	if (!ptr) {
+		Com_Error( ERR_DROP, "Z_Free: NULL pointer" );
+	}
 
-static	hunkblock_t *hunkblocks;
+	if ( memProfile.active ) {
+		Z_ProfileFree( ptr );
+	}
 
-static	hunkUsed_t	hunk_low, hunk_high;
-static	hunkUsed_t	*hunk_permanent, *hunk_temp;
+#ifdef USE_ZONE_SLABS
+	if ( Z_SlabFree( ptr ) ) {
+		return;
+	}
+#endif
 
-static	byte	*s_hunkData = NULL;
-static	int		s_hunkTotal;
+	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
+	if (block->id != ZONEID) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
+	}
 
-static const char *tagName[ TAG_COUNT ] = {
-	"FREE",
-	"GENERAL",
-	"PACK",
-	"SEARCH-PATH",
-	"SEARCH-PACK",
-	"SEARCH-DIR",
-	"BOTLIB",
-	"RENDERER",
-	"CLIENTS",
-	"SMALL",
-	"STATIC"
-};
+	if (block->tag == TAG_FREE) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a freed pointer" );
+	}
 
-typedef struct zone_stats_s {
-	int	zoneSegments;
-	int zoneBlocks;
-	int	zoneBytes;
-	int	botlibBytes;
-	int	rendererBytes;
-	int freeBytes;
-	int freeBlocks;
-	int freeSmallest;
-	int freeLargest;
-} zone_stats_t;
+	// if static memory
+#ifdef USE_STATIC_TAGS
+	if (block->tag == TAG_STATIC) {
+		return;
+	}
+#endif
 
+	// check the memory trash tester
+#ifdef USE_TRASH_TEST
+	if ( *(int *)((byte *)block + block->size - 4 ) != ZONEID ) {
+		Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
+	}
+#endif
 
-static void Zone_Stats( const char *name, const memzone_t *z, bool printDetails, zone_stats_t *stats )
-{
-	const memblock_t 	*block;
-	const memzone_t 	*zone;
-	zone_stats_t 		st;
+	if ( block->tag == TAG_SMALL ) {
+		zone = smallzone;
+	} else {
+		zone = mainzone;
+	}
 
-	memset( &st, 0, sizeof( st ) );
-	zone = z;
-	st.zoneSegments = 1;
-	st.freeSmallest = 0x7FFFFFFF;
+	zone->used -= block->size;
 
-	//if ( printDetails ) {
-	//	Com_Printf( "---------- %s zone segment #%i ----------\n", name, zone->segnum );
-	//}
+	// set the block to something that should cause problems
+	// if it is referenced...
+	Com_Memset( ptr, 0xaa, block->size - sizeof( *block ) );
 
-	for ( block = zone->blocklist.next ; ; ) {
-		if ( printDetails ) {
-			int tag = block->tag;
-			Com_Printf( "block:%p  size:%8i  tag: %s\n", (void *)block, block->size,
-				(unsigned)tag < TAG_COUNT ? tagName[ tag ] : va( "%i", tag ) );
-		}
-		if ( block->tag != TAG_FREE ) {
-			st.zoneBytes += block->size;
-			st.zoneBlocks++;
-			if ( block->tag == TAG_BOTLIB ) {
-				st.botlibBytes += block->size;
-			} else if ( block->tag == TAG_RENDERER ) {
-				st.rendererBytes += block->size;
-			}
-		} else {
-			st.freeBytes += block->size;
-			st.freeBlocks++;
-			if ( block->size > st.freeLargest )
-				st.freeLargest = block->size;
-			if ( block->size < st.freeSmallest )
-				st.freeSmallest = block->size;
-		}
-		if ( block->next == &zone->blocklist ) {
-			break; // all blocks have been hit
-		}
-		if ( (byte *)block + block->size != (byte *)block->next) {
+	block->tag = TAG_FREE; // mark as free
+	block->id = ZONEID;
+
+	other = block->prev;
+	if ( other->tag == TAG_FREE ) {
 #ifdef USE_MULTI_SEGMENT
-			const memblock_t *next = block->next;
-			if ( next->size == 0 && next->id == -ZONEID && next->tag == TAG_GENERAL ) {
-				st.zoneSegments++;
-				if ( printDetails ) {
-					Com_Printf( "---------- %s zone segment #%i ----------\n", name, st.zoneSegments );
-				}
-				block = next->next;
-				continue;
-			} else
+		RemoveFree( other );
 #endif
-				Com_Printf( "ERROR: block size does not touch the next block\n" );
-		}
-		if ( block->next->prev != block) {
-			Com_Printf( "ERROR: next block doesn't have proper back link\n" );
-		}
-		if ( block->tag == TAG_FREE && block->next->tag == TAG_FREE ) {
-			Com_Printf( "ERROR: two consecutive free blocks\n" );
+		// merge with previous free block
+		MergeBlock( other, block );
+#ifndef USE_MULTI_SEGMENT
+		if ( block == zone->rover ) {
+			zone->rover = other;
 		}
-		block = block->next;
+#endif
+		block = other;
 	}
 
-	// export stats
-	if ( stats ) {
-		memcpy( stats, &st, sizeof( *stats ) );
+#ifndef USE_MULTI_SEGMENT
+	zone->rover = block;
+#endif
+
+	other = block->next;
+	if ( other->tag == TAG_FREE ) {
+#ifdef USE_MULTI_SEGMENT
+		RemoveFree( other );
+#endif
+		// merge the next free block onto the end
+		MergeBlock( block, other );
 	}
+
+#ifdef USE_MULTI_SEGMENT
+	InsertFree( zone, block );
+#endif
 }
 
 
 /*
-=================
-Com_Meminfo_f
-=================
+================
+Z_FreeTags
+================
 */
-static void Com_Meminfo_f( void ) {
-	zone_stats_t st;
-	int		unused;
+int Z_FreeTags( memtag_t tag ) {
+	int			count;
+	memzone_t	*zone;
+	memblock_t	*block, *freed;
 
-	Com_Printf( "%8i bytes total hunk\n", s_hunkTotal );
-	Com_Printf( "\n" );
-	Com_Printf( "%8i low mark\n", hunk_low.mark );
-	Com_Printf( "%8i low permanent\n", hunk_low.permanent );
-	if ( hunk_low.temp != hunk_low.permanent ) {
-		Com_Printf( "%8i low temp\n", hunk_low.temp );
-	}
-	Com_Printf( "%8i low tempHighwater\n", hunk_low.tempHighwater );
-	Com_Printf( "\n" );
-	Com_Printf( "%8i high mark\n", hunk_high.mark );
-	Com_Printf( "%8i high permanent\n", hunk_high.permanent );
-	if ( hunk_high.temp != hunk_high.permanent ) {
-		Com_Printf( "%8i high temp\n", hunk_high.temp );
-	}
-	Com_Printf( "%8i high tempHighwater\n", hunk_high.tempHighwater );
-	Com_Printf( "\n" );
-	Com_Printf( "%8i total hunk in use\n", hunk_low.permanent + hunk_high.permanent );
-	unused = 0;
-	if ( hunk_low.tempHighwater > hunk_low.permanent ) {
-		unused += hunk_low.tempHighwater - hunk_low.permanent;
-	}
-	if ( hunk_high.tempHighwater > hunk_high.permanent ) {
-		unused += hunk_high.tempHighwater - hunk_high.permanent;
+	if ( tag == TAG_STATIC ) {
+		Com_Error( ERR_FATAL, "Z_FreeTags( TAG_STATIC )" );
+		return 0;
+	} else if ( tag == TAG_SMALL ) {
+		zone = smallzone;
+	} else {
+		zone = mainzone;
 	}
-	Com_Printf( "%8i unused highwater\n", unused );
-	Com_Printf( "\n" );
 
-	Zone_Stats( "main", mainzone, !Q_stricmp( Cmd_Argv(1), "main" ) || !Q_stricmp( Cmd_Argv(1), "all" ), &st );
-	Com_Printf( "%8i bytes total main zone\n\n", mainzone->size );
-	Com_Printf( "%8i bytes in %i main zone blocks%s\n", st.zoneBytes, st.zoneBlocks,
-		st.zoneSegments > 1 ? va( " and %i segments", st.zoneSegments ) : "" );
-	Com_Printf( "        %8i bytes in botlib\n", st.botlibBytes );
-	Com_Printf( "        %8i bytes in renderer\n", st.rendererBytes );
-	Com_Printf( "        %8i bytes in other\n", st.zoneBytes - ( st.botlibBytes + st.rendererBytes ) );
-	Com_Printf( "        %8i bytes in %i free blocks\n", st.freeBytes, st.freeBlocks );
-	if ( st.freeBlocks > 1 ) {
-		Com_Printf( "        (largest: %i bytes, smallest: %i bytes)\n\n", st.freeLargest, st.freeSmallest );
+	count = 0;
+	for ( block = zone->blocklist.next ; ; ) {
+		if ( block->tag == tag && block->id == ZONEID ) {
+			if ( block->prev->tag == TAG_FREE )
+				freed = block->prev;  // current block will be merged with previous
+			else
+				freed = block; // will leave in place
+			Z_Free( (void*)( block + 1 ) );
+			block = freed;
+			count++;
+		}
+		if ( block->next == &zone->blocklist ) {
+			break;	// all blocks have been hit
+		}
+		block = block->next;
 	}
 
-	Zone_Stats( "small", smallzone, !Q_stricmp( Cmd_Argv(1), "small" ) || !Q_stricmp( Cmd_Argv(1), "all" ), &st );
-	Com_Printf( "%8i bytes total small zone\n\n", smallzone->size );
-	Com_Printf( "%8i bytes in %i small zone blocks%s\n", st.zoneBytes, st.zoneBlocks,
-		st.zoneSegments > 1 ? va( " and %i segments", st.zoneSegments ) : "" );
-	Com_Printf( "        %8i bytes in %i free blocks\n", st.freeBytes, st.freeBlocks );
-	if ( st.freeBlocks > 1 ) {
-		Com_Printf( "        (largest: %i bytes, smallest: %i bytes)\n\n", st.freeLargest, st.freeSmallest );
-	}
+#ifdef USE_ZONE_SLABS
+	count += Z_SlabFreeTags( tag );
+#endif
+
+	return count;
 }
 
 
 /*
-===============
-Com_TouchMemory
-
-Touch all known used data to make sure it is paged in
-===============
+================
+Z_TagMalloc
+================
 */
-unsigned int Com_TouchMemory( void ) {
-	const memblock_t *block;
-	const memzone_t *zone;
-	int		start, end;
-	int		i, j;
-	unsigned int sum;
-
-	Z_CheckHeap();
-
-	start = Sys_Milliseconds();
-
-	sum = 0;
-
-	j = hunk_low.permanent >> 2;
-	for ( i = 0 ; i < j ; i+=64 ) {			// only need to touch each page
-		sum += ((unsigned int *)s_hunkData)[i];
-	}
+#ifdef ZONE_DEBUG
+void *Z_TagMallocDebug( int size, memtag_t tag, char *label, char *file, int line ) {
+#else
+void *Z_TagMallocSite( int size, memtag_t tag, const char *file, int line ) {
+#endif
+	int		allocSize;
+	int		extra;
+#ifndef USE_MULTI_SEGMENT
+	memblock_t	*start, *rover;
+#endif
+	memblock_t *base;
+	memzone_t *zone;
 
-	i = ( s_hunkTotal - hunk_high.permanent ) >> 2;
-	j = hunk_high.permanent >> 2;
-	for (  ; i < j ; i+=64 ) {			// only need to touch each page
-		sum += ((unsigned int *)s_hunkData)[i];
+	if ( tag == TAG_FREE ) {
+		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use with TAG_FREE" );
 	}
 
-	zone = mainzone;
-	for (block = zone->blocklist.next ; ; block = block->next) {
-		if ( block->tag != TAG_FREE ) {
-			j = block->size >> 2;
-			for ( i = 0 ; i < j ; i+=64 ) {				// only need to touch each page
-				sum += ((unsigned int *)block)[i];
+#ifdef USE_ZONE_SLABS
+	if ( size >= 0 && size <= MAX_SLAB_SIZE - SLAB_TRASH_SIZE ) {
+		void *ptr = Z_SlabAlloc( size + SLAB_TRASH_SIZE, tag );
+		if ( ptr ) {
+			if ( memProfile.active ) {
+				Z_ProfileAlloc( ptr, size, tag, file, line );
 			}
-		}
-		if ( block->next == &zone->blocklist ) {
-			break; // all blocks have been hit
+			return ptr;
 		}
 	}
+#endif
 
-	end = Sys_Milliseconds();
+	if ( tag == TAG_SMALL ) {
+		zone = smallzone;
+	} else {
+		zone = mainzone;
+	}
 
-	Com_Printf( "Com_TouchMemory: %i msec\n", end - start );
+	allocSize = size;
 
-	return sum; // just to silent compiler warning
-}
+#ifdef USE_MULTI_SEGMENT
+	if ( size < (sizeof( freeblock_t ) ) ) {
+		size = (sizeof( freeblock_t ) );
+	}
+#endif
 
+	//
+	// scan through the block list looking for the first free block
+	// of sufficient size
+	//
+	size += sizeof( *base );	// account for size of block header
+#ifdef USE_TRASH_TEST
+	size += 4;					// space for memory trash tester
+#endif
 
-/*
-=================
-Com_InitSmallZoneMemory
-=================
-*/
-static void Com_InitSmallZoneMemory( void ) {
-	static byte s_buf[ 512 * 1024 ];
-	int smallZoneSize;
+	size = PAD(size, sizeof(intptr_t));		// align to 32/64 bit boundary
 
-	smallZoneSize = sizeof( s_buf );
-	Com_Memset( s_buf, 0, smallZoneSize );
-	smallzone = (memzone_t *)s_buf;
-	Z_ClearZone( smallzone, smallzone, smallZoneSize, 1 );
-}
+#ifdef USE_MULTI_SEGMENT
+	base = SearchFree( zone, size );
 
+	RemoveFree( base );
+#else
 
-/*
-=================
-Com_InitZoneMemory
-=================
-*/
-static void Com_InitZoneMemory( void ) {
-	int		mainZoneSize;
-	cvar_t	*cv;
+	base = rover = zone->rover;
+	start = base->prev;
 
-	// Please note: com_zoneMegs can only be set on the command line, and
-	// not in q3config.cfg or Com_StartupVariable, as they haven't been
-	// executed by this point. It's a chicken and egg problem. We need the
-	// memory manager configured to handle those places where you would
-	// configure the memory manager.
-
-	// allocate the random block zone
-	cv = Cvar_Get( "com_zoneMegs", XSTRING( DEF_COMZONEMEGS ), CVAR_LATCH | CVAR_ARCHIVE );
-	Cvar_CheckRange( cv, "1", NULL, CV_INTEGER );
-	Cvar_SetDescription( cv, "Initial amount of memory (RAM) allocated for the main block zone (in MB)." );
-
-#ifndef USE_MULTI_SEGMENT
-	if ( cv->integer < DEF_COMZONEMEGS )
-		mainZoneSize = 1024 * 1024 * DEF_COMZONEMEGS;
-	else
-#endif
-		mainZoneSize = cv->integer * 1024 * 1024;
-
-	mainzone = calloc( mainZoneSize, 1 );
-	if ( !mainzone ) {
-		Com_Error( ERR_FATAL, "Zone data failed to allocate %i megs", mainZoneSize / (1024*1024) );
-	}
-	Z_ClearZone( mainzone, mainzone, mainZoneSize, 1 );
-}
-
-
-/*
-=================
-Hunk_Log
-=================
-*/
-void Hunk_Log( void ) {
-	hunkblock_t	*block;
-	char		buf[4096];
-	int size, numBlocks;
-
-	if ( logfile == FS_INVALID_HANDLE || !FS_Initialized() )
-		return;
-
-	size = 0;
-	numBlocks = 0;
-	Com_sprintf(buf, sizeof(buf), "\r\n================\r\nHunk log\r\n================\r\n");
-	FS_Write(buf, strlen(buf), logfile);
-	for (block = hunkblocks ; block; block = block->next) {
-#ifdef HUNK_DEBUG
-		Com_sprintf(buf, sizeof(buf), "size = %8d: %s, line: %d (%s)\r\n", block->size, block->file, block->line, block->label);
-		FS_Write(buf, strlen(buf), logfile);
+	do {
+		if ( rover == start ) {
+			// scanned all the way around the list
+#ifdef ZONE_DEBUG
+			Z_LogHeap();
+			Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone: %s, line: %d (%s)",
+								size, zone == smallzone ? "small" : "main", file, line, label );
+#else
+			Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes from the %s zone",
+								size, zone == smallzone ? "small" : "main" );
 #endif
-		size += block->size;
-		numBlocks++;
-	}
-	Com_sprintf(buf, sizeof(buf), "%d Hunk memory\r\n", size);
-	FS_Write(buf, strlen(buf), logfile);
-	Com_sprintf(buf, sizeof(buf), "%d hunk blocks\r\n", numBlocks);
-	FS_Write(buf, strlen(buf), logfile);
-}
-
-
-/*
-=================
-Hunk_SmallLog
-=================
-*/
-#ifdef HUNK_DEBUG
-void Hunk_SmallLog( void ) {
-	hunkblock_t	*block, *block2;
-	char		buf[4096];
-	int size, locsize, numBlocks;
-
-	if ( logfile == FS_INVALID_HANDLE || !FS_Initialized() )
-		return;
-
-	for (block = hunkblocks ; block; block = block->next) {
-		block->printed = false;
-	}
-	size = 0;
-	numBlocks = 0;
-	Com_sprintf(buf, sizeof(buf), "\r\n================\r\nHunk Small log\r\n================\r\n");
-	FS_Write(buf, strlen(buf), logfile);
-	for (block = hunkblocks; block; block = block->next) {
-		if (block->printed) {
-			continue;
+			return NULL;
 		}
-		locsize = block->size;
-		for (block2 = block->next; block2; block2 = block2->next) {
-			if (block->line != block2->line) {
-				continue;
-			}
-			if (Q_stricmp(block->file, block2->file)) {
-				continue;
-			}
-			size += block2->size;
-			locsize += block2->size;
-			block2->printed = true;
+		if ( rover->tag != TAG_FREE ) {
+			base = rover = rover->next;
+		} else {
+			rover = rover->next;
 		}
-		Com_sprintf(buf, sizeof(buf), "size = %8d: %s, line: %d (%s)\r\n", locsize, block->file, block->line, block->label);
-		FS_Write(buf, strlen(buf), logfile);
-		size += block->size;
-		numBlocks++;
-	}
-	Com_sprintf(buf, sizeof(buf), "%d Hunk memory\r\n", size);
-	FS_Write(buf, strlen(buf), logfile);
-	Com_sprintf(buf, sizeof(buf), "%d hunk blocks\r\n", numBlocks);
-	FS_Write(buf, strlen(buf), logfile);
-}
+	} while (base->tag != TAG_FREE || base->size < size);
 #endif
 
-
-/*
-=================
-Com_InitHunkMemory
-=================
-*/
-static void Com_InitHunkMemory( void ) {
-	cvar_t	*cv;
-
-	// make sure the file system has allocated and "not" freed any temp blocks
-	// this allows the config and product id files ( journal files too ) to be loaded
-	// by the file system without redundant routines in the file system utilizing different
-	// memory systems
-	if ( FS_LoadStack() != 0 ) {
-		Com_Error( ERR_FATAL, "Hunk initialization failed. File system load stack not zero" );
+	//
+	// found a block big enough
+	//
+	extra = base->size - size;
+	if ( extra >= minfragment ) {
+		memblock_t *fragment;
+		// there will be a free fragment after the allocated block
+		fragment = (memblock_t *)( (byte *)base + size );
+		fragment->size = extra;
+		fragment->tag = TAG_FREE; // free block
+		fragment->id = ZONEID;
+		fragment->prev = base;
+		fragment->next = base->next;
+		fragment->next->prev = fragment;
+		base->next = fragment;
+		base->size = size;
+#ifdef USE_MULTI_SEGMENT
+		InsertFree( zone, fragment );
+#endif
 	}
 
-	// allocate the stack based hunk allocator
-	cv = Cvar_Get( "com_hunkMegs", XSTRING( DEF_COMHUNKMEGS ), CVAR_LATCH | CVAR_ARCHIVE );
-	Cvar_CheckRange( cv, XSTRING( MIN_COMHUNKMEGS ), NULL, CV_INTEGER );
-	Cvar_SetDescription( cv, "The size of the hunk memory segment." );
+#ifndef USE_MULTI_SEGMENT
+	zone->rover = base->next;	// next allocation will start looking here
+#endif
+	zone->used += base->size;
+	zoneAllocs++;
 
-	s_hunkTotal = cv->integer * 1024 * 1024;
+	base->tag = tag;			// no longer a free block
+	base->id = ZONEID;
 
-	s_hunkData = calloc( s_hunkTotal + 63, 1 );
-	if ( !s_hunkData ) {
-		Com_Error( ERR_FATAL, "Hunk data failed to allocate %i megs", s_hunkTotal / (1024*1024) );
+	if ( memProfile.active ) {
+		Z_ProfileAlloc( base + 1, allocSize, tag, file, line );
 	}
 
-	// cacheline align
-	s_hunkData = PADP( s_hunkData, 64 );
-	Hunk_Clear();
-
-	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
 #ifdef ZONE_DEBUG
-	Cmd_AddCommand( "zonelog", Z_LogHeap );
+	base->d.label = label;
+	base->d.file = file;
+	base->d.line = line;
+	base->d.allocSize = allocSize;
 #endif
-#ifdef HUNK_DEBUG
-	Cmd_AddCommand( "hunklog", Hunk_Log );
-	Cmd_AddCommand( "hunksmalllog", Hunk_SmallLog );
+
+#ifdef USE_TRASH_TEST
+	// marker for memory trash testing
+	*(int *)((byte *)base + base->size - 4) = ZONEID;
 #endif
+
+	return (void *) ( base + 1 );
 }
 
 
 /*
-====================
-Hunk_MemoryRemaining
-====================
+========================
+Z_Malloc
+========================
 */
-int	Hunk_MemoryRemaining( void ) {
-	int		low, high;
+#ifdef ZONE_DEBUG
+void *Z_MallocDebug( int size, char *label, char *file, int line ) {
+#else
+void *Z_MallocSite( int size, const char *file, int line ) {
+#endif
+	void	*buf;
 
-	low = hunk_low.permanent > hunk_low.temp ? hunk_low.permanent : hunk_low.temp;
-	high = hunk_high.permanent > hunk_high.temp ? hunk_high.permanent : hunk_high.temp;
+  //Z_CheckHeap ();	// DEBUG
 
-	return s_hunkTotal - ( low + high );
+#ifdef ZONE_DEBUG
+	buf = Z_TagMallocDebug( size, TAG_GENERAL, label, file, line );
+#else
+	buf = Z_TagMallocSite( size, TAG_GENERAL, file, line );
+#endif
+	Com_Memset( buf, 0, size );
+
+	return buf;
 }
 
 
 /*
-===================
-Hunk_SetMark
-
-The server calls this after the level and game VM have been loaded
-===================
+========================
+S_Malloc
+========================
 */
-void Hunk_SetMark( void ) {
-	hunk_low.mark = hunk_low.permanent;
-	hunk_high.mark = hunk_high.permanent;
+#ifdef ZONE_DEBUG
+void *S_MallocDebug( int size, char *label, char *file, int line ) {
+	return Z_TagMallocDebug( size, TAG_SMALL, label, file, line );
+}
+#else
+void *S_MallocSite( int size, const char *file, int line ) {
+	return Z_TagMallocSite( size, TAG_SMALL, file, line );
 }
+#endif
 
 
 /*
-=================
-Hunk_ClearToMark
-
-The client calls this before starting a vid_restart or snd_restart
-=================
+========================
+Z_CheckHeap
+========================
 */
-void Hunk_ClearToMark( void ) {
-	hunk_low.permanent = hunk_low.temp = hunk_low.mark;
-	hunk_high.permanent = hunk_high.temp = hunk_high.mark;
+static void Z_CheckHeap( void ) {
+	const memblock_t *block;
+	const memzone_t *zone;
+
+	zone =  mainzone;
+	for ( block = zone->blocklist.next ; ; ) {
+		if ( block->next == &zone->blocklist ) {
+			break;	// all blocks have been hit
+		}
+		if ( (byte *)block + block->size != (byte *)block->next) {
+#ifdef USE_MULTI_SEGMENT
+			const memblock_t *next = block->next;
+			if ( next->size == 0 && next->id == -ZONEID && next->tag == TAG_GENERAL ) {
+				block = next; // new zone segment
+			} else
+#endif
+			Com_Error( ERR_FATAL, "Z_CheckHeap: block size does not touch the next block" );
+		}
+		if ( block->next->prev != block) {
+			Com_Error( ERR_FATAL, "Z_CheckHeap: next block doesn't have proper back link" );
+		}
+		if ( block->tag == TAG_FREE && block->next->tag == TAG_FREE ) {
+			Com_Error( ERR_FATAL, "Z_CheckHeap: two consecutive free blocks" );
+		}
+		block = block->next;
+	}
 }
 
 
 /*
-=================
-Hunk_CheckMark
-=================
+========================
+Z_LogZoneHeap
+========================
 */
-bool Hunk_CheckMark( void ) {
-	if( hunk_low.mark || hunk_high.mark ) {
-		return true;
+static void Z_LogZoneHeap( memzone_t *zone, const char *name ) {
+#ifdef ZONE_DEBUG
+	char dump[32], *ptr;
+	int  i, j;
+#endif
+	memblock_t	*block;
+	char		buf[4096];
+	int size, allocSize, numBlocks;
+	int len;
+
+	if ( logWriter.file == NULL )
+		return;
+
+	size = numBlocks = 0;
+#ifdef ZONE_DEBUG
+	allocSize = 0;
+#endif
+	len = Com_sprintf( buf, sizeof(buf), "\r\n================\r\n%s log\r\n================\r\n", name );
+	Com_LogWrite( buf, len, true );
+	for ( block = zone->blocklist.next ; ; ) {
+		if ( block->tag != TAG_FREE ) {
+#ifdef ZONE_DEBUG
+			ptr = ((char *) block) + sizeof(memblock_t);
+			j = 0;
+			for (i = 0; i < 20 && i < block->d.allocSize; i++) {
+				if (ptr[i] >= 32 && ptr[i] < 127) {
+					dump[j++] = ptr[i];
+				}
+				else {
+					dump[j++] = '_';
+				}
+			}
+			dump[j] = '\0';
+			len = Com_sprintf(buf, sizeof(buf), "size = %8d: %s, line: %d (%s) [%s]\r\n", block->d.allocSize, block->d.file, block->d.line, block->d.label, dump);
+			Com_LogWrite( buf, len, true );
+			allocSize += block->d.allocSize;
+#endif
+			size += block->size;
+			numBlocks++;
+		}
+		if ( block->next == &zone->blocklist ) {
+			break; // all blocks have been hit
+		}
+		block = block->next;
 	}
-	return false;
+#ifdef ZONE_DEBUG
+	// subtract debug memory
+	size -= numBlocks * sizeof(zonedebug_t);
+#else
+	allocSize = numBlocks * sizeof(memblock_t); // + 32 bit alignment
+#endif
+	len = Com_sprintf( buf, sizeof( buf ), "%d %s memory in %d blocks\r\n", size, name, numBlocks );
+	Com_LogWrite( buf, len, true );
+	len = Com_sprintf( buf, sizeof( buf ), "%d %s memory overhead\r\n", size - allocSize, name );
+	Com_LogWrite( buf, len, true );
+	Com_LogFlush();
 }
 
-void CL_ShutdownCGame( void );
-void CL_ShutdownUI( void );
-void SV_ShutdownGameProgs( void );
 
 /*
-=================
-Hunk_Clear
-
-The server calls this before shutting down or loading a new map
-=================
+========================
+Z_LogHeap
+========================
 */
-void Hunk_Clear( void ) {
+void Z_LogHeap( void ) {
+	Z_LogZoneHeap( mainzone, "MAIN" );
+	Z_LogZoneHeap( smallzone, "SMALL" );
+}
 
-#ifndef DEDICATED
-	CL_ShutdownCGame();
-	CL_ShutdownUI();
-#endif
-	SV_ShutdownGameProgs();
-#ifndef DEDICATED
-	CIN_CloseAllVideos();
-#endif
-	hunk_low.mark = 0;
-	hunk_low.permanent = 0;
-	hunk_low.temp = 0;
-	hunk_low.tempHighwater = 0;
+#ifdef USE_STATIC_TAGS
 
-	hunk_high.mark = 0;
-	hunk_high.permanent = 0;
-	hunk_high.temp = 0;
-	hunk_high.tempHighwater = 0;
+// static mem blocks to reduce a lot of small zone overhead
+typedef struct memstatic_s {
+	memblock_t b;
+	byte mem[2];
+} memstatic_t;
 
-	hunk_permanent = &hunk_low;
-	hunk_temp = &hunk_high;
+#define MEM_STATIC(chr) { { NULL, NULL, PAD(sizeof(memstatic_t),4), TAG_STATIC, ZONEID }, {chr,'\0'} }
 
-	Com_Printf( "Hunk_Clear: reset the hunk ok\n" );
-	VM_Clear();
-#ifdef HUNK_DEBUG
-	hunkblocks = NULL;
-#endif
-}
+static const memstatic_t emptystring =
+	MEM_STATIC( '\0' );
 
+static const memstatic_t numberstring[] = {
+	MEM_STATIC( '0' ),
+	MEM_STATIC( '1' ),
+	MEM_STATIC( '2' ),
+	MEM_STATIC( '3' ),
+	MEM_STATIC( '4' ),
+	MEM_STATIC( '5' ),
+	MEM_STATIC( '6' ),
+	MEM_STATIC( '7' ),
+	MEM_STATIC( '8' ),
+	MEM_STATIC( '9' )
+};
+#endif // USE_STATIC_TAGS
 
-static void Hunk_SwapBanks( void ) {
-	hunkUsed_t	*swap;
+/*
+========================
+CopyString
 
-	// can't swap banks if there is any temp already allocated
-	if ( hunk_temp->temp != hunk_temp->permanent ) {
-		return;
+ NOTE:	never write over the memory CopyString returns because
+		memory from a memstatic_t might be returned
+========================
+*/
+char *CopyString( const char *in ) {
+	char *out;
+#ifdef USE_STATIC_TAGS
+	if ( in[0] == '\0' ) {
+		return ((char *)&emptystring) + sizeof(memblock_t);
 	}
-
-	// if we have a larger highwater mark on this side, start making
-	// our permanent allocations here and use the other side for temp
-	if ( hunk_temp->tempHighwater - hunk_temp->permanent >
-		hunk_permanent->tempHighwater - hunk_permanent->permanent ) {
-		swap = hunk_temp;
-		hunk_temp = hunk_permanent;
-		hunk_permanent = swap;
+	else if ( in[0] >= '0' && in[0] <= '9' && in[1] == '\0' ) {
+		return ((char *)&numberstring[in[0]-'0']) + sizeof(memblock_t);
 	}
+#endif
+	out = S_Malloc( strlen( in ) + 1 );
+	strcpy( out, in );
+	return out;
 }
 
 
 /*
-=================
-Hunk_Alloc
+==============================================================================
 
-Allocate permanent (until the hunk is cleared) memory
-=================
-*/
-#ifdef HUNK_DEBUG
-void *Hunk_AllocDebug( int size, ha_pref preference, char *label, char *file, int line ) {
-#else
-void *Hunk_Alloc( int size, ha_pref preference ) {
-#endif
-	void	*buf;
+						FRAME MEMORY
 
-	if ( s_hunkData == NULL)
-	{
-		Com_Error( ERR_FATAL, "Hunk_Alloc: Hunk memory system not initialized" );
-	}
+Linear scratch arenas for transient allocations: a bump pointer which is
+rewound either by the owner with Arena_Release() or as a whole by
+Arena_Reset(). The frame arena is reset at the end of every Com_Frame()
+and may only be used from the main thread, other threads must set up
+arenas of their own.
 
-	// can't do preference if there is any temp allocated
-	if (preference == h_dontcare || hunk_temp->temp != hunk_temp->permanent) {
-		Hunk_SwapBanks();
-	} else {
-		if (preference == h_low && hunk_permanent != &hunk_low) {
-			Hunk_SwapBanks();
-		} else if (preference == h_high && hunk_permanent != &hunk_high) {
-			Hunk_SwapBanks();
-		}
-	}
+Requests that don't fit are served by malloc() and freed on the next
+reset, so callers never have to deal with failures.
+==============================================================================
+*/
 
-#ifdef HUNK_DEBUG
-	size += sizeof(hunkblock_t);
-#endif
+#define FRAME_ARENA_SIZE	(1024*1024)
 
-	// round to cacheline
-	size = PAD( size, 64 );
+typedef struct arenaOverflow_s {
+	struct arenaOverflow_s *next;
+} arenaOverflow_t;
 
-	if ( hunk_low.temp + hunk_high.temp + size > s_hunkTotal ) {
-#ifdef HUNK_DEBUG
-		Hunk_Log();
-		Hunk_SmallLog();
+// all initialized arenas, for meminfo
+static memArena_t *arenaList;
 
-		Com_Error(ERR_DROP, "Hunk_Alloc failed on %i: %s, line: %d (%s)", size, file, line, label);
-#else
-		Com_Error(ERR_DROP, "Hunk_Alloc failed on %i", size);
-#endif
-	}
+static memArena_t frameArena;
 
-	if ( hunk_permanent == &hunk_low ) {
-		buf = (void *)(s_hunkData + hunk_permanent->permanent);
-		hunk_permanent->permanent += size;
-	} else {
-		hunk_permanent->permanent += size;
-		buf = (void *)(s_hunkData + s_hunkTotal - hunk_permanent->permanent );
-	}
 
-	hunk_permanent->temp = hunk_permanent->permanent;
+/*
+=================
+Arena_Init
 
-	Com_Memset( buf, 0, size );
+Must be called from the main thread
+=================
+*/
+void Arena_Init( memArena_t *arena, const char *name, int size ) {
 
-#ifdef HUNK_DEBUG
-	{
-		hunkblock_t *block;
+	Com_Memset( arena, 0, sizeof( *arena ) );
 
-		block = (hunkblock_t *) buf;
-		block->size = size - sizeof(hunkblock_t);
-		block->file = file;
-		block->label = label;
-		block->line = line;
-		block->next = hunkblocks;
-		hunkblocks = block;
-		buf = ((byte *) buf) + sizeof(hunkblock_t);
+	arena->mem = malloc( size + 63 );
+	if ( arena->mem == NULL ) {
+		Com_Error( ERR_FATAL, "Arena_Init: failed on allocation of %i bytes for %s", size, name );
 	}
-#endif
-	return buf;
+
+	arena->base = PADP( arena->mem, 64 );
+	arena->size = size;
+	arena->name = name;
+
+	arena->next = arenaList;
+	arenaList = arena;
 }
 
 
 /*
 =================
-Hunk_AllocateTempMemory
-
-This is used by the file loading system.
-Multiple files can be loaded in temporary memory.
-When the files-in-use count reaches zero, all temp memory will be deleted
+Arena_Shutdown
 =================
 */
-void *Hunk_AllocateTempMemory( int size ) {
-	void		*buf;
-	hunkHeader_t	*hdr;
+void Arena_Shutdown( memArena_t *arena ) {
+	memArena_t **prev;
 
-	// return a Z_Malloc'd block if the hunk has not been initialized
-	// this allows the config and product id files ( journal files too ) to be loaded
-	// by the file system without redundant routines in the file system utilizing different
-	// memory systems
-	if ( s_hunkData == NULL )
-	{
-		return Z_Malloc(size);
+	for ( prev = &arenaList; *prev; prev = &(*prev)->next ) {
+		if ( *prev == arena ) {
+			*prev = arena->next;
+			break;
+		}
 	}
 
-	Hunk_SwapBanks();
+	Arena_Reset( arena );
+	free( arena->mem );
 
-	size = PAD(size, sizeof(intptr_t)) + sizeof( hunkHeader_t );
+	Com_Memset( arena, 0, sizeof( *arena ) );
+}
 
-	if ( hunk_temp->temp + hunk_permanent->permanent + size > s_hunkTotal ) {
-		Com_Error( ERR_DROP, "Hunk_AllocateTempMemory: failed on %i", size );
-	}
 
-	if ( hunk_temp == &hunk_low ) {
-		buf = (void *)(s_hunkData + hunk_temp->temp);
-		hunk_temp->temp += size;
-	} else {
-		hunk_temp->temp += size;
-		buf = (void *)(s_hunkData + s_hunkTotal - hunk_temp->temp );
+/*
+=================
+Arena_Alloc
+
+Alignment must be a power of two up to 64 bytes
+=================
+*/
+void *Arena_Alloc( memArena_t *arena, int size, int align ) {
+	arenaOverflow_t *ov;
+	int offset;
+
+	offset = PAD( arena->used, align );
+	if ( offset + size <= arena->size ) {
+		arena->used = offset + size;
+		if ( arena->used > arena->peak ) {
+			arena->peak = arena->used;
+		}
+		return arena->base + offset;
 	}
 
-	if ( hunk_temp->temp > hunk_temp->tempHighwater ) {
-		hunk_temp->tempHighwater = hunk_temp->temp;
+	ov = malloc( sizeof( *ov ) + size + align );
+	if ( ov == NULL ) {
+		Com_Error( ERR_FATAL, "Arena_Alloc: failed on allocation of %i bytes for %s", size, arena->name );
 	}
 
-	hdr = (hunkHeader_t *)buf;
-	buf = (void *)(hdr+1);
+	ov->next = arena->overflow;
+	arena->overflow = ov;
+	arena->overflows++;
 
-	hdr->magic = HUNK_MAGIC;
-	hdr->size = size;
-
-	// don't bother clearing, because we are going to load a file over it
-	return buf;
-}
+	return PADP( ov + 1, align );
+}
 
 
 /*
-==================
-Hunk_FreeTempMemory
-==================
+=================
+Arena_Mark
+=================
 */
-void Hunk_FreeTempMemory( void *buf ) {
-	hunkHeader_t	*hdr;
-
-	// free with Z_Free if the hunk has not been initialized
-	// this allows the config and product id files ( journal files too ) to be loaded
-	// by the file system without redundant routines in the file system utilizing different
-	// memory systems
-	if ( s_hunkData == NULL )
-	{
-		Z_Free(buf);
-		return;
-	}
-
-	hdr = ( (hunkHeader_t *)buf ) - 1;
-	if ( hdr->magic != HUNK_MAGIC ) {
-		Com_Error( ERR_FATAL, "Hunk_FreeTempMemory: bad magic" );
-	}
-
-	hdr->magic = HUNK_FREE_MAGIC;
-
-	// this only works if the files are freed in stack order,
-	// otherwise the memory will stay around until Hunk_ClearTempMemory
-	if ( hunk_temp == &hunk_low ) {
-		if ( hdr == (void *)(s_hunkData + hunk_temp->temp - hdr->size ) ) {
-			hunk_temp->temp -= hdr->size;
-		} else {
-			Com_Printf( "Hunk_FreeTempMemory: not the final block\n" );
-		}
-	} else {
-		if ( hdr == (void *)(s_hunkData + s_hunkTotal - hunk_temp->temp ) ) {
-			hunk_temp->temp -= hdr->size;
-		} else {
-			Com_Printf( "Hunk_FreeTempMemory: not the final block\n" );
-		}
-	}
+int Arena_Mark( const memArena_t *arena ) {
+	return arena->used;
 }
 
 
 /*
 =================
-Hunk_ClearTempMemory
+Arena_Release
 
-The temp space is no longer needed.  If we have left more
-touched but unused memory on this side, have future
-permanent allocs use this side.
+Frees everything allocated after the mark, except overflow blocks
 =================
 */
-void Hunk_ClearTempMemory( void ) {
-	if ( s_hunkData != NULL ) {
-		hunk_temp->temp = hunk_temp->permanent;
-	}
+void Arena_Release( memArena_t *arena, int mark ) {
+	arena->used = mark;
 }
 
-/*
-===================================================================
-
-EVENTS AND JOURNALING
-
-In addition to these events, .cfg files are also copied to the
-journaled file
-===================================================================
-*/
-
-#define	MAX_PUSHED_EVENTS 256
-static int com_pushedEventsHead = 0;
-static int com_pushedEventsTail = 0;
-static sysEvent_t com_pushedEvents[MAX_PUSHED_EVENTS];
-
 
 /*
 =================
-Com_InitJournaling
+Arena_Reset
 =================
 */
-static void Com_InitJournaling( void ) {
-	if ( !com_journal->integer ) {
-		return;
-	}
+void Arena_Reset( memArena_t *arena ) {
+	arenaOverflow_t *ov;
 
-	if ( com_journal->integer == 1 ) {
-		Com_Printf( "Journaling events\n" );
-		com_journalFile = FS_FOpenFileWrite( "journal.dat" );
-		com_journalDataFile = FS_FOpenFileWrite( "journaldata.dat" );
-	} else if ( com_journal->integer == 2 ) {
-		Com_Printf( "Replaying journaled events\n" );
-		FS_FOpenFileRead( "journal.dat", &com_journalFile, true );
-		FS_FOpenFileRead( "journaldata.dat", &com_journalDataFile, true );
+	while ( ( ov = arena->overflow ) != NULL ) {
+		arena->overflow = ov->next;
+		free( ov );
 	}
 
-	if ( com_journalFile == FS_INVALID_HANDLE || com_journalDataFile == FS_INVALID_HANDLE ) {
-		Cvar_Set( "com_journal", "0" );
-		if ( com_journalFile != FS_INVALID_HANDLE ) {
-			FS_FCloseFile( com_journalFile );
-			com_journalFile = FS_INVALID_HANDLE;
-		}
-		if ( com_journalDataFile != FS_INVALID_HANDLE ) {
-			FS_FCloseFile( com_journalDataFile );
-			com_journalDataFile = FS_INVALID_HANDLE;
-		}
-		Com_Printf( "Couldn't open journal files\n" );
+	if ( arena->peak > arena->highwater ) {
+		arena->highwater = arena->peak;
 	}
+
+	arena->lastPeak = arena->peak;
+	arena->peak = 0;
+	arena->used = 0;
 }
 
 
 /*
-========================================================================
-
-EVENT LOOP
+=================
+Com_FrameAlloc
 
-========================================================================
+Returns 16-byte aligned memory which is valid until the end of current frame
+=================
 */
+void *Com_FrameAlloc( int size ) {
+	return Arena_Alloc( &frameArena, size, 16 );
+}
 
-#define MAX_QUED_EVENTS		128
-#define MASK_QUED_EVENTS	( MAX_QUED_EVENTS - 1 )
-
-static sysEvent_t			eventQue[ MAX_QUED_EVENTS ];
-static sysEvent_t			*lastEvent = eventQue + MAX_QUED_EVENTS - 1;
-static unsigned int			eventHead = 0;
-static unsigned int			eventTail = 0;
 
-static const char *Sys_EventName( sysEventType_t evType ) {
+/*
+=================
+Com_FrameMark
+=================
+*/
+int Com_FrameMark( void ) {
+	return Arena_Mark( &frameArena );
+}
 
-	static const char *evNames[ SE_MAX ] = {
-		"SE_NONE",
-		"SE_KEY",
-		"SE_CHAR",
-		"SE_MOUSE",
-		"SE_JOYSTICK_AXIS",
-		"SE_CONSOLE"
-	};
 
-	if ( (unsigned)evType >= ARRAY_LEN( evNames ) ) {
-		return "SE_UNKNOWN";
-	} else {
-		return evNames[ evType ];
-	}
+/*
+=================
+Com_FrameRelease
+=================
+*/
+void Com_FrameRelease( int mark ) {
+	Arena_Release( &frameArena, mark );
 }
 
 
 /*
-================
-Sys_QueEvent
-
-A time of 0 will get the current time
-Ptr should either be null, or point to a block of data that can
-be freed by the game later.
-================
-*/
-void Sys_QueEvent( int evTime, sysEventType_t evType, int value, int value2, int ptrLength, void *ptr ) {
-	sysEvent_t	*ev;
+==============================================================================
 
-#if 0
-	Com_Printf( "%-10s: evTime=%i, evTail=%i, evHead=%i\n",
-		Sys_EventName( evType ), evTime, eventTail, eventHead );
-#endif
+Goals:
+	reproducible without history effects -- no out of memory errors on weird map to map changes
+	allow restarting of the client without fragmentation
+	minimize total pages in use at run time
+	minimize total pages needed during load time
 
-	if ( evTime == 0 ) {
-		evTime = Sys_Milliseconds();
-	}
+  Single block of memory with stack allocators coming from both ends towards the middle.
 
-	// try to combine all sequential mouse moves in one event
-	if ( evType == SE_MOUSE && lastEvent->evType == SE_MOUSE && eventHead != eventTail ) {
-		lastEvent->evValue += value;
-		lastEvent->evValue2 += value2;
-		lastEvent->evTime = evTime;
-		return;
-	}
+  One side is designated the temporary memory allocator.
 
-	ev = &eventQue[ eventHead & MASK_QUED_EVENTS ];
+  Temporary memory can be allocated and freed in any order.
 
-	if ( eventHead - eventTail >= MAX_QUED_EVENTS ) {
-		Com_Printf( "%s(type=%s,keys=(%i,%i),time=%i): overflow\n", __func__, Sys_EventName( evType ), value, value2, evTime );
-		// we are discarding an event, but don't leak memory
-		if ( ev->evPtr ) {
-			Z_Free( ev->evPtr );
-		}
-		eventTail++;
-	}
+  A highwater mark is kept of the most in use at any time.
 
-	eventHead++;
+  When there is no temporary memory allocated, the permanent and temp sides
+  can be switched, allowing the already touched temp memory to be used for
+  permanent storage.
 
-	ev->evTime = evTime;
-	ev->evType = evType;
-	ev->evValue = value;
-	ev->evValue2 = value2;
-	ev->evPtrLength = ptrLength;
-	ev->evPtr = ptr;
+  Temp memory must never be allocated on two ends at once, or fragmentation
+  could occur.
 
-	lastEvent = ev;
-}
+  If we have any in-use temp memory, additional temp allocations must come from
+  that side.
 
+  If not, we can choose to make either side the new temp side and push future
+  permanent allocations to the other side.  Permanent allocations should be
+  kept on the side that has the current greatest wasted highwater mark.
 
-/*
-================
-Com_GetSystemEvent
-================
+==============================================================================
 */
-static sysEvent_t Com_GetSystemEvent( void )
-{
-	sysEvent_t  ev;
-	const char	*s;
-	int			evTime;
 
-	// return if we have data
-	if ( eventHead - eventTail > 0 )
-		return eventQue[ ( eventTail++ ) & MASK_QUED_EVENTS ];
 
-	Sys_SendKeyEvents();
+#define	HUNK_MAGIC	0x89537892
+#define	HUNK_FREE_MAGIC	0x89537893
 
-	evTime = Sys_Milliseconds();
+typedef struct {
+	unsigned int magic;
+	unsigned int size;
+} hunkHeader_t;
 
-	// check for console commands
-	s = Sys_ConsoleInput();
-	if ( s )
-	{
-		char  *b;
-		int   len;
+typedef struct {
+	int		mark;
+	int		permanent;
+	int		temp;
+	int		tempHighwater;
+} hunkUsed_t;
 
-		len = strlen( s ) + 1;
-		b = Z_Malloc( len );
-		strcpy( b, s );
-		Sys_QueEvent( evTime, SE_CONSOLE, 0, 0, len, b );
-	}
+typedef struct hunkblock_s {
+	int size;
+	byte printed;
+	struct hunkblock_s *next;
+	const char *label;
+	const char *file;
+	int line;
+} hunkblock_t;
 
-	// return if we have data
-	if ( eventHead - eventTail > 0 )
-		return eventQue[ ( eventTail++ ) & MASK_QUED_EVENTS ];
+static	hunkblock_t *hunkblocks;
 
-	// create an empty event to return
-	memset( &ev, 0, sizeof( ev ) );
-	ev.evTime = evTime;
+static	hunkUsed_t	hunk_low, hunk_high;
+static	hunkUsed_t	*hunk_permanent, *hunk_temp;
 
-	return ev;
-}
+static	byte	*s_hunkData = NULL;
+static	int		s_hunkTotal;
 
+static const char *tagName[ TAG_COUNT ] = {
+	"FREE",
+	"GENERAL",
+	"PACK",
+	"SEARCH-PATH",
+	"SEARCH-PACK",
+	"SEARCH-DIR",
+	"BOTLIB",
+	"RENDERER",
+	"CLIENTS",
+	"SMALL",
+	"STATIC"
+};
 
-/*
-=================
-Com_GetRealEvent
-=================
-*/
-static sysEvent_t Com_GetRealEvent( void ) {
+typedef struct zone_stats_s {
+	int	zoneSegments;
+	int zoneBlocks;
+	int	zoneBytes;
+	int	botlibBytes;
+	int	rendererBytes;
+	int freeBytes;
+	int freeBlocks;
+	int freeSmallest;
+	int freeLargest;
+} zone_stats_t;
 
-	// get or save an event from/to the journal file
-	if ( com_journalFile != FS_INVALID_HANDLE ) {
-		int			r;
-		sysEvent_t	ev;
 
-		if ( com_journal->integer == 2 ) {
-			Sys_SendKeyEvents();
-			r = FS_Read( &ev, sizeof(ev), com_journalFile );
-			if ( r != sizeof(ev) ) {
-				Com_Error( ERR_FATAL, "Error reading from journal file" );
-			}
-			if ( ev.evPtrLength ) {
-				ev.evPtr = Z_Malloc( ev.evPtrLength );
-				r = FS_Read( ev.evPtr, ev.evPtrLength, com_journalFile );
-				if ( r != ev.evPtrLength ) {
-					Com_Error( ERR_FATAL, "Error reading from journal file" );
-				}
+static void Zone_Stats( const char *name, const memzone_t *z, bool printDetails, zone_stats_t *stats )
+{
+	const memblock_t 	*block;
+	const memzone_t 	*zone;
+	zone_stats_t 		st;
+
+	memset( &st, 0, sizeof( st ) );
+	zone = z;
+	st.zoneSegments = 1;
+	st.freeSmallest = 0x7FFFFFFF;
+
+	//if ( printDetails ) {
+	//	Com_Printf( "---------- %s zone segment #%i ----------\n", name, zone->segnum );
+	//}
+
+	for ( block = zone->blocklist.next ; ; ) {
+		if ( printDetails ) {
+			int tag = block->tag;
+			Com_Printf( "block:%p  size:%8i  tag: %s\n", (void *)block, block->size,
+				(unsigned)tag < TAG_COUNT ? tagName[ tag ] : va( "%i", tag ) );
+		}
+		if ( block->tag != TAG_FREE ) {
+			st.zoneBytes += block->size;
+			st.zoneBlocks++;
+			if ( block->tag == TAG_BOTLIB ) {
+				st.botlibBytes += block->size;
+			} else if ( block->tag == TAG_RENDERER ) {
+				st.rendererBytes += block->size;
 			}
 		} else {
-			ev = Com_GetSystemEvent();
-
-			// write the journal value out if needed
-			if ( com_journal->integer == 1 ) {
-				r = FS_Write( &ev, sizeof(ev), com_journalFile );
-				if ( r != sizeof(ev) ) {
-					Com_Error( ERR_FATAL, "Error writing to journal file" );
-				}
-				if ( ev.evPtrLength ) {
-					r = FS_Write( ev.evPtr, ev.evPtrLength, com_journalFile );
-					if ( r != ev.evPtrLength ) {
-						Com_Error( ERR_FATAL, "Error writing to journal file" );
-					}
+			st.freeBytes += block->size;
+			st.freeBlocks++;
+			if ( block->size > st.freeLargest )
+				st.freeLargest = block->size;
+			if ( block->size < st.freeSmallest )
+				st.freeSmallest = block->size;
+		}
+		if ( block->next == &zone->blocklist ) {
+			break; // all blocks have been hit
+		}
+		if ( (byte *)block + block->size != (byte *)block->next) {
+#ifdef USE_MULTI_SEGMENT
+			const memblock_t *next = block->next;
+			if ( next->size == 0 && next->id == -ZONEID && next->tag == TAG_GENERAL ) {
+				st.zoneSegments++;
+				if ( printDetails ) {
+					Com_Printf( "---------- %s zone segment #%i ----------\n", name, st.zoneSegments );
 				}
-			}
+				block = next->next;
+				continue;
+			} else
+#endif
+				Com_Printf( "ERROR: block size does not touch the next block\n" );
 		}
-
-		return ev;
+		if ( block->next->prev != block) {
+			Com_Printf( "ERROR: next block doesn't have proper back link\n" );
+		}
+		if ( block->tag == TAG_FREE && block->next->tag == TAG_FREE ) {
+			Com_Printf( "ERROR: two consecutive free blocks\n" );
+		}
+		block = block->next;
 	}
 
-	return Com_GetSystemEvent();
+	// export stats
+	if ( stats ) {
+		memcpy( stats, &st, sizeof( *stats ) );
+	}
 }
 
 
-/*
-=================
-Com_InitPushEvent
-=================
-*/
-static void Com_InitPushEvent( void ) {
-  // clear the static buffer array
-  // this requires SE_NONE to be accepted as a valid but NOP event
-  memset( com_pushedEvents, 0, sizeof(com_pushedEvents) );
-  // reset counters while we are at it
-  // beware: GetEvent might still return an SE_NONE from the buffer
-  com_pushedEventsHead = 0;
-  com_pushedEventsTail = 0;
+#ifdef USE_ZONE_SLABS
+static void Slab_Stats( bool printDetails )
+{
+	int objectBytes, pageBytes;
+	int c;
+
+	objectBytes = pageBytes = 0;
+	for ( c = 0; c < TAG_COUNT; c++ ) {
+		objectBytes += slabStats.tagBytes[ c ];
+	}
+	for ( c = 0; c < SLAB_CLASSES; c++ ) {
+		pageBytes += slabStats.pages[ c ] * SLAB_PAGE_SIZE;
+	}
+
+	Com_Printf( "%8i bytes total slab in %i chunks\n\n", slabNumChunks * SLAB_CHUNK_SIZE, slabNumChunks );
+	Com_Printf( "%8i bytes in %i slab pages\n", pageBytes, pageBytes / SLAB_PAGE_SIZE );
+	for ( c = 0; c < TAG_COUNT; c++ ) {
+		if ( slabStats.tagBytes[ c ] ) {
+			Com_Printf( "        %8i bytes in %s\n", slabStats.tagBytes[ c ], tagName[ c ] );
+		}
+	}
+	Com_Printf( "        %8i bytes in %i free pages\n", slabStats.freePages * SLAB_PAGE_SIZE, slabStats.freePages );
+	if ( pageBytes ) {
+		Com_Printf( "        (%i%% of used pages occupied)\n", (int)( (int64_t)objectBytes * 100 / pageBytes ) );
+	}
+	Com_Printf( "\n" );
+
+	if ( printDetails ) {
+		for ( c = 0; c < SLAB_CLASSES; c++ ) {
+			Com_Printf( "%4i bytes: %5i pages %7i objects %10u allocs\n", slabSizes[ c ],
+				slabStats.pages[ c ], slabStats.objects[ c ], slabStats.allocs[ c ] );
+		}
+		Com_Printf( "\n" );
+	}
 }
+#endif
 
 
 /*
 =================
-Com_PushEvent
+Com_Meminfo_f
 =================
 */
-static void Com_PushEvent( const sysEvent_t *event ) {
-	sysEvent_t		*ev;
-	static int printedWarning = 0;
+static void Com_Meminfo_f( void ) {
+	static unsigned int lastAllocs;
+	static int lastTime;
+	const memArena_t *arena;
+	zone_stats_t st;
+	unsigned int slabAllocs, allocs;
+	int		unused, msec;
+#ifdef USE_ZONE_SLABS
+	int		c;
+#endif
 
-	ev = &com_pushedEvents[ com_pushedEventsHead & (MAX_PUSHED_EVENTS-1) ];
+	Com_Printf( "%8i bytes total hunk\n", s_hunkTotal );
+	Com_Printf( "\n" );
+	Com_Printf( "%8i low mark\n", hunk_low.mark );
+	Com_Printf( "%8i low permanent\n", hunk_low.permanent );
+	if ( hunk_low.temp != hunk_low.permanent ) {
+		Com_Printf( "%8i low temp\n", hunk_low.temp );
+	}
+	Com_Printf( "%8i low tempHighwater\n", hunk_low.tempHighwater );
+	Com_Printf( "\n" );
+	Com_Printf( "%8i high mark\n", hunk_high.mark );
+	Com_Printf( "%8i high permanent\n", hunk_high.permanent );
+	if ( hunk_high.temp != hunk_high.permanent ) {
+		Com_Printf( "%8i high temp\n", hunk_high.temp );
+	}
+	Com_Printf( "%8i high tempHighwater\n", hunk_high.tempHighwater );
+	Com_Printf( "\n" );
+	Com_Printf( "%8i total hunk in use\n", hunk_low.permanent + hunk_high.permanent );
+	unused = 0;
+	if ( hunk_low.tempHighwater > hunk_low.permanent ) {
+		unused += hunk_low.tempHighwater - hunk_low.permanent;
+	}
+	if ( hunk_high.tempHighwater > hunk_high.permanent ) {
+		unused += hunk_high.tempHighwater - hunk_high.permanent;
+	}
+	Com_Printf( "%8i unused highwater\n", unused );
+	Com_Printf( "\n" );
 
-	if ( com_pushedEventsHead - com_pushedEventsTail >= MAX_PUSHED_EVENTS ) {
+	Zone_Stats( "main", mainzone, !Q_stricmp( Cmd_Argv(1), "main" ) || !Q_stricmp( Cmd_Argv(1), "all" ), &st );
+	Com_Printf( "%8i bytes total main zone\n\n", mainzone->size );
+	Com_Printf( "%8i bytes in %i main zone blocks%s\n", st.zoneBytes, st.zoneBlocks,
+		st.zoneSegments > 1 ? va( " and %i segments", st.zoneSegments ) : "" );
+	Com_Printf( "        %8i bytes in botlib\n", st.botlibBytes );
+	Com_Printf( "        %8i bytes in renderer\n", st.rendererBytes );
+	Com_Printf( "        %8i bytes in other\n", st.zoneBytes - ( st.botlibBytes + st.rendererBytes ) );
+	Com_Printf( "        %8i bytes in %i free blocks\n", st.freeBytes, st.freeBlocks );
+	if ( st.freeBlocks > 1 ) {
+		Com_Printf( "        (largest: %i bytes, smallest: %i bytes, %i%% fragmented)\n\n", st.freeLargest, st.freeSmallest,
+			100 - (int)( (int64_t)st.freeLargest * 100 / st.freeBytes ) );
+	}
 
-		// don't print the warning constantly, or it can give time for more...
-		if ( !printedWarning ) {
-			printedWarning = true;
-			Com_Printf( "WARNING: Com_PushEvent overflow\n" );
-		}
+	Zone_Stats( "small", smallzone, !Q_stricmp( Cmd_Argv(1), "small" ) || !Q_stricmp( Cmd_Argv(1), "all" ), &st );
+	Com_Printf( "%8i bytes total small zone\n\n", smallzone->size );
+	Com_Printf( "%8i bytes in %i small zone blocks%s\n", st.zoneBytes, st.zoneBlocks,
+		st.zoneSegments > 1 ? va( " and %i segments", st.zoneSegments ) : "" );
+	Com_Printf( "        %8i bytes in %i free blocks\n", st.freeBytes, st.freeBlocks );
+	if ( st.freeBlocks > 1 ) {
+		Com_Printf( "        (largest: %i bytes, smallest: %i bytes, %i%% fragmented)\n\n", st.freeLargest, st.freeSmallest,
+			100 - (int)( (int64_t)st.freeLargest * 100 / st.freeBytes ) );
+	}
 
-		if ( ev->evPtr ) {
-			Z_Free( ev->evPtr );
+	slabAllocs = 0;
+#ifdef USE_ZONE_SLABS
+	Slab_Stats( !Q_stricmp( Cmd_Argv(1), "slab" ) || !Q_stricmp( Cmd_Argv(1), "all" ) );
+	for ( c = 0; c < SLAB_CLASSES; c++ ) {
+		slabAllocs += slabStats.allocs[ c ];
+	}
+#endif
+
+	allocs = zoneAllocs + slabAllocs;
+	msec = Sys_Milliseconds();
+	Com_Printf( "%8u allocations, %u from zone and %u from slab\n", allocs, zoneAllocs, slabAllocs );
+	if ( lastTime && msec > lastTime ) {
+		Com_Printf( "        (%.1f allocations per second since last meminfo)\n",
+			(double)( allocs - lastAllocs ) * 1000.0 / ( msec - lastTime ) );
+	}
+	lastAllocs = allocs;
+	lastTime = msec;
+
+	for ( arena = arenaList; arena; arena = arena->next ) {
+		Com_Printf( "%8i bytes in %s arena\n", arena->size, arena->name );
+		Com_Printf( "        %8i bytes peak before last reset, %i highwater\n", arena->lastPeak,
+			arena->peak > arena->highwater ? arena->peak : arena->highwater );
+		if ( arena->overflows ) {
+			Com_Printf( "        %8i overflows\n", arena->overflows );
 		}
-		com_pushedEventsTail++;
-	} else {
-		printedWarning = false;
 	}
+}
 
-	*ev = *event;
-	com_pushedEventsHead++;
+
+static void Z_ProfileClear( void )
+{
+	free( memProfile.sites );
+	free( memProfile.live );
+	Com_Memset( &memProfile, 0, sizeof( memProfile ) );
+}
+
+
+static int Z_ProfileCompareSites( const void *a, const void *b )
+{
+	const allocSite_t *s1 = &memProfile.sites[ *(const int *)a ];
+	const allocSite_t *s2 = &memProfile.sites[ *(const int *)b ];
+
+	if ( s1->allocs != s2->allocs ) {
+		return s1->allocs < s2->allocs ? 1 : -1;
+	}
+
+	return s1->bytes < s2->bytes ? 1 : ( s1->bytes > s2->bytes ? -1 : 0 );
 }
 
 
 /*
 =================
-Com_GetEvent
+Z_ProfileSortSites
+
+Returns malloc()'ed list of used site indexes, most active first
 =================
 */
-static sysEvent_t Com_GetEvent( void ) {
-	if ( com_pushedEventsHead - com_pushedEventsTail > 0 ) {
-		return com_pushedEvents[ (com_pushedEventsTail++) & (MAX_PUSHED_EVENTS-1) ];
+static int *Z_ProfileSortSites( int *count )
+{
+	int *list;
+	int i, n;
+
+	list = malloc( ( memProfile.numSites + 1 ) * sizeof( *list ) );
+	if ( list == NULL ) {
+		*count = 0;
+		return NULL;
 	}
-	return Com_GetRealEvent();
+
+	for ( i = 0, n = 0; i < MAX_PROFILE_SITES && n < memProfile.numSites; i++ ) {
+		if ( memProfile.sites[ i ].file ) {
+			list[ n++ ] = i;
+		}
+	}
+
+	qsort( list, n, sizeof( *list ), Z_ProfileCompareSites );
+
+	*count = n;
+	return list;
+}
+
+
+static const char *Z_ProfileSiteName( const allocSite_t *site )
+{
+	return va( "%s:%i", COM_SkipPath( (char *)site->file ), site->line );
+}
+
+
+static void Z_ProfilePrintLine( const char *name, const allocSite_t *st, double seconds )
+{
+	Com_Printf( "%-32s %9u %9u %9.1f %9.2f %9i %9i %9.1f\n", name, st->allocs, st->frees,
+		seconds > 0.0 ? st->allocs / seconds : 0.0, st->bytes / ( 1024.0 * 1024.0 ),
+		st->liveBytes, st->peakBytes, st->frees ? st->lifetime / ( 1000.0 * st->frees ) : 0.0 );
+}
+
+
+static double Z_ProfileSeconds( void )
+{
+	int64_t end;
+
+	end = memProfile.active ? Sys_Microseconds() : memProfile.stopTime;
+
+	return ( end - memProfile.startTime ) / 1000000.0;
 }
 
 
 /*
 =================
-Com_RunAndTimeServerPacket
+Z_ProfileReport
 =================
 */
-void Com_RunAndTimeServerPacket( const netadr_t *evFrom, msg_t *buf ) {
-	int		t1, t2, msec;
+static void Z_ProfileReport( int numSites )
+{
+	double seconds;
+	int *list, count;
+	int i;
 
-	t1 = 0;
+	seconds = Z_ProfileSeconds();
 
-	if ( com_speeds->integer ) {
-		t1 = Sys_Milliseconds ();
+	Com_Printf( "memprofile %s, %.1f seconds, %i call sites", memProfile.active ? "running" : "stopped",
+		seconds, memProfile.numSites );
+	if ( memProfile.lostSites ) {
+		Com_Printf( ", %u allocations not tracked by site", memProfile.lostSites );
 	}
+	Com_Printf( "\n\n" );
 
-	SV_PacketEvent( evFrom, buf );
-
-	if ( com_speeds->integer ) {
-		t2 = Sys_Milliseconds ();
-		msec = t2 - t1;
-		if ( com_speeds->integer == 3 ) {
-			Com_Printf( "SV_PacketEvent time: %i\n", msec );
+	Com_Printf( "%-32s %9s %9s %9s %9s %9s %9s %9s\n", "", "allocs", "frees", "allocs/s", "MB", "live", "peak", "life(ms)" );
+	for ( i = 0; i < TAG_COUNT; i++ ) {
+		if ( memProfile.tags[ i ].allocs ) {
+			Z_ProfilePrintLine( tagName[ i ], &memProfile.tags[ i ], seconds );
 		}
 	}
+	Z_ProfilePrintLine( "total", &memProfile.total, seconds );
+	Com_Printf( "\n" );
+
+	list = Z_ProfileSortSites( &count );
+	for ( i = 0; i < count && i < numSites; i++ ) {
+		const allocSite_t *st = &memProfile.sites[ list[ i ] ];
+		Z_ProfilePrintLine( va( "%s %s", Z_ProfileSiteName( st ), tagName[ st->tag ] ), st, seconds );
+	}
+	free( list );
 }
 
 
 /*
 =================
-Com_EventLoop
+Z_ProfileWrite
 
-Returns last event time
+Writes all tags and call sites as comma separated values
 =================
 */
-int Com_EventLoop( void ) {
-	sysEvent_t	ev;
-	netadr_t	evFrom;
-	byte		bufData[ MAX_MSGLEN_BUF ];
-	msg_t		buf;
+static void Z_ProfileWrite( const char *filename )
+{
+	const allocSite_t *st;
+	fileHandle_t f;
+	double seconds;
+	int *list, count;
+	int i;
 
-	MSG_Init( &buf, bufData, MAX_MSGLEN );
+	f = FS_FOpenFileWrite( filename );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open %s\n", filename );
+		return;
+	}
 
-	while ( 1 ) {
-		ev = Com_GetEvent();
+	seconds = Z_ProfileSeconds();
+	list = Z_ProfileSortSites( &count );
 
-		// if no more events are available
-		if ( ev.evType == SE_NONE ) {
-			// manually send packet events for the loopback channel
-#ifndef DEDICATED
-			while ( NET_GetLoopPacket( NS_CLIENT, &evFrom, &buf ) ) {
-				CL_PacketEvent( &evFrom, &buf );
+	FS_Printf( f, "site,tag,allocs,frees,allocs_per_sec,bytes,live_bytes,peak_bytes,avg_lifetime_ms\n" );
+	for ( i = -TAG_COUNT; i < count; i++ ) {
+		if ( i < 0 ) {
+			st = &memProfile.tags[ i + TAG_COUNT ];
+			if ( st->allocs == 0 ) {
+				continue;
 			}
+			FS_Printf( f, "*,%s", tagName[ i + TAG_COUNT ] );
+		} else {
+			st = &memProfile.sites[ list[ i ] ];
+			FS_Printf( f, "%s,%s", Z_ProfileSiteName( st ), tagName[ st->tag ] );
+		}
+		FS_Printf( f, ",%u,%u,%.1f,%lli,%i,%i,%.3f\n", st->allocs, st->frees, seconds > 0.0 ? st->allocs / seconds : 0.0,
+			(long long)st->bytes, st->liveBytes, st->peakBytes, st->frees ? st->lifetime / ( 1000.0 * st->frees ) : 0.0 );
+	}
+
+	FS_FCloseFile( f );
+	free( list );
+
+	Com_Printf( "Wrote %i call sites to %s\n", count, filename );
+}
+
+
+/*
+=================
+Com_MemProfile_f
+=================
+*/
+static void Com_MemProfile_f( void ) {
+	const char *cmd = Cmd_Argv( 1 );
+
+	if ( !Q_stricmp( cmd, "start" ) ) {
+		Z_ProfileClear();
+		memProfile.sites = calloc( MAX_PROFILE_SITES, sizeof( allocSite_t ) );
+		if ( memProfile.sites == NULL ) {
+			Com_Error( ERR_FATAL, "memprofile: out of memory" );
+		}
+		Z_ProfileGrowLive();
+		memProfile.startTime = Sys_Microseconds();
+		memProfile.active = true;
+		Com_Printf( "Allocation profiling started.\n" );
+	} else if ( !Q_stricmp( cmd, "stop" ) ) {
+		if ( memProfile.sites == NULL ) {
+			Com_Printf( "Allocation profiling has not been started.\n" );
+			return;
+		}
+		if ( memProfile.active ) {
+			memProfile.active = false;
+			memProfile.stopTime = Sys_Microseconds();
+			// blocks still alive can't be tracked anymore
+			free( memProfile.live );
+			memProfile.live = NULL;
+			memProfile.liveMask = 0;
+			memProfile.numLive = 0;
+		}
+		Z_ProfileReport( 20 );
+	} else if ( !Q_stricmp( cmd, "write" ) ) {
+		if ( memProfile.sites == NULL ) {
+			Com_Printf( "Allocation profiling has not been started.\n" );
+			return;
+		}
+		Z_ProfileWrite( Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : "memprofile.csv" );
+	} else if ( !Q_stricmp( cmd, "clear" ) ) {
+		Z_ProfileClear();
+	} else if ( memProfile.sites && ( *cmd == '\0' || atoi( cmd ) > 0 ) ) {
+		Z_ProfileReport( *cmd ? atoi( cmd ) : 20 );
+	} else {
+		Com_Printf( "usage: memprofile <start|stop|write [filename]|clear|[sites]>\n" );
+	}
+}
+
+
+/*
+===============
+Com_TouchMemory
+
+Touch all known used data to make sure it is paged in
+===============
+*/
+unsigned int Com_TouchMemory( void ) {
+	const memblock_t *block;
+	const memzone_t *zone;
+	int		start, end;
+	int		i, j;
+#ifdef USE_ZONE_SLABS
+	int		k, n;
 #endif
-			while ( NET_GetLoopPacket( NS_SERVER, &evFrom, &buf ) ) {
-				// if the server just shut down, flush the events
-				if ( com_sv_running->integer ) {
-					Com_RunAndTimeServerPacket( &evFrom, &buf );
-				}
+	unsigned int sum;
+
+	Z_CheckHeap();
+
+	start = Sys_Milliseconds();
+
+	sum = 0;
+
+	j = hunk_low.permanent >> 2;
+	for ( i = 0 ; i < j ; i+=64 ) {			// only need to touch each page
+		sum += ((unsigned int *)s_hunkData)[i];
+	}
+
+	i = ( s_hunkTotal - hunk_high.permanent ) >> 2;
+	j = hunk_high.permanent >> 2;
+	for (  ; i < j ; i+=64 ) {			// only need to touch each page
+		sum += ((unsigned int *)s_hunkData)[i];
+	}
+
+	zone = mainzone;
+	for (block = zone->blocklist.next ; ; block = block->next) {
+		if ( block->tag != TAG_FREE ) {
+			j = block->size >> 2;
+			for ( i = 0 ; i < j ; i+=64 ) {				// only need to touch each page
+				sum += ((unsigned int *)block)[i];
 			}
+		}
+		if ( block->next == &zone->blocklist ) {
+			break; // all blocks have been hit
+		}
+	}
 
-			return ev.evTime;
+#ifdef USE_ZONE_SLABS
+	for ( k = 0; k < slabNumChunks; k++ ) {
+		const slabChunk_t *chunk = slabChunks[ k ];
+		for ( n = 0; n < SLAB_CHUNK_PAGES; n++ ) {
+			if ( chunk->pages[ n ].tag != TAG_FREE ) {
+				j = SLAB_PAGE_SIZE >> 2;
+				for ( i = 0 ; i < j ; i+=64 ) {
+					sum += ((unsigned int *)chunk->pages[ n ].data)[i];
+				}
+			}
 		}
+	}
+#endif
 
+	end = Sys_Milliseconds();
 
-		switch ( ev.evType ) {
-#ifndef DEDICATED
-		case SE_KEY:
-			CL_KeyEvent( ev.evValue, ev.evValue2, ev.evTime );
-			break;
-		case SE_CHAR:
-			CL_CharEvent( ev.evValue );
-			break;
-		case SE_MOUSE:
-			CL_MouseEvent( ev.evValue, ev.evValue2 /*, ev.evTime*/ );
-			break;
-		case SE_JOYSTICK_AXIS:
-			CL_JoystickEvent( ev.evValue, ev.evValue2, ev.evTime );
-			break;
+	Com_Printf( "Com_TouchMemory: %i msec\n", end - start );
+
+	return sum; // just to silent compiler warning
+}
+
+
+/*
+=================
+Com_InitSmallZoneMemory
+=================
+*/
+static void Com_InitSmallZoneMemory( void ) {
+	static byte s_buf[ 512 * 1024 ];
+	int smallZoneSize;
+
+	smallZoneSize = sizeof( s_buf );
+	Com_Memset( s_buf, 0, smallZoneSize );
+	smallzone = (memzone_t *)s_buf;
+	Z_ClearZone( smallzone, smallzone, smallZoneSize, 1 );
+#ifdef USE_ZONE_SLABS
+	Slab_Init();
 #endif
-		case SE_CONSOLE:
-			Cbuf_AddText( (char *)ev.evPtr );
-			Cbuf_AddText( "\n" );
-			break;
-		default:
-				Com_Error( ERR_FATAL, "Com_EventLoop: bad event type %i", ev.evType );
-			break;
+}
+
+
+/*
+=================
+Com_AllocPages
+
+Allocates memory for the hunk and the main zone, backed with
+huge pages and faulted in on startup if requested
+=================
+*/
+static void *Com_AllocPages( int size, const char *name ) {
+	static cvar_t *com_hugePages;
+	static cvar_t *com_prefaultMemory;
+	int flags, result;
+	void *ptr;
+
+	if ( com_hugePages == NULL ) {
+		// like com_zoneMegs these are read before any config is executed
+		com_hugePages = Cvar_Get( "com_hugePages", "0", CVAR_LATCH | CVAR_ARCHIVE_ND );
+		Cvar_CheckRange( com_hugePages, "0", "2", CV_INTEGER );
+		Cvar_SetDescription( com_hugePages, "Back the hunk and the main zone with huge pages to reduce TLB misses:\n"
+			" 0 - disabled\n"
+			" 1 - transparent huge pages (Linux)\n"
+			" 2 - explicit huge pages (hugetlbfs on Linux, large pages on Windows), falls back to transparent ones" );
+		com_prefaultMemory = Cvar_Get( "com_prefaultMemory", "0", CVAR_LATCH | CVAR_ARCHIVE_ND );
+		Cvar_CheckRange( com_prefaultMemory, "0", "2", CV_INTEGER );
+		Cvar_SetDescription( com_prefaultMemory, "Fault in the hunk and the main zone on startup:\n"
+			" 0 - disabled, pages are faulted in on first use\n"
+			" 1 - by the main thread, which also keeps them on its NUMA node\n"
+			" 2 - same as 1 and lock them in physical memory" );
+	}
+
+	flags = 0;
+	if ( com_hugePages->integer == 1 )
+		flags |= PAGES_HUGE;
+	else if ( com_hugePages->integer == 2 )
+		flags |= PAGES_HUGETLB;
+	if ( com_prefaultMemory->integer == 1 )
+		flags |= PAGES_PREFAULT;
+	else if ( com_prefaultMemory->integer == 2 )
+		flags |= PAGES_LOCK;
+
+	if ( flags == 0 ) {
+		return calloc( size, 1 );
+	}
+
+	ptr = Sys_AllocPages( size, flags, &result );
+	if ( ptr == NULL ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to allocate pages for %s, using malloc\n", name );
+		return calloc( size, 1 );
+	}
+
+	Com_Printf( "%s: %i MB%s%s%s%s\n", name, size / ( 1024 * 1024 ),
+		( result & PAGES_HUGETLB ) ? ", huge pages" : "",
+		( result & PAGES_HUGE ) ? ", transparent huge pages" : "",
+		( result & PAGES_PREFAULT ) ? ", prefaulted" : "",
+		( result & PAGES_LOCK ) ? ", locked" : "" );
+
+	return ptr;
+}
+
+
+/*
+=================
+Com_InitZoneMemory
+=================
+*/
+static void Com_InitZoneMemory( void ) {
+	int		mainZoneSize;
+	cvar_t	*cv;
+
+	// Please note: com_zoneMegs can only be set on the command line, and
+	// not in q3config.cfg or Com_StartupVariable, as they haven't been
+	// executed by this point. It's a chicken and egg problem. We need the
+	// memory manager configured to handle those places where you would
+	// configure the memory manager.
+
+	// allocate the random block zone
+	cv = Cvar_Get( "com_zoneMegs", XSTRING( DEF_COMZONEMEGS ), CVAR_LATCH | CVAR_ARCHIVE );
+	Cvar_CheckRange( cv, "1", NULL, CV_INTEGER );
+	Cvar_SetDescription( cv, "Initial amount of memory (RAM) allocated for the main block zone (in MB)." );
+
+#ifndef USE_MULTI_SEGMENT
+	if ( cv->integer < DEF_COMZONEMEGS )
+		mainZoneSize = 1024 * 1024 * DEF_COMZONEMEGS;
+	else
+#endif
+		mainZoneSize = cv->integer * 1024 * 1024;
+
+	mainzone = Com_AllocPages( mainZoneSize, "main zone" );
+	if ( !mainzone ) {
+		Com_Error( ERR_FATAL, "Zone data failed to allocate %i megs", mainZoneSize / (1024*1024) );
+	}
+	Z_ClearZone( mainzone, mainzone, mainZoneSize, 1 );
+}
+
+
+/*
+=================
+Hunk_Log
+=================
+*/
+void Hunk_Log( void ) {
+	hunkblock_t	*block;
+	char		buf[4096];
+	int size, numBlocks;
+
+	if ( logWriter.file == NULL )
+		return;
+
+	size = 0;
+	numBlocks = 0;
+	Com_sprintf(buf, sizeof(buf), "\r\n================\r\nHunk log\r\n================\r\n");
+	Com_LogWrite( buf, strlen( buf ), true );
+	for (block = hunkblocks ; block; block = block->next) {
+#ifdef HUNK_DEBUG
+		Com_sprintf(buf, sizeof(buf), "size = %8d: %s, line: %d (%s)\r\n", block->size, block->file, block->line, block->label);
+		Com_LogWrite( buf, strlen( buf ), true );
+#endif
+		size += block->size;
+		numBlocks++;
+	}
+	Com_sprintf(buf, sizeof(buf), "%d Hunk memory\r\n", size);
+	Com_LogWrite( buf, strlen( buf ), true );
+	Com_sprintf(buf, sizeof(buf), "%d hunk blocks\r\n", numBlocks);
+	Com_LogWrite( buf, strlen( buf ), true );
+}
+
+
+/*
+=================
+Hunk_SmallLog
+=================
+*/
+#ifdef HUNK_DEBUG
+void Hunk_SmallLog( void ) {
+	hunkblock_t	*block, *block2;
+	char		buf[4096];
+	int size, locsize, numBlocks;
+
+	if ( logWriter.file == NULL )
+		return;
+
+	for (block = hunkblocks ; block; block = block->next) {
+		block->printed = false;
+	}
+	size = 0;
+	numBlocks = 0;
+	Com_sprintf(buf, sizeof(buf), "\r\n================\r\nHunk Small log\r\n================\r\n");
+	Com_LogWrite( buf, strlen( buf ), true );
+	for (block = hunkblocks; block; block = block->next) {
+		if (block->printed) {
+			continue;
+		}
+		locsize = block->size;
+		for (block2 = block->next; block2; block2 = block2->next) {
+			if (block->line != block2->line) {
+				continue;
+			}
+			if (Q_stricmp(block->file, block2->file)) {
+				continue;
+			}
+			size += block2->size;
+			locsize += block2->size;
+			block2->printed = true;
 		}
+		Com_sprintf(buf, sizeof(buf), "size = %8d: %s, line: %d (%s)\r\n", locsize, block->file, block->line, block->label);
+		Com_LogWrite( buf, strlen( buf ), true );
+		size += block->size;
+		numBlocks++;
+	}
+	Com_sprintf(buf, sizeof(buf), "%d Hunk memory\r\n", size);
+	Com_LogWrite( buf, strlen( buf ), true );
+	Com_sprintf(buf, sizeof(buf), "%d hunk blocks\r\n", numBlocks);
+	Com_LogWrite( buf, strlen( buf ), true );
+}
+#endif
 
-		// free any block data
-		if ( ev.evPtr ) {
-			Z_Free( ev.evPtr );
-			ev.evPtr = NULL;
+
+/*
+=================
+Com_InitHunkMemory
+=================
+*/
+static void Com_InitHunkMemory( void ) {
+	cvar_t	*cv;
+
+	// make sure the file system has allocated and "not" freed any temp blocks
+	// this allows the config and product id files ( journal files too ) to be loaded
+	// by the file system without redundant routines in the file system utilizing different
+	// memory systems
+	if ( FS_LoadStack() != 0 ) {
+		Com_Error( ERR_FATAL, "Hunk initialization failed. File system load stack not zero" );
+	}
+
+	// allocate the stack based hunk allocator
+	cv = Cvar_Get( "com_hunkMegs", XSTRING( DEF_COMHUNKMEGS ), CVAR_LATCH | CVAR_ARCHIVE );
+	Cvar_CheckRange( cv, XSTRING( MIN_COMHUNKMEGS ), NULL, CV_INTEGER );
+	Cvar_SetDescription( cv, "The size of the hunk memory segment." );
+
+	s_hunkTotal = cv->integer * 1024 * 1024;
+
+	s_hunkData = Com_AllocPages( s_hunkTotal + 63, "hunk" );
+	if ( !s_hunkData ) {
+		Com_Error( ERR_FATAL, "Hunk data failed to allocate %i megs", s_hunkTotal / (1024*1024) );
+	}
+
+	// cacheline align
+	s_hunkData = PADP( s_hunkData, 64 );
+	Hunk_Clear();
+
+	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+	Cmd_AddCommand( "memprofile", Com_MemProfile_f );
+#ifdef ZONE_DEBUG
+	Cmd_AddCommand( "zonelog", Z_LogHeap );
+#endif
+#ifdef HUNK_DEBUG
+	Cmd_AddCommand( "hunklog", Hunk_Log );
+	Cmd_AddCommand( "hunksmalllog", Hunk_SmallLog );
+#endif
+}
+
+
+/*
+====================
+Hunk_MemoryRemaining
+====================
+*/
+int	Hunk_MemoryRemaining( void ) {
+	int		low, high;
+
+	low = hunk_low.permanent > hunk_low.temp ? hunk_low.permanent : hunk_low.temp;
+	high = hunk_high.permanent > hunk_high.temp ? hunk_high.permanent : hunk_high.temp;
+
+	return s_hunkTotal - ( low + high );
+}
+
+
+/*
+===================
+Hunk_SetMark
+
+The server calls this after the level and game VM have been loaded
+===================
+*/
+void Hunk_SetMark( void ) {
+	hunk_low.mark = hunk_low.permanent;
+	hunk_high.mark = hunk_high.permanent;
+}
+
+
+/*
+=================
+Hunk_ClearToMark
+
+The client calls this before starting a vid_restart or snd_restart
+=================
+*/
+void Hunk_ClearToMark( void ) {
+	hunk_low.permanent = hunk_low.temp = hunk_low.mark;
+	hunk_high.permanent = hunk_high.temp = hunk_high.mark;
+}
+
+
+/*
+=================
+Hunk_CheckMark
+=================
+*/
+bool Hunk_CheckMark( void ) {
+	if( hunk_low.mark || hunk_high.mark ) {
+		return true;
+	}
+	return false;
+}
+
+void CL_ShutdownCGame( void );
+void CL_ShutdownUI( void );
+void SV_ShutdownGameProgs( void );
+
+/*
+=================
+Hunk_Clear
+
+The server calls this before shutting down or loading a new map
+=================
+*/
+void Hunk_Clear( void ) {
+
+#ifndef DEDICATED
+	CL_ShutdownCGame();
+	CL_ShutdownUI();
+#endif
+	SV_ShutdownGameProgs();
+#ifndef DEDICATED
+	CIN_CloseAllVideos();
+#endif
+	hunk_low.mark = 0;
+	hunk_low.permanent = 0;
+	hunk_low.temp = 0;
+	hunk_low.tempHighwater = 0;
+
+	hunk_high.mark = 0;
+	hunk_high.permanent = 0;
+	hunk_high.temp = 0;
+	hunk_high.tempHighwater = 0;
+
+	hunk_permanent = &hunk_low;
+	hunk_temp = &hunk_high;
+
+	Com_Printf( "Hunk_Clear: reset the hunk ok\n" );
+	VM_Clear();
+#ifdef HUNK_DEBUG
+	hunkblocks = NULL;
+#endif
+}
+
+
+static void Hunk_SwapBanks( void ) {
+	hunkUsed_t	*swap;
+
+	// can't swap banks if there is any temp already allocated
+	if ( hunk_temp->temp != hunk_temp->permanent ) {
+		return;
+	}
+
+	// if we have a larger highwater mark on this side, start making
+	// our permanent allocations here and use the other side for temp
+	if ( hunk_temp->tempHighwater - hunk_temp->permanent >
+		hunk_permanent->tempHighwater - hunk_permanent->permanent ) {
+		swap = hunk_temp;
+		hunk_temp = hunk_permanent;
+		hunk_permanent = swap;
+	}
+}
+
+
+/*
+=================
+Hunk_Alloc
+
+Allocate permanent (until the hunk is cleared) memory
+=================
+*/
+#ifdef HUNK_DEBUG
+void *Hunk_AllocDebug( int size, ha_pref preference, char *label, char *file, int line ) {
+#else
+void *Hunk_Alloc( int size, ha_pref preference ) {
+#endif
+	void	*buf;
+
+	if ( s_hunkData == NULL)
+	{
+		Com_Error( ERR_FATAL, "Hunk_Alloc: Hunk memory system not initialized" );
+	}
+
+	// can't do preference if there is any temp allocated
+	if (preference == h_dontcare || hunk_temp->temp != hunk_temp->permanent) {
+		Hunk_SwapBanks();
+	} else {
+		if (preference == h_low && hunk_permanent != &hunk_low) {
+			Hunk_SwapBanks();
+		} else if (preference == h_high && hunk_permanent != &hunk_high) {
+			Hunk_SwapBanks();
+		}
+	}
+
+#ifdef HUNK_DEBUG
+	size += sizeof(hunkblock_t);
+#endif
+
+	// round to cacheline
+	size = PAD( size, 64 );
+
+	if ( hunk_low.temp + hunk_high.temp + size > s_hunkTotal ) {
+#ifdef HUNK_DEBUG
+		Hunk_Log();
+		Hunk_SmallLog();
+
+		Com_Error(ERR_DROP, "Hunk_Alloc failed on %i: %s, line: %d (%s)", size, file, line, label);
+#else
+		Com_Error(ERR_DROP, "Hunk_Alloc failed on %i", size);
+#endif
+	}
+
+	if ( hunk_permanent == &hunk_low ) {
+		buf = (void *)(s_hunkData + hunk_permanent->permanent);
+		hunk_permanent->permanent += size;
+	} else {
+		hunk_permanent->permanent += size;
+		buf = (void *)(s_hunkData + s_hunkTotal - hunk_permanent->permanent );
+	}
+
+	hunk_permanent->temp = hunk_permanent->permanent;
+
+	Com_Memset( buf, 0, size );
+
+#ifdef HUNK_DEBUG
+	{
+		hunkblock_t *block;
+
+		block = (hunkblock_t *) buf;
+		block->size = size - sizeof(hunkblock_t);
+		block->file = file;
+		block->label = label;
+		block->line = line;
+		block->next = hunkblocks;
+		hunkblocks = block;
+		buf = ((byte *) buf) + sizeof(hunkblock_t);
+	}
+#endif
+	return buf;
+}
+
+
+/*
+=================
+Hunk_AllocateTempMemory
+
+This is used by the file loading system.
+Multiple files can be loaded in temporary memory.
+When the files-in-use count reaches zero, all temp memory will be deleted
+=================
+*/
+void *Hunk_AllocateTempMemory( int size ) {
+	void		*buf;
+	hunkHeader_t	*hdr;
+
+	// return a Z_Malloc'd block if the hunk has not been initialized
+	// this allows the config and product id files ( journal files too ) to be loaded
+	// by the file system without redundant routines in the file system utilizing different
+	// memory systems
+	if ( s_hunkData == NULL )
+	{
+		return Z_Malloc(size);
+	}
+
+	Hunk_SwapBanks();
+
+	size = PAD(size, sizeof(intptr_t)) + sizeof( hunkHeader_t );
+
+	if ( hunk_temp->temp + hunk_permanent->permanent + size > s_hunkTotal ) {
+		Com_Error( ERR_DROP, "Hunk_AllocateTempMemory: failed on %i", size );
+	}
+
+	if ( hunk_temp == &hunk_low ) {
+		buf = (void *)(s_hunkData + hunk_temp->temp);
+		hunk_temp->temp += size;
+	} else {
+		hunk_temp->temp += size;
+		buf = (void *)(s_hunkData + s_hunkTotal - hunk_temp->temp );
+	}
+
+	if ( hunk_temp->temp > hunk_temp->tempHighwater ) {
+		hunk_temp->tempHighwater = hunk_temp->temp;
+	}
+
+	hdr = (hunkHeader_t *)buf;
+	buf = (void *)(hdr+1);
+
+	hdr->magic = HUNK_MAGIC;
+	hdr->size = size;
+
+	// don't bother clearing, because we are going to load a file over it
+	return buf;
+}
+
+
+/*
+==================
+Hunk_FreeTempMemory
+==================
+*/
+void Hunk_FreeTempMemory( void *buf ) {
+	hunkHeader_t	*hdr;
+
+	// free with Z_Free if the hunk has not been initialized
+	// this allows the config and product id files ( journal files too ) to be loaded
+	// by the file system without redundant routines in the file system utilizing different
+	// memory systems
+	if ( s_hunkData == NULL )
+	{
+		Z_Free(buf);
+		return;
+	}
+
+	hdr = ( (hunkHeader_t *)buf ) - 1;
+	if ( hdr->magic != HUNK_MAGIC ) {
+		Com_Error( ERR_FATAL, "Hunk_FreeTempMemory: bad magic" );
+	}
+
+	hdr->magic = HUNK_FREE_MAGIC;
+
+	// this only works if the files are freed in stack order,
+	// otherwise the memory will stay around until Hunk_ClearTempMemory
+	if ( hunk_temp == &hunk_low ) {
+		if ( hdr == (void *)(s_hunkData + hunk_temp->temp - hdr->size ) ) {
+			hunk_temp->temp -= hdr->size;
+		} else {
+			Com_Printf( "Hunk_FreeTempMemory: not the final block\n" );
+		}
+	} else {
+		if ( hdr == (void *)(s_hunkData + s_hunkTotal - hunk_temp->temp ) ) {
+			hunk_temp->temp -= hdr->size;
+		} else {
+			Com_Printf( "Hunk_FreeTempMemory: not the final block\n" );
+		}
+	}
+}
+
+
+/*
+=================
+Hunk_ClearTempMemory
+
+The temp space is no longer needed.  If we have left more
+touched but unused memory on this side, have future
+permanent allocs use this side.
+=================
+*/
+void Hunk_ClearTempMemory( void ) {
+	if ( s_hunkData != NULL ) {
+		hunk_temp->temp = hunk_temp->permanent;
+	}
+}
+
+/*
+===================================================================
+
+EVENTS AND JOURNALING
+
+In addition to these events, .cfg files are also copied to the
+journaled file
+===================================================================
+*/
+
+#define	MAX_PUSHED_EVENTS 256
+static int com_pushedEventsHead = 0;
+static int com_pushedEventsTail = 0;
+static sysEvent_t com_pushedEvents[MAX_PUSHED_EVENTS];
+
+
+/*
+=================
+Com_InitJournaling
+=================
+*/
+static void Com_InitJournaling( void ) {
+	if ( !com_journal->integer ) {
+		return;
+	}
+
+	if ( com_journal->integer == 1 ) {
+		Com_Printf( "Journaling events\n" );
+		com_journalFile = FS_FOpenFileWrite( "journal.dat" );
+		com_journalDataFile = FS_FOpenFileWrite( "journaldata.dat" );
+	} else if ( com_journal->integer == 2 ) {
+		Com_Printf( "Replaying journaled events\n" );
+		FS_FOpenFileRead( "journal.dat", &com_journalFile, true );
+		FS_FOpenFileRead( "journaldata.dat", &com_journalDataFile, true );
+	}
+
+	if ( com_journalFile == FS_INVALID_HANDLE || com_journalDataFile == FS_INVALID_HANDLE ) {
+		Cvar_Set( "com_journal", "0" );
+		if ( com_journalFile != FS_INVALID_HANDLE ) {
+			FS_FCloseFile( com_journalFile );
+			com_journalFile = FS_INVALID_HANDLE;
+		}
+		if ( com_journalDataFile != FS_INVALID_HANDLE ) {
+			FS_FCloseFile( com_journalDataFile );
+			com_journalDataFile = FS_INVALID_HANDLE;
+		}
+		Com_Printf( "Couldn't open journal files\n" );
+	}
+}
+
+
+/*
+========================================================================
+
+EVENT LOOP
+
+========================================================================
+*/
+
+/*
+System events are posted by any number of threads and consumed by the main
+thread only. The queue is a bounded ring where each cell carries a sequence
+number telling whether it is free for position N (N) or holds the event
+for position N (N+1), producers claim positions with compare-and-swap on
+eventHead and publish the cell by advancing its sequence.
+
+Mouse moves are merged into the last queued event while it is still the
+most recent one, deltas are kept in a separate word so that the main
+thread can close it atomically when it takes the event.
+*/
+
+#define MAX_QUED_EVENTS		256
+#define MASK_QUED_EVENTS	( MAX_QUED_EVENTS - 1 )
+
+#define MOUSE_CLOSED		0
+
+typedef struct {
+	volatile int		seq;	// minus cell index, so zeroed memory is an empty queue
+	volatile int64_t	mouse;	// packed SE_MOUSE deltas or MOUSE_CLOSED
+	sysEvent_t			ev;
+} eventCell_t;
+
+static eventCell_t			eventQue[ MAX_QUED_EVENTS ];
+static volatile int			eventHead;		// next position to claim
+static unsigned int			eventTail;		// next position to read
+static volatile int			eventLastMouse;	// position of the last SE_MOUSE event
+static volatile int			eventOverflows;
+static volatile int			eventDroppedType;
+static int					eventOverflowsReported;
+
+static const char *Sys_EventName( sysEventType_t evType ) {
+
+	static const char *evNames[ SE_MAX ] = {
+		"SE_NONE",
+		"SE_KEY",
+		"SE_CHAR",
+		"SE_MOUSE",
+		"SE_JOYSTICK_AXIS",
+		"SE_CONSOLE"
+	};
+
+	if ( (unsigned)evType >= ARRAY_LEN( evNames ) ) {
+		return "SE_UNKNOWN";
+	} else {
+		return evNames[ evType ];
+	}
+}
+
+
+// open mouse words never match MOUSE_CLOSED unless both deltas are INT_MIN
+static int64_t Com_PackMouse( int dx, int dy ) {
+	return (int64_t)( ( ( (uint64_t)(uint32_t)dy << 32 ) | (uint32_t)dx ) ^ 0x8000000080000000ULL );
+}
+
+
+static void Com_UnpackMouse( int64_t mouse, int *dx, int *dy ) {
+	uint64_t v = (uint64_t)mouse ^ 0x8000000080000000ULL;
+	*dx = (int)(uint32_t)v;
+	*dy = (int)(uint32_t)( v >> 32 );
+}
+
+
+static unsigned int Com_EventSeq( eventCell_t *cell, unsigned int pos ) {
+	return (unsigned int)Sys_AtomicLoad( &cell->seq ) + ( pos & MASK_QUED_EVENTS );
+}
+
+
+/*
+================
+Com_MergeMouseEvent
+
+Adds the move to the last queued event if that is an SE_MOUSE
+not yet taken by the main thread
+================
+*/
+static bool Com_MergeMouseEvent( int dx, int dy ) {
+	eventCell_t *cell;
+	unsigned int pos;
+	int64_t mouse;
+	int mx, my;
+
+	pos = (unsigned int)Sys_AtomicLoad( &eventLastMouse );
+	if ( pos + 1 != (unsigned int)Sys_AtomicLoad( &eventHead ) ) {
+		return false;
+	}
+
+	cell = &eventQue[ pos & MASK_QUED_EVENTS ];
+	for ( ;; ) {
+		mouse = Sys_AtomicLoad64( &cell->mouse );
+		if ( mouse == MOUSE_CLOSED ) {
+			return false;
+		}
+		Com_UnpackMouse( mouse, &mx, &my );
+		mx = (int)( (unsigned int)mx + dx );
+		my = (int)( (unsigned int)my + dy );
+		if ( Sys_AtomicCompareSwap64( &cell->mouse, mouse, Com_PackMouse( mx, my ) ) ) {
+			return true;
+		}
+	}
+}
+
+
+/*
+================
+Sys_QueEvent
+
+A time of 0 will get the current time
+Ptr should either be null, or point to a block of data that can
+be freed by the game later.
+================
+*/
+void Sys_QueEvent( int evTime, sysEventType_t evType, int value, int value2, int ptrLength, void *ptr ) {
+	eventCell_t	*cell;
+	unsigned int pos;
+	int			dif;
+
+	if ( evTime == 0 ) {
+		evTime = Sys_Milliseconds();
+	}
+
+	// try to combine all sequential mouse moves in one event
+	if ( evType == SE_MOUSE && Com_MergeMouseEvent( value, value2 ) ) {
+		return;
+	}
+
+	pos = (unsigned int)Sys_AtomicLoad( &eventHead );
+	for ( ;; ) {
+		cell = &eventQue[ pos & MASK_QUED_EVENTS ];
+		dif = (int)( Com_EventSeq( cell, pos ) - pos );
+		if ( dif == 0 ) {
+			if ( Sys_AtomicCompareSwap( &eventHead, (int)pos, (int)( pos + 1 ) ) ) {
+				break;
+			}
+		} else if ( dif < 0 ) {
+			// full, main thread will report it
+			Sys_AtomicStore( &eventDroppedType, evType );
+			Sys_AtomicIncrement( &eventOverflows );
+			// we are discarding an event, but don't leak memory
+			if ( ptr ) {
+				Z_Free( ptr );
+			}
+			return;
+		}
+		pos = (unsigned int)Sys_AtomicLoad( &eventHead );
+	}
+
+	cell->ev.evTime = evTime;
+	cell->ev.evType = evType;
+	cell->ev.evValue = value;
+	cell->ev.evValue2 = value2;
+	cell->ev.evPtrLength = ptrLength;
+	cell->ev.evPtr = ptr;
+
+	if ( evType == SE_MOUSE ) {
+		// closed while the cell was free
+		Sys_AtomicCompareSwap64( &cell->mouse, MOUSE_CLOSED, Com_PackMouse( value, value2 ) );
+	}
+
+	// publish
+	Sys_AtomicStore( &cell->seq, (int)( pos + 1 - ( pos & MASK_QUED_EVENTS ) ) );
+
+	if ( evType == SE_MOUSE ) {
+		Sys_AtomicStore( &eventLastMouse, (int)pos );
+	}
+}
+
+
+/*
+================
+Com_DequeueEvent
+
+Main thread only
+================
+*/
+static bool Com_DequeueEvent( sysEvent_t *ev ) {
+	eventCell_t *cell;
+	int64_t mouse;
+
+	cell = &eventQue[ eventTail & MASK_QUED_EVENTS ];
+
+	// claimed but not yet published events are left for the next call
+	if ( Com_EventSeq( cell, eventTail ) != eventTail + 1 ) {
+		return false;
+	}
+
+	*ev = cell->ev;
+
+	if ( ev->evType == SE_MOUSE ) {
+		// no more moves can be merged after this
+		do {
+			mouse = Sys_AtomicLoad64( &cell->mouse );
+		} while ( !Sys_AtomicCompareSwap64( &cell->mouse, mouse, MOUSE_CLOSED ) );
+		Com_UnpackMouse( mouse, &ev->evValue, &ev->evValue2 );
+	}
+
+	// release the cell for the next lap
+	Sys_AtomicStore( &cell->seq, (int)( eventTail + MAX_QUED_EVENTS - ( eventTail & MASK_QUED_EVENTS ) ) );
+	eventTail++;
+
+	return true;
+}
+
+
+/*
+================
+Com_GetSystemEvent
+================
+*/
+static sysEvent_t Com_GetSystemEvent( void )
+{
+	sysEvent_t  ev;
+	const char	*s;
+	int			evTime;
+	int			overflows;
+
+	overflows = Sys_AtomicLoad( &eventOverflows );
+	if ( overflows != eventOverflowsReported ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %i system events dropped on queue overflow, last one %s\n",
+			overflows - eventOverflowsReported, Sys_EventName( Sys_AtomicLoad( &eventDroppedType ) ) );
+		eventOverflowsReported = overflows;
+	}
+
+	// return if we have data
+	if ( Com_DequeueEvent( &ev ) )
+		return ev;
+
+	Sys_SendKeyEvents();
+
+	evTime = Sys_Milliseconds();
+
+	// check for console commands
+	s = Sys_ConsoleInput();
+	if ( s )
+	{
+		char  *b;
+		int   len;
+
+		len = strlen( s ) + 1;
+		b = Z_Malloc( len );
+		strcpy( b, s );
+		Sys_QueEvent( evTime, SE_CONSOLE, 0, 0, len, b );
+	}
+
+	// return if we have data
+	if ( Com_DequeueEvent( &ev ) )
+		return ev;
+
+	// create an empty event to return
+	memset( &ev, 0, sizeof( ev ) );
+	ev.evTime = evTime;
+
+	return ev;
+}
+
+
+#define MAX_EVENT_PRODUCERS 32
+
+typedef struct {
+	int			id;
+	int			count;
+	volatile int *finished;
+} eventProducer_t;
+
+
+static void Com_EventProducer( void *arg ) {
+	eventProducer_t *p = (eventProducer_t *)arg;
+	int i;
+
+	for ( i = 0; i < p->count; i++ ) {
+		Sys_QueEvent( 1, SE_NONE, p->id, i, 0, NULL );
+		if ( ( i & 3 ) == 0 ) {
+			Sys_QueEvent( 1, SE_MOUSE, 1, 0, 0, NULL );
+		}
+	}
+
+	Sys_AtomicIncrement( p->finished );
+}
+
+
+/*
+=================
+Com_EventBench_f
+
+Posts events from several threads at once while the main thread
+consumes them, checks that nothing is lost or reordered per thread
+=================
+*/
+static void Com_EventBench_f( void ) {
+	eventProducer_t producers[ MAX_EVENT_PRODUCERS ];
+	void		*threads[ MAX_EVENT_PRODUCERS ];
+	int			last[ MAX_EVENT_PRODUCERS ];
+	volatile int finished;
+	int			numThreads, count, i, overflows;
+	int			received, mouseEvents, mouseMoves, reordered, foreign;
+	int64_t		posted, start, end;
+	sysEvent_t	ev;
+	bool		done;
+
+	numThreads = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 4;
+	numThreads = MAX( 1, MIN( numThreads, MAX_EVENT_PRODUCERS ) );
+	count = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 1000000;
+	count = MAX( 1, count );
+
+	overflows = Sys_AtomicLoad( &eventOverflows );
+	received = mouseEvents = mouseMoves = reordered = foreign = 0;
+	finished = 0;
+
+	start = Sys_Microseconds();
+
+	for ( i = 0; i < numThreads; i++ ) {
+		producers[ i ].id = i;
+		producers[ i ].count = count;
+		producers[ i ].finished = &finished;
+		last[ i ] = -1;
+		threads[ i ] = Sys_CreateThread( Com_EventProducer, &producers[ i ] );
+		if ( threads[ i ] == NULL ) {
+			// run it here, no concurrency but still counts
+			Com_EventProducer( &producers[ i ] );
+		}
+	}
+
+	do {
+		done = ( Sys_AtomicLoad( &finished ) == numThreads );
+		while ( Com_DequeueEvent( &ev ) ) {
+			if ( ev.evType == SE_NONE && (unsigned)ev.evValue < numThreads ) {
+				if ( ev.evValue2 <= last[ ev.evValue ] ) {
+					reordered++;
+				}
+				last[ ev.evValue ] = ev.evValue2;
+				received++;
+			} else if ( ev.evType == SE_MOUSE ) {
+				mouseEvents++;
+				mouseMoves += ev.evValue;
+			} else {
+				if ( ev.evPtr ) {
+					Z_Free( ev.evPtr );
+				}
+				foreign++;
+			}
+		}
+	} while ( !done );
+
+	end = Sys_Microseconds();
+
+	for ( i = 0; i < numThreads; i++ ) {
+		if ( threads[ i ] ) {
+			Sys_JoinThread( threads[ i ] );
+		}
+	}
+
+	overflows = Sys_AtomicLoad( &eventOverflows ) - overflows;
+	eventOverflowsReported = Sys_AtomicLoad( &eventOverflows );
+
+	posted = (int64_t)numThreads * ( count + ( count + 3 ) / 4 );
+
+	Com_Printf( "%i threads posted %lli events in %.1f msec (%.0f events/sec)\n", numThreads,
+		(long long)posted, ( end - start ) / 1000.0, posted * 1000000.0 / MAX( end - start, 1 ) );
+	Com_Printf( "%i received, %i mouse moves merged into %i events, %i dropped on overflow\n",
+		received, mouseMoves, mouseEvents, overflows );
+	if ( foreign ) {
+		Com_Printf( "%i other events discarded\n", foreign );
+	}
+
+	if ( received + mouseMoves + overflows != posted || reordered ) {
+		Com_Printf( S_COLOR_RED "FAILED: %lli events lost, %i out of order\n",
+			(long long)( posted - received - mouseMoves - overflows ), reordered );
+	} else {
+		Com_Printf( "All events accounted for, per-thread order kept.\n" );
+	}
+}
+
+
+/*
+=================
+Com_GetRealEvent
+=================
+*/
+static sysEvent_t Com_GetRealEvent( void ) {
+
+	// get or save an event from/to the journal file
+	if ( com_journalFile != FS_INVALID_HANDLE ) {
+		int			r;
+		sysEvent_t	ev;
+
+		if ( com_journal->integer == 2 ) {
+			Sys_SendKeyEvents();
+			r = FS_Read( &ev, sizeof(ev), com_journalFile );
+			if ( r != sizeof(ev) ) {
+				Com_Error( ERR_FATAL, "Error reading from journal file" );
+			}
+			if ( ev.evPtrLength ) {
+				ev.evPtr = Z_Malloc( ev.evPtrLength );
+				r = FS_Read( ev.evPtr, ev.evPtrLength, com_journalFile );
+				if ( r != ev.evPtrLength ) {
+					Com_Error( ERR_FATAL, "Error reading from journal file" );
+				}
+			}
+		} else {
+			ev = Com_GetSystemEvent();
+
+			// write the journal value out if needed
+			if ( com_journal->integer == 1 ) {
+				r = FS_Write( &ev, sizeof(ev), com_journalFile );
+				if ( r != sizeof(ev) ) {
+					Com_Error( ERR_FATAL, "Error writing to journal file" );
+				}
+				if ( ev.evPtrLength ) {
+					r = FS_Write( ev.evPtr, ev.evPtrLength, com_journalFile );
+					if ( r != ev.evPtrLength ) {
+						Com_Error( ERR_FATAL, "Error writing to journal file" );
+					}
+				}
+			}
+		}
+
+		return ev;
+	}
+
+	return Com_GetSystemEvent();
+}
+
+
+/*
+=================
+Com_InitPushEvent
+=================
+*/
+static void Com_InitPushEvent( void ) {
+  // clear the static buffer array
+  // this requires SE_NONE to be accepted as a valid but NOP event
+  memset( com_pushedEvents, 0, sizeof(com_pushedEvents) );
+  // reset counters while we are at it
+  // beware: GetEvent might still return an SE_NONE from the buffer
+  com_pushedEventsHead = 0;
+  com_pushedEventsTail = 0;
+}
+
+
+/*
+=================
+Com_PushEvent
+=================
+*/
+static void Com_PushEvent( const sysEvent_t *event ) {
+	sysEvent_t		*ev;
+	static int printedWarning = 0;
+
+	ev = &com_pushedEvents[ com_pushedEventsHead & (MAX_PUSHED_EVENTS-1) ];
+
+	if ( com_pushedEventsHead - com_pushedEventsTail >= MAX_PUSHED_EVENTS ) {
+
+		// don't print the warning constantly, or it can give time for more...
+		if ( !printedWarning ) {
+			printedWarning = true;
+			Com_Printf( "WARNING: Com_PushEvent overflow\n" );
+		}
+
+		if ( ev->evPtr ) {
+			Z_Free( ev->evPtr );
+		}
+		com_pushedEventsTail++;
+	} else {
+		printedWarning = false;
+	}
+
+	*ev = *event;
+	com_pushedEventsHead++;
+}
+
+
+/*
+=================
+Com_GetEvent
+=================
+*/
+static sysEvent_t Com_GetEvent( void ) {
+	if ( com_pushedEventsHead - com_pushedEventsTail > 0 ) {
+		return com_pushedEvents[ (com_pushedEventsTail++) & (MAX_PUSHED_EVENTS-1) ];
+	}
+	return Com_GetRealEvent();
+}
+
+
+/*
+=================
+Com_RunAndTimeServerPacket
+=================
+*/
+void Com_RunAndTimeServerPacket( const netadr_t *evFrom, msg_t *buf ) {
+	int		t1, t2, msec;
+
+	t1 = 0;
+
+	if ( com_speeds->integer ) {
+		t1 = Sys_Milliseconds ();
+	}
+
+	Com_RecordPacket( evFrom, buf );
+
+	TRACE_BEGIN( "SV_PacketEvent" );
+	SV_PacketEvent( evFrom, buf );
+	TRACE_END();
+
+	if ( com_speeds->integer ) {
+		t2 = Sys_Milliseconds ();
+		msec = t2 - t1;
+		if ( com_speeds->integer == 3 ) {
+			Com_Printf( "SV_PacketEvent time: %i\n", msec );
+		}
+	}
+}
+
+
+/*
+=================
+Com_EventLoop
+
+Returns last event time
+=================
+*/
+int Com_EventLoop( void ) {
+	sysEvent_t	ev;
+	netadr_t	evFrom;
+	byte		bufData[ MAX_MSGLEN_BUF ];
+	msg_t		buf;
+
+	MSG_Init( &buf, bufData, MAX_MSGLEN );
+
+	TRACE_BEGIN( "Com_EventLoop" );
+
+	while ( 1 ) {
+		ev = Com_GetEvent();
+
+		// if no more events are available
+		if ( ev.evType == SE_NONE ) {
+			// manually send packet events for the loopback channel
+#ifndef DEDICATED
+			while ( NET_GetLoopPacket( NS_CLIENT, &evFrom, &buf ) ) {
+				CL_PacketEvent( &evFrom, &buf );
+			}
+#endif
+			while ( NET_GetLoopPacket( NS_SERVER, &evFrom, &buf ) ) {
+				// if the server just shut down, flush the events
+				if ( com_sv_running->integer ) {
+					Com_RunAndTimeServerPacket( &evFrom, &buf );
+				}
+			}
+
+			TRACE_END();
+			return ev.evTime;
+		}
+
+
+		switch ( ev.evType ) {
+#ifndef DEDICATED
+		case SE_KEY:
+			CL_KeyEvent( ev.evValue, ev.evValue2, ev.evTime );
+			break;
+		case SE_CHAR:
+			CL_CharEvent( ev.evValue );
+			break;
+		case SE_MOUSE:
+			CL_MouseEvent( ev.evValue, ev.evValue2 /*, ev.evTime*/ );
+			break;
+		case SE_JOYSTICK_AXIS:
+			CL_JoystickEvent( ev.evValue, ev.evValue2, ev.evTime );
+			break;
+#endif
+		case SE_CONSOLE:
+			Com_RecordCommand( (char *)ev.evPtr );
+			Cbuf_AddText( (char *)ev.evPtr );
+			Cbuf_AddText( "\n" );
+			break;
+		default:
+				Com_Error( ERR_FATAL, "Com_EventLoop: bad event type %i", ev.evType );
+			break;
+		}
+
+		// free any block data
+		if ( ev.evPtr ) {
+			Z_Free( ev.evPtr );
+			ev.evPtr = NULL;
+		}
+	}
+
+	return 0;	// never reached
+}
+
+
+/*
+================
+Com_Milliseconds
+
+Can be used for profiling, but will be journaled accurately
+================
+*/
+int Com_Milliseconds( void ) {
+
+	sysEvent_t	ev;
+
+	// get events and push them until we get a null event with the current time
+	do {
+		ev = Com_GetRealEvent();
+		if ( ev.evType != SE_NONE ) {
+			Com_PushEvent( &ev );
+		}
+	} while ( ev.evType != SE_NONE );
+
+	return ev.evTime;
+}
+
+//============================================================================
+
+/*
+=============
+Com_Error_f
+
+Just throw a fatal error to
+test error shutdown procedures
+=============
+*/
+static void __attribute__((__noreturn__)) Com_Error_f (void) {
+	if ( Cmd_Argc() > 1 ) {
+		Com_Error( ERR_DROP, "Testing drop error" );
+	} else {
+		Com_Error( ERR_FATAL, "Testing fatal error" );
+	}
+}
+
+
+/*
+=============
+Com_Freeze_f
+
+Just freeze in place for a given number of seconds to test
+error recovery
+=============
+*/
+static void Com_Freeze_f( void ) {
+	int		s;
+	int		start, now;
+
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "freeze <seconds>\n" );
+		return;
+	}
+	s = atoi( Cmd_Argv(1) ) * 1000;
+
+	start = Com_Milliseconds();
+
+	while ( 1 ) {
+		now = Com_Milliseconds();
+		if ( now - start > s ) {
+			break;
+		}
+	}
+}
+
+
+/*
+=================
+Com_Crash_f
+
+A way to force a bus error for development reasons
+=================
+*/
+static void Com_Crash_f( void ) {
+	* ( volatile int * ) 0 = 0x12345678;
+}
+
+
+/*
+==================
+Com_ExecuteCfg
+
+For controlling environment variables
+==================
+*/
+static void Com_ExecuteCfg( void )
+{
+	Cbuf_ExecuteText(EXEC_NOW, "exec default.cfg\n");
+	Cbuf_Execute(); // Always execute after exec to prevent text buffer overflowing
+
+	if (!Com_SafeMode())
+	{
+		// skip the q3config.cfg and autoexec.cfg if "safe" is on the command line
+		Cbuf_ExecuteText(EXEC_NOW, "exec " Q3CONFIG_CFG "\n");
+		Cbuf_Execute();
+		Cbuf_ExecuteText(EXEC_NOW, "exec autoexec.cfg\n");
+		Cbuf_Execute();
+	}
+}
+
+
+/*
+==================
+Com_GameRestart
+
+Change to a new mod properly with cleaning up cvars before switching.
+==================
+*/
+void Com_GameRestart( int checksumFeed, bool clientRestart )
+{
+	static bool com_gameRestarting = false;
+
+	// make sure no recursion can be triggered
+	if ( !com_gameRestarting && com_fullyInitialized )
+	{
+		com_gameRestarting = true;
+#ifndef DEDICATED
+		if ( clientRestart )
+		{
+			CL_Disconnect( false );
+			CL_ShutdownAll();
+			CL_ClearMemory(); // Hunk_Clear(); // -EC-
+		}
+#endif
+
+		// Kill server if we have one
+		if ( com_sv_running->integer )
+			SV_Shutdown( "Game directory changed" );
+
+		// Reset console command history
+		Con_ResetHistory();
+
+		// Shutdown FS early so Cvar_Restart will not reset old game cvars
+		FS_Shutdown( true );
+
+		// Clean out any user and VM created cvars
+		Cvar_Restart( true );
+
+#ifndef DEDICATED
+		// Reparse pure paks and update cvars before FS startup
+		if ( CL_GameSwitch() )
+			CL_SystemInfoChanged( false );
+#endif
+
+		FS_Restart( checksumFeed );
+
+		// Load new configuration
+		Com_ExecuteCfg();
+
+#ifndef DEDICATED
+		if ( clientRestart )
+			CL_StartHunkUsers();
+#endif
+
+		com_gameRestarting = false;
+	}
+}
+
+
+/*
+==================
+Com_GameRestart_f
+
+Expose possibility to change current running mod to the user
+==================
+*/
+static void Com_GameRestart_f( void )
+{
+	Cvar_Set( "fs_game", Cmd_Argv( 1 ) );
+
+	Com_GameRestart( 0, true );
+}
+
+
+// TTimo: centralizing the cl_cdkey stuff after I discovered a buffer overflow problem with the dedicated server version
+//   not sure it's necessary to have different defaults for regular and dedicated, but I don't want to risk it
+//   https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=470
+#ifndef DEDICATED
+char	cl_cdkey[34] = "                                ";
+#else
+char	cl_cdkey[34] = "123456789";
+#endif
+
+/*
+=================
+bool CL_CDKeyValidate
+=================
+*/
+bool Com_CDKeyValidate( const char *key, const char *checksum ) {
+#ifdef STANDALONE
+	return true;
+#else
+	char	ch;
+	byte	sum;
+	char	chs[10];
+	int 	i, len;
+
+	len = strlen(key);
+	if( len != CDKEY_LEN ) {
+		return false;
+	}
+
+	if( checksum && strlen( checksum ) != CDCHKSUM_LEN ) {
+		return false;
+	}
+
+	sum = 0;
+	// for loop gets rid of conditional assignment warning
+	for (i = 0; i < len; i++) {
+		ch = *key++;
+		if (ch>='a' && ch<='z') {
+			ch -= 32;
+		}
+		switch( ch ) {
+		case '2':
+		case '3':
+		case '7':
+		case 'A':
+		case 'B':
+		case 'C':
+		case 'D':
+		case 'G':
+		case 'H':
+		case 'J':
+		case 'L':
+		case 'P':
+		case 'R':
+		case 'S':
+		case 'T':
+		case 'W':
+			sum += ch;
+			continue;
+		default:
+			return false;
+		}
+	}
+
+	sprintf(chs, "%02x", sum);
+
+	if (checksum && !Q_stricmp(chs, checksum)) {
+		return true;
+	}
+
+	if (!checksum) {
+		return true;
+	}
+
+	return false;
+#endif
+}
+
+
+/*
+=================
+Com_ReadCDKey
+=================
+*/
+void Com_ReadCDKey( const char *filename ) {
+	fileHandle_t	f;
+	char			buffer[33];
+	char			fbuffer[MAX_OSPATH];
+
+	Com_sprintf( fbuffer, sizeof( fbuffer ), "%s/q3key", filename );
+
+	FS_SV_FOpenFileRead( fbuffer, &f );
+	if ( f == FS_INVALID_HANDLE ) {
+		Q_strncpyz( cl_cdkey, "                ", 17 );
+		return;
+	}
+
+	Com_Memset( buffer, 0, sizeof( buffer ) );
+
+	FS_Read( buffer, 16, f );
+	FS_FCloseFile( f );
+
+	if ( Com_CDKeyValidate(buffer, NULL) ) {
+		Q_strncpyz( cl_cdkey, buffer, 17 );
+	} else {
+		Q_strncpyz( cl_cdkey, "                ", 17 );
+	}
+}
+
+
+/*
+=================
+Com_AppendCDKey
+=================
+*/
+void Com_AppendCDKey( const char *filename ) {
+	fileHandle_t	f;
+	char			buffer[33];
+	char			fbuffer[MAX_OSPATH];
+
+	Com_sprintf(fbuffer, sizeof(fbuffer), "%s/q3key", filename);
+
+	FS_SV_FOpenFileRead( fbuffer, &f );
+	if ( f == FS_INVALID_HANDLE ) {
+		Q_strncpyz( &cl_cdkey[16], "                ", 17 );
+		return;
+	}
+
+	Com_Memset( buffer, 0, sizeof(buffer) );
+
+	FS_Read( buffer, 16, f );
+	FS_FCloseFile( f );
+
+	if ( Com_CDKeyValidate(buffer, NULL)) {
+		strcat( &cl_cdkey[16], buffer );
+	} else {
+		Q_strncpyz( &cl_cdkey[16], "                ", 17 );
+	}
+}
+
+
+#ifndef DEDICATED // bk001204
+/*
+=================
+Com_WriteCDKey
+=================
+*/
+static void Com_WriteCDKey( const char *filename, const char *ikey ) {
+	fileHandle_t	f;
+	char			fbuffer[MAX_OSPATH];
+	char			key[17];
+#ifndef _WIN32
+	mode_t			savedumask;
+#endif
+
+	Com_sprintf( fbuffer, sizeof(fbuffer), "%s/q3key", filename );
+
+	Q_strncpyz( key, ikey, 17 );
+
+	if( !Com_CDKeyValidate(key, NULL) ) {
+		return;
+	}
+
+#ifndef _WIN32
+	savedumask = umask(0077);
+#endif
+	f = FS_SV_FOpenFileWrite( fbuffer );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( "Couldn't write CD key to %s.\n", fbuffer );
+		goto out;
+	}
+
+	FS_Write( key, 16, f );
+
+	FS_Printf( f, Q_NEWLINE "// generated by quake, do not modify" Q_NEWLINE );
+	FS_Printf( f, "// Do not give this file to ANYONE." Q_NEWLINE );
+	FS_Printf( f, "// id Software and Activision will NOT ask you to send this file to them." Q_NEWLINE );
+
+	FS_FCloseFile( f );
+out:
+#ifndef _WIN32
+	umask(savedumask);
+#else
+	;
+#endif
+}
+#endif
+
+
+/*
+** --------------------------------------------------------------------------------
+**
+** PROCESSOR STUFF
+**
+** --------------------------------------------------------------------------------
+*/
+
+#ifdef USE_AFFINITY_MASK
+static uint64_t eCoreMask;
+static uint64_t pCoreMask;
+static uint64_t affinityMask; // saved at startup
+#endif
+
+#if (idx64 || id386)
+
+#if defined _MSC_VER
+#include <intrin.h>
+static void CPUID( int func, unsigned int *regs )
+{
+	__cpuid( (int*)regs, func );
+}
+
+#ifdef USE_AFFINITY_MASK
+#if idx64
+extern void CPUID_EX( int func, int param, unsigned int *regs );
+#else
+void CPUID_EX( int func, int param, unsigned int *regs )
+{
+	__asm {
+		push edi
+		mov eax, func
+		mov ecx, param
+		cpuid
+		mov edi, regs
+		mov [edi +0], eax
+		mov [edi +4], ebx
+		mov [edi +8], ecx
+		mov [edi+12], edx
+		pop edi
+	}
+}
+#endif // !idx64
+#endif // USE_AFFINITY_MASK
+
+#else // clang/gcc/mingw
+
+static void CPUID( int func, unsigned int *regs )
+{
+	__asm__ __volatile__( "cpuid" :
+		"=a"(regs[0]),
+		"=b"(regs[1]),
+		"=c"(regs[2]),
+		"=d"(regs[3]) :
+		"a"(func) );
+}
+
+#ifdef USE_AFFINITY_MASK
+static void CPUID_EX( int func, int param, unsigned int *regs )
+{
+	__asm__ __volatile__( "cpuid" :
+		"=a"(regs[0]),
+		"=b"(regs[1]),
+		"=c"(regs[2]),
+		"=d"(regs[3]) :
+		"a"(func),
+		"c"(param) );
+}
+#endif // USE_AFFINITY_MASK
+
+#endif  // clang/gcc/mingw
+
+static void Sys_GetProcessorId( char *vendor )
+{
+	uint32_t regs[4]; // EAX, EBX, ECX, EDX
+	uint32_t cpuid_level_ex;
+	char vendor_str[12 + 1]; // short CPU vendor string
+
+	// setup initial features
+#if idx64
+	CPU_Flags |= CPU_SSE | CPU_SSE2 | CPU_FCOM;
+#else
+	CPU_Flags = 0;
+#endif
+	vendor[0] = '\0';
+
+	CPUID( 0x80000000, regs );
+	cpuid_level_ex = regs[0];
+
+	// get CPUID level & short CPU vendor string
+	CPUID( 0x0, regs );
+	memcpy(vendor_str + 0, (char*)&regs[1], 4);
+	memcpy(vendor_str + 4, (char*)&regs[3], 4);
+	memcpy(vendor_str + 8, (char*)&regs[2], 4);
+	vendor_str[12] = '\0';
+
+	// get CPU feature bits
+	CPUID( 0x1, regs );
+
+	// bit 15 of EDX denotes CMOV/FCMOV/FCOMI existence
+	if ( regs[3] & ( 1 << 15 ) )
+		CPU_Flags |= CPU_FCOM;
+
+	// bit 23 of EDX denotes MMX existence
+	if ( regs[3] & ( 1 << 23 ) )
+		CPU_Flags |= CPU_MMX;
+
+	// bit 25 of EDX denotes SSE existence
+	if ( regs[3] & ( 1 << 25 ) )
+		CPU_Flags |= CPU_SSE;
+
+	// bit 26 of EDX denotes SSE2 existence
+	if ( regs[3] & ( 1 << 26 ) )
+		CPU_Flags |= CPU_SSE2;
+
+	// bit 0 of ECX denotes SSE3 existence
+	//if ( regs[2] & ( 1 << 0 ) )
+	//	CPU_Flags |= CPU_SSE3;
+
+	// bit 19 of ECX denotes SSE41 existence
+	if ( regs[ 2 ] & ( 1 << 19 ) )
+		CPU_Flags |= CPU_SSE41;
+
+	if ( vendor ) {
+		if ( cpuid_level_ex >= 0x80000004 ) {
+			// read CPU Brand string
+			uint32_t i;
+			for ( i = 0x80000002; i <= 0x80000004; i++) {
+				CPUID( i, regs );
+				memcpy( vendor+0, (char*)&regs[0], 4 );
+				memcpy( vendor+4, (char*)&regs[1], 4 );
+				memcpy( vendor+8, (char*)&regs[2], 4 );
+				memcpy( vendor+12, (char*)&regs[3], 4 );
+				vendor[16] = '\0';
+				vendor += strlen( vendor );
+			}
+		} else {
+			const int print_flags = CPU_Flags;
+			vendor = Q_stradd( vendor, vendor_str );
+			if (print_flags) {
+				// print features
+				strcat(vendor, " w/");
+				if (print_flags & CPU_FCOM)
+					strcat(vendor, " CMOV");
+				if (print_flags & CPU_MMX)
+					strcat(vendor, " MMX");
+				if (print_flags & CPU_SSE)
+					strcat(vendor, " SSE");
+				if (print_flags & CPU_SSE2)
+					strcat(vendor, " SSE2");
+				//if ( CPU_Flags & CPU_SSE3 )
+				//	strcat( vendor, " SSE3" );
+				if (print_flags & CPU_SSE41)
+					strcat(vendor, " SSE4.1");
+			}
+		}
+	}
+}
+
+
+#ifdef USE_AFFINITY_MASK
+static void DetectCPUCoresConfig( void )
+{
+	uint32_t regs[4];
+	uint32_t i;
+
+	// get highest function parameter and vendor id
+	CPUID( 0x0, regs );
+	if ( regs[1] != 0x756E6547 || regs[2] != 0x6C65746E || regs[3] != 0x49656E69 || regs[0] < 0x1A ) {
+		// non-intel signature or too low cpuid level - unsupported
+		eCoreMask = pCoreMask = affinityMask;
+		return;
+	}
+
+	eCoreMask = 0;
+	pCoreMask = 0;
+
+	for ( i = 0; i < sizeof( affinityMask ) * 8; i++ ) {
+		const uint64_t mask = 1ULL << i;
+		if ( (mask & affinityMask) && Sys_SetAffinityMask( mask ) ) {
+			CPUID_EX( 0x1A, 0x0, regs );
+			switch ( (regs[0] >> 24) & 0xFF ) {
+				case 0x20: eCoreMask |= mask; break;
+				case 0x40: pCoreMask |= mask; break;
+				default: // non-existing leaf
+					eCoreMask = pCoreMask = 0;
+					break;
+			}
+		}
+	}
+
+	// restore original affinity
+	Sys_SetAffinityMask( affinityMask );
+
+	if ( pCoreMask == 0 || eCoreMask == 0 ) {
+		// if either mask is empty - assume non-hybrid configuration
+		eCoreMask = pCoreMask = affinityMask;
+	}
+}
+#endif // USE_AFFINITY_MASK
+
+#else // non-x86
+
+#ifndef __linux__
+
+static void Sys_GetProcessorId( char *vendor )
+{
+	Com_sprintf( vendor, 100, "%s", ARCH_STRING );
+}
+
+#else // __linux__
+
+#include <sys/auxv.h>
+
+#if arm32
+#include <asm/hwcap.h>
+#endif
+
+static void Sys_GetProcessorId( char *vendor )
+{
+#if arm32
+	const char *platform;
+	long hwcaps;
+	CPU_Flags = 0;
+
+	platform = (const char*)getauxval( AT_PLATFORM );
+
+	if ( !platform || *platform == '\0' ) {
+		platform = "(unknown)";
+	}
+
+	if ( platform[0] == 'v' || platform[0] == 'V' ) {
+		if ( atoi( platform + 1 ) >= 7 ) {
+			CPU_Flags |= CPU_ARMv7;
+		}
+	}
+
+	Com_sprintf( vendor, 100, "ARM %s", platform );
+	hwcaps = getauxval( AT_HWCAP );
+	if ( hwcaps & ( HWCAP_IDIVA | HWCAP_VFPv3 ) ) {
+		strcat( vendor, " /w" );
+
+		if ( hwcaps & HWCAP_IDIVA ) {
+			CPU_Flags |= CPU_IDIVA;
+			strcat( vendor, " IDIVA" );
+		}
+
+		if ( hwcaps & HWCAP_VFPv3 ) {
+			CPU_Flags |= CPU_VFPv3;
+			strcat( vendor, " VFPv3" );
+		}
+
+		if ( ( CPU_Flags & ( CPU_ARMv7 | CPU_VFPv3 ) ) == ( CPU_ARMv7 | CPU_VFPv3 ) ) {
+			strcat( vendor, " QVM-bytecode" );
+		}
+	}
+#else // !arm32
+	CPU_Flags = 0;
+#if arm64
+	Com_sprintf( vendor, 100, "%s", ARCH_STRING );
+#else
+	Com_sprintf( vendor, 128, "%s %s", ARCH_STRING, (const char*)getauxval( AT_PLATFORM ) );
+#endif
+#endif // !arm32
+}
+
+#endif // __linux__
+
+#endif // non-x86
+
+/*
+================
+Sys_SnapVector
+================
+*/
+#ifdef _MSC_VER
+#if idx64
+void Sys_SnapVector( float *vector )
+{
+	__m128 vf0, vf1, vf2;
+	__m128i vi;
+	DWORD mxcsr;
+
+	mxcsr = _mm_getcsr();
+	vf0 = _mm_setr_ps( vector[0], vector[1], vector[2], 0.0f );
+
+	_mm_setcsr( mxcsr & ~0x6000 ); // enforce rounding mode to "round to nearest"
+
+	vi = _mm_cvtps_epi32( vf0 );
+	vf0 = _mm_cvtepi32_ps( vi );
+
+	vf1 = _mm_shuffle_ps(vf0, vf0, _MM_SHUFFLE(1,1,1,1));
+	vf2 = _mm_shuffle_ps(vf0, vf0, _MM_SHUFFLE(2,2,2,2));
+
+	_mm_setcsr( mxcsr ); // restore rounding mode
+
+	_mm_store_ss( &vector[0], vf0 );
+	_mm_store_ss( &vector[1], vf1 );
+	_mm_store_ss( &vector[2], vf2 );
+}
+#endif // idx64
+
+#if id386
+void Sys_SnapVector( float *vector )
+{
+	static const DWORD cw037F = 0x037F;
+	DWORD cwCurr;
+__asm {
+	fnstcw word ptr [cwCurr]
+	mov ecx, vector
+	fldcw word ptr [cw037F]
+
+	fld   dword ptr[ecx+8]
+	fistp dword ptr[ecx+8]
+	fild  dword ptr[ecx+8]
+	fstp  dword ptr[ecx+8]
+
+	fld   dword ptr[ecx+4]
+	fistp dword ptr[ecx+4]
+	fild  dword ptr[ecx+4]
+	fstp  dword ptr[ecx+4]
+
+	fld   dword ptr[ecx+0]
+	fistp dword ptr[ecx+0]
+	fild  dword ptr[ecx+0]
+	fstp  dword ptr[ecx+0]
+
+	fldcw word ptr cwCurr
+	}; // __asm
+}
+#endif // id386
+
+#if arm64
+void Sys_SnapVector( float *vector )
+{
+	vector[0] = rint( vector[0] );
+	vector[1] = rint( vector[1] );
+	vector[2] = rint( vector[2] );
+}
+#endif
+
+#else // clang/gcc/mingw
+
+#if id386
+
+#define QROUNDX87(src) \
+	"flds " src "\n" \
+	"fistpl " src "\n" \
+	"fildl " src "\n" \
+	"fstps " src "\n"
+
+void Sys_SnapVector( float *vector )
+{
+	static const unsigned short cw037F = 0x037F;
+	unsigned short cwCurr;
+
+	__asm__ volatile
+	(
+		"fnstcw %1\n" \
+		"fldcw %2\n" \
+		QROUNDX87("0(%0)")
+		QROUNDX87("4(%0)")
+		QROUNDX87("8(%0)")
+		"fldcw %1\n" \
+		:
+		: "r" (vector), "m"(cwCurr), "m"(cw037F)
+		: "memory", "st"
+	);
+}
+
+#else // idx64, non-x86
+
+void Sys_SnapVector( float *vector )
+{
+	vector[0] = rint( vector[0] );
+	vector[1] = rint( vector[1] );
+	vector[2] = rint( vector[2] );
+}
+
+#endif
+
+#endif // clang/gcc/mingw
+
+#ifdef USE_AFFINITY_MASK
+
+static int hex_code( const int code ) {
+	if ( code >= '0' && code <= '9' ) {
+		return code - '0';
+	}
+	if ( code >= 'A' && code <= 'F' ) {
+		return code - 'A' + 10;
+	}
+	if ( code >= 'a' && code <= 'f' ) {
+		return code - 'a' + 10;
+	}
+	return -1;
+}
+
+
+static const char *parseAffinityMask( const char *str, uint64_t *outv, int level ) {
+	uint64_t v, mask = 0;
+
+	while ( *str != '\0' ) {
+		if ( *str == 'A' || *str == 'a' ) {
+			mask = affinityMask;
+			++str;
+			continue;
+		}
+		else if ( *str == 'P' || *str == 'p' ) {
+			mask = pCoreMask;
+			++str;
+			continue;
+		}
+		else if ( *str == 'E' || *str == 'e' ) {
+			mask = eCoreMask;
+			++str;
+			continue;
+		}
+		else if ( *str == '0' && (str[1] == 'x' || str[1] == 'X') && (v = hex_code( str[2] )) >= 0 ) {
+			int hex;
+			str += 3; // 0xH
+			while ( (hex = hex_code( *str )) >= 0 ) {
+				v = v * 16 + hex;
+				str++;
+			}
+			mask = v;
+			continue;
+		}
+		else if ( *str >= '0' && *str <= '9' ) {
+			mask = *str++ - '0';
+			while ( *str >= '0' && *str <= '9' ) {
+				mask = mask * 10 + *str - '0';
+				++str;
+			}
+			continue;
+		}
+
+		if ( level == 0 ) {
+			while ( *str == '+' || *str == '-' ) {
+				str = parseAffinityMask( str + 1, &v, level + 1 );
+				switch ( *str ) {
+					case '+': mask |= v; break;
+					case '-': mask &= ~v; break;
+					default: str = ""; break;
+				}
+			}
+			if ( *str != '\0' ) {
+				++str; // skip unknown characters
+			}
+		} else {
+			break;
+		}
+	}
+
+	*outv = mask;
+	return str;
+}
+
+
+// parse and set affinity mask
+static void Com_SetAffinityMask( const char *str )
+{
+	uint64_t mask = 0;
+
+	parseAffinityMask( str, &mask, 0 );
+
+	if ( ( mask & affinityMask ) == 0 ) {
+		mask = affinityMask; // reset to default
+	}
+
+	if ( mask != 0 ) {
+		Sys_SetAffinityMask( mask );
+	}
+}
+#endif // USE_AFFINITY_MASK
+
+
+/*
+=================
+Com_Init
+=================
+*/
+void Com_Init( char *commandLine ) {
+	const char *s;
+	int	qport;
+
+	Com_Printf( "%s %s %s\n", SVN_VERSION, PLATFORM_STRING, __DATE__ );
+
+	if ( Q_setjmp( abortframe ) ) {
+		Sys_Error ("Error during initialization");
+	}
+
+	// bk001129 - do this before anything else decides to push events
+	Com_InitPushEvent();
+
+	Com_InitSmallZoneMemory();
+	Cvar_Init();
+
+#if defined(_WIN32) && defined(_DEBUG)
+	com_noErrorInterrupt = Cvar_Get( "com_noErrorInterrupt", "0", 0 );
+#endif
+
+#ifdef DEFAULT_GAME
+	Cvar_Set( "fs_game", DEFAULT_GAME );
+#endif
+
+	// prepare enough of the subsystems to handle
+	// cvar and command buffer management
+	Com_ParseCommandLine( commandLine );
+
+//	Swap_Init ();
+	Cbuf_Init();
+
+	// override anything from the config files with command line args
+	Com_StartupVariable( NULL );
+
+	Com_InitZoneMemory();
+	Arena_Init( &frameArena, "frame", FRAME_ARENA_SIZE );
+	Cmd_Init();
+
+	// get the developer cvar set as early as possible
+	Com_StartupVariable( "developer" );
+	com_developer = Cvar_Get( "developer", "0", CVAR_TEMP );
+	Cvar_CheckRange( com_developer, NULL, NULL, CV_INTEGER );
+
+	Com_StartupVariable( "vm_rtChecks" );
+	vm_rtChecks = Cvar_Get( "vm_rtChecks", "15", CVAR_INIT | CVAR_PROTECTED );
+	Cvar_CheckRange( vm_rtChecks, "0", "15", CV_INTEGER );
+	Cvar_SetDescription( vm_rtChecks,
+		"Runtime checks in compiled vm code, bitmask:\n 1 - program stack overflow\n" \
+		" 2 - opcode stack overflow\n 4 - jump target range\n 8 - data read/write range" );
+
+	Com_StartupVariable( "journal" );
+	com_journal = Cvar_Get( "journal", "0", CVAR_INIT | CVAR_PROTECTED );
+	Cvar_CheckRange( com_journal, "0", "2", CV_INTEGER );
+	Cvar_SetDescription( com_journal, "When enabled, writes events and its data to 'journal.dat' and 'journaldata.dat'.");
+
+	Com_StartupVariable( "sv_master1" );
+	Com_StartupVariable( "sv_master2" );
+	Com_StartupVariable( "sv_master3" );
+	Cvar_Get( "sv_master1", MASTER_SERVER_NAME, CVAR_INIT );
+	Cvar_Get( "sv_master2", "master.ioquake3.org", CVAR_INIT );
+	Cvar_Get( "sv_master3", "master.maverickservers.com", CVAR_INIT );
+
+	com_protocol = Cvar_Get( "protocol", XSTRING( DEFAULT_PROTOCOL_VERSION ), 0 );
+	Cvar_SetDescription( com_protocol, "Specify network protocol version number, use -compat suffix for OpenArena compatibility.");
+	if ( Q_stristr( com_protocol->string, "-compat" ) > com_protocol->string ) {
+		// strip -compat suffix
+		Cvar_Set2( "protocol", va( "%i", com_protocol->integer ), true );
+		// enforce legacy stream encoding but with new challenge format
+		com_protocolCompat = true;
+	} else {
+		com_protocolCompat = false;
+	}
+
+	Cvar_CheckRange( com_protocol, "0", NULL, CV_INTEGER );
+	com_protocol->flags &= ~CVAR_USER_CREATED;
+	com_protocol->flags |= CVAR_SERVERINFO | CVAR_ROM;
+
+	// done early so bind command exists
+	Com_InitKeyCommands();
+
+	FS_InitFilesystem();
+
+	com_logfile = Cvar_Get( "logfile", "0", CVAR_TEMP );
+	Cvar_CheckRange( com_logfile, "0", "4", CV_INTEGER );
+	Cvar_SetDescription( com_logfile, "System console logging:\n"
+		" 0 - disabled\n"
+		" 1 - overwrite mode, buffered\n"
+		" 2 - overwrite mode, synced\n"
+		" 3 - append mode, buffered\n"
+		" 4 - append mode, synced\n" );
+
+	Com_InitJournaling();
+
+	Com_ExecuteCfg();
+
+	// override anything from the config files with command line args
+	Com_StartupVariable( NULL );
+
+	// get dedicated here for proper hunk megs initialization
+#ifdef DEDICATED
+	com_dedicated = Cvar_Get( "dedicated", "1", CVAR_INIT );
+	Cvar_CheckRange( com_dedicated, "1", "2", CV_INTEGER );
+#else
+	com_dedicated = Cvar_Get( "dedicated", "0", CVAR_LATCH );
+	Cvar_CheckRange( com_dedicated, "0", "2", CV_INTEGER );
+#endif
+	Cvar_SetDescription( com_dedicated, "Enables dedicated server mode.\n 0: Listen server\n 1: Unlisted dedicated server \n 2: Listed dedicated server" );
+	// allocate the stack based hunk allocator
+	Com_InitHunkMemory();
+
+	// if any archived cvars are modified after this, we will trigger a writing
+	// of the config file
+	cvar_modifiedFlags &= ~CVAR_ARCHIVE;
+
+	//
+	// init commands and vars
+	//
+#ifndef DEDICATED
+	com_maxfps = Cvar_Get( "com_maxfps", "125", 0 ); // try to force that in some light way
+	Cvar_CheckRange( com_maxfps, "0", "1000", CV_INTEGER );
+	Cvar_SetDescription( com_maxfps, "Sets maximum frames per second." );
+	com_maxfpsUnfocused = Cvar_Get( "com_maxfpsUnfocused", "60", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( com_maxfpsUnfocused, "0", "1000", CV_INTEGER );
+	Cvar_SetDescription( com_maxfpsUnfocused, "Sets maximum frames per second in unfocused game window." );
+	com_yieldCPU = Cvar_Get( "com_yieldCPU", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( com_yieldCPU, "0", "16", CV_INTEGER );
+	Cvar_SetDescription( com_yieldCPU, "Attempt to sleep specified amount of time between rendered frames when game is active, this will greatly reduce CPU load. Use 0 only if you're experiencing some lag." );
+#endif
+	com_frameSpin = Cvar_Get( "com_frameSpin", "500", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( com_frameSpin, "0", "4000", CV_INTEGER );
+	Cvar_SetDescription( com_frameSpin, "Stop sleeping specified amount of microseconds before next frame is due and poll the network until then, trades some CPU time for stable frame intervals." );
+
+#ifdef USE_AFFINITY_MASK
+	com_affinityMask = Cvar_Get( "com_affinityMask", "", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( com_affinityMask, "Bind game process to bitmask-specified CPU core(s), special characters:\n A or a - all default cores\n P or p - performance cores\n E or e - efficiency cores\n 0x<value> - use hexadecimal notation\n + or - can be used to add or exclude particular cores" );
+	com_affinityMask->modified = false;
+#endif
+
+	// com_blood = Cvar_Get( "com_blood", "1", CVAR_ARCHIVE_ND );
+
+	com_timescale = Cvar_Get( "timescale", "1", CVAR_CHEAT | CVAR_SYSTEMINFO );
+	Cvar_CheckRange( com_timescale, "0", NULL, CV_FLOAT );
+	Cvar_SetDescription( com_timescale, "System timing factor:\n < 1: Slows the game down\n = 1: Regular speed\n > 1: Speeds the game up" );
+	com_fixedtime = Cvar_Get( "fixedtime", "0", CVAR_CHEAT );
+	Cvar_SetDescription( com_fixedtime, "Toggle the rendering of every frame the game will wait until each frame is completely rendered before sending the next frame." );
+	com_showtrace = Cvar_Get( "com_showtrace", "0", CVAR_CHEAT );
+	Cvar_SetDescription( com_showtrace, "Debugging tool that prints out trace information." );
+	com_viewlog = Cvar_Get( "viewlog", "0", 0 );
+	Cvar_SetDescription( com_viewlog, "Toggle the display of the startup console window over the game screen." );
+	com_speeds = Cvar_Get( "com_speeds", "0", 0 );
+	Cvar_SetDescription( com_speeds, "Prints speed information per frame to the console. Used for debugging." );
+	com_cameraMode = Cvar_Get( "com_cameraMode", "0", CVAR_CHEAT );
+
+#ifndef DEDICATED
+	com_timedemo = Cvar_Get( "timedemo", "0", 0 );
+	Cvar_CheckRange( com_timedemo, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( com_timedemo, "When set to '1' times a demo and returns frames per second like a benchmark." );
+	cl_paused = Cvar_Get( "cl_paused", "0", CVAR_ROM );
+	Cvar_SetDescription( cl_paused, "Read-only CVAR to toggle functionality of paused games (the variable holds the status of the paused flag on the client side)." );
+	cl_packetdelay = Cvar_Get( "cl_packetdelay", "0", CVAR_CHEAT );
+	Cvar_SetDescription( cl_packetdelay, "Artificially set the client's latency. Simulates packet delay, which can lead to packet loss." );
+	com_cl_running = Cvar_Get( "cl_running", "0", CVAR_ROM | CVAR_NOTABCOMPLETE );
+	Cvar_SetDescription( com_cl_running, "Can be used to check the status of the client game." );
+#endif
+
+	sv_paused = Cvar_Get( "sv_paused", "0", CVAR_ROM );
+	sv_packetdelay = Cvar_Get( "sv_packetdelay", "0", CVAR_CHEAT );
+	Cvar_SetDescription( sv_packetdelay, "Simulates packet delay, which can lead to packet loss. Server side." );
+	com_sv_running = Cvar_Get( "sv_running", "0", CVAR_ROM | CVAR_NOTABCOMPLETE );
+	Cvar_SetDescription( com_sv_running, "Communicates to game modules if there is a server currently running." );
+
+	com_buildScript = Cvar_Get( "com_buildScript", "0", 0 );
+	Cvar_SetDescription( com_buildScript, "Loads all game assets, regardless whether they are required or not." );
+
+	Cvar_Get( "com_errorMessage", "", CVAR_ROM | CVAR_NORESTART );
+
+#ifndef DEDICATED
+	com_introPlayed = Cvar_Get( "com_introplayed", "0", CVAR_ARCHIVE );
+	Cvar_SetDescription( com_introPlayed, "Skips the introduction cinematic." );
+	com_skipIdLogo  = Cvar_Get( "com_skipIdLogo", "0", CVAR_ARCHIVE );
+	Cvar_SetDescription( com_skipIdLogo, "Skip playing Id Software logo cinematic at startup." );
+#endif
+
+	if ( com_dedicated->integer ) {
+		if ( !com_viewlog->integer ) {
+			Cvar_Set( "viewlog", "1" );
 		}
+		gw_minimized = true;
+	} else {
+		gw_minimized = false;
 	}
 
-	return 0;	// never reached
-}
-
-
-/*
-================
-Com_Milliseconds
+	if ( com_developer->integer ) {
+		Cmd_AddCommand( "error", Com_Error_f );
+		Cmd_AddCommand( "crash", Com_Crash_f );
+		Cmd_AddCommand( "freeze", Com_Freeze_f );
+		Cmd_AddCommand( "eventbench", Com_EventBench_f );
+	}
 
-Can be used for profiling, but will be journaled accurately
-================
-*/
-int Com_Milliseconds( void ) {
+	Cmd_AddCommand( "quit", Com_Quit_f );
+	Cmd_AddCommand( "changeVectors", MSG_ReportChangeVectors_f );
+	Cmd_AddCommand( "writeconfig", Com_WriteConfig_f );
+	Cmd_AddCommand( "frametimes", Com_FrameTimes_f );
+	Cmd_AddCommand( "trace", Com_Trace_f );
+	Cmd_AddCommand( "sv_record", Com_ServerRecord_f );
+	Cmd_AddCommand( "sv_stoprecord", Com_ServerStopRecord_f );
+	Cmd_AddCommand( "sv_replay", Com_ServerReplay_f );
+	Cmd_SetCommandCompletionFunc( "writeconfig", Cmd_CompleteWriteCfgName );
+	Cmd_AddCommand( "game_restart", Com_GameRestart_f );
 
-	sysEvent_t	ev;
+	CM_Init();
 
-	// get events and push them until we get a null event with the current time
-	do {
-		ev = Com_GetRealEvent();
-		if ( ev.evType != SE_NONE ) {
-			Com_PushEvent( &ev );
-		}
-	} while ( ev.evType != SE_NONE );
+	s = va( "%s %s %s", Q3_VERSION, PLATFORM_STRING, __DATE__ );
+	com_version = Cvar_Get( "version", s, CVAR_PROTECTED | CVAR_ROM | CVAR_SERVERINFO );
+	Cvar_SetDescription( com_version, "Read-only CVAR to see the version of the game." );
 
-	return ev.evTime;
-}
+	// this cvar is the single entry point of the entire extension system
+	Cvar_Get( "//trap_GetValue", va( "%i", COM_TRAP_GETVALUE ), CVAR_PROTECTED | CVAR_ROM | CVAR_NOTABCOMPLETE );
 
-//============================================================================
+	Sys_Init();
 
-/*
-=============
-Com_Error_f
+	// CPU detection
+	Cvar_Get( "sys_cpustring", "detect", CVAR_PROTECTED | CVAR_ROM | CVAR_NORESTART );
+	if ( !Q_stricmp( Cvar_VariableString( "sys_cpustring" ), "detect" ) ) {
+		char vendor[128];
+		Com_Printf( "...detecting CPU, found " );
+		Sys_GetProcessorId( vendor );
+		Cvar_Set( "sys_cpustring", vendor );
+	}
+	Com_Printf( "%s\n", Cvar_VariableString( "sys_cpustring" ) );
 
-Just throw a fatal error to
-test error shutdown procedures
-=============
-*/
-static void __attribute__((__noreturn__)) Com_Error_f (void) {
-	if ( Cmd_Argc() > 1 ) {
-		Com_Error( ERR_DROP, "Testing drop error" );
-	} else {
-		Com_Error( ERR_FATAL, "Testing fatal error" );
+#ifdef USE_AFFINITY_MASK
+	// get initial process affinity - we will respect it when setting custom affinity masks
+	eCoreMask = pCoreMask = affinityMask = Sys_GetAffinityMask();
+#if (idx64 || id386)
+	DetectCPUCoresConfig();
+#endif
+	if ( com_affinityMask->string[0] != '\0' ) {
+		Com_SetAffinityMask( com_affinityMask->string );
+		com_affinityMask->modified = false;
 	}
-}
+#endif
 
+	// Pick a random port value
+	Com_RandomBytes( (byte*)&qport, sizeof( qport ) );
+	Netchan_Init( qport & 0xffff );
 
-/*
-=============
-Com_Freeze_f
+	VM_Init();
+	SV_Init();
 
-Just freeze in place for a given number of seconds to test
-error recovery
-=============
-*/
-static void Com_Freeze_f( void ) {
-	int		s;
-	int		start, now;
+	com_dedicated->modified = false;
 
-	if ( Cmd_Argc() != 2 ) {
-		Com_Printf( "freeze <seconds>\n" );
-		return;
+#ifndef DEDICATED
+	if ( !com_dedicated->integer ) {
+		CL_Init();
+		// Sys_ShowConsole( com_viewlog->integer, false ); // moved down
 	}
-	s = atoi( Cmd_Argv(1) ) * 1000;
-
-	start = Com_Milliseconds();
+#endif
 
-	while ( 1 ) {
-		now = Com_Milliseconds();
-		if ( now - start > s ) {
-			break;
+	// add + commands from command line
+	if ( !Com_AddStartupCommands() ) {
+		// if the user didn't give any commands, run default action
+		if ( !com_dedicated->integer ) {
+#ifndef DEDICATED
+			if ( !com_skipIdLogo || !com_skipIdLogo->integer )
+				Cbuf_AddText( "cinematic idlogo.RoQ\n" );
+			if( !com_introPlayed->integer ) {
+				Cvar_Set( com_introPlayed->name, "1" );
+				Cvar_Set( "nextmap", "cinematic intro.RoQ" );
+			}
+#endif
 		}
 	}
-}
 
+#ifndef DEDICATED
+	CL_StartHunkUsers();
+#endif
 
-/*
-=================
-Com_Crash_f
+	// set com_frameTime so that if a map is started on the
+	// command line it will still be able to count on com_frameTime
+	// being random enough for a serverid
+	lastTime = com_frameTime = Com_Milliseconds();
 
-A way to force a bus error for development reasons
-=================
-*/
-static void Com_Crash_f( void ) {
-	* ( volatile int * ) 0 = 0x12345678;
+	if ( !com_errorEntered )
+		Sys_ShowConsole( com_viewlog->integer, false );
+
+#ifndef DEDICATED
+	// make sure single player is off by default
+	Cvar_Set( "ui_singlePlayerActive", "0" );
+#endif
+
+	com_fullyInitialized = true;
+
+	Com_Printf( "--- Common Initialization Complete ---\n" );
 }
 
 
-/*
-==================
-Com_ExecuteCfg
+//==================================================================
 
-For controlling environment variables
-==================
-*/
-static void Com_ExecuteCfg( void )
-{
-	Cbuf_ExecuteText(EXEC_NOW, "exec default.cfg\n");
-	Cbuf_Execute(); // Always execute after exec to prevent text buffer overflowing
+static void Com_WriteConfigToFile( const char *filename ) {
+	fileHandle_t	f;
 
-	if (!Com_SafeMode())
-	{
-		// skip the q3config.cfg and autoexec.cfg if "safe" is on the command line
-		Cbuf_ExecuteText(EXEC_NOW, "exec " Q3CONFIG_CFG "\n");
-		Cbuf_Execute();
-		Cbuf_ExecuteText(EXEC_NOW, "exec autoexec.cfg\n");
-		Cbuf_Execute();
+	f = FS_FOpenFileWrite( filename );
+	if ( f == FS_INVALID_HANDLE ) {
+		if ( !FS_ResetReadOnlyAttribute( filename ) || ( f = FS_FOpenFileWrite( filename ) ) == FS_INVALID_HANDLE ) {
+			Com_Printf( "Couldn't write %s.\n", filename );
+			return;
+		}
 	}
+
+	FS_Printf( f, "// generated by quake, do not modify" Q_NEWLINE );
+#ifndef DEDICATED
+	Key_WriteBindings( f );
+#endif
+	Cvar_WriteVariables( f );
+	FS_FCloseFile( f );
 }
 
 
 /*
-==================
-Com_GameRestart
+===============
+Com_WriteConfiguration
 
-Change to a new mod properly with cleaning up cvars before switching.
-==================
+Writes key bindings and archived cvars to config file if modified
+===============
 */
-void Com_GameRestart( int checksumFeed, bool clientRestart )
-{
-	static bool com_gameRestarting = false;
-
-	// make sure no recursion can be triggered
-	if ( !com_gameRestarting && com_fullyInitialized )
-	{
-		com_gameRestarting = true;
+void Com_WriteConfiguration( void ) {
 #ifndef DEDICATED
-		if ( clientRestart )
-		{
-			CL_Disconnect( false );
-			CL_ShutdownAll();
-			CL_ClearMemory(); // Hunk_Clear(); // -EC-
-		}
+	const char *basegame;
+	const char *gamedir;
 #endif
+	// if we are quitting without fully initializing, make sure
+	// we don't write out anything
+	if ( !com_fullyInitialized ) {
+		return;
+	}
 
-		// Kill server if we have one
-		if ( com_sv_running->integer )
-			SV_Shutdown( "Game directory changed" );
+	if ( !(cvar_modifiedFlags & CVAR_ARCHIVE ) ) {
+		return;
+	}
 
-		// Reset console command history
-		Con_ResetHistory();
+	// replayed values are restored when the journal ends
+	if ( com_serverReplay ) {
+		return;
+	}
 
-		// Shutdown FS early so Cvar_Restart will not reset old game cvars
-		FS_Shutdown( true );
+	cvar_modifiedFlags &= ~CVAR_ARCHIVE;
 
-		// Clean out any user and VM created cvars
-		Cvar_Restart( true );
+	Com_WriteConfigToFile( Q3CONFIG_CFG );
 
 #ifndef DEDICATED
-		// Reparse pure paks and update cvars before FS startup
-		if ( CL_GameSwitch() )
-			CL_SystemInfoChanged( false );
+	gamedir = FS_GetCurrentGameDir();
+	basegame = FS_GetBaseGameDir();
+	if ( UI_usesUniqueCDKey() && gamedir[0] && Q_stricmp( basegame, gamedir ) ) {
+		Com_WriteCDKey( gamedir, &cl_cdkey[16] );
+	} else {
+		Com_WriteCDKey( basegame, cl_cdkey );
+	}
 #endif
+}
 
-		FS_Restart( checksumFeed );
 
-		// Load new configuration
-		Com_ExecuteCfg();
+/*
+===============
+Com_WriteConfig_f
 
-#ifndef DEDICATED
-		if ( clientRestart )
-			CL_StartHunkUsers();
-#endif
+Write the config file to a specific name
+===============
+*/
+static void Com_WriteConfig_f( void ) {
+	char	filename[MAX_QPATH];
+	const char *ext;
 
-		com_gameRestarting = false;
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "Usage: writeconfig <filename>\n" );
+		return;
 	}
-}
-
 
-/*
-==================
-Com_GameRestart_f
+	Q_strncpyz( filename, Cmd_Argv(1), sizeof( filename ) );
+	COM_DefaultExtension( filename, sizeof( filename ), ".cfg" );
 
-Expose possibility to change current running mod to the user
-==================
-*/
-static void Com_GameRestart_f( void )
-{
-	Cvar_Set( "fs_game", Cmd_Argv( 1 ) );
+	if ( !FS_AllowedExtension( filename, false, &ext ) ) {
+		Com_Printf( "%s: Invalid filename extension: '%s'.\n", __func__, ext );
+		return;
+	}
 
-	Com_GameRestart( 0, true );
+	Com_Printf( "Writing %s.\n", filename );
+	Com_WriteConfigToFile( filename );
 }
 
 
-// TTimo: centralizing the cl_cdkey stuff after I discovered a buffer overflow problem with the dedicated server version
-//   not sure it's necessary to have different defaults for regular and dedicated, but I don't want to risk it
-//   https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=470
-#ifndef DEDICATED
-char	cl_cdkey[34] = "                                ";
-#else
-char	cl_cdkey[34] = "123456789";
-#endif
-
 /*
-=================
-bool CL_CDKeyValidate
-=================
+================
+Com_ModifyMsec
+================
 */
-bool Com_CDKeyValidate( const char *key, const char *checksum ) {
-#ifdef STANDALONE
-	return true;
-#else
-	char	ch;
-	byte	sum;
-	char	chs[10];
-	int 	i, len;
-
-	len = strlen(key);
-	if( len != CDKEY_LEN ) {
-		return false;
-	}
+static int Com_ModifyMsec( int msec ) {
+	int		clampTime;
 
-	if( checksum && strlen( checksum ) != CDCHKSUM_LEN ) {
-		return false;
+	//
+	// modify time for debugging values
+	//
+	if ( com_fixedtime->integer ) {
+		msec = com_fixedtime->integer;
+	} else if ( com_timescale->value ) {
+		msec *= com_timescale->value;
+	} else if (com_cameraMode->integer) {
+		msec *= com_timescale->value;
 	}
 
-	sum = 0;
-	// for loop gets rid of conditional assignment warning
-	for (i = 0; i < len; i++) {
-		ch = *key++;
-		if (ch>='a' && ch<='z') {
-			ch -= 32;
-		}
-		switch( ch ) {
-		case '2':
-		case '3':
-		case '7':
-		case 'A':
-		case 'B':
-		case 'C':
-		case 'D':
-		case 'G':
-		case 'H':
-		case 'J':
-		case 'L':
-		case 'P':
-		case 'R':
-		case 'S':
-		case 'T':
-		case 'W':
-			sum += ch;
-			continue;
-		default:
-			return false;
-		}
+	// don't let it scale below 1 msec
+	if ( msec < 1 && com_timescale->value) {
+		msec = 1;
 	}
 
-	sprintf(chs, "%02x", sum);
+	if ( com_dedicated->integer ) {
+		// dedicated servers don't want to clamp for a much longer
+		// period, because it would mess up all the client's views
+		// of time.
+		if (com_sv_running->integer && msec > 500)
+			Com_Printf( "Hitch warning: %i msec frame time\n", msec );
 
-	if (checksum && !Q_stricmp(chs, checksum)) {
-		return true;
+		clampTime = 5000;
+	} else
+	if ( !com_sv_running->integer ) {
+		// clients of remote servers do not want to clamp time, because
+		// it would skew their view of the server's time temporarily
+		clampTime = 5000;
+	} else {
+		// for local single player gaming
+		// we may want to clamp the time to prevent players from
+		// flying off edges when something hitches.
+		clampTime = 200;
 	}
 
-	if (!checksum) {
-		return true;
+	if ( msec > clampTime ) {
+		msec = clampTime;
 	}
 
-	return false;
-#endif
+	return msec;
 }
 
 
 /*
-=================
-Com_ReadCDKey
-=================
+==============================================================================
+
+						TIMELINE TRACING
+
+Zones are recorded as begin/end pairs into a ring per thread and written
+out in Chrome trace event format, open it with chrome://tracing or
+ui.perfetto.dev. Zones must be strictly nested within a thread, names
+must be static strings, details are copied.
+
+==============================================================================
 */
-void Com_ReadCDKey( const char *filename ) {
-	fileHandle_t	f;
-	char			buffer[33];
-	char			fbuffer[MAX_OSPATH];
 
-	Com_sprintf( fbuffer, sizeof( fbuffer ), "%s/q3key", filename );
+#define MAX_TRACE_THREADS	16
+#define TRACE_EVENTS		32768	// per thread, must be power of two
+#define TRACE_DETAIL		48
 
-	FS_SV_FOpenFileRead( fbuffer, &f );
-	if ( f == FS_INVALID_HANDLE ) {
-		Q_strncpyz( cl_cdkey, "                ", 17 );
-		return;
-	}
+typedef struct {
+	int64_t		time;			// nanoseconds
+	const char	*name;			// NULL for the end of a zone
+	char		detail[ TRACE_DETAIL ];
+} traceEvent_t;
 
-	Com_Memset( buffer, 0, sizeof( buffer ) );
+typedef struct {
+	traceEvent_t *events;
+	unsigned	count;
+	int			depth;
+	char		name[ 32 ];
+} traceRing_t;
 
-	FS_Read( buffer, 16, f );
-	FS_FCloseFile( f );
+#ifdef _MSC_VER
+#define TRACE_TLS __declspec( thread )
+#else
+#define TRACE_TLS __thread
+#endif
 
-	if ( Com_CDKeyValidate(buffer, NULL) ) {
-		Q_strncpyz( cl_cdkey, buffer, 17 );
-	} else {
-		Q_strncpyz( cl_cdkey, "                ", 17 );
-	}
-}
+int						com_traceActive;
+
+static traceRing_t		traceRings[ MAX_TRACE_THREADS ];
+static volatile int		traceNumRings;
+static volatile int		traceGeneration;
+static int64_t			traceStartTime;
+static int64_t			traceStopTime;
+static int				traceHitchMsec;
+static int				traceHitchDumps;
+static int				traceHitchWritten;
+
+static TRACE_TLS traceRing_t *traceThreadRing;
+static TRACE_TLS int	traceThreadGeneration;
 
 
 /*
 =================
-Com_AppendCDKey
+Com_TraceClaimRing
+
+Threads take a ring on their first zone after tracing was (re)started,
+main thread always gets the first one
 =================
 */
-void Com_AppendCDKey( const char *filename ) {
-	fileHandle_t	f;
-	char			buffer[33];
-	char			fbuffer[MAX_OSPATH];
+static traceRing_t *Com_TraceClaimRing( int index, const char *name )
+{
+	traceRing_t *ring;
 
-	Com_sprintf(fbuffer, sizeof(fbuffer), "%s/q3key", filename);
+	traceThreadGeneration = Sys_AtomicLoad( &traceGeneration );
+	traceThreadRing = NULL;
 
-	FS_SV_FOpenFileRead( fbuffer, &f );
-	if ( f == FS_INVALID_HANDLE ) {
-		Q_strncpyz( &cl_cdkey[16], "                ", 17 );
-		return;
+	if ( index >= MAX_TRACE_THREADS )
+		return NULL;
+
+	ring = &traceRings[ index ];
+	if ( ring->events == NULL ) {
+		// may run on a worker thread so can't use the zone
+		ring->events = malloc( TRACE_EVENTS * sizeof( traceEvent_t ) );
+		if ( ring->events == NULL )
+			return NULL;
 	}
 
-	Com_Memset( buffer, 0, sizeof(buffer) );
+	ring->count = 0;
+	ring->depth = 0;
+	Q_strncpyz( ring->name, name, sizeof( ring->name ) );
 
-	FS_Read( buffer, 16, f );
-	FS_FCloseFile( f );
+	traceThreadRing = ring;
 
-	if ( Com_CDKeyValidate(buffer, NULL)) {
-		strcat( &cl_cdkey[16], buffer );
-	} else {
-		Q_strncpyz( &cl_cdkey[16], "                ", 17 );
-	}
+	return ring;
 }
 
 
-#ifndef DEDICATED // bk001204
 /*
 =================
-Com_WriteCDKey
+Com_TraceBegin
 =================
 */
-static void Com_WriteCDKey( const char *filename, const char *ikey ) {
-	fileHandle_t	f;
-	char			fbuffer[MAX_OSPATH];
-	char			key[17];
-#ifndef _WIN32
-	mode_t			savedumask;
-#endif
-
-	Com_sprintf( fbuffer, sizeof(fbuffer), "%s/q3key", filename );
-
-	Q_strncpyz( key, ikey, 17 );
+void Com_TraceBegin( const char *name, const char *detail )
+{
+	traceRing_t *ring;
+	traceEvent_t *ev;
 
-	if( !Com_CDKeyValidate(key, NULL) ) {
+	if ( !com_traceActive )
 		return;
-	}
 
-#ifndef _WIN32
-	savedumask = umask(0077);
-#endif
-	f = FS_SV_FOpenFileWrite( fbuffer );
-	if ( f == FS_INVALID_HANDLE ) {
-		Com_Printf( "Couldn't write CD key to %s.\n", fbuffer );
-		goto out;
+	ring = traceThreadRing;
+	if ( traceThreadGeneration != Sys_AtomicLoad( &traceGeneration ) ) {
+		char threadName[ 32 ];
+		int index = Sys_AtomicIncrement( &traceNumRings ) - 1;
+		Com_sprintf( threadName, sizeof( threadName ), "thread %i", index );
+		ring = Com_TraceClaimRing( index, threadName );
 	}
 
-	FS_Write( key, 16, f );
+	if ( ring == NULL )
+		return;
 
-	FS_Printf( f, Q_NEWLINE "// generated by quake, do not modify" Q_NEWLINE );
-	FS_Printf( f, "// Do not give this file to ANYONE." Q_NEWLINE );
-	FS_Printf( f, "// id Software and Activision will NOT ask you to send this file to them." Q_NEWLINE );
+	ev = &ring->events[ ring->count & ( TRACE_EVENTS - 1 ) ];
+	ev->time = Sys_Nanoseconds();
+	ev->name = name;
+	if ( detail )
+		Q_strncpyz( ev->detail, detail, sizeof( ev->detail ) );
+	else
+		ev->detail[0] = '\0';
 
-	FS_FCloseFile( f );
-out:
-#ifndef _WIN32
-	umask(savedumask);
-#else
-	;
-#endif
+	ring->count++;
+	ring->depth++;
 }
-#endif
 
 
 /*
-** --------------------------------------------------------------------------------
-**
-** PROCESSOR STUFF
-**
-** --------------------------------------------------------------------------------
+=================
+Com_TraceEnd
+
+Ends without matching begin are dropped, i.e. when
+tracing was started in the middle of a zone
+=================
 */
+void Com_TraceEnd( void )
+{
+	traceRing_t *ring;
+	traceEvent_t *ev;
 
-#ifdef USE_AFFINITY_MASK
-static uint64_t eCoreMask;
-static uint64_t pCoreMask;
-static uint64_t affinityMask; // saved at startup
-#endif
+	ring = traceThreadRing;
+	if ( ring == NULL || ring->depth == 0 || traceThreadGeneration != Sys_AtomicLoad( &traceGeneration ) )
+		return;
 
-#if (idx64 || id386)
+	ev = &ring->events[ ring->count & ( TRACE_EVENTS - 1 ) ];
+	ev->time = Sys_Nanoseconds();
+	ev->name = NULL;
 
-#if defined _MSC_VER
-#include <intrin.h>
-static void CPUID( int func, unsigned int *regs )
-{
-	__cpuid( (int*)regs, func );
+	ring->count++;
+	ring->depth--;
 }
 
-#ifdef USE_AFFINITY_MASK
-#if idx64
-extern void CPUID_EX( int func, int param, unsigned int *regs );
-#else
-void CPUID_EX( int func, int param, unsigned int *regs )
-{
-	__asm {
-		push edi
-		mov eax, func
-		mov ecx, param
-		cpuid
-		mov edi, regs
-		mov [edi +0], eax
-		mov [edi +4], ebx
-		mov [edi +8], ecx
-		mov [edi+12], edx
-		pop edi
+
+/*
+=================
+Com_TraceUnwind
+
+Closes zones left open on the main thread by a longjmp out of the frame
+=================
+*/
+static void Com_TraceUnwind( void )
+{
+	while ( traceThreadRing && traceThreadRing->depth > 0 && com_traceActive ) {
+		Com_TraceEnd();
 	}
 }
-#endif // !idx64
-#endif // USE_AFFINITY_MASK
 
-#else // clang/gcc/mingw
 
-static void CPUID( int func, unsigned int *regs )
+/*
+=================
+Com_TraceStart
+=================
+*/
+static void Com_TraceStart( void )
 {
-	__asm__ __volatile__( "cpuid" :
-		"=a"(regs[0]),
-		"=b"(regs[1]),
-		"=c"(regs[2]),
-		"=d"(regs[3]) :
-		"a"(func) );
+	com_traceActive = 0;
+
+	// force all threads to claim new rings
+	Sys_AtomicIncrement( &traceGeneration );
+	Sys_AtomicStore( &traceNumRings, 1 );
+
+	Com_TraceClaimRing( 0, "main" );
+
+	traceStartTime = Sys_Nanoseconds();
+	traceStopTime = 0;
+	com_traceActive = 1;
 }
 
-#ifdef USE_AFFINITY_MASK
-static void CPUID_EX( int func, int param, unsigned int *regs )
+
+/*
+=================
+Com_TraceStop
+=================
+*/
+static void Com_TraceStop( void )
 {
-	__asm__ __volatile__( "cpuid" :
-		"=a"(regs[0]),
-		"=b"(regs[1]),
-		"=c"(regs[2]),
-		"=d"(regs[3]) :
-		"a"(func),
-		"c"(param) );
+	if ( com_traceActive ) {
+		com_traceActive = 0;
+		traceStopTime = Sys_Nanoseconds();
+	}
 }
-#endif // USE_AFFINITY_MASK
 
-#endif  // clang/gcc/mingw
 
-static void Sys_GetProcessorId( char *vendor )
+static void Com_TraceWriteString( fileHandle_t f, const char *s )
 {
-	uint32_t regs[4]; // EAX, EBX, ECX, EDX
-	uint32_t cpuid_level_ex;
-	char vendor_str[12 + 1]; // short CPU vendor string
-
-	// setup initial features
-#if idx64
-	CPU_Flags |= CPU_SSE | CPU_SSE2 | CPU_FCOM;
-#else
-	CPU_Flags = 0;
-#endif
-	vendor[0] = '\0';
+	char buf[ TRACE_DETAIL * 2 + 1 ], *d;
 
-	CPUID( 0x80000000, regs );
-	cpuid_level_ex = regs[0];
+	for ( d = buf; *s && d < buf + sizeof( buf ) - 2; s++ ) {
+		if ( *s == '"' || *s == '\\' ) {
+			*d++ = '\\';
+		} else if ( *s < ' ' ) {
+			continue;
+		}
+		*d++ = *s;
+	}
+	*d = '\0';
 
-	// get CPUID level & short CPU vendor string
-	CPUID( 0x0, regs );
-	memcpy(vendor_str + 0, (char*)&regs[1], 4);
-	memcpy(vendor_str + 4, (char*)&regs[3], 4);
-	memcpy(vendor_str + 8, (char*)&regs[2], 4);
-	vendor_str[12] = '\0';
+	FS_Printf( f, "\"%s\"", buf );
+}
 
-	// get CPU feature bits
-	CPUID( 0x1, regs );
 
-	// bit 15 of EDX denotes CMOV/FCMOV/FCOMI existence
-	if ( regs[3] & ( 1 << 15 ) )
-		CPU_Flags |= CPU_FCOM;
+/*
+=================
+Com_TraceWrite
 
-	// bit 23 of EDX denotes MMX existence
-	if ( regs[3] & ( 1 << 23 ) )
-		CPU_Flags |= CPU_MMX;
+Writes recorded zones in Chrome trace event format.
+Ends whose begin was overwritten in the ring are skipped,
+zones still open are closed at the end of the trace
+=================
+*/
+static void Com_TraceWrite( const char *filename )
+{
+	const traceRing_t *ring;
+	const traceEvent_t *ev;
+	fileHandle_t f;
+	int64_t endTime;
+	unsigned first, n;
+	int numRings, numEvents;
+	int tid, depth;
 
-	// bit 25 of EDX denotes SSE existence
-	if ( regs[3] & ( 1 << 25 ) )
-		CPU_Flags |= CPU_SSE;
+	f = FS_FOpenFileWrite( filename );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open %s\n", filename );
+		return;
+	}
 
-	// bit 26 of EDX denotes SSE2 existence
-	if ( regs[3] & ( 1 << 26 ) )
-		CPU_Flags |= CPU_SSE2;
+	endTime = traceStopTime ? traceStopTime : Sys_Nanoseconds();
+	numRings = MIN( Sys_AtomicLoad( &traceNumRings ), MAX_TRACE_THREADS );
+	numEvents = 0;
 
-	// bit 0 of ECX denotes SSE3 existence
-	//if ( regs[2] & ( 1 << 0 ) )
-	//	CPU_Flags |= CPU_SSE3;
+	FS_Printf( f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	FS_Printf( f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"%s\"}}", Q3_VERSION );
 
-	// bit 19 of ECX denotes SSE41 existence
-	if ( regs[ 2 ] & ( 1 << 19 ) )
-		CPU_Flags |= CPU_SSE41;
+	for ( tid = 0; tid < numRings; tid++ ) {
+		ring = &traceRings[ tid ];
+		if ( ring->events == NULL || ring->count == 0 )
+			continue;
 
-	if ( vendor ) {
-		if ( cpuid_level_ex >= 0x80000004 ) {
-			// read CPU Brand string
-			uint32_t i;
-			for ( i = 0x80000002; i <= 0x80000004; i++) {
-				CPUID( i, regs );
-				memcpy( vendor+0, (char*)&regs[0], 4 );
-				memcpy( vendor+4, (char*)&regs[1], 4 );
-				memcpy( vendor+8, (char*)&regs[2], 4 );
-				memcpy( vendor+12, (char*)&regs[3], 4 );
-				vendor[16] = '\0';
-				vendor += strlen( vendor );
-			}
-		} else {
-			const int print_flags = CPU_Flags;
-			vendor = Q_stradd( vendor, vendor_str );
-			if (print_flags) {
-				// print features
-				strcat(vendor, " w/");
-				if (print_flags & CPU_FCOM)
-					strcat(vendor, " CMOV");
-				if (print_flags & CPU_MMX)
-					strcat(vendor, " MMX");
-				if (print_flags & CPU_SSE)
-					strcat(vendor, " SSE");
-				if (print_flags & CPU_SSE2)
-					strcat(vendor, " SSE2");
-				//if ( CPU_Flags & CPU_SSE3 )
-				//	strcat( vendor, " SSE3" );
-				if (print_flags & CPU_SSE41)
-					strcat(vendor, " SSE4.1");
+		FS_Printf( f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}", tid, ring->name );
+		FS_Printf( f, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"sort_index\":%i}}", tid, tid );
+
+		first = ring->count > TRACE_EVENTS ? ring->count - TRACE_EVENTS : 0;
+		depth = 0;
+
+		for ( n = first; n != ring->count; n++ ) {
+			ev = &ring->events[ n & ( TRACE_EVENTS - 1 ) ];
+			if ( ev->name ) {
+				FS_Printf( f, ",\n{\"name\":\"%s\",\"ph\":\"B\",\"pid\":1,\"tid\":%i,\"ts\":%.3f", ev->name, tid,
+					( ev->time - traceStartTime ) / 1000.0 );
+				if ( ev->detail[0] ) {
+					FS_Printf( f, ",\"args\":{\"detail\":" );
+					Com_TraceWriteString( f, ev->detail );
+					FS_Printf( f, "}" );
+				}
+				FS_Printf( f, "}" );
+				depth++;
+			} else {
+				if ( depth == 0 )
+					continue;
+				FS_Printf( f, ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":%i,\"ts\":%.3f}", tid, ( ev->time - traceStartTime ) / 1000.0 );
+				depth--;
 			}
+			numEvents++;
+		}
+
+		while ( depth-- > 0 ) {
+			FS_Printf( f, ",\n{\"ph\":\"E\",\"pid\":1,\"tid\":%i,\"ts\":%.3f}", tid, ( endTime - traceStartTime ) / 1000.0 );
 		}
 	}
+
+	FS_Printf( f, "\n]}\n" );
+	FS_FCloseFile( f );
+
+	Com_Printf( "Wrote %i trace events from %i threads to %s\n", numEvents, numRings, filename );
 }
 
 
-#ifdef USE_AFFINITY_MASK
-static void DetectCPUCoresConfig( void )
+/*
+=================
+Com_TraceFrameEnd
+
+In hitch mode writes the trace out and starts over when
+a frame took too long, otherwise just keeps recording
+=================
+*/
+static void Com_TraceFrameEnd( int64_t frameStart )
 {
-	uint32_t regs[4];
-	uint32_t i;
+	char filename[ MAX_QPATH ];
 
-	// get highest function parameter and vendor id
-	CPUID( 0x0, regs );
-	if ( regs[1] != 0x756E6547 || regs[2] != 0x6C65746E || regs[3] != 0x49656E69 || regs[0] < 0x1A ) {
-		// non-intel signature or too low cpuid level - unsupported
-		eCoreMask = pCoreMask = affinityMask;
+	// zero if tracing was started during this frame
+	if ( !com_traceActive || traceHitchMsec <= 0 || frameStart == 0 )
 		return;
-	}
 
-	eCoreMask = 0;
-	pCoreMask = 0;
+	if ( Sys_Nanoseconds() - frameStart < traceHitchMsec * 1000000LL )
+		return;
 
-	for ( i = 0; i < sizeof( affinityMask ) * 8; i++ ) {
-		const uint64_t mask = 1ULL << i;
-		if ( (mask & affinityMask) && Sys_SetAffinityMask( mask ) ) {
-			CPUID_EX( 0x1A, 0x0, regs );
-			switch ( (regs[0] >> 24) & 0xFF ) {
-				case 0x20: eCoreMask |= mask; break;
-				case 0x40: pCoreMask |= mask; break;
-				default: // non-existing leaf
-					eCoreMask = pCoreMask = 0;
-					break;
-			}
-		}
-	}
+	Com_TraceStop();
 
-	// restore original affinity
-	Sys_SetAffinityMask( affinityMask );
+	Com_sprintf( filename, sizeof( filename ), "trace-hitch-%03i.json", traceHitchWritten++ );
+	Com_Printf( "Frame %i took %.1f msec, ", com_frameNumber, ( traceStopTime - frameStart ) / 1000000.0 );
+	Com_TraceWrite( filename );
 
-	if ( pCoreMask == 0 || eCoreMask == 0 ) {
-		// if either mask is empty - assume non-hybrid configuration
-		eCoreMask = pCoreMask = affinityMask;
+	if ( --traceHitchDumps > 0 ) {
+		Com_TraceStart();
+	} else {
+		traceHitchMsec = 0;
 	}
 }
-#endif // USE_AFFINITY_MASK
-
-#else // non-x86
 
-#ifndef __linux__
 
-static void Sys_GetProcessorId( char *vendor )
+/*
+=================
+Com_Trace_f
+=================
+*/
+static void Com_Trace_f( void )
 {
-	Com_sprintf( vendor, 100, "%s", ARCH_STRING );
+	const char *cmd = Cmd_Argv( 1 );
+	char filename[ MAX_QPATH ];
+
+	if ( !Q_stricmp( cmd, "start" ) ) {
+		traceHitchMsec = 0;
+		Com_TraceStart();
+		Com_Printf( "Tracing started.\n" );
+	} else if ( !Q_stricmp( cmd, "stop" ) ) {
+		Com_TraceStop();
+		traceHitchMsec = 0;
+		Com_Printf( "Tracing stopped.\n" );
+	} else if ( !Q_stricmp( cmd, "dump" ) ) {
+		if ( traceStartTime == 0 ) {
+			Com_Printf( "Tracing has not been started.\n" );
+			return;
+		}
+		Com_TraceStop();
+		traceHitchMsec = 0;
+		Q_strncpyz( filename, Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : "trace", sizeof( filename ) );
+		COM_DefaultExtension( filename, sizeof( filename ), ".json" );
+		Com_TraceWrite( filename );
+	} else if ( !Q_stricmp( cmd, "hitch" ) && atoi( Cmd_Argv( 2 ) ) > 0 ) {
+		traceHitchMsec = atoi( Cmd_Argv( 2 ) );
+		traceHitchDumps = Cmd_Argc() > 3 ? MAX( atoi( Cmd_Argv( 3 ) ), 1 ) : 1;
+		traceHitchWritten = 0;
+		Com_TraceStart();
+		Com_Printf( "Tracing until %i frame(s) take %i msec or longer.\n", traceHitchDumps, traceHitchMsec );
+	} else {
+		Com_Printf( "usage: trace <start|stop|dump [filename]|hitch <msec> [count]>\n" );
+		if ( com_traceActive ) {
+			Com_Printf( "Tracing is active%s.\n", traceHitchMsec ? va( ", waiting for a %i msec frame", traceHitchMsec ) : "" );
+		}
+	}
 }
 
-#else // __linux__
 
-#include <sys/auxv.h>
+/*
+==============================================================================
 
-#if arm32
-#include <asm/hwcap.h>
-#endif
+						SERVER JOURNAL
 
-static void Sys_GetProcessorId( char *vendor )
-{
-#if arm32
-	const char *platform;
-	long hwcaps;
-	CPU_Flags = 0;
+"sv_record <name>" arms recording of a dedicated server session to
+journals/<name>.svj, it starts with the next map load and runs until
+"sv_stoprecord". Header keeps the map and frame time it was loaded at,
+variables that differ from defaults follow (except private ones and
+passwords), then inbound packets with arrival time, console commands,
+frame times and random seeds in the order server consumed them.
 
-	platform = (const char*)getauxval( AT_PLATFORM );
+"sv_replay <name> [quit]" loads the map again and feeds the recorded
+input frame by frame as fast as possible. Nothing is sent to the network
+and rate control runs on recorded time. Phases of each frame are measured
+with timeline zones and reported at the end of the journal. Variables
+set from the journal get their previous values back when replay ends.
 
-	if ( !platform || *platform == '\0' ) {
-		platform = "(unknown)";
-	}
+Challenges are not verified during replay as secret key is not recorded.
+Journal is written in native byte order.
 
-	if ( platform[0] == 'v' || platform[0] == 'V' ) {
-		if ( atoi( platform + 1 ) >= 7 ) {
-			CPU_Flags |= CPU_ARMv7;
-		}
-	}
+==============================================================================
+*/
 
-	Com_sprintf( vendor, 100, "ARM %s", platform );
-	hwcaps = getauxval( AT_HWCAP );
-	if ( hwcaps & ( HWCAP_IDIVA | HWCAP_VFPv3 ) ) {
-		strcat( vendor, " /w" );
+#define SVJ_IDENT			(('J'<<24)+('V'<<16)+('S'<<8)+'Q')
+#define SVJ_VERSION			1
 
-		if ( hwcaps & HWCAP_IDIVA ) {
-			CPU_Flags |= CPU_IDIVA;
-			strcat( vendor, " IDIVA" );
-		}
+#define SVJ_DIR				"journals"
+#define SVJ_EXT				".svj"
 
-		if ( hwcaps & HWCAP_VFPv3 ) {
-			CPU_Flags |= CPU_VFPv3;
-			strcat( vendor, " VFPv3" );
-		}
+#define MAX_REPLAY_DEPTH	64
 
-		if ( ( CPU_Flags & ( CPU_ARMv7 | CPU_VFPv3 ) ) == ( CPU_ARMv7 | CPU_VFPv3 ) ) {
-			strcat( vendor, " QVM-bytecode" );
-		}
+typedef enum {
+	SVJ_CVAR,			// name and value, zero-terminated
+	SVJ_SEED,			// int
+	SVJ_PACKET,			// svjPacket_t followed by message data
+	SVJ_COMMAND,		// console text
+	SVJ_FRAME			// int event time
+} svjRecordType_t;
+
+typedef enum {
+	SVJ_IDLE,
+	SVJ_ARMED,			// waiting for map load
+	SVJ_RECORDING,
+	SVJ_REPLAYING
+} svjState_t;
+
+typedef struct {
+	int		ident;
+	int		version;
+	int		frameTime;		// event time of the frame that loaded the map
+	int		lastTime;		// and of the previous one
+	int		killBots;
+	char	mapname[MAX_QPATH];
+} svjHeader_t;
+
+typedef struct {
+	netadr_t	from;
+	int			time;		// Sys_Milliseconds() on arrival
+} svjPacket_t;
+
+// value of a variable before replay changed it
+typedef struct svjSavedCvar_s {
+	struct svjSavedCvar_s *next;
+	char		*name;
+	char		*value;		// NULL if it didn't exist
+} svjSavedCvar_t;
+
+// zones reported by replay, inclusive times
+static const char *const svj_replayPhases[] = {
+	"Com_Frame",
+	"SV_PacketEvent",
+	"Cbuf_Execute",
+	"SV_Frame",
+	"SV_CalcPings",
+	"SV_BotFrame",
+	"GAME_RUN_FRAME",
+	"SV_SendClientMessages",
+	"qagame"
+};
+
+#define REPLAY_PHASES ARRAY_LEN( svj_replayPhases )
+
+typedef struct {
+	svjState_t		state;
+	fileHandle_t	file;
+	char			name[MAX_QPATH];
+
+	int				frames;
+	int				packets;
+	int				bytes;
+
+	// replay
+	svjHeader_t		header;
+	int				type;			// last record read
+	int				length;
+	bool			pending;		// read but not consumed yet
+	byte			data[ sizeof( svjPacket_t ) + MAX_MSGLEN + 1 ];
+
+	bool			loadMap;
+	int				clock;			// recorded Sys_Milliseconds()
+	int				lastFrameTime;
+	int				mismatches;
+	bool			quit;
+
+	int64_t			startTime;
+	unsigned		traceFirst;
+	bool			skipFrame;
+	int				*samples;		// REPLAY_PHASES per frame, usec
+	int				numSamples;
+	int				maxSamples;
+	int				lostSamples;
+	svjSavedCvar_t	*savedCvars;
+} serverJournal_t;
+
+bool					com_serverReplay;
+
+static serverJournal_t	svj = { SVJ_IDLE, FS_INVALID_HANDLE };
+
+
+/*
+===============================================================================
+
+RECORDING
+
+===============================================================================
+*/
+
+/*
+=================
+Com_WriteJournalRecord
+=================
+*/
+static void Com_WriteJournalRecord( svjRecordType_t type, const void *head, int headLength, const void *data, int dataLength )
+{
+	int header[2];
+
+	header[0] = type;
+	header[1] = headLength + dataLength;
+
+	if ( FS_Write( header, sizeof( header ), svj.file ) != sizeof( header )
+		|| FS_Write( head, headLength, svj.file ) != headLength
+		|| ( dataLength > 0 && FS_Write( data, dataLength, svj.file ) != dataLength ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to write server journal, stopped recording\n" );
+		Com_StopServerJournal();
 	}
-#else // !arm32
-	CPU_Flags = 0;
-#if arm64
-	Com_sprintf( vendor, 100, "%s", ARCH_STRING );
-#else
-	Com_sprintf( vendor, 128, "%s %s", ARCH_STRING, (const char*)getauxval( AT_PLATFORM ) );
-#endif
-#endif // !arm32
 }
 
-#endif // __linux__
 
-#endif // non-x86
+/*
+=================
+Com_RecordCvar
+=================
+*/
+static void Com_RecordCvar( const char *name, const char *value )
+{
+	// journals get shared to reproduce problems, keep secrets out
+	if ( Q_stristr( name, "password" ) ) {
+		return;
+	}
+
+	Com_WriteJournalRecord( SVJ_CVAR, name, strlen( name ) + 1, value, strlen( value ) + 1 );
+}
+
 
 /*
-================
-Sys_SnapVector
-================
+=================
+Com_ServerJournalSpawn
+
+Called on start of every map load, begins armed recording
+=================
 */
-#ifdef _MSC_VER
-#if idx64
-void Sys_SnapVector( float *vector )
+void Com_ServerJournalSpawn( const char *mapname, bool killBots )
 {
-	__m128 vf0, vf1, vf2;
-	__m128i vi;
-	DWORD mxcsr;
+	svjHeader_t header;
 
-	mxcsr = _mm_getcsr();
-	vf0 = _mm_setr_ps( vector[0], vector[1], vector[2], 0.0f );
+	if ( svj.state != SVJ_ARMED )
+		return;
 
-	_mm_setcsr( mxcsr & ~0x6000 ); // enforce rounding mode to "round to nearest"
+	svj.file = FS_FOpenFileWrite( svj.name );
+	if ( svj.file == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open %s\n", svj.name );
+		svj.state = SVJ_IDLE;
+		return;
+	}
 
-	vi = _mm_cvtps_epi32( vf0 );
-	vf0 = _mm_cvtepi32_ps( vi );
+	Com_Memset( &header, 0, sizeof( header ) );
+	header.ident = SVJ_IDENT;
+	header.version = SVJ_VERSION;
+	header.frameTime = com_frameTime;
+	header.lastTime = lastTime;
+	header.killBots = killBots;
+	Q_strncpyz( header.mapname, mapname, sizeof( header.mapname ) );
+	FS_Write( &header, sizeof( header ), svj.file );
 
-	vf1 = _mm_shuffle_ps(vf0, vf0, _MM_SHUFFLE(1,1,1,1));
-	vf2 = _mm_shuffle_ps(vf0, vf0, _MM_SHUFFLE(2,2,2,2));
+	svj.state = SVJ_RECORDING;
+	svj.frames = 0;
+	svj.packets = 0;
+	svj.bytes = 0;
 
-	_mm_setcsr( mxcsr ); // restore rounding mode
+	Cvar_ForEachModified( Com_RecordCvar );
 
-	_mm_store_ss( &vector[0], vf0 );
-	_mm_store_ss( &vector[1], vf1 );
-	_mm_store_ss( &vector[2], vf2 );
+	Com_Printf( "Recording server journal of %s to %s.\n", mapname, svj.name );
 }
-#endif // idx64
 
-#if id386
-void Sys_SnapVector( float *vector )
+
+/*
+=================
+Com_RecordPacket
+=================
+*/
+static void Com_RecordPacket( const netadr_t *from, const msg_t *msg )
 {
-	static const DWORD cw037F = 0x037F;
-	DWORD cwCurr;
-__asm {
-	fnstcw word ptr [cwCurr]
-	mov ecx, vector
-	fldcw word ptr [cw037F]
+	svjPacket_t packet;
 
-	fld   dword ptr[ecx+8]
-	fistp dword ptr[ecx+8]
-	fild  dword ptr[ecx+8]
-	fstp  dword ptr[ecx+8]
+	if ( svj.state != SVJ_RECORDING )
+		return;
 
-	fld   dword ptr[ecx+4]
-	fistp dword ptr[ecx+4]
-	fild  dword ptr[ecx+4]
-	fstp  dword ptr[ecx+4]
+	Com_Memset( &packet, 0, sizeof( packet ) );
+	packet.from = *from;
+	packet.time = Sys_Milliseconds();
 
-	fld   dword ptr[ecx+0]
-	fistp dword ptr[ecx+0]
-	fild  dword ptr[ecx+0]
-	fstp  dword ptr[ecx+0]
+	svj.packets++;
+	svj.bytes += msg->cursize;
 
-	fldcw word ptr cwCurr
-	}; // __asm
+	Com_WriteJournalRecord( SVJ_PACKET, &packet, sizeof( packet ), msg->data, msg->cursize );
 }
-#endif // id386
 
-#if arm64
-void Sys_SnapVector( float *vector )
+
+/*
+=================
+Com_RecordCommand
+=================
+*/
+static void Com_RecordCommand( const char *text )
 {
-	vector[0] = rint( vector[0] );
-	vector[1] = rint( vector[1] );
-	vector[2] = rint( vector[2] );
+	if ( svj.state == SVJ_RECORDING ) {
+		Com_WriteJournalRecord( SVJ_COMMAND, text, strlen( text ) + 1, NULL, 0 );
+	}
 }
-#endif
-
-#else // clang/gcc/mingw
 
-#if id386
 
-#define QROUNDX87(src) \
-	"flds " src "\n" \
-	"fistpl " src "\n" \
-	"fildl " src "\n" \
-	"fstps " src "\n"
+/*
+=================
+Com_RecordFrame
 
-void Sys_SnapVector( float *vector )
+Written before command buffer is executed, so seeds
+of a map load always follow the frame it happens in
+=================
+*/
+static void Com_RecordFrame( int frameTime )
 {
-	static const unsigned short cw037F = 0x037F;
-	unsigned short cwCurr;
-
-	__asm__ volatile
-	(
-		"fnstcw %1\n" \
-		"fldcw %2\n" \
-		QROUNDX87("0(%0)")
-		QROUNDX87("4(%0)")
-		QROUNDX87("8(%0)")
-		"fldcw %1\n" \
-		:
-		: "r" (vector), "m"(cwCurr), "m"(cw037F)
-		: "memory", "st"
-	);
+	if ( svj.state == SVJ_RECORDING ) {
+		svj.frames++;
+		Com_WriteJournalRecord( SVJ_FRAME, &frameTime, sizeof( frameTime ), NULL, 0 );
+	}
 }
 
-#else // idx64, non-x86
 
-void Sys_SnapVector( float *vector )
-{
-	vector[0] = rint( vector[0] );
-	vector[1] = rint( vector[1] );
-	vector[2] = rint( vector[2] );
-}
+/*
+===============================================================================
 
-#endif
+REPLAY
 
-#endif // clang/gcc/mingw
+===============================================================================
+*/
 
-#ifdef USE_AFFINITY_MASK
+/*
+=================
+Com_ReadJournalRecord
 
-static int hex_code( const int code ) {
-	if ( code >= '0' && code <= '9' ) {
-		return code - '0';
-	}
-	if ( code >= 'A' && code <= 'F' ) {
-		return code - 'A' + 10;
+Returns false at the end of the journal
+=================
+*/
+static bool Com_ReadJournalRecord( void )
+{
+	int header[2];
+
+	if ( svj.pending ) {
+		svj.pending = false;
+		return true;
 	}
-	if ( code >= 'a' && code <= 'f' ) {
-		return code - 'a' + 10;
+
+	if ( FS_Read( header, sizeof( header ), svj.file ) != sizeof( header ) )
+		return false;
+
+	if ( header[1] < 0 || header[1] >= (int)sizeof( svj.data ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: bad record size %i in %s\n", header[1], svj.name );
+		return false;
 	}
-	return -1;
+
+	if ( header[1] > 0 && FS_Read( svj.data, header[1], svj.file ) != header[1] )
+		return false;
+
+	svj.type = header[0];
+	svj.length = header[1];
+	svj.data[ svj.length ] = '\0';
+
+	return true;
 }
 
 
-static const char *parseAffinityMask( const char *str, uint64_t *outv, int level ) {
-	uint64_t v, mask = 0;
+/*
+=================
+Com_ServerJournalMilliseconds
 
-	while ( *str != '\0' ) {
-		if ( *str == 'A' || *str == 'a' ) {
-			mask = affinityMask;
-			++str;
-			continue;
-		}
-		else if ( *str == 'P' || *str == 'p' ) {
-			mask = pCoreMask;
-			++str;
-			continue;
-		}
-		else if ( *str == 'E' || *str == 'e' ) {
-			mask = eCoreMask;
-			++str;
-			continue;
-		}
-		else if ( *str == '0' && (str[1] == 'x' || str[1] == 'X') && (v = hex_code( str[2] )) >= 0 ) {
-			int hex;
-			str += 3; // 0xH
-			while ( (hex = hex_code( *str )) >= 0 ) {
-				v = v * 16 + hex;
-				str++;
-			}
-			mask = v;
-			continue;
-		}
-		else if ( *str >= '0' && *str <= '9' ) {
-			mask = *str++ - '0';
-			while ( *str >= '0' && *str <= '9' ) {
-				mask = mask * 10 + *str - '0';
-				++str;
-			}
-			continue;
-		}
+Sys_Milliseconds() as it was when the server handled
+replayed input, used for network rate control
+=================
+*/
+int Com_ServerJournalMilliseconds( void )
+{
+	return svj.clock;
+}
 
-		if ( level == 0 ) {
-			while ( *str == '+' || *str == '-' ) {
-				str = parseAffinityMask( str + 1, &v, level + 1 );
-				switch ( *str ) {
-					case '+': mask |= v; break;
-					case '-': mask &= ~v; break;
-					default: str = ""; break;
-				}
-			}
-			if ( *str != '\0' ) {
-				++str; // skip unknown characters
-			}
+
+/*
+=================
+Com_ServerJournalSeed
+
+Records random seed or returns the recorded one on replay
+=================
+*/
+int Com_ServerJournalSeed( int seed )
+{
+	if ( svj.state == SVJ_RECORDING ) {
+		Com_WriteJournalRecord( SVJ_SEED, &seed, sizeof( seed ), NULL, 0 );
+	} else if ( svj.state == SVJ_REPLAYING ) {
+		if ( !Com_ReadJournalRecord() ) {
+			svj.mismatches++;
+		} else if ( svj.type != SVJ_SEED ) {
+			svj.pending = true;
+			svj.mismatches++;
 		} else {
-			break;
+			memcpy( &seed, svj.data, sizeof( seed ) );
 		}
 	}
 
-	*outv = mask;
-	return str;
+	return seed;
 }
 
 
-// parse and set affinity mask
-static void Com_SetAffinityMask( const char *str )
+/*
+=================
+Com_ReplaySetCvar
+
+Sets recorded value, the previous one is kept for Com_ReplayRestoreCvars
+=================
+*/
+static void Com_ReplaySetCvar( const char *name, const char *value )
 {
-	uint64_t mask = 0;
+	svjSavedCvar_t *saved;
 
-	parseAffinityMask( str, &mask, 0 );
+	for ( saved = svj.savedCvars; saved; saved = saved->next ) {
+		if ( !Q_stricmp( saved->name, name ) ) {
+			break;
+		}
+	}
 
-	if ( ( mask & affinityMask ) == 0 ) {
-		mask = affinityMask; // reset to default
+	if ( !saved ) {
+		saved = Z_Malloc( sizeof( *saved ) );
+		saved->name = CopyString( name );
+		saved->value = ( Cvar_Flags( name ) & CVAR_NONEXISTENT ) ? NULL : CopyString( Cvar_VariableString( name ) );
+		saved->next = svj.savedCvars;
+		svj.savedCvars = saved;
 	}
 
-	if ( mask != 0 ) {
-		Sys_SetAffinityMask( mask );
+	if ( Cvar_Flags( name ) & CVAR_NONEXISTENT ) {
+		// like the set command, so code registering it later takes over
+		Cvar_Get( name, value, CVAR_USER_CREATED );
+	} else {
+		Cvar_Set2( name, value, true );
 	}
 }
-#endif // USE_AFFINITY_MASK
 
 
 /*
 =================
-Com_Init
+Com_ReplayRestoreCvars
+
+Undoes variables set by Com_ReplayStart
 =================
 */
-void Com_Init( char *commandLine ) {
-	const char *s;
-	int	qport;
+static void Com_ReplayRestoreCvars( void )
+{
+	svjSavedCvar_t *saved;
 
-	Com_Printf( "%s %s %s\n", SVN_VERSION, PLATFORM_STRING, __DATE__ );
+	while ( ( saved = svj.savedCvars ) != NULL ) {
+		svj.savedCvars = saved->next;
 
-	if ( Q_setjmp( abortframe ) ) {
-		Sys_Error ("Error during initialization");
+		if ( saved->value ) {
+			Cvar_Set2( saved->name, saved->value, true );
+			Z_Free( saved->value );
+		} else if ( Cvar_Flags( saved->name ) & CVAR_USER_CREATED ) {
+			Cvar_Set2( saved->name, "", true );
+		} else {
+			// registered by code during replay
+			Cvar_ForceReset( saved->name );
+		}
+
+		Z_Free( saved->name );
+		Z_Free( saved );
+	}
+}
+
+
+/*
+=================
+Com_ReplayStart
+
+Restores variables and loads the recorded map
+=================
+*/
+static int Com_ReplayStart( void )
+{
+	const char *name, *value;
+
+	while ( Com_ReadJournalRecord() ) {
+		if ( svj.type != SVJ_CVAR ) {
+			svj.pending = true;
+			break;
+		}
+		name = (const char *)svj.data;
+		value = name + strlen( name ) + 1;
+		if ( value - name < svj.length ) {
+			Com_ReplaySetCvar( name, value );
+		}
 	}
 
-	// bk001129 - do this before anything else decides to push events
-	Com_InitPushEvent();
+	lastTime = svj.header.lastTime;
+	com_frameTime = svj.header.frameTime;
+	svj.clock = com_frameTime;
+	svj.lastFrameTime = com_frameTime;
+
+	SV_SpawnServer( svj.header.mapname, svj.header.killBots );
+
+	// map load is not counted as frame time
+	svj.skipFrame = true;
+	svj.startTime = Sys_Microseconds();
+
+	return com_frameTime;
+}
+
+
+/*
+=================
+Com_ReplayFrame
+
+Feeds recorded input of the next frame to the server,
+returns its event time
+=================
+*/
+static int Com_ReplayFrame( void )
+{
+	static byte bufData[ MAX_MSGLEN_BUF ];
+	svjPacket_t packet;
+	msg_t buf;
+	int frameTime;
 
-	Com_InitSmallZoneMemory();
-	Cvar_Init();
+	if ( svj.loadMap ) {
+		svj.loadMap = false;
+		return Com_ReplayStart();
+	}
 
-#if defined(_WIN32) && defined(_DEBUG)
-	com_noErrorInterrupt = Cvar_Get( "com_noErrorInterrupt", "0", 0 );
-#endif
+	// fragments left from the last frame
+	if ( com_sv_running->integer ) {
+		SV_SendQueuedPackets();
+	}
 
-#ifdef DEFAULT_GAME
-	Cvar_Set( "fs_game", DEFAULT_GAME );
-#endif
+	while ( Com_ReadJournalRecord() ) {
+		switch ( svj.type ) {
+		case SVJ_PACKET:
+			if ( svj.length < (int)sizeof( packet ) )
+				break;
+			memcpy( &packet, svj.data, sizeof( packet ) );
+			MSG_Init( &buf, bufData, MAX_MSGLEN );
+			buf.cursize = svj.length - sizeof( packet );
+			memcpy( bufData, svj.data + sizeof( packet ), buf.cursize );
+			svj.clock = packet.time;
+			svj.packets++;
+			svj.bytes += buf.cursize;
+			if ( com_sv_running->integer ) {
+				Com_RunAndTimeServerPacket( &packet.from, &buf );
+			}
+			break;
+		case SVJ_COMMAND:
+			Cbuf_AddText( (char *)svj.data );
+			Cbuf_AddText( "\n" );
+			break;
+		case SVJ_FRAME:
+			memcpy( &frameTime, svj.data, sizeof( frameTime ) );
+			svj.clock = frameTime;
+			svj.lastFrameTime = frameTime;
+			svj.frames++;
+			return frameTime;
+		default:
+			// seed that replay didn't ask for
+			svj.mismatches++;
+			break;
+		}
+	}
 
-	// prepare enough of the subsystems to handle
-	// cvar and command buffer management
-	Com_ParseCommandLine( commandLine );
+	Com_StopServerJournal();
 
-//	Swap_Init ();
-	Cbuf_Init();
+	return Com_Milliseconds();
+}
 
-	// override anything from the config files with command line args
-	Com_StartupVariable( NULL );
 
-	Com_InitZoneMemory();
-	Cmd_Init();
+/*
+=================
+Com_ReplayFrameEnd
 
-	// get the developer cvar set as early as possible
-	Com_StartupVariable( "developer" );
-	com_developer = Cvar_Get( "developer", "0", CVAR_TEMP );
-	Cvar_CheckRange( com_developer, NULL, NULL, CV_INTEGER );
+Sums recorded zones of the frame per phase
+=================
+*/
+static void Com_ReplayFrameEnd( void )
+{
+	const traceRing_t *ring = &traceRings[ 0 ];
+	const traceEvent_t *ev;
+	const char *zones[ MAX_REPLAY_DEPTH ];
+	int64_t starts[ MAX_REPLAY_DEPTH ];
+	int64_t sums[ REPLAY_PHASES ];
+	unsigned first, n;
+	int depth, i, j;
+	int *sample;
+
+	if ( svj.state != SVJ_REPLAYING )
+		return;
 
-	Com_StartupVariable( "vm_rtChecks" );
-	vm_rtChecks = Cvar_Get( "vm_rtChecks", "15", CVAR_INIT | CVAR_PROTECTED );
-	Cvar_CheckRange( vm_rtChecks, "0", "15", CV_INTEGER );
-	Cvar_SetDescription( vm_rtChecks,
-		"Runtime checks in compiled vm code, bitmask:\n 1 - program stack overflow\n" \
-		" 2 - opcode stack overflow\n 4 - jump target range\n 8 - data read/write range" );
+	first = svj.traceFirst;
+	svj.traceFirst = ring->count;
 
-	Com_StartupVariable( "journal" );
-	com_journal = Cvar_Get( "journal", "0", CVAR_INIT | CVAR_PROTECTED );
-	Cvar_CheckRange( com_journal, "0", "2", CV_INTEGER );
-	Cvar_SetDescription( com_journal, "When enabled, writes events and its data to 'journal.dat' and 'journaldata.dat'.");
+	if ( svj.skipFrame ) {
+		svj.skipFrame = false;
+		return;
+	}
 
-	Com_StartupVariable( "sv_master1" );
-	Com_StartupVariable( "sv_master2" );
-	Com_StartupVariable( "sv_master3" );
-	Cvar_Get( "sv_master1", MASTER_SERVER_NAME, CVAR_INIT );
-	Cvar_Get( "sv_master2", "master.ioquake3.org", CVAR_INIT );
-	Cvar_Get( "sv_master3", "master.maverickservers.com", CVAR_INIT );
+	// trace was restarted, stopped or overflowed in this frame
+	if ( !com_traceActive || first > ring->count || ring->count - first > TRACE_EVENTS ) {
+		svj.lostSamples++;
+		return;
+	}
 
-	com_protocol = Cvar_Get( "protocol", XSTRING( DEFAULT_PROTOCOL_VERSION ), 0 );
-	Cvar_SetDescription( com_protocol, "Specify network protocol version number, use -compat suffix for OpenArena compatibility.");
-	if ( Q_stristr( com_protocol->string, "-compat" ) > com_protocol->string ) {
-		// strip -compat suffix
-		Cvar_Set2( "protocol", va( "%i", com_protocol->integer ), true );
-		// enforce legacy stream encoding but with new challenge format
-		com_protocolCompat = true;
-	} else {
-		com_protocolCompat = false;
+	if ( svj.numSamples == svj.maxSamples ) {
+		int maxSamples = svj.maxSamples ? svj.maxSamples * 2 : 4096;
+		sample = realloc( svj.samples, maxSamples * REPLAY_PHASES * sizeof( *sample ) );
+		if ( sample == NULL ) {
+			svj.lostSamples++;
+			return;
+		}
+		svj.samples = sample;
+		svj.maxSamples = maxSamples;
 	}
 
-	Cvar_CheckRange( com_protocol, "0", NULL, CV_INTEGER );
-	com_protocol->flags &= ~CVAR_USER_CREATED;
-	com_protocol->flags |= CVAR_SERVERINFO | CVAR_ROM;
+	memset( sums, 0, sizeof( sums ) );
 
-	// done early so bind command exists
-	Com_InitKeyCommands();
+	for ( depth = 0, n = first; n != ring->count; n++ ) {
+		ev = &ring->events[ n & ( TRACE_EVENTS - 1 ) ];
+		if ( ev->name ) {
+			if ( depth < MAX_REPLAY_DEPTH ) {
+				zones[ depth ] = ev->name;
+				starts[ depth ] = ev->time;
+			}
+			depth++;
+			continue;
+		}
+		if ( depth == 0 || --depth >= MAX_REPLAY_DEPTH )
+			continue;
+		for ( i = 0; i < REPLAY_PHASES; i++ ) {
+			if ( !strcmp( zones[ depth ], svj_replayPhases[ i ] ) )
+				break;
+		}
+		if ( i == REPLAY_PHASES )
+			continue;
+		// count recursive zones once
+		for ( j = 0; j < depth; j++ ) {
+			if ( !strcmp( zones[ j ], svj_replayPhases[ i ] ) )
+				break;
+		}
+		if ( j == depth ) {
+			sums[ i ] += ev->time - starts[ depth ];
+		}
+	}
 
-	FS_InitFilesystem();
+	sample = svj.samples + svj.numSamples * REPLAY_PHASES;
+	for ( i = 0; i < REPLAY_PHASES; i++ ) {
+		sample[ i ] = (int)( sums[ i ] / 1000 );
+	}
+	svj.numSamples++;
+}
 
-	com_logfile = Cvar_Get( "logfile", "0", CVAR_TEMP );
-	Cvar_CheckRange( com_logfile, "0", "4", CV_INTEGER );
-	Cvar_SetDescription( com_logfile, "System console logging:\n"
-		" 0 - disabled\n"
-		" 1 - overwrite mode, buffered\n"
-		" 2 - overwrite mode, synced\n"
-		" 3 - append mode, buffered\n"
-		" 4 - append mode, synced\n" );
 
-	Com_InitJournaling();
+/*
+=================
+Com_ReplayReport
+=================
+*/
+static void Com_ReplayReport( void )
+{
+	int64_t elapsed, sum;
+	double serverTime;
+	int *sorted;
+	int i, n, count;
 
-	Com_ExecuteCfg();
+	elapsed = Sys_Microseconds() - svj.startTime;
+	serverTime = ( svj.lastFrameTime - svj.header.lastTime ) / 1000.0;
 
-	// override anything from the config files with command line args
-	Com_StartupVariable( NULL );
+	Com_Printf( "Replayed %i frames and %i packets (%i bytes) of %s: %.1f sec of server time in %.3f sec, %.1fx real time.\n",
+		svj.frames, svj.packets, svj.bytes, svj.name, serverTime, elapsed / 1000000.0,
+		elapsed > 0 ? serverTime * 1000000.0 / elapsed : 0.0 );
 
-	// get dedicated here for proper hunk megs initialization
-#ifdef DEDICATED
-	com_dedicated = Cvar_Get( "dedicated", "1", CVAR_INIT );
-	Cvar_CheckRange( com_dedicated, "1", "2", CV_INTEGER );
-#else
-	com_dedicated = Cvar_Get( "dedicated", "0", CVAR_LATCH );
-	Cvar_CheckRange( com_dedicated, "0", "2", CV_INTEGER );
-#endif
-	Cvar_SetDescription( com_dedicated, "Enables dedicated server mode.\n 0: Listen server\n 1: Unlisted dedicated server \n 2: Listed dedicated server" );
-	// allocate the stack based hunk allocator
-	Com_InitHunkMemory();
+	if ( svj.mismatches ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %i seeds didn't match, replay went different way than recording.\n", svj.mismatches );
+	}
+	if ( svj.lostSamples ) {
+		Com_Printf( "%i frames without complete timeline were not measured.\n", svj.lostSamples );
+	}
 
-	// if any archived cvars are modified after this, we will trigger a writing
-	// of the config file
-	cvar_modifiedFlags &= ~CVAR_ARCHIVE;
+	count = svj.numSamples;
+	if ( count == 0 )
+		return;
 
-	//
-	// init commands and vars
-	//
-#ifndef DEDICATED
-	com_maxfps = Cvar_Get( "com_maxfps", "125", 0 ); // try to force that in some light way
-	Cvar_CheckRange( com_maxfps, "0", "1000", CV_INTEGER );
-	Cvar_SetDescription( com_maxfps, "Sets maximum frames per second." );
-	com_maxfpsUnfocused = Cvar_Get( "com_maxfpsUnfocused", "60", CVAR_ARCHIVE_ND );
-	Cvar_CheckRange( com_maxfpsUnfocused, "0", "1000", CV_INTEGER );
-	Cvar_SetDescription( com_maxfpsUnfocused, "Sets maximum frames per second in unfocused game window." );
-	com_yieldCPU = Cvar_Get( "com_yieldCPU", "1", CVAR_ARCHIVE_ND );
-	Cvar_CheckRange( com_yieldCPU, "0", "16", CV_INTEGER );
-	Cvar_SetDescription( com_yieldCPU, "Attempt to sleep specified amount of time between rendered frames when game is active, this will greatly reduce CPU load. Use 0 only if you're experiencing some lag." );
-#endif
+	sorted = malloc( count * sizeof( *sorted ) );
+	if ( sorted == NULL )
+		return;
 
-#ifdef USE_AFFINITY_MASK
-	com_affinityMask = Cvar_Get( "com_affinityMask", "", CVAR_ARCHIVE_ND );
-	Cvar_SetDescription( com_affinityMask, "Bind game process to bitmask-specified CPU core(s), special characters:\n A or a - all default cores\n P or p - performance cores\n E or e - efficiency cores\n 0x<value> - use hexadecimal notation\n + or - can be used to add or exclude particular cores" );
-	com_affinityMask->modified = false;
-#endif
+	Com_Printf( "%-22s %8s %8s %8s %8s  (usec per frame)\n", "phase", "mean", "p50", "p99", "max" );
 
-	// com_blood = Cvar_Get( "com_blood", "1", CVAR_ARCHIVE_ND );
+	for ( i = 0; i < REPLAY_PHASES; i++ ) {
+		for ( sum = 0, n = 0; n < count; n++ ) {
+			sorted[ n ] = svj.samples[ n * REPLAY_PHASES + i ];
+			sum += sorted[ n ];
+		}
+		qsort( sorted, count, sizeof( sorted[0] ), Com_CompareInts );
+		Com_Printf( "%-22s %8.1f %8i %8i %8i\n", svj_replayPhases[ i ], (double)sum / count,
+			sorted[ count / 2 ], sorted[ ( count * 99 ) / 100 ], sorted[ count - 1 ] );
+	}
 
-	com_timescale = Cvar_Get( "timescale", "1", CVAR_CHEAT | CVAR_SYSTEMINFO );
-	Cvar_CheckRange( com_timescale, "0", NULL, CV_FLOAT );
-	Cvar_SetDescription( com_timescale, "System timing factor:\n < 1: Slows the game down\n = 1: Regular speed\n > 1: Speeds the game up" );
-	com_fixedtime = Cvar_Get( "fixedtime", "0", CVAR_CHEAT );
-	Cvar_SetDescription( com_fixedtime, "Toggle the rendering of every frame the game will wait until each frame is completely rendered before sending the next frame." );
-	com_showtrace = Cvar_Get( "com_showtrace", "0", CVAR_CHEAT );
-	Cvar_SetDescription( com_showtrace, "Debugging tool that prints out trace information." );
-	com_viewlog = Cvar_Get( "viewlog", "0", 0 );
-	Cvar_SetDescription( com_viewlog, "Toggle the display of the startup console window over the game screen." );
-	com_speeds = Cvar_Get( "com_speeds", "0", 0 );
-	Cvar_SetDescription( com_speeds, "Prints speed information per frame to the console. Used for debugging." );
-	com_cameraMode = Cvar_Get( "com_cameraMode", "0", CVAR_CHEAT );
+	free( sorted );
+}
 
-#ifndef DEDICATED
-	com_timedemo = Cvar_Get( "timedemo", "0", 0 );
-	Cvar_CheckRange( com_timedemo, "0", "1", CV_INTEGER );
-	Cvar_SetDescription( com_timedemo, "When set to '1' times a demo and returns frames per second like a benchmark." );
-	cl_paused = Cvar_Get( "cl_paused", "0", CVAR_ROM );
-	Cvar_SetDescription( cl_paused, "Read-only CVAR to toggle functionality of paused games (the variable holds the status of the paused flag on the client side)." );
-	cl_packetdelay = Cvar_Get( "cl_packetdelay", "0", CVAR_CHEAT );
-	Cvar_SetDescription( cl_packetdelay, "Artificially set the client's latency. Simulates packet delay, which can lead to packet loss." );
-	com_cl_running = Cvar_Get( "cl_running", "0", CVAR_ROM | CVAR_NOTABCOMPLETE );
-	Cvar_SetDescription( com_cl_running, "Can be used to check the status of the client game." );
-#endif
 
-	sv_paused = Cvar_Get( "sv_paused", "0", CVAR_ROM );
-	sv_packetdelay = Cvar_Get( "sv_packetdelay", "0", CVAR_CHEAT );
-	Cvar_SetDescription( sv_packetdelay, "Simulates packet delay, which can lead to packet loss. Server side." );
-	com_sv_running = Cvar_Get( "sv_running", "0", CVAR_ROM | CVAR_NOTABCOMPLETE );
-	Cvar_SetDescription( com_sv_running, "Communicates to game modules if there is a server currently running." );
+/*
+=================
+Com_StopServerJournal
+=================
+*/
+static void Com_StopServerJournal( void )
+{
+	switch ( svj.state ) {
+	case SVJ_ARMED:
+		Com_Printf( "Server journal recording cancelled.\n" );
+		break;
+	case SVJ_RECORDING:
+		Com_Printf( "Stopped server journal recording, %i frames and %i packets written.\n", svj.frames, svj.packets );
+		break;
+	case SVJ_REPLAYING:
+		Com_ReplayReport();
+		// still without network, so disconnects don't leave
+		if ( com_sv_running->integer ) {
+			SV_Shutdown( "Server journal replay finished" );
+		}
+		com_serverReplay = false;
+		Com_ReplayRestoreCvars();
+		Com_TraceStop();
+		free( svj.samples );
+		svj.samples = NULL;
+		svj.maxSamples = 0;
+		if ( svj.quit ) {
+			Cbuf_AddText( "quit\n" );
+		}
+		break;
+	default:
+		return;
+	}
 
-	com_buildScript = Cvar_Get( "com_buildScript", "0", 0 );
-	Cvar_SetDescription( com_buildScript, "Loads all game assets, regardless whether they are required or not." );
+	if ( svj.file != FS_INVALID_HANDLE ) {
+		FS_FCloseFile( svj.file );
+		svj.file = FS_INVALID_HANDLE;
+	}
 
-	Cvar_Get( "com_errorMessage", "", CVAR_ROM | CVAR_NORESTART );
+	svj.state = SVJ_IDLE;
+}
 
-#ifndef DEDICATED
-	com_introPlayed = Cvar_Get( "com_introplayed", "0", CVAR_ARCHIVE );
-	Cvar_SetDescription( com_introPlayed, "Skips the introduction cinematic." );
-	com_skipIdLogo  = Cvar_Get( "com_skipIdLogo", "0", CVAR_ARCHIVE );
-	Cvar_SetDescription( com_skipIdLogo, "Skip playing Id Software logo cinematic at startup." );
-#endif
 
-	if ( com_dedicated->integer ) {
-		if ( !com_viewlog->integer ) {
-			Cvar_Set( "viewlog", "1" );
-		}
-		gw_minimized = true;
-	} else {
-		gw_minimized = false;
+/*
+=================
+Com_ServerRecord_f
+=================
+*/
+static void Com_ServerRecord_f( void )
+{
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "usage: %s <name>\n", Cmd_Argv( 0 ) );
+		return;
 	}
 
-	if ( com_developer->integer ) {
-		Cmd_AddCommand( "error", Com_Error_f );
-		Cmd_AddCommand( "crash", Com_Crash_f );
-		Cmd_AddCommand( "freeze", Com_Freeze_f );
+	if ( !com_dedicated->integer ) {
+		Com_Printf( "Server journal is available only on dedicated server.\n" );
+		return;
 	}
 
-	Cmd_AddCommand( "quit", Com_Quit_f );
-	Cmd_AddCommand( "changeVectors", MSG_ReportChangeVectors_f );
-	Cmd_AddCommand( "writeconfig", Com_WriteConfig_f );
-	Cmd_SetCommandCompletionFunc( "writeconfig", Cmd_CompleteWriteCfgName );
-	Cmd_AddCommand( "game_restart", Com_GameRestart_f );
-
-	s = va( "%s %s %s", Q3_VERSION, PLATFORM_STRING, __DATE__ );
-	com_version = Cvar_Get( "version", s, CVAR_PROTECTED | CVAR_ROM | CVAR_SERVERINFO );
-	Cvar_SetDescription( com_version, "Read-only CVAR to see the version of the game." );
+	if ( svj.state != SVJ_IDLE ) {
+		Com_Printf( "Server journal is already %s.\n", svj.state == SVJ_REPLAYING ? "replaying" : "recording" );
+		return;
+	}
 
-	// this cvar is the single entry point of the entire extension system
-	Cvar_Get( "//trap_GetValue", va( "%i", COM_TRAP_GETVALUE ), CVAR_PROTECTED | CVAR_ROM | CVAR_NOTABCOMPLETE );
+	Com_sprintf( svj.name, sizeof( svj.name ), SVJ_DIR "/%s", Cmd_Argv( 1 ) );
+	COM_DefaultExtension( svj.name, sizeof( svj.name ), SVJ_EXT );
 
-	Sys_Init();
+	svj.state = SVJ_ARMED;
 
-	// CPU detection
-	Cvar_Get( "sys_cpustring", "detect", CVAR_PROTECTED | CVAR_ROM | CVAR_NORESTART );
-	if ( !Q_stricmp( Cvar_VariableString( "sys_cpustring" ), "detect" ) ) {
-		char vendor[128];
-		Com_Printf( "...detecting CPU, found " );
-		Sys_GetProcessorId( vendor );
-		Cvar_Set( "sys_cpustring", vendor );
+	if ( com_sv_running->integer ) {
+		Com_Printf( "Server journal recording starts with the next map load, clients connected by then will be missing from replay.\n" );
+	} else {
+		Com_Printf( "Server journal recording starts with the next map load.\n" );
 	}
-	Com_Printf( "%s\n", Cvar_VariableString( "sys_cpustring" ) );
+}
 
-#ifdef USE_AFFINITY_MASK
-	// get initial process affinity - we will respect it when setting custom affinity masks
-	eCoreMask = pCoreMask = affinityMask = Sys_GetAffinityMask();
-#if (idx64 || id386)
-	DetectCPUCoresConfig();
-#endif
-	if ( com_affinityMask->string[0] != '\0' ) {
-		Com_SetAffinityMask( com_affinityMask->string );
-		com_affinityMask->modified = false;
+
+/*
+=================
+Com_ServerStopRecord_f
+=================
+*/
+static void Com_ServerStopRecord_f( void )
+{
+	if ( svj.state == SVJ_IDLE ) {
+		Com_Printf( "Not recording server journal.\n" );
+		return;
 	}
-#endif
 
-	// Pick a random port value
-	Com_RandomBytes( (byte*)&qport, sizeof( qport ) );
-	Netchan_Init( qport & 0xffff );
+	Com_StopServerJournal();
+}
 
-	VM_Init();
-	SV_Init();
 
-	com_dedicated->modified = false;
+/*
+=================
+Com_ServerReplay_f
+=================
+*/
+static void Com_ServerReplay_f( void )
+{
+	svjHeader_t *header = &svj.header;
+
+	if ( Cmd_Argc() < 2 || Cmd_Argc() > 3 || ( Cmd_Argc() == 3 && Q_stricmp( Cmd_Argv( 2 ), "quit" ) ) ) {
+		Com_Printf( "usage: %s <name> [quit]\n", Cmd_Argv( 0 ) );
+		return;
+	}
 
-#ifndef DEDICATED
 	if ( !com_dedicated->integer ) {
-		CL_Init();
-		// Sys_ShowConsole( com_viewlog->integer, false ); // moved down
+		Com_Printf( "Server journal is available only on dedicated server.\n" );
+		return;
 	}
-#endif
 
-	// add + commands from command line
-	if ( !Com_AddStartupCommands() ) {
-		// if the user didn't give any commands, run default action
-		if ( !com_dedicated->integer ) {
-#ifndef DEDICATED
-			if ( !com_skipIdLogo || !com_skipIdLogo->integer )
-				Cbuf_AddText( "cinematic idlogo.RoQ\n" );
-			if( !com_introPlayed->integer ) {
-				Cvar_Set( com_introPlayed->name, "1" );
-				Cvar_Set( "nextmap", "cinematic intro.RoQ" );
-			}
-#endif
-		}
+	if ( svj.state != SVJ_IDLE ) {
+		Com_Printf( "Server journal is already %s.\n", svj.state == SVJ_REPLAYING ? "replaying" : "recording" );
+		return;
 	}
 
-#ifndef DEDICATED
-	CL_StartHunkUsers();
-#endif
+	Com_sprintf( svj.name, sizeof( svj.name ), SVJ_DIR "/%s", Cmd_Argv( 1 ) );
+	COM_DefaultExtension( svj.name, sizeof( svj.name ), SVJ_EXT );
 
-	// set com_frameTime so that if a map is started on the
-	// command line it will still be able to count on com_frameTime
-	// being random enough for a serverid
-	lastTime = com_frameTime = Com_Milliseconds();
+	FS_FOpenFileRead( svj.name, &svj.file, true );
+	if ( svj.file == FS_INVALID_HANDLE ) {
+		Com_Printf( "Couldn't open %s\n", svj.name );
+		return;
+	}
 
-	if ( !com_errorEntered )
-		Sys_ShowConsole( com_viewlog->integer, false );
+	if ( FS_Read( header, sizeof( *header ), svj.file ) != sizeof( *header )
+		|| header->ident != SVJ_IDENT || header->version != SVJ_VERSION ) {
+		Com_Printf( "%s is not a version %i server journal.\n", svj.name, SVJ_VERSION );
+		FS_FCloseFile( svj.file );
+		svj.file = FS_INVALID_HANDLE;
+		return;
+	}
 
-#ifndef DEDICATED
-	// make sure single player is off by default
-	Cvar_Set( "ui_singlePlayerActive", "0" );
-#endif
+	if ( com_sv_running->integer ) {
+		SV_Shutdown( "Server journal replay" );
+	}
 
-	com_fullyInitialized = true;
+	svj.state = SVJ_REPLAYING;
+	svj.loadMap = true;
+	svj.pending = false;
+	svj.frames = 0;
+	svj.packets = 0;
+	svj.bytes = 0;
+	svj.mismatches = 0;
+	svj.numSamples = 0;
+	svj.lostSamples = 0;
+	svj.quit = ( Cmd_Argc() == 3 );
 
-	Com_Printf( "--- Common Initialization Complete ---\n" );
+	// replayed frames are measured on the main thread ring
+	Com_TraceStart();
+	svj.traceFirst = 0;
+	svj.skipFrame = true;
+
+	com_serverReplay = true;
+
+	Com_Printf( "Replaying %s recorded on %s.\n", svj.name, header->mapname );
 }
 
 
-//==================================================================
+/*
+==============================================================================
 
-static void Com_WriteConfigToFile( const char *filename ) {
-	fileHandle_t	f;
+						FRAME SCHEDULING
 
-	f = FS_FOpenFileWrite( filename );
-	if ( f == FS_INVALID_HANDLE ) {
-		if ( !FS_ResetReadOnlyAttribute( filename ) || ( f = FS_FOpenFileWrite( filename ) ) == FS_INVALID_HANDLE ) {
-			Com_Printf( "Couldn't write %s.\n", filename );
-			return;
-		}
-	}
+Frames are paced against absolute deadlines on the microsecond clock so
+sleep overshoot of one frame is taken out of the next one instead of
+accumulating. The thread sleeps until com_frameSpin microseconds before
+the deadline and polls the network for the rest of the time.
 
-	FS_Printf( f, "// generated by quake, do not modify" Q_NEWLINE );
-#ifndef DEDICATED
-	Key_WriteBindings( f );
-#endif
-	Cvar_WriteVariables( f );
-	FS_FCloseFile( f );
-}
+==============================================================================
+*/
+
+#define FRAME_SAMPLES		4096
+
+typedef struct {
+	int64_t		deadline;		// when the last frame was due
+	int64_t		lastStart;		// when the last frame actually started
+	int			target;			// interval requested for the last frame, usec
+	int			intervals[ FRAME_SAMPLES ];	// start to start, usec
+	int			late[ FRAME_SAMPLES ];		// start minus deadline, usec
+	int			targets[ FRAME_SAMPLES ];
+	unsigned	count;
+	int			maxInterval;
+	int			maxLate;
+} frameSchedule_t;
+
+static frameSchedule_t frameSched;
 
 
 /*
-===============
-Com_WriteConfiguration
+=================
+Com_FrameDeadline
 
-Writes key bindings and archived cvars to config file if modified
-===============
+Returns deadline for the next frame, usec.
+Interval of 0 means do not wait at all
+=================
 */
-void Com_WriteConfiguration( void ) {
-#ifndef DEDICATED
-	const char *basegame;
-	const char *gamedir;
-#endif
-	// if we are quitting without fully initializing, make sure
-	// we don't write out anything
-	if ( !com_fullyInitialized ) {
-		return;
-	}
+static int64_t Com_FrameDeadline( int64_t now, int interval )
+{
+	int64_t deadline;
 
-	if ( !(cvar_modifiedFlags & CVAR_ARCHIVE ) ) {
-		return;
-	}
-	cvar_modifiedFlags &= ~CVAR_ARCHIVE;
+	if ( interval == 0 )
+		return now;
 
-	Com_WriteConfigToFile( Q3CONFIG_CFG );
+	deadline = frameSched.deadline + interval;
 
-#ifndef DEDICATED
-	gamedir = FS_GetCurrentGameDir();
-	basegame = FS_GetBaseGameDir();
-	if ( UI_usesUniqueCDKey() && gamedir[0] && Q_stricmp( basegame, gamedir ) ) {
-		Com_WriteCDKey( gamedir, &cl_cdkey[16] );
-	} else {
-		Com_WriteCDKey( basegame, cl_cdkey );
-	}
-#endif
+	// more than a frame behind: start over instead
+	// of running a burst of frames to catch up
+	if ( deadline < now - interval )
+		deadline = now;
+
+	// clock went backwards
+	if ( deadline > now + interval )
+		deadline = now + interval;
+
+	return deadline;
 }
 
 
 /*
-===============
-Com_WriteConfig_f
-
-Write the config file to a specific name
-===============
+=================
+Com_FrameStarted
+=================
 */
-static void Com_WriteConfig_f( void ) {
-	char	filename[MAX_QPATH];
-	const char *ext;
+static void Com_FrameStarted( int64_t now, int64_t deadline, int interval )
+{
+	unsigned n;
+
+	if ( frameSched.lastStart && interval ) {
+		n = frameSched.count % FRAME_SAMPLES;
+		frameSched.intervals[ n ] = (int)( now - frameSched.lastStart );
+		frameSched.late[ n ] = (int)( now - deadline );
+		frameSched.targets[ n ] = interval;
+		if ( frameSched.intervals[ n ] > frameSched.maxInterval )
+			frameSched.maxInterval = frameSched.intervals[ n ];
+		if ( frameSched.late[ n ] > frameSched.maxLate )
+			frameSched.maxLate = frameSched.late[ n ];
+		frameSched.count++;
+	}
+
+	frameSched.deadline = deadline;
+	frameSched.lastStart = now;
+	frameSched.target = interval;
+}
 
-	if ( Cmd_Argc() != 2 ) {
-		Com_Printf( "Usage: writeconfig <filename>\n" );
-		return;
-	}
 
-	Q_strncpyz( filename, Cmd_Argv(1), sizeof( filename ) );
-	COM_DefaultExtension( filename, sizeof( filename ), ".cfg" );
+static int Com_CompareInts( const void *a, const void *b )
+{
+	return *(const int *)a - *(const int *)b;
+}
 
-	if ( !FS_AllowedExtension( filename, false, &ext ) ) {
-		Com_Printf( "%s: Invalid filename extension: '%s'.\n", __func__, ext );
-		return;
-	}
 
-	Com_Printf( "Writing %s.\n", filename );
-	Com_WriteConfigToFile( filename );
+/*
+=================
+Com_PrintFrameStats
+=================
+*/
+static void Com_PrintFrameStats( const char *name, const int *samples, int count, int maxValue )
+{
+	static int sorted[ FRAME_SAMPLES ];
+	int64_t sum;
+	int i;
+
+	memcpy( sorted, samples, count * sizeof( sorted[0] ) );
+	qsort( sorted, count, sizeof( sorted[0] ), Com_CompareInts );
+
+	for ( sum = 0, i = 0; i < count; i++ )
+		sum += sorted[ i ];
+
+	Com_Printf( "%-9s min %6i  p50 %6i  p99 %6i  max %6i  mean %8.1f  (max %i since reset)\n", name,
+		sorted[ 0 ], sorted[ count / 2 ], sorted[ ( count * 99 ) / 100 ], sorted[ count - 1 ],
+		(double)sum / count, maxValue );
 }
 
 
 /*
-================
-Com_ModifyMsec
-================
+=================
+Com_FrameTimes_f
+
+Shows distribution of the last FRAME_SAMPLES frame intervals
+=================
 */
-static int Com_ModifyMsec( int msec ) {
-	int		clampTime;
+static void Com_FrameTimes_f( void )
+{
+	static int delta[ FRAME_SAMPLES ];
+	static const int bounds[] = { 10, 50, 100, 250, 500, 1000, 2000, 5000 };
+	int hist[ ARRAY_LEN( bounds ) + 1 ];
+	int count, i, j, bar;
 
-	//
-	// modify time for debugging values
-	//
-	if ( com_fixedtime->integer ) {
-		msec = com_fixedtime->integer;
-	} else if ( com_timescale->value ) {
-		msec *= com_timescale->value;
-	} else if (com_cameraMode->integer) {
-		msec *= com_timescale->value;
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( &frameSched.count, 0, sizeof( frameSched ) - offsetof( frameSchedule_t, count ) );
+		return;
 	}
 
-	// don't let it scale below 1 msec
-	if ( msec < 1 && com_timescale->value) {
-		msec = 1;
+	count = MIN( frameSched.count, FRAME_SAMPLES );
+	if ( count == 0 ) {
+		Com_Printf( "No paced frames recorded.\n" );
+		return;
 	}
 
-	if ( com_dedicated->integer ) {
-		// dedicated servers don't want to clamp for a much longer
-		// period, because it would mess up all the client's views
-		// of time.
-		if (com_sv_running->integer && msec > 500)
-			Com_Printf( "Hitch warning: %i msec frame time\n", msec );
+	Com_Printf( "%i frames, target interval %i usec, com_frameSpin %i usec\n", count, frameSched.target, com_frameSpin->integer );
 
-		clampTime = 5000;
-	} else
-	if ( !com_sv_running->integer ) {
-		// clients of remote servers do not want to clamp time, because
-		// it would skew their view of the server's time temporarily
-		clampTime = 5000;
-	} else {
-		// for local single player gaming
-		// we may want to clamp the time to prevent players from
-		// flying off edges when something hitches.
-		clampTime = 200;
-	}
+	Com_PrintFrameStats( "interval", frameSched.intervals, count, frameSched.maxInterval );
+	Com_PrintFrameStats( "late", frameSched.late, count, frameSched.maxLate );
 
-	if ( msec > clampTime ) {
-		msec = clampTime;
+	// distribution of the distance from requested interval
+	memset( hist, 0, sizeof( hist ) );
+	for ( i = 0; i < count; i++ ) {
+		delta[ i ] = abs( frameSched.intervals[ i ] - frameSched.targets[ i ] );
+		for ( j = 0; j < ARRAY_LEN( bounds ); j++ ) {
+			if ( delta[ i ] < bounds[ j ] )
+				break;
+		}
+		hist[ j ]++;
 	}
 
-	return msec;
+	Com_Printf( "deviation from target interval, usec:\n" );
+	for ( j = 0; j <= ARRAY_LEN( bounds ); j++ ) {
+		if ( j < ARRAY_LEN( bounds ) )
+			Com_Printf( "  < %5i", bounds[ j ] );
+		else
+			Com_Printf( " >= %5i", bounds[ j - 1 ] );
+		bar = ( hist[ j ] * 50 + count - 1 ) / count;
+		Com_Printf( " %6i %5.1f%% ", hist[ j ], hist[ j ] * 100.0 / count );
+		while ( bar-- > 0 )
+			Com_Printf( "#" );
+		Com_Printf( "\n" );
+	}
 }
 
 
 /*
 =================
 Com_TimeVal
+
+Milliseconds left until next frame on the event clock
 =================
 */
 static int Com_TimeVal( int minMsec )
@@ -4189,18 +7315,65 @@ static int Com_TimeVal( int minMsec )
 
 /*
 =================
-Com_Frame
+Com_WaitFrame
+
+Sleeps and services network until deadline, returns actual deadline.
+Server frames are counted on the millisecond event clock so dedicated
+server also waits for it to advance by minMsec, otherwise a wakeup just
+before the millisecond boundary would leave no server frame to run
 =================
 */
-void Com_Frame( bool noDelay ) {
+static int64_t Com_WaitFrame( int64_t deadline, int minMsec )
+{
+	int64_t now, remain, sleep;
+	int timeValSV;
+
+	for ( ;; ) {
+		now = Sys_Microseconds();
+		remain = deadline - now;
+
+		if ( remain <= 0 ) {
+			if ( !com_dedicated->integer || Com_TimeVal( minMsec ) == 0 )
+				return deadline;
+			// event clock is behind, move the schedule so that
+			// following frames will not wait for it again
+			NET_Sleep( 100 );
+			deadline = Sys_Microseconds();
+			continue;
+		}
+
+		sleep = remain - com_frameSpin->integer;
+
+		if ( com_sv_running->integer ) {
+			timeValSV = SV_SendQueuedPackets();
+			if ( (int64_t)timeValSV * 1000 < sleep )
+				sleep = (int64_t)timeValSV * 1000;
+		}
 
 #ifndef DEDICATED
-	static int bias = 0;
+		if ( !gw_minimized && sleep > com_yieldCPU->integer * 1000 )
+			sleep = com_yieldCPU->integer * 1000;
+		if ( remain > sleep && sleep > 0 )
+			Com_EventLoop();
 #endif
+
+		// in spin window: just poll sockets
+		NET_Sleep( sleep > 0 ? (int)sleep : 0 );
+	}
+}
+
+
+/*
+=================
+Com_Frame
+=================
+*/
+void Com_Frame( bool noDelay ) {
+
 	int	msec, realMsec, minMsec;
-	int	sleepMsec;
-	int	timeVal;
-	int	timeValSV;
+	int	interval;
+	int64_t	now, deadline;
+	int64_t	traceFrameStart;
 
 	int	timeBeforeFirstEvents;
 	int	timeBeforeServer;
@@ -4209,10 +7382,13 @@ void Com_Frame( bool noDelay ) {
 	int	timeAfter;
 
 	if ( Q_setjmp( abortframe ) ) {
+		Com_TraceUnwind();
+		Arena_Reset( &frameArena );
 		return;			// an ERR_DROP was thrown
 	}
 
 	minMsec = 0; // silent compiler warning
+	interval = 0;
 
 	// bk001204 - init to zero.
 	//  also:  might be clobbered by `longjmp' or `vfork'
@@ -4251,63 +7427,61 @@ void Com_Frame( bool noDelay ) {
 
 	// we may want to spin here if things are going too fast
 	if ( com_dedicated->integer ) {
+		// remaining part of the server frame on the event clock,
+		// residual is already covered by the absolute deadline
 		minMsec = SV_FrameMsec();
-#ifndef DEDICATED
-		bias = 0;
-#endif
+		interval = Cvar_VariableIntegerValue( "sv_fps" );
+		interval = interval > 0 ? ( 1000 / interval ) * 1000 : 1000;
 	} else {
 #ifndef DEDICATED
 		if ( noDelay ) {
-			minMsec = 0;
-			bias = 0;
+			interval = 0;
 		} else {
 			if ( !gw_active && com_maxfpsUnfocused->integer > 0 )
-				minMsec = 1000 / com_maxfpsUnfocused->integer;
+				interval = 1000000 / com_maxfpsUnfocused->integer;
 			else
 			if ( com_maxfps->integer > 0 )
-				minMsec = 1000 / com_maxfps->integer;
+				interval = 1000000 / com_maxfps->integer;
 			else
-				minMsec = 1;
-
-			timeVal = com_frameTime - lastTime;
-			bias += timeVal - minMsec;
-
-			if ( bias > minMsec )
-				bias = minMsec;
-
-			// Adjust minMsec if previous frame took too long to render so
-			// that framerate is stable at the requested value.
-			minMsec -= bias;
+				interval = 1000;
 		}
 #endif
 	}
 
-	// waiting for incoming packets
-	if ( noDelay == false )
-	do {
-		if ( com_sv_running->integer ) {
-			timeValSV = SV_SendQueuedPackets();
-			timeVal = Com_TimeVal( minMsec );
-			if ( timeValSV < timeVal )
-				timeVal = timeValSV;
-		} else {
-			timeVal = Com_TimeVal( minMsec );
-		}
-		sleepMsec = timeVal;
-#ifndef DEDICATED
-		if ( !gw_minimized && timeVal > com_yieldCPU->integer )
-			sleepMsec = com_yieldCPU->integer;
-		if ( timeVal > sleepMsec )
-			Com_EventLoop();
-#endif
-		NET_Sleep( sleepMsec * 1000 - 500 );
-	} while( Com_TimeVal( minMsec ) );
+	now = Sys_Microseconds();
+	deadline = Com_FrameDeadline( now, interval );
+
+	// waiting for incoming packets, replay doesn't wait
+	if ( noDelay == false && !com_serverReplay ) {
+		TRACE_BEGIN( "Com_WaitFrame" );
+		deadline = Com_WaitFrame( deadline, minMsec );
+		TRACE_END();
+		now = Sys_Microseconds();
+	}
+
+	Com_FrameStarted( now, deadline, interval );
+
+	traceFrameStart = com_traceActive ? Sys_Nanoseconds() : 0;
+	TRACE_BEGIN( "Com_Frame" );
 
 	lastTime = com_frameTime;
-	com_frameTime = Com_EventLoop();
+	if ( com_serverReplay ) {
+		com_frameTime = Com_ReplayFrame();
+	} else {
+		com_frameTime = Com_EventLoop();
+		Com_RecordFrame( com_frameTime );
+	}
 	realMsec = com_frameTime - lastTime;
 
+	TRACE_BEGIN( "Cbuf_Execute" );
 	Cbuf_Execute();
+	TRACE_END();
+
+	// deliver file reads completed by the I/O thread
+	FS_RunAsyncReads();
+
+	// pick up pk3 files changed on disk
+	FS_CheckPakChanges();
 
 	// mess with msec if needed
 	msec = Com_ModifyMsec( realMsec );
@@ -4319,7 +7493,9 @@ void Com_Frame( bool noDelay ) {
 		timeBeforeServer = Sys_Milliseconds();
 	}
 
+	TRACE_BEGIN( "SV_Frame" );
 	SV_Frame( msec );
+	TRACE_END();
 
 	// if "dedicated" has been modified, start up
 	// or shut down the client system.
@@ -4382,7 +7558,9 @@ void Com_Frame( bool noDelay ) {
 			timeBeforeClient = Sys_Milliseconds();
 		}
 
+		TRACE_BEGIN( "CL_Frame" );
 		CL_Frame( msec, realMsec );
+		TRACE_END();
 
 		if ( com_speeds->integer ) {
 			timeAfter = Sys_Milliseconds();
@@ -4425,6 +7603,15 @@ void Com_Frame( bool noDelay ) {
 		c_pointcontents = 0;
 	}
 
+	// release scratch memory handed out during this frame
+	Arena_Reset( &frameArena );
+
+	TRACE_END();
+	Com_TraceFrameEnd( traceFrameStart );
+	Com_ReplayFrameEnd();
+
+	Com_LogKick();
+
 	com_frameNumber++;
 }
 
@@ -4435,10 +7622,9 @@ Com_Shutdown
 =================
 */
 static void Com_Shutdown( void ) {
-	if ( logfile != FS_INVALID_HANDLE ) {
-		FS_FCloseFile( logfile );
-		logfile = FS_INVALID_HANDLE;
-	}
+	Com_StopServerJournal();
+
+	Com_LogClose();
 
 	if ( com_journalFile != FS_INVALID_HANDLE ) {
 		FS_FCloseFile( com_journalFile );
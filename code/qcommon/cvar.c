@@ -1372,6 +1372,34 @@ void Cvar_WriteVariables( fileHandle_t f )
 }
 
 
+/*
+============
+Cvar_ForEachModified
+
+Calls back with all variables that can be changed at runtime and
+were either set by user or differ from defaults, latched value
+is passed if it hasn't taken effect yet. Private ones are skipped
+============
+*/
+void Cvar_ForEachModified( void (*callback)( const char *name, const char *value ) )
+{
+	const cvar_t *var;
+	const char *value;
+
+	for ( var = cvar_vars; var; var = var->next )
+	{
+		if ( !var->name || ( var->flags & ( CVAR_ROM | CVAR_INIT | CVAR_PROTECTED | CVAR_PRIVATE ) ) )
+			continue;
+
+		value = var->latchedString ? var->latchedString : var->string;
+		if ( !( var->flags & CVAR_USER_CREATED ) && !strcmp( value, var->resetString ) )
+			continue;
+
+		callback( var->name, value );
+	}
+}
+
+
 /*
 ============
 Cvar_List_f
@@ -222,11 +222,14 @@ static const unsigned pak_checksums[] = {
 #define USE_PK3_CACHE
 #define USE_PK3_CACHE_FILE
 
+#define USE_CONTENT_CACHE
+
 #define USE_HANDLE_CACHE
 #define MAX_CACHED_HANDLES 384
 
 #define MAX_ZPATH			256
 #define MAX_FILEHASH_SIZE	4096
+#define MAX_FILEINDEX_SIZE	(1<<20)
 
 typedef struct fileInPack_s {
 	char					*name;		// name of the file
@@ -267,6 +270,7 @@ typedef struct pack_s {
 	struct pack_s	*next;
 	struct pack_s	*prev;
 	int				checksumFeed;
+	bool		pureValid;					// pure_checksum is computed for checksumFeed
 	int				*headerLongs;
 	int				numHeaderLongs;
 #endif
@@ -275,6 +279,7 @@ typedef struct pack_s {
 typedef struct {
 	char		*path;		// c:\quake3
 	char		*gamedir;	// baseq3
+	int			watch;		// change notification of game directories, -1 if none
 } directory_t;
 
 typedef enum {
@@ -288,8 +293,26 @@ typedef struct searchpath_s {
 	pack_t		*pack;		// only one of pack / dir will be non NULL
 	directory_t	*dir;
 	dirPolicy_t	policy;
+	int			order;		// position in search order, set by FS_BuildFileIndex
 } searchpath_t;
 
+// all pak entries of the search path hashed by name, entries with the same
+// name are chained in search order so runtime pure/exclude checks still apply
+typedef struct fileIndexEntry_s {
+	fileInPack_t				*file;
+	const searchpath_t			*search;
+	struct fileIndexEntry_s		*next;
+	long						hash;		// full name hash
+} fileIndexEntry_t;
+
+// pak entries linked by their parent and grandparent directory names,
+// which are the only directories whose listings may return them
+typedef struct fileIndexDirLink_s {
+	const fileIndexEntry_t		*entry;
+	struct fileIndexDirLink_s	*next;
+	int							dirLen;		// length of the linked directory name
+} fileIndexDirLink_t;
+
 #define MAX_BASEGAMES 4
 static  char		basegame_str[MAX_OSPATH], *basegames[MAX_BASEGAMES];
 static  int			basegame_cnt;
@@ -313,8 +336,23 @@ static	cvar_t		*fs_gamedirvar;
 static	cvar_t		*fs_locked;
 #endif
 static	cvar_t		*fs_excludeReference;
+static	cvar_t		*fs_mmap;
+#ifdef USE_CONTENT_CACHE
+static	cvar_t		*fs_contentCache;
+#endif
+static	cvar_t		*fs_scanThreads;
+static	cvar_t		*fs_readahead;
+#ifdef USE_PK3_CACHE
+static	cvar_t		*fs_watch;
+#endif
 
 static	searchpath_t	*fs_searchpaths;
+
+static	fileIndexEntry_t	**fs_fileIndex;
+static	int			fs_fileIndexSize;		// power of 2
+static	fileIndexDirLink_t	**fs_dirIndex;	// fs_fileIndexSize heads
+static	const searchpath_t	**fs_indexDirs;	// directories in search order
+static	int			fs_numIndexDirs;
 static	int			fs_readCount;			// total bytes read
 static	int			fs_loadCount;			// total files read
 static	int			fs_loadStack;			// total files in memory
@@ -326,6 +364,80 @@ static	int			fs_dirCount;			// total number of directories in searchpath
 
 static	int			fs_checksumFeed;
 
+// stored pk3 entries at least this large are mapped by FS_ReadFile instead of copied,
+// below that the mmap/munmap pair costs more than the read
+#define	MIN_MAPPED_FILE_SIZE	65536
+#define	MAX_MAPPED_FILES		64
+// callers cast loaded data to int/float structures, entries at less aligned
+// offsets in the archive are copied instead
+#define	MAPPED_FILE_ALIGN		16
+
+typedef struct {
+	void	*data;
+	int		length;					// mapped length, including the trailing zero
+	bool	shared;					// still backed by the pk3, see FS_DetachMappedEntries()
+} mappedFile_t;
+
+static	mappedFile_t	fs_mappedFiles[ MAX_MAPPED_FILES ];
+static	int			fs_numMappedFiles;
+
+// pk3 files missing in the cache are scanned in batches to limit number of open handles
+#define	MAX_SCAN_BATCH		64
+#define	MAX_SCAN_THREADS	16
+
+#define	MIN_PURE_PAKS_PER_THREAD	256
+
+typedef struct {
+	unsigned long	pos;			// file info position in zip
+	unsigned long	size;			// uncompressed size
+	unsigned long	crc;
+	int				method;			// compression method
+	int				name;			// offset in names buffer
+} zipScanEntry_t;
+
+typedef struct {
+	unzFile			handle;
+	zipScanEntry_t	*entries;
+	int				numEntries;
+	char			*names;
+	char			*ospath;		// set for worker scans
+	unz_s			zip;			// opened by worker, copied to handle afterwards
+} zipScan_t;
+
+// persistent fs_scanThreads workers for pk3 scans and pure checksums,
+// each job calls func for every index in [0, count) spread over the workers
+// and the main thread
+typedef void (*fsWorkerFunc_t)( void *data, int index );
+
+static	void			*fs_workerThreads[ MAX_SCAN_THREADS ];
+static	int				fs_numWorkers;			// not counting the main thread
+static	void			*fs_workerWake;			// posted once per worker for each job or to quit
+static	void			*fs_workerDone;			// posted by a worker when the job has no more items
+static	volatile int	fs_workerQuit;
+static	fsWorkerFunc_t	fs_workerFunc;
+static	void			*fs_workerData;
+static	int				fs_workerCount;
+static	volatile int	fs_workerNext;			// next item to take
+
+// FS_Startup timing breakdown, printed by fs_restart
+typedef struct {
+	int64_t		cacheLoad;
+	int64_t		list;			// directory listing
+	int64_t		open;			// pk3 cache lookups
+	int64_t		scan;			// opening and central directory walk, wall time
+	int64_t		build;			// pack tables and checksums
+	int64_t		order;			// search path reordering
+	int64_t		pure;			// pure checksums, wall time
+	int64_t		cacheSave;
+	int64_t		total;
+	int			cached;			// paks taken from the pk3 cache
+	int			scanned;		// paks read from the disk
+	int			threads;		// max. number of threads used for scanning
+	int			pureCount;		// paks with pure checksum (re)computed
+} fsStartupTimes_t;
+
+static	fsStartupTimes_t	fs_startupTimes;
+
 typedef union qfile_gus {
 	FILE*		o;
 	unzFile		z;
@@ -380,6 +492,15 @@ void Com_ReadCDKey( const char *filename );
 static int FS_GetModList( char *listbuf, int bufsize );
 static void FS_CheckIdPaks( void );
 void FS_Reload( void );
+static void FS_Restart_f( void );
+static void FS_InflateBench_f( void );
+static void FS_ListBench_f( void );
+static void FS_ReadaheadRecord( const char *name );
+#ifdef USE_PK3_CACHE
+static void FS_Rescan_f( void );
+static void FS_StopPakWatch( void );
+static void FS_FreeRetiredPaks( void );
+#endif
 
 
 /*
@@ -1323,6 +1444,40 @@ fileHandle_t FS_FOpenFileAppend( const char *filename ) {
 }
 
 
+/*
+===========
+FS_OpenHomeFile
+
+Opens a file in the game directory under homepath outside of
+the handle table, so it may be used from another thread and
+stays valid across filesystem restarts
+===========
+*/
+FILE *FS_OpenHomeFile( const char *filename, bool append ) {
+	const char *mode = append ? "ab" : "wb";
+	char *ospath;
+	FILE *f;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	ospath = FS_BuildOSPath( fs_homepath->string, fs_gamedir, filename );
+
+	FS_CheckFilenameIsNotAllowed( ospath, __func__, false );
+
+	f = Sys_FOpen( ospath, mode );
+	if ( f == NULL ) {
+		if ( FS_CreatePath( ospath ) ) {
+			return NULL;
+		}
+		f = Sys_FOpen( ospath, mode );
+	}
+
+	return f;
+}
+
+
 /*
 ===========
 FS_FilenameCompare
@@ -1467,6 +1622,219 @@ void FS_RestorePure( void )
 }
 
 
+/*
+=================
+FS_MarkPakReference
+
+Sets referenced flags of the pak for a file loaded from it
+=================
+*/
+static void FS_MarkPakReference( pack_t *pak, const char *filename )
+{
+	if ( !( pak->referenced & FS_GENERAL_REF ) && FS_GeneralRef( filename ) ) {
+		pak->referenced |= FS_GENERAL_REF;
+	}
+	if ( !( pak->referenced & FS_CGAME_REF ) && !strcmp( filename, "vm/cgame.qvm" ) ) {
+		pak->referenced |= FS_CGAME_REF;
+	}
+	if ( !( pak->referenced & FS_UI_REF ) && !strcmp( filename, "vm/ui.qvm" ) ) {
+		pak->referenced |= FS_UI_REF;
+	}
+}
+
+
+/*
+=================
+FS_FreeFileIndex
+=================
+*/
+static void FS_FreeFileIndex( void )
+{
+	if ( fs_fileIndex ) {
+		Z_Free( fs_fileIndex );
+	}
+
+	fs_fileIndex = NULL;
+	fs_fileIndexSize = 0;
+	fs_dirIndex = NULL;
+	fs_indexDirs = NULL;
+	fs_numIndexDirs = 0;
+}
+
+
+/*
+=================
+FS_HashDirName
+
+Hashes the first len characters of a directory name,
+case and separator insensitive
+=================
+*/
+static long FS_HashDirName( const char *name, int len )
+{
+	unsigned long hash;
+	int c, i;
+
+	hash = 0;
+	for ( i = 0; i < len; i++ ) {
+		c = locase[ (byte)name[ i ] ];
+		if ( c == '\\' )
+			c = '/';
+		hash = hash * 101 + c;
+	}
+
+	return (long)( hash ^ ( hash >> 10 ) ^ ( hash >> 20 ) );
+}
+
+
+/*
+=================
+FS_EntryDirLengths
+
+Returns number of parent directories of a pak entry name which should
+link it: the parent itself and the grandparent, root is never linked
+=================
+*/
+static int FS_EntryDirLengths( const char *name, int *dirLen )
+{
+	const char *s, *last, *prev;
+
+	last = prev = NULL;
+	for ( s = name; *s != '\0'; s++ ) {
+		if ( *s == '/' ) {
+			prev = last;
+			last = s;
+		}
+	}
+
+	if ( last == NULL || last == name )
+		return 0;
+
+	dirLen[ 0 ] = (int)( last - name );
+	if ( prev == NULL || prev == name )
+		return 1;
+
+	dirLen[ 1 ] = (int)( prev - name );
+	return 2;
+}
+
+
+/*
+=================
+FS_BuildFileIndex
+
+Hashes every pak entry of the current search path into a single table so name
+lookups cost one probe regardless of the number of pk3 files, must be called
+again after any change of the search order.
+Entries are also linked by directory so FS_ListFilteredFiles() only visits
+candidates instead of every file of every pak
+=================
+*/
+static void FS_BuildFileIndex( void )
+{
+	searchpath_t		*search;
+	fileIndexEntry_t	*entries, *entry;
+	fileIndexDirLink_t	*links, *link;
+	const pack_t		*pak;
+	int					numEntries, numDirs, numLinks;
+	int					size, order, i, j, n;
+	int					dirLen[ 2 ];
+	long				hash;
+
+	FS_FreeFileIndex();
+
+	numEntries = 0;
+	numDirs = 0;
+	numLinks = 0;
+	for ( search = fs_searchpaths; search; search = search->next ) {
+		if ( search->pack ) {
+			pak = search->pack;
+			numEntries += pak->numfiles;
+			for ( i = 0; i < pak->numfiles; i++ ) {
+				numLinks += FS_EntryDirLengths( pak->buildBuffer[ i ].name, dirLen );
+			}
+		} else {
+			numDirs++;
+		}
+	}
+
+	for ( size = 64; size < numEntries && size < MAX_FILEINDEX_SIZE; size <<= 1 )
+		;
+
+	fs_fileIndex = Z_TagMalloc( size * sizeof( fs_fileIndex[0] ) * 2 + numEntries * sizeof( *entries ) + numLinks * sizeof( *links ) + numDirs * sizeof( fs_indexDirs[0] ), TAG_SEARCH_PATH );
+	Com_Memset( fs_fileIndex, 0, size * sizeof( fs_fileIndex[0] ) * 2 );
+	fs_fileIndexSize = size;
+
+	fs_dirIndex = (fileIndexDirLink_t **)( fs_fileIndex + size );
+	entries = (fileIndexEntry_t *)( fs_dirIndex + size );
+	links = (fileIndexDirLink_t *)( entries + numEntries );
+	fs_indexDirs = (const searchpath_t **)( links + numLinks );
+
+	entry = entries;
+	order = 0;
+	for ( search = fs_searchpaths; search; search = search->next ) {
+		search->order = order++;
+		if ( search->pack ) {
+			pak = search->pack;
+			for ( i = 0; i < pak->numfiles; i++, entry++ ) {
+				entry->file = pak->buildBuffer + i;
+				entry->search = search;
+				entry->hash = FS_HashFileName( entry->file->name, 0U );
+			}
+		} else {
+			fs_indexDirs[ fs_numIndexDirs++ ] = search;
+		}
+	}
+
+	// link backwards so equal names are chained in search order
+	link = links + numLinks;
+	for ( j = numEntries - 1; j >= 0; j-- ) {
+		entry = &entries[ j ];
+		hash = entry->hash & ( size - 1 );
+		entry->next = fs_fileIndex[ hash ];
+		fs_fileIndex[ hash ] = entry;
+
+		n = FS_EntryDirLengths( entry->file->name, dirLen );
+		for ( i = 0; i < n; i++ ) {
+			link--;
+			link->entry = entry;
+			link->dirLen = dirLen[ i ];
+			hash = FS_HashDirName( entry->file->name, dirLen[ i ] ) & ( size - 1 );
+			link->next = fs_dirIndex[ hash ];
+			fs_dirIndex[ hash ] = link;
+		}
+	}
+}
+
+
+/*
+=================
+FS_IndexNext
+
+Returns next pak entry of filename in search order after entry, or the first one if entry is NULL
+=================
+*/
+static const fileIndexEntry_t *FS_IndexNext( const fileIndexEntry_t *entry, const char *filename, long fullHash )
+{
+	if ( entry == NULL ) {
+		if ( fs_fileIndex == NULL )
+			return NULL;
+		entry = fs_fileIndex[ fullHash & ( fs_fileIndexSize - 1 ) ];
+	} else {
+		entry = entry->next;
+	}
+
+	for ( ; entry != NULL; entry = entry->next ) {
+		// case and separator insensitive comparisons
+		if ( entry->hash == fullHash && !FS_FilenameCompare( entry->file->name, filename ) ) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
 static int FS_OpenFileInPak( fileHandle_t *file, pack_t *pak, fileInPack_t *pakFile, bool uniqueFILE ) {
 	fileHandleData_t *f;
 	unz_s *zfi;
@@ -1476,15 +1844,7 @@ static int FS_OpenFileInPak( fileHandle_t *file, pack_t *pak, fileInPack_t *pakF
 	// these are loaded from all pk3s
 	// from every pk3 file.
 
-	if ( !( pak->referenced & FS_GENERAL_REF ) && FS_GeneralRef( pakFile->name ) ) {
-		pak->referenced |= FS_GENERAL_REF;
-	}
-	if ( !( pak->referenced & FS_CGAME_REF ) && !strcmp( pakFile->name, "vm/cgame.qvm" ) ) {
-		pak->referenced |= FS_CGAME_REF;
-	}
-	if ( !( pak->referenced & FS_UI_REF ) && !strcmp( pakFile->name, "vm/ui.qvm" ) ) {
-		pak->referenced |= FS_UI_REF;
-	}
+	FS_MarkPakReference( pak, pakFile->name );
 
 	if ( !pak->handle ) {
 		pak->handle = unzOpen( pak->pakFilename );
@@ -1564,14 +1924,13 @@ extern bool			com_fullyInitialized;
 
 int FS_FOpenFileRead( const char *filename, fileHandle_t *file, bool uniqueFILE ) {
 	const searchpath_t	*search;
+	const fileIndexEntry_t *entry;
 	char			*netpath;
-	pack_t			*pak;
-	fileInPack_t	*pakFile;
 	directory_t		*dir;
-	long			hash;
 	long			fullHash;
 	FILE			*temp;
 	int				length;
+	int				i;
 	fileHandleData_t *f;
 
 	if ( !fs_searchpaths ) {
@@ -1595,106 +1954,84 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, bool uniqueFILE
 		return -1;
 	}
 
-	// we will calculate full hash only once then just mask it by current pack->hashSize
-	// we can do that as long as we know properties of our hash function
-	fullHash = FS_HashFileName( filename, 0U );
-
-	if ( file == NULL ) {
-		// just wants to see if file is there
-		for ( search = fs_searchpaths ; search ; search = search->next ) {
-			// is the element a pak file?
-			if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
-				// skip non-pure files
-				if ( !FS_PakIsPure( search->pack ) )
-					continue;
-				// look through all the pak file elements
-				pak = search->pack;
-				pakFile = pak->hashTable[hash];
-				do {
-					// case and separator insensitive comparisons
-					if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-						// found it!
-						return pakFile->size; 
-					}
-					pakFile = pakFile->next;
-				} while ( pakFile != NULL );
-			} else if ( search->dir && search->policy != DIR_DENY ) {
-				dir = search->dir;
-				netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
-				temp = Sys_FOpen( netpath, "rb" );
-				if ( temp ) {
-					length = FS_FileLength( temp );
-					fclose( temp );
-					return length;
-				}
-			}
-		}
-		return -1;
-	}
-
 	// make sure the q3key file is only readable by the quake3.exe at initialization
 	// any other time the key should only be accessed in memory using the provided functions
-	if ( com_fullyInitialized && strstr( filename, "q3key" ) ) {
+	if ( file != NULL && com_fullyInitialized && strstr( filename, "q3key" ) ) {
 		*file = FS_INVALID_HANDLE;
 		return -1;
 	}
 
+	fullHash = FS_HashFileName( filename, 0U );
+
+	// first pak entry allowed by the pure rules
+	for ( entry = FS_IndexNext( NULL, filename, fullHash ); entry; entry = FS_IndexNext( entry, filename, fullHash ) ) {
+		if ( FS_PakIsPure( entry->search->pack ) ) {
+			break;
+		}
+	}
+
 	//
-	// search through the path, one element at a time
+	// only directories in front of that pak can override it
 	//
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			if ( !FS_PakIsPure( search->pack ) ) {
-				continue;
-			}
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
-					return FS_OpenFileInPak( file, pak, pakFile, uniqueFILE );
-				}
-				pakFile = pakFile->next;
-			} while ( pakFile != NULL );
-		} else if ( search->dir && search->policy != DIR_DENY ) {
-			// check a file in the directory tree
-			dir = search->dir;
+	for ( i = 0; i < fs_numIndexDirs; i++ ) {
+		search = fs_indexDirs[ i ];
+		if ( entry && search->order > entry->search->order ) {
+			break;
+		}
+		if ( search->policy == DIR_DENY ) {
+			continue;
+		}
 
-			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+		// check a file in the directory tree
+		dir = search->dir;
 
-			temp = Sys_FOpen( netpath, "rb" );
-			if ( temp == NULL ) {
-				continue;
-			}
+		netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+
+		temp = Sys_FOpen( netpath, "rb" );
+		if ( temp == NULL ) {
+			continue;
+		}
 
-			*file = FS_HandleForFile();
-			f = &fsh[ *file ];
-			FS_InitHandle( f );
+		if ( file == NULL ) {
+			// just wants to see if file is there
+			length = FS_FileLength( temp );
+			fclose( temp );
+			return length;
+		}
 
-			f->handleFiles.file.o = temp;
-			Q_strncpyz( f->name, filename, sizeof( f->name ) );
-			f->zipFile = false;
+		*file = FS_HandleForFile();
+		f = &fsh[ *file ];
+		FS_InitHandle( f );
 
-			if ( fs_debug->integer ) {
-				Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
-					dir->path, dir->gamedir );
-			}
+		f->handleFiles.file.o = temp;
+		Q_strncpyz( f->name, filename, sizeof( f->name ) );
+		f->zipFile = false;
+
+		if ( fs_debug->integer ) {
+			Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s')\n", filename,
+				dir->path, dir->gamedir );
+		}
 
-			return FS_FileLength( f->handleFiles.file.o );
+		return FS_FileLength( f->handleFiles.file.o );
+	}
+
+	if ( entry ) {
+		if ( file == NULL ) {
+			return entry->file->size;
 		}
+		FS_ReadaheadRecord( entry->file->name );
+		return FS_OpenFileInPak( file, entry->search->pack, entry->file, uniqueFILE );
 	}
 
 #ifdef FS_MISSING
-	if ( missingFiles ) {
+	if ( missingFiles && file != NULL ) {
 		fprintf( missingFiles, "%s\n", filename );
 	}
 #endif
 
-	*file = FS_INVALID_HANDLE;
+	if ( file != NULL ) {
+		*file = FS_INVALID_HANDLE;
+	}
 	return -1;
 }
 
@@ -1705,43 +2042,22 @@ FS_TouchFileInPak
 ===========
 */
 void FS_TouchFileInPak( const char *filename ) {
-	const searchpath_t *search;
-	long			fullHash, hash;
+	const fileIndexEntry_t *entry;
+	long			fullHash;
 	pack_t			*pak;
-	fileInPack_t	*pakFile;
 
 	fullHash = FS_HashFileName( filename, 0U );
 
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		
-		// is the element a pak file?
-		if ( !search->pack )
-			continue;
-		
-		if ( search->pack->exclude ) // skip paks in \fs_excludeReference list
+	for ( entry = FS_IndexNext( NULL, filename, fullHash ); entry; entry = FS_IndexNext( entry, filename, fullHash ) ) {
+
+		pak = entry->search->pack;
+
+		if ( pak->exclude ) // skip paks in \fs_excludeReference list
 			continue;
 
-		if ( search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
-					if ( !( pak->referenced & FS_GENERAL_REF ) && FS_GeneralRef( filename ) ) {
-						pak->referenced |= FS_GENERAL_REF;
-					}
-					if ( !( pak->referenced & FS_CGAME_REF ) && !strcmp( filename, "vm/cgame.qvm" ) ) {
-						pak->referenced |= FS_CGAME_REF;
-					}
-					if ( !( pak->referenced & FS_UI_REF ) && !strcmp( filename, "vm/ui.qvm" ) ) {
-						pak->referenced |= FS_UI_REF;
-					}
-					return;
-				}
-				pakFile = pakFile->next;
-			} while ( pakFile != NULL );
-		}
+		// found it!
+		FS_MarkPakReference( pak, filename );
+		return;
 	}
 }
 
@@ -2017,10 +2333,8 @@ CONVENIENCE FUNCTIONS FOR ENTIRE FILES
 */
 
 bool FS_FileIsInPAK( const char *filename, int *pChecksum, char *pakName ) {
-	const searchpath_t	*search;
-	const pack_t		*pak;
-	const fileInPack_t	*pakFile;
-	long			hash;
+	const fileIndexEntry_t *entry;
+	const pack_t	*pak;
 	long			fullHash;
 
 	if ( !fs_searchpaths ) {
@@ -2045,2620 +2359,5378 @@ bool FS_FileIsInPAK( const char *filename, int *pChecksum, char *pakName ) {
 	fullHash = FS_HashFileName( filename, 0U );
 
 	//
-	// search through the path, one element at a time
+	// search through the pak entries in search order
 	//
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
-			// disregard if it doesn't match one of the allowed pure pak files
-			//if ( !FS_PakIsPure( search->pack ) ) {
-			//	continue;
-			//}
-			//
-			if ( search->pack->exclude ) {
-				continue;
-			}
+	for ( entry = FS_IndexNext( NULL, filename, fullHash ); entry; entry = FS_IndexNext( entry, filename, fullHash ) ) {
+		pak = entry->search->pack;
+
+		// disregard if it doesn't match one of the allowed pure pak files
+		//if ( !FS_PakIsPure( pak ) ) {
+		//	continue;
+		//}
+		//
+		if ( pak->exclude ) {
+			continue;
+		}
 
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					if ( pChecksum ) {
-						*pChecksum = pak->pure_checksum;
-					}
-					if ( pakName ) {
-						Com_sprintf( pakName, MAX_OSPATH, "%s/%s", pak->pakGamename, pak->pakBasename );
-					}
-					return true;
-				}
-				pakFile = pakFile->next;
-			} while ( pakFile != NULL );
+		if ( pChecksum ) {
+			*pChecksum = pak->pure_checksum;
 		}
-	}
+		if ( pakName ) {
+			Com_sprintf( pakName, MAX_OSPATH, "%s/%s", pak->pakGamename, pak->pakBasename );
+		}
+		return true;
+	}
 	return false;
 }
 
 
 /*
 ============
-FS_ReadFile
+FS_MapPackedEntry
 
-Filename are relative to the quake search path
-a null buffer will just return the file length without loading
+Maps a large pk3 entry stored without compression in place of a temp hunk copy.
+The view is copy-on-write, so the trailing zero and any in-place changes
+made by the caller stay private to this buffer
 ============
 */
-int FS_ReadFile( const char *qpath, void **buffer ) {
-	fileHandle_t	h;
-	byte*			buf;
-	bool		isConfig;
-	long			len;
+static byte *FS_MapPackedEntry( fileHandle_t h, int len ) {
+	fileHandleData_t *fd;
+	unsigned long	pos;
+	int				stored;
+	byte			*data;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	fd = &fsh[ h ];
+
+	if ( !fd->zipFile || !fs_mmap->integer || len < MIN_MAPPED_FILE_SIZE || fs_numMappedFiles >= MAX_MAPPED_FILES ) {
+		return NULL;
 	}
 
-	if ( !qpath || !qpath[0] ) {
-		Com_Error( ERR_FATAL, "FS_ReadFile with empty name" );
+	if ( unzGetCurrentFileDataPosition( fd->handleFiles.file.z, &pos, &stored ) != UNZ_OK || !stored ) {
+		return NULL;
 	}
 
-	buf = NULL;	// quiet compiler warning
-	isConfig = false;
+	// mappings start at page boundary so data is aligned as well as its offset
+	if ( pos & ( MAPPED_FILE_ALIGN - 1 ) ) {
+		return NULL;
+	}
 
-	// if this is a .cfg file and we are playing back a journal, read
-	// it from the journal file
-	if ( com_journalDataFile != FS_INVALID_HANDLE && strstr( qpath, ".cfg" ) ) {
-		if ( com_journal->integer == 2 ) {
-			int		r;
+	// the central directory always follows entry data, so len+1 is still inside the archive
+	data = Sys_MapFile( ((unz_s *)fd->handleFiles.file.z)->file, (fileOffset_t)pos, len + 1 );
+	if ( !data ) {
+		return NULL;
+	}
 
-			Com_DPrintf( "Loading %s from journal file.\n", qpath );
-			r = FS_Read( &len, sizeof( len ), com_journalDataFile );
-			if ( r != sizeof( len ) ) {
-				if (buffer != NULL) *buffer = NULL;
-				return -1;
-			}
-			// if the file didn't exist when the journal was created
-			if (!len) {
-				if (buffer == NULL) {
-					return 1;			// hack for old journal files
-				}
-				*buffer = NULL;
-				return -1;
-			}
-			if (buffer == NULL) {
-				return len;
-			}
+	// guarantee that it will have a trailing 0 for string operations
+	data[ len ] = '\0';
 
-			buf = Hunk_AllocateTempMemory(len+1);
-			*buffer = buf;
+	fs_mappedFiles[ fs_numMappedFiles ].data = data;
+	fs_mappedFiles[ fs_numMappedFiles ].length = len + 1;
+	fs_mappedFiles[ fs_numMappedFiles ].shared = true;
+	fs_numMappedFiles++;
 
-			r = FS_Read( buf, len, com_journalDataFile );
-			if ( r != len ) {
-				Com_Error( ERR_FATAL, "Read from journalDataFile failed" );
-			}
+	return data;
+}
 
-			fs_loadCount++;
-			fs_loadStack++;
 
-			// guarantee that it will have a trailing 0 for string operations
-			buf[len] = '\0';
+#ifdef USE_PK3_CACHE
+/*
+============
+FS_DetachMappedEntries
 
-			return len;
-		} else if ( com_journal->integer == 1 ) {
-			isConfig = true;
-		}
-	}
+Copies live pk3 views out of the file before it can be rewritten in place,
+reading a view of a truncated pk3 would fault
+============
+*/
+static void FS_DetachMappedEntries( void ) {
+	int i;
 
-	// look for it in the filesystem or pack files
-	len = FS_FOpenFileRead( qpath, &h, false );
-	if ( h == FS_INVALID_HANDLE ) {
-		if ( buffer ) {
-			*buffer = NULL;
-		}
-		// if we are journaling and it is a config file, write a zero to the journal file
-		if ( isConfig ) {
-			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
-			len = 0;
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
+	for ( i = 0; i < fs_numMappedFiles; i++ ) {
+		if ( fs_mappedFiles[ i ].shared && Sys_DetachMappedFile( fs_mappedFiles[ i ].data, fs_mappedFiles[ i ].length ) ) {
+			fs_mappedFiles[ i ].shared = false;
 		}
-		return -1;
 	}
+}
+#endif
 
-	if ( !buffer ) {
-		if ( isConfig ) {
-			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
-			FS_Write( &len, sizeof( len ), com_journalDataFile );
-			FS_Flush( com_journalDataFile );
-		}
-		FS_FCloseFile( h );
-		return len;
-	}
 
-	buf = Hunk_AllocateTempMemory( len + 1 );
-	*buffer = buf;
+#ifdef USE_CONTENT_CACHE
 
-	FS_Read( buf, len, h );
+/*
+=============================================================================
 
-	fs_loadCount++;
-	fs_loadStack++;
+CONTENT CACHE
 
-	// guarantee that it will have a trailing 0 for string operations
-	buf[ len ] = '\0';
-	FS_FCloseFile( h );
+Deflated pk3 entries of at least MIN_MAPPED_FILE_SIZE bytes loaded with
+FS_ReadFile are written decompressed to <fs_homepath>/contentcache and mapped
+from there on later loads instead of being inflated again.  Files are keyed by
+pak checksum, a CRC of the entry name and the entry CRC, so a changed pak
+never hits stale data, and the payload is checked against the entry CRC before
+it is used.  index.dat keeps their sizes and order of last use, the least
+recently used files are removed when the total exceeds fs_contentCache
+megabytes.  The order of use is saved with new files, on shutdown and at most
+every CONTENT_INDEX_SAVE_MSEC while files are served from the cache
 
-	// if we are journaling and it is a config file, write it to the journal file
-	if ( isConfig ) {
-		Com_DPrintf( "Writing %s to journal file.\n", qpath );
-		FS_Write( &len, sizeof( len ), com_journalDataFile );
-		FS_Write( buf, len, com_journalDataFile );
-		FS_Flush( com_journalDataFile );
-	}
-	return len;
-}
+=============================================================================
+*/
+
+#define CONTENT_CACHE_DIR		"contentcache"
+#define CONTENT_CACHE_INDEX		"index.dat"
+#define CONTENT_CACHE_IDENT		(('C'<<24)+('C'<<16)+('3'<<8)+'Q')
+#define CONTENT_CACHE_VERSION	2
+#define CONTENT_HEADER_SIZE		64		// keeps mapped payloads aligned
+#define CONTENT_INDEX_SAVE_MSEC	30000
+#define CONTENT_INDEX_IDENT		(('I'<<24)+('C'<<16)+('3'<<8)+'Q')
+#define CONTENT_CACHE_HASH_SIZE	1024
+
+typedef struct {
+	uint32_t	pakChecksum;
+	uint32_t	nameHash;
+	uint32_t	crc;
+	uint32_t	size;
+} contentKey_t;
+
+typedef struct {
+	uint32_t	ident;
+	uint32_t	version;
+	contentKey_t key;
+	byte		pad[ CONTENT_HEADER_SIZE - 8 - sizeof( contentKey_t ) ];
+} contentFileHeader_t;
+
+typedef struct {
+	contentKey_t key;
+	uint32_t	lastUse;
+	int			next;				// hash chain
+} contentEntry_t;
+
+typedef struct {
+	contentEntry_t	*entries;		// Z_Malloc'ed, grows as needed
+	int			numEntries;
+	int			maxEntries;
+	int			hash[ CONTENT_CACHE_HASH_SIZE ];
+	uint32_t	useCounter;
+	int64_t		totalSize;
+	bool		loaded;
+	bool		dirty;
+	int			lastSave;			// Sys_Milliseconds()
+
+	int			hits;
+	int			misses;
+	int			stores;
+	int			evictions;
+	int64_t		bytesServed;		// loaded from the cache instead of inflating
+	int64_t		bytesStored;
+} contentCache_t;
+
+static contentCache_t fs_cc;
 
 
 /*
-=============
-FS_FreeFile
-=============
+=================
+FS_ContentHashKey
+=================
 */
-void FS_FreeFile( void *buffer ) {
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
-	}
-	if ( !buffer ) {
-		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
-	}
-	fs_loadStack--;
+static int FS_ContentHashKey( const contentKey_t *key ) {
+	return ( key->pakChecksum ^ key->nameHash ^ key->crc ) & ( CONTENT_CACHE_HASH_SIZE - 1 );
+}
 
-	Hunk_FreeTempMemory( buffer );
 
-	// if all of our temp files are free, clear all of our space
-	if ( fs_loadStack == 0 ) {
-		Hunk_ClearTempMemory();
-	}
+/*
+=================
+FS_ContentCachePath
+=================
+*/
+static const char *FS_ContentCachePath( const contentKey_t *key, const char *ext ) {
+	return FS_BuildOSPath( fs_homepath->string, CONTENT_CACHE_DIR,
+		va( "%08x%08x%08x.%s", key->pakChecksum, key->nameHash, key->crc, ext ) );
 }
 
 
 /*
-============
-FS_WriteFile
-
-Filename are relative to the quake search path
-============
+=================
+FS_RehashContentCache
+=================
 */
-void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
-	fileHandle_t f;
+static void FS_RehashContentCache( void ) {
+	int i, h;
 
-	if ( !qpath || !buffer ) {
-		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	for ( i = 0; i < CONTENT_CACHE_HASH_SIZE; i++ ) {
+		fs_cc.hash[ i ] = -1;
 	}
 
-	f = FS_FOpenFileWrite( qpath );
-	if ( f == FS_INVALID_HANDLE ) {
-		Com_Printf( "Failed to open %s\n", qpath );
-		return;
+	fs_cc.totalSize = 0;
+	for ( i = 0; i < fs_cc.numEntries; i++ ) {
+		h = FS_ContentHashKey( &fs_cc.entries[ i ].key );
+		fs_cc.entries[ i ].next = fs_cc.hash[ h ];
+		fs_cc.hash[ h ] = i;
+		fs_cc.totalSize += fs_cc.entries[ i ].key.size;
 	}
-
-	FS_Write( buffer, size, f );
-
-	FS_FCloseFile( f );
 }
 
 
-
 /*
-==========================================================================
-
-ZIP FILE LOADING
-
-==========================================================================
+=================
+FS_FindContentEntry
+=================
 */
-static int FS_PakHashSize( const int filecount )
-{
-	int hashSize;
+static contentEntry_t *FS_FindContentEntry( const contentKey_t *key ) {
+	contentEntry_t *e;
+	int i;
 
-	for ( hashSize = 2; hashSize < MAX_FILEHASH_SIZE; hashSize <<= 1 ) {
-		if ( hashSize >= filecount ) {
-			break;
+	for ( i = fs_cc.hash[ FS_ContentHashKey( key ) ]; i != -1; i = e->next ) {
+		e = &fs_cc.entries[ i ];
+		if ( !memcmp( &e->key, key, sizeof( *key ) ) ) {
+			return e;
 		}
 	}
 
-	return hashSize;
+	return NULL;
 }
 
 
 /*
-============
-FS_BannedPakFile
-
-Check if file should NOT be added to hash search table
-============
+=================
+FS_AddContentEntry
+=================
 */
-static bool FS_BannedPakFile( const char *filename )
-{
-	if ( !strcmp( filename, "autoexec.cfg" ) || !strcmp( filename, Q3CONFIG_CFG ) )
-		return true;
-	else
-		return false;
+static void FS_AddContentEntry( const contentKey_t *key, uint32_t lastUse ) {
+	contentEntry_t *e;
+	int h;
+
+	if ( fs_cc.numEntries == fs_cc.maxEntries ) {
+		fs_cc.maxEntries = fs_cc.maxEntries ? fs_cc.maxEntries * 2 : 256;
+		e = Z_Malloc( fs_cc.maxEntries * sizeof( *e ) );
+		if ( fs_cc.numEntries ) {
+			Com_Memcpy( e, fs_cc.entries, fs_cc.numEntries * sizeof( *e ) );
+		}
+		if ( fs_cc.entries ) {
+			Z_Free( fs_cc.entries );
+		}
+		fs_cc.entries = e;
+	}
+
+	h = FS_ContentHashKey( key );
+	e = &fs_cc.entries[ fs_cc.numEntries ];
+	e->key = *key;
+	e->lastUse = lastUse;
+	e->next = fs_cc.hash[ h ];
+	fs_cc.hash[ h ] = fs_cc.numEntries++;
+	fs_cc.totalSize += key->size;
 }
 
 
 /*
 =================
-FS_ConvertFilename
+FS_RemoveContentEntry
 
-lower case and replace '\\' ':' with '/'
+Deletes the cache file as well
 =================
 */
-static void FS_ConvertFilename( char *name )
-{
-	int c;
-	while ( (c = *name) != '\0' ) {
-		if ( c <= 'Z' && c >= 'A' ) {
-			*name = c - 'A' + 'a';
-		} else if ( c == '\\' || c == ':' ) {
-			*name = '/';
-		}
-		name++;
-	}
+static void FS_RemoveContentEntry( contentEntry_t *e ) {
+	FS_Remove( FS_ContentCachePath( &e->key, "dat" ) );
+
+	*e = fs_cc.entries[ --fs_cc.numEntries ];
+	FS_RehashContentCache();
+	fs_cc.dirty = true;
 }
 
 
-#ifdef USE_PK3_CACHE
+/*
+=================
+FS_SaveContentCacheIndex
+=================
+*/
+static void FS_SaveContentCacheIndex( void ) {
+	uint32_t header[ 3 ];
+	FILE *f;
+	int i;
 
-#define PK3_HASH_SIZE 512
+	if ( !fs_cc.dirty ) {
+		return;
+	}
 
-static void FS_FreePak( pack_t *pak );
+	f = Sys_FOpen( FS_BuildOSPath( fs_homepath->string, CONTENT_CACHE_DIR, CONTENT_CACHE_INDEX ), "wb" );
+	if ( !f ) {
+		return;
+	}
 
-static pack_t *pakHashTable[ PK3_HASH_SIZE ];
+	header[ 0 ] = CONTENT_INDEX_IDENT;
+	header[ 1 ] = fs_cc.numEntries;
+	header[ 2 ] = fs_cc.useCounter;
+	fwrite( header, sizeof( header ), 1, f );
 
-#ifdef USE_PK3_CACHE_FILE
+	for ( i = 0; i < fs_cc.numEntries; i++ ) {
+		fwrite( &fs_cc.entries[ i ].key, sizeof( contentKey_t ), 1, f );
+		fwrite( &fs_cc.entries[ i ].lastUse, sizeof( uint32_t ), 1, f );
+	}
 
-#define CACHE_FILE_NAME "pk3cache.dat"
+	fclose( f );
+	fs_cc.dirty = false;
+	fs_cc.lastSave = Sys_Milliseconds();
+}
 
-#define CACHE_SYNC_CONDITION ( fs_paksReaded + fs_paksSkipped + fs_paksReleased >= 8 )
 
-static int fs_paksCached;	// readed from cache file
-static int fs_paksSkipped;	// outdated/non-existent cache file pk3 entries
+/*
+=================
+FS_LoadContentCacheIndex
+=================
+*/
+static void FS_LoadContentCacheIndex( void ) {
+	uint32_t header[ 3 ];
+	contentKey_t key;
+	uint32_t lastUse;
+	FILE *f;
+	int i;
 
-static int fs_paksReaded;	// actually readed from the disk
-static int fs_paksReleased;	// unreferenced paks since last FS restart
+	if ( fs_cc.loaded ) {
+		return;
+	}
 
-static bool fs_cacheLoaded = false;
-static bool fs_cacheSynced = true;
+	fs_cc.loaded = true;
+	FS_RehashContentCache();
 
-#pragma pack( push, 1 )
+	f = Sys_FOpen( FS_BuildOSPath( fs_homepath->string, CONTENT_CACHE_DIR, CONTENT_CACHE_INDEX ), "rb" );
+	if ( !f ) {
+		return;
+	}
 
-// platform-specific 4-byte signature:
-// 0: [version] anything following depends from it
-// 1: [endianess] 0 - LSB, 1 - MSB
-// 2: [path separation] '/' or '\\'
-// 3: [size of file offset and file time]
-// non-matching header will cause whole file being ignored
-static const byte cache_header[ 4 ] = {
-	0, //version
-#ifdef Q3_LITTLE_ENDIAN
-	0x0,
-#else
-	0x1,
-#endif
-	PATH_SEP,
-	( ( sizeof( fileOffset_t ) - 1 ) << 4 ) | ( sizeof( fileTime_t ) - 1 )
-};
+	if ( fread( header, sizeof( header ), 1, f ) == 1 && header[ 0 ] == CONTENT_INDEX_IDENT ) {
+		fs_cc.useCounter = header[ 2 ];
+		for ( i = 0; i < (int)header[ 1 ]; i++ ) {
+			if ( fread( &key, sizeof( key ), 1, f ) != 1 || fread( &lastUse, sizeof( lastUse ), 1, f ) != 1 ) {
+				break;
+			}
+			if ( !FS_FindContentEntry( &key ) ) {
+				FS_AddContentEntry( &key, lastUse );
+			}
+		}
+	}
 
-typedef struct pk3cacheHeader_s {
-	int pakNameLen;		// full path
-	int namesLen;
-	int numFiles;
-	int numHeaderLongs; // including first uninitialized
-	int contentLen;
-	fileTime_t ctime;	// creation/status change time
-	fileTime_t mtime;	// modification time
-	fileOffset_t size;	// zip file size
-} pk3cacheHeader_t;
+	fclose( f );
+}
 
-typedef struct pk3cacheFileItem_s {
-	unsigned long name; // offset in namebuffer
-	unsigned long size;
-	unsigned long pos;	// info position in pk3 file
-} pk3cacheFileItem_t;
 
-#pragma pack( pop )
+/*
+=================
+FS_CompareContentUse
+=================
+*/
+static int QDECL FS_CompareContentUse( const void *a, const void *b ) {
+	const contentEntry_t *ea = (const contentEntry_t *)a;
+	const contentEntry_t *eb = (const contentEntry_t *)b;
 
-#endif // USE_PK3_CACHE_FILE
+	if ( ea->lastUse < eb->lastUse )
+		return -1;
+	if ( ea->lastUse > eb->lastUse )
+		return 1;
+	return 0;
+}
 
 
-static int FS_HashPK3( const char *name )
-{
-	unsigned int c, hash = 0;
-	while ( (c = *name++) != '\0' )
-	{
-		hash = hash * 101 + c;
-	}
-	hash = hash ^ (hash >> 16);
-	return hash & (PK3_HASH_SIZE-1);
-}
+/*
+=================
+FS_TrimContentCache
 
+Removes least recently used files until the cache fits into limit bytes.
+Files that can't be deleted, like ones still mapped on Windows, are kept
+=================
+*/
+static void FS_TrimContentCache( int64_t limit ) {
+	contentEntry_t *e;
+	const char *path;
+	fileOffset_t size;
+	fileTime_t mtime, ctime;
+	int i, n;
 
-static pack_t *FS_FindInCache( const char *zipfile )
-{
-	pack_t *pack;
-	unsigned int hash;
+	if ( fs_cc.totalSize <= limit || !fs_cc.numEntries ) {
+		return;
+	}
 
-	hash = FS_HashPK3( zipfile );
-	pack = pakHashTable[ hash ];
-	while ( pack )
-	{
-		if ( !strcmp( zipfile, pack->pakFilename ) )
-		{
-			return pack;
+	// oldest first, hash chains are rebuilt below
+	qsort( fs_cc.entries, fs_cc.numEntries, sizeof( fs_cc.entries[0] ), FS_CompareContentUse );
+
+	for ( i = 0, n = 0; i < fs_cc.numEntries; i++ ) {
+		e = &fs_cc.entries[ i ];
+		if ( fs_cc.totalSize > limit ) {
+			path = FS_ContentCachePath( &e->key, "dat" );
+			if ( remove( path ) == 0 || !Sys_GetFileStats( path, &size, &mtime, &ctime ) ) {
+				fs_cc.totalSize -= e->key.size;
+				fs_cc.evictions++;
+				continue;
+			}
 		}
-		pack = pack->next;
+		fs_cc.entries[ n++ ] = *e;
 	}
 
-	return NULL;
+	fs_cc.numEntries = n;
+	FS_RehashContentCache();
+	fs_cc.dirty = true;
 }
 
 
-static void FS_AddToCache( pack_t *pack )
-{
-	pack->namehash = FS_HashPK3( pack->pakFilename );
-	pack->next = pakHashTable[ pack->namehash ];
-	pack->prev = NULL;
-	if ( pakHashTable[ pack->namehash ] )
-		pakHashTable[ pack->namehash ]->prev = pack;
-	pakHashTable[ pack->namehash ] = pack;
-}
+/*
+=================
+FS_ContentCacheKey
 
+Returns false if the entry opened in the handle is not worth caching
+=================
+*/
+static bool FS_ContentCacheKey( fileHandle_t h, const char *qpath, int len, contentKey_t *key ) {
+	const fileHandleData_t *fd;
+	unz_file_info info;
+	char name[ MAX_ZPATH ];
+	int i;
 
-static void FS_RemoveFromCache( pack_t *pack )
-{
-	if ( !pack->next && !pack->prev && pakHashTable[ pack->namehash ] != pack )
-	{
-		Com_Error( ERR_FATAL, "Invalid pak link" );
-	} 
+	fd = &fsh[ h ];
 
-	if ( pack->prev != NULL )
-		pack->prev->next = pack->next;
-	else
-		pakHashTable[ pack->namehash ] = pack->next;
+	if ( !fs_contentCache->integer || !fd->zipFile || !fd->pak || len < MIN_MAPPED_FILE_SIZE ) {
+		return false;
+	}
 
-	if ( pack->next != NULL )
-		pack->next->prev = pack->prev;
+	if ( unzGetCurrentFileInfo( fd->handleFiles.file.z, &info, NULL, 0, NULL, 0, NULL, 0 ) != UNZ_OK || info.compression_method == 0 ) {
+		return false;
+	}
+
+	for ( i = 0; i < sizeof( name ) && qpath[ i ]; i++ ) {
+		name[ i ] = ( qpath[ i ] == '\\' ) ? '/' : locase[ (byte)qpath[ i ] ];
+	}
+
+	key->pakChecksum = fd->pak->checksum;
+	key->nameHash = crc32_buffer( (const byte *)name, i );
+	key->crc = info.crc;
+	key->size = len;
+
+	FS_LoadContentCacheIndex();
+
+	// the limit may have been lowered since the last store
+	FS_TrimContentCache( (int64_t)fs_contentCache->integer * 1024 * 1024 );
+
+	return true;
 }
 
 
-static pack_t *FS_LoadCachedPK3( const char *zipfile )
-{
-	fileOffset_t size;
-	fileTime_t mtime;
-	fileTime_t ctime;
-	pack_t *pak;
+/*
+=================
+FS_ReadContentCache
 
-	pak = FS_FindInCache( zipfile );
-	if ( pak == NULL )
-		return NULL;
-	
-	if ( !Sys_GetFileStats( zipfile, &size, &mtime, &ctime ) )
-	{
-		FS_RemoveFromCache( pak );
-		FS_FreePak( pak );
+Returns the cached copy of the entry, mapped if possible, with a trailing zero.
+Copies that do not match the entry CRC are dropped and stored again
+=================
+*/
+static byte *FS_ReadContentCache( const contentKey_t *key ) {
+	contentFileHeader_t header;
+	contentEntry_t *e;
+	bool mapped;
+	byte *data;
+	FILE *f;
+
+	e = FS_FindContentEntry( key );
+	if ( !e ) {
+		fs_cc.misses++;
 		return NULL;
 	}
 
-	if ( pak->size != size || pak->mtime != mtime || pak->ctime != ctime )
-	{
-		// release outdated information
-		FS_RemoveFromCache( pak );
-		FS_FreePak( pak );
+	data = NULL;
+	mapped = false;
+	f = Sys_FOpen( FS_ContentCachePath( key, "dat" ), "rb" );
+	if ( f ) {
+		if ( fread( &header, sizeof( header ), 1, f ) == 1 && header.ident == CONTENT_CACHE_IDENT && header.version == CONTENT_CACHE_VERSION
+			&& !memcmp( &header.key, key, sizeof( *key ) ) && FS_FileLength( f ) == sizeof( header ) + key->size + 1 ) {
+			if ( fs_mmap->integer && fs_numMappedFiles < MAX_MAPPED_FILES ) {
+				data = Sys_MapFile( f, sizeof( header ), key->size + 1 );
+				mapped = ( data != NULL );
+			}
+			if ( !data ) {
+				data = Hunk_AllocateTempMemory( key->size + 1 );
+				fseek( f, sizeof( header ), SEEK_SET );
+				if ( fread( data, key->size + 1, 1, f ) != 1 ) {
+					Hunk_FreeTempMemory( data );
+					data = NULL;
+				}
+			}
+			if ( data && ( data[ key->size ] != '\0' || crc32_buffer( data, key->size ) != key->crc ) ) {
+				if ( mapped ) {
+					Sys_UnmapFile( data, key->size + 1 );
+				} else {
+					Hunk_FreeTempMemory( data );
+				}
+				data = NULL;
+			}
+			if ( data && mapped ) {
+				fs_mappedFiles[ fs_numMappedFiles ].data = data;
+				fs_mappedFiles[ fs_numMappedFiles ].length = key->size + 1;
+				fs_mappedFiles[ fs_numMappedFiles ].shared = false; // replaced by rename, never in place
+				fs_numMappedFiles++;
+			}
+		}
+		fclose( f );
+	}
+
+	if ( !data ) {
+		// missing or damaged, store it again
+		FS_RemoveContentEntry( e );
+		fs_cc.misses++;
 		return NULL;
 	}
 
-	return pak;
-}
+	e->lastUse = ++fs_cc.useCounter;
+	fs_cc.dirty = true;
 
+	fs_cc.hits++;
+	fs_cc.bytesServed += key->size;
 
-static void FS_InsertPK3ToCache( pack_t *pak )
-{
-	if ( Sys_GetFileStats( pak->pakFilename, &pak->size, &pak->mtime, &pak->ctime ) )
-	{
-		FS_AddToCache( pak );
-		pak->touched = true;
+	if ( Sys_Milliseconds() - fs_cc.lastSave >= CONTENT_INDEX_SAVE_MSEC ) {
+		FS_SaveContentCacheIndex();
 	}
+
+	return data;
 }
 
 
-static void FS_ResetCacheReferences( void )
-{
-	pack_t *pak;
-	int i;
-	for ( i = 0; i < ARRAY_LEN( pakHashTable ); i++ )
-	{
-		pak = pakHashTable[ i ];
-		while ( pak )
-		{
-			pak->touched = false;
-			pak->referenced = 0;
-			pak = pak->next;
-		}
+/*
+=================
+FS_WriteContentCache
+
+Stores a freshly inflated entry, buffer includes the trailing zero
+=================
+*/
+static void FS_WriteContentCache( const contentKey_t *key, const byte *buffer ) {
+	contentFileHeader_t header;
+	char tmpPath[ MAX_OSPATH * 2 + 1 ];
+	int64_t limit;
+	bool ok;
+	FILE *f;
+
+	limit = (int64_t)fs_contentCache->integer * 1024 * 1024;
+	if ( key->size > limit ) {
+		return;
 	}
-}
 
+	FS_TrimContentCache( limit - key->size );
 
-static void FS_FreeUnusedCache( void )
-{
-	pack_t *next, *pak;
-	int i;
+	Q_strncpyz( tmpPath, FS_ContentCachePath( key, "tmp" ), sizeof( tmpPath ) );
+	FS_CreatePath( tmpPath );
 
-	for ( i = 0; i < ARRAY_LEN( pakHashTable ); i++ )
-	{
-		pak = pakHashTable[ i ];
-		while ( pak ) 
-		{
-			next = pak->next;
-			if ( !pak->touched )
-			{
-				FS_RemoveFromCache( pak );
-				FS_FreePak( pak );
-#ifdef USE_PK3_CACHE_FILE
-				fs_paksReleased++;
-#endif
-			}
-			pak = next;
-		}
+	f = Sys_FOpen( tmpPath, "wb" );
+	if ( !f ) {
+		return;
 	}
-}
 
-#ifdef USE_PK3_CACHE_FILE
+	Com_Memset( &header, 0, sizeof( header ) );
+	header.ident = CONTENT_CACHE_IDENT;
+	header.version = CONTENT_CACHE_VERSION;
+	header.key = *key;
+	ok = fwrite( &header, sizeof( header ), 1, f ) == 1 && fwrite( buffer, key->size + 1, 1, f ) == 1;
+	ok = ( fclose( f ) == 0 ) && ok;
 
-static void FS_WriteCacheHeader( FILE *f )
-{
-	fwrite( cache_header, sizeof( cache_header ), 1, f );
+	// rename only complete files into place
+	if ( !ok || rename( tmpPath, FS_ContentCachePath( key, "dat" ) ) != 0 ) {
+		FS_Remove( tmpPath );
+		return;
+	}
+
+	FS_AddContentEntry( key, ++fs_cc.useCounter );
+	fs_cc.dirty = true;
+
+	fs_cc.stores++;
+	fs_cc.bytesStored += key->size;
+
+	FS_SaveContentCacheIndex();
 }
 
 
-static bool FS_ValidateCacheHeader( FILE *f )
-{
-	byte buf[ sizeof(cache_header) ];
+/*
+=================
+FS_ContentCache_f
+=================
+*/
+static void FS_ContentCache_f( void ) {
+	int lookups;
 
-	if ( fread( buf, sizeof( buf ), 1, f ) != 1 )
-		return false;
+	if ( !fs_contentCache->integer && !fs_cc.loaded ) {
+		Com_Printf( "content cache is disabled, set \\fs_contentCache to its size in megabytes\n" );
+		return;
+	}
 
-	if ( memcmp( buf, cache_header, sizeof( buf ) ) != 0 )
-		return false;
+	FS_LoadContentCacheIndex();
 
-	return true;
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "clear" ) ) {
+		FS_TrimContentCache( 0 );
+		FS_SaveContentCacheIndex();
+	}
+
+	lookups = fs_cc.hits + fs_cc.misses;
+	Com_Printf( "%i files, %.1f of %i MB\n", fs_cc.numEntries, fs_cc.totalSize / ( 1024.0 * 1024.0 ), fs_contentCache->integer );
+	Com_Printf( "%i hits, %i misses, %.1f%% hit rate\n", fs_cc.hits, fs_cc.misses, lookups ? fs_cc.hits * 100.0 / lookups : 0.0 );
+	Com_Printf( "%i stored, %i evicted\n", fs_cc.stores, fs_cc.evictions );
+	Com_Printf( "%.1f MB served without inflating, %.1f MB written\n",
+		fs_cc.bytesServed / ( 1024.0 * 1024.0 ), fs_cc.bytesStored / ( 1024.0 * 1024.0 ) );
 }
 
+#endif // USE_CONTENT_CACHE
 
-static bool FS_SavePackToFile( const pack_t *pak, FILE *f )
-{
-	const char *namePtr;
-	const char *pakName;
-	int i, pakNameLen;
-	pk3cacheHeader_t pk;
-	pk3cacheFileItem_t it;
-	int namesLen, contentLen;
-	
-	namePtr = (char*)(pak->buildBuffer + pak->numfiles);
 
-	pakName = pak->pakFilename;
-	pakNameLen = (int) strlen( pakName ) + 1;
-	pakNameLen = PAD( pakNameLen, sizeof( int ) );
+/*
+============
+FS_ReadFileData
+============
+*/
+static int FS_ReadFileData( const char *qpath, void **buffer ) {
+	fileHandle_t	h;
+	byte*			buf;
+	bool		isConfig;
+	long			len;
+#ifdef USE_CONTENT_CACHE
+	contentKey_t	key;
+	bool		cacheable;
+#endif
 
-	namesLen = pakName - namePtr;
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
 
-	// file content length
-	contentLen = 0;
-#if 0
-	for ( i = 0; i < pak->numfiles; i++ )
-	{
-		if ( pak->buildBuffer[ i ].data && pak->buildBuffer[ i ].size ) 
-		{
-			contentLen += sizeof( int ) + PAD( pak->buildBuffer[ i ].size, sizeof( int ) );
-		}
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFile with empty name" );
 	}
-#endif
-
-	// pak filename length
-	pk.pakNameLen = pakNameLen;
-	// filenames length
-	pk.namesLen = namesLen;
-	// number of files
-	pk.numFiles = pak->numfiles;
-	// number of checksums
-	pk.numHeaderLongs = pak->numHeaderLongs;
-	// content of some files
-	pk.contentLen = contentLen;
-	// creation/status change time
-	pk.ctime = pak->ctime;
-	// modification time
-	pk.mtime = pak->mtime;
-	// pak file size
-	pk.size = pak->size;
-
-	// dump header
-	fwrite( &pk, sizeof( pk ), 1, f );
-
-	// pak filename
-	fwrite( pakName, pakNameLen, 1, f );
-
-	// filenames
-	fwrite( namePtr, namesLen, 1, f );
 
-	// file entries
-	for ( i = 0; i < pak->numfiles; i++ )
-	{
-		it.name = (unsigned long)(pak->buildBuffer[i].name - namePtr);
-		it.size = pak->buildBuffer[i].size;
-		it.pos = pak->buildBuffer[i].pos;
-		fwrite( &it, sizeof( it ), 1, f );
-	}
+	buf = NULL;	// quiet compiler warning
+	isConfig = false;
 
-	// pure checksums, excluding first uninitialized
-	fwrite( pak->headerLongs + 1, (pak->numHeaderLongs - 1) * sizeof( pak->headerLongs[0] ), 1, f );
+	// if this is a .cfg file and we are playing back a journal, read
+	// it from the journal file
+	if ( com_journalDataFile != FS_INVALID_HANDLE && strstr( qpath, ".cfg" ) ) {
+		if ( com_journal->integer == 2 ) {
+			int		r;
 
-#if 0
-	if ( contentLen )
-	{
-		const fileInPack_t *currFile = pak->buildBuffer;
-		for ( i = 0; i < pak->numfiles; i++, currFile++ )
-		{
-			if ( currFile->data && currFile->size ) {
-				// file index
-				fwrite( &i, sizeof( i ), 1, f );
-				// file data
-				fwrite( currFile->data, PAD( currFile->size, sizeof( int ) ), 1, f );
+			Com_DPrintf( "Loading %s from journal file.\n", qpath );
+			r = FS_Read( &len, sizeof( len ), com_journalDataFile );
+			if ( r != sizeof( len ) ) {
+				if (buffer != NULL) *buffer = NULL;
+				return -1;
+			}
+			// if the file didn't exist when the journal was created
+			if (!len) {
+				if (buffer == NULL) {
+					return 1;			// hack for old journal files
+				}
+				*buffer = NULL;
+				return -1;
+			}
+			if (buffer == NULL) {
+				return len;
 			}
-		}
-	}
-#endif
-
-	return true;
-}
 
+			buf = Hunk_AllocateTempMemory(len+1);
+			*buffer = buf;
 
-static bool FS_LoadPakFromFile( FILE *f )
-{
-	fileTime_t ctime, mtime;
-	fileOffset_t fsize;
-	fileInPack_t *curFile;
-	char pakName[ PAD( MAX_OSPATH*3+1, sizeof( int ) ) ];
-	char pakBase[ PAD( MAX_OSPATH, sizeof( int ) ) ], *basename;
-	char *filename_inzip;
-	pk3cacheHeader_t pk;
-	pk3cacheFileItem_t it;
-	pack_t *pack;
-	char *namePtr;
-	int size, i;
-	int pakBaseLen;
-	int hashSize;
-	long hash;
+			r = FS_Read( buf, len, com_journalDataFile );
+			if ( r != len ) {
+				Com_Error( ERR_FATAL, "Read from journalDataFile failed" );
+			}
 
-	if ( fread( &pk, sizeof( pk ), 1, f ) != 1 )
-		return false; // probably EOF
+			fs_loadCount++;
+			fs_loadStack++;
 
-	// validate header data
+			// guarantee that it will have a trailing 0 for string operations
+			buf[len] = '\0';
 
-	if ( pk.pakNameLen > sizeof( pakName ) || pk.pakNameLen & 3 || pk.pakNameLen == 0 )
-	{
-		//Com_Printf( "bad pakNameLen: %08X\n", pk.pakNameLen );
-		return false;
+			return len;
+		} else if ( com_journal->integer == 1 ) {
+			isConfig = true;
+		}
 	}
 
-	if ( pk.namesLen & 3 || pk.namesLen < pk.numFiles )
-	{
-		//Com_Printf( "bad namesLen: %i\n", pk.namesLen );
-		return false;
+	// look for it in the filesystem or pack files
+	len = FS_FOpenFileRead( qpath, &h, false );
+	if ( h == FS_INVALID_HANDLE ) {
+		if ( buffer ) {
+			*buffer = NULL;
+		}
+		// if we are journaling and it is a config file, write a zero to the journal file
+		if ( isConfig ) {
+			Com_DPrintf( "Writing zero for %s to journal file.\n", qpath );
+			len = 0;
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		return -1;
 	}
 
-	if ( pk.numHeaderLongs == 0 || pk.numHeaderLongs > pk.numFiles + 1 )
-	{
-		//Com_Printf( "bad numHeaderLongs: %i\n", pk.numHeaderLongs );
-		return false;
+	if ( !buffer ) {
+		if ( isConfig ) {
+			Com_DPrintf( "Writing len for %s to journal file.\n", qpath );
+			FS_Write( &len, sizeof( len ), com_journalDataFile );
+			FS_Flush( com_journalDataFile );
+		}
+		FS_FCloseFile( h );
+		return len;
 	}
 
-	if ( pk.contentLen & 3 || pk.contentLen < 0 )
-	{
-		//Com_Printf( "bad contentLen: %i\n", pk.contentLen );
-		return false;
+	buf = isConfig ? NULL : FS_MapPackedEntry( h, len );
+#ifdef USE_CONTENT_CACHE
+	cacheable = !buf && !isConfig && FS_ContentCacheKey( h, qpath, len, &key );
+	if ( cacheable ) {
+		buf = FS_ReadContentCache( &key );
 	}
-
-	// load filename
-	if ( fread( pakName, pk.pakNameLen, 1, f ) != 1 )
-	{
-		//Com_Printf( "error reading pakname\n" );
-		return false;
+#endif
+	if ( buf ) {
+		*buffer = buf;
+		fs_loadCount++;
+		fs_loadStack++;
+		FS_FCloseFile( h );
+		return len;
 	}
 
-	// pakName must be zero-terminated
-	if ( pakName[ pk.pakNameLen - 1 ] != '\0' )
-	{
-		//Com_Printf( "pakname is not zero-terminated!\n" );
-		return false;
-	}
+	buf = Hunk_AllocateTempMemory( len + 1 );
+	*buffer = buf;
 
-	if ( !Sys_GetFileStats( pakName, &fsize, &mtime, &ctime ) || fsize != pk.size || mtime != pk.mtime || ctime != pk.ctime )
-	{
-		const int seek_len = pk.namesLen + pk.numFiles * sizeof( it ) + (pk.numHeaderLongs-1) * sizeof( pack->headerLongs[0] ) + pk.contentLen;
-		if ( fseek( f, seek_len, SEEK_CUR ) != 0 )
-		{
-			return false;
-		}
-		else
-		{
-			fs_paksSkipped++;
-			return true; // just outdated info, we can continue
-		}
+	// pk3 entries are decoded from a single read of their compressed data,
+	// the streaming read is only a fallback for entries that fail that way
+	if ( fsh[ h ].zipFile && unzReadCurrentFileEntire( fsh[ h ].handleFiles.file.z, buf, len ) == UNZ_OK ) {
+		fs_readCount += len;
+	} else {
+		FS_Read( buf, len, h );
 	}
 
-	// extract basename from zip path
-	basename = strrchr( pakName, PATH_SEP );
-	if ( basename == NULL )
-		basename = pakName;
-	else
-		basename++;
+	fs_loadCount++;
+	fs_loadStack++;
 
-	Q_strncpyz( pakBase, basename, sizeof( pakBase ) );
-	FS_StripExt( pakBase, ".pk3" );
-	pakBaseLen = (int) strlen( pakBase ) + 1;
-	pakBaseLen = PAD( pakBaseLen, sizeof( int ) );
+	// guarantee that it will have a trailing 0 for string operations
+	buf[ len ] = '\0';
+	FS_FCloseFile( h );
 
-	hashSize = FS_PakHashSize( pk.numFiles );
+#ifdef USE_CONTENT_CACHE
+	if ( cacheable ) {
+		FS_WriteContentCache( &key, buf );
+	}
+#endif
 
-	size = sizeof( *pack ) + pk.namesLen + pk.numFiles * sizeof( pack->buildBuffer[0] );
-	size += hashSize * sizeof( pack->hashTable[0] );
-	size += pk.pakNameLen;
-	size += pakBaseLen;
-	size += pk.numHeaderLongs * sizeof( pack->headerLongs[0] );
+	// if we are journaling and it is a config file, write it to the journal file
+	if ( isConfig ) {
+		Com_DPrintf( "Writing %s to journal file.\n", qpath );
+		FS_Write( &len, sizeof( len ), com_journalDataFile );
+		FS_Write( buf, len, com_journalDataFile );
+		FS_Flush( com_journalDataFile );
+	}
+	return len;
+}
 
-	pack = Z_TagMalloc( size, TAG_PACK );
-	Com_Memset( pack, 0, size );
 
-	pack->mtime = pk.mtime;
-	pack->ctime = pk.ctime;
-	pack->size = pk.size;
+/*
+============
+FS_ReadFile
 
-//	pack->handle = uf;
-	pack->numfiles = pk.numFiles;
-	pack->numHeaderLongs = pk.numHeaderLongs;
+Filename are relative to the quake search path
+a null buffer will just return the file length without loading
+============
+*/
+int FS_ReadFile( const char *qpath, void **buffer ) {
+	int len;
 
-	// setup memory layout
-	pack->hashSize = hashSize;
-	pack->hashTable = (fileInPack_t **)( pack + 1 );
+	TRACE_BEGIN_DETAIL( "FS_ReadFile", qpath );
+	len = FS_ReadFileData( qpath, buffer );
+	TRACE_END();
 
-	pack->buildBuffer = (fileInPack_t*)( pack->hashTable + pack->hashSize );
+	return len;
+}
 
-	namePtr = (char*)( pack->buildBuffer + pack->numfiles );
 
-	pack->pakFilename = (char*)( namePtr + pk.namesLen );
-	pack->pakBasename = (char*)( pack->pakFilename + pk.pakNameLen );
-	pack->headerLongs = (int*)( pack->pakBasename + pakBaseLen );
+/*
+=============
+FS_FreeFile
+=============
+*/
+void FS_FreeFile( void *buffer ) {
+	int i;
 
-	strcpy( pack->pakFilename, pakName );
-	strcpy( pack->pakBasename, pakBase );
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_FreeFile( NULL )" );
+	}
+	fs_loadStack--;
 
-	if ( fread( namePtr, pk.namesLen, 1, f ) != 1 )
-	{
-		//Com_Printf( "error reading pak filenames\n" );
-		goto __error;
+	for ( i = 0; i < fs_numMappedFiles; i++ ) {
+		if ( fs_mappedFiles[ i ].data == buffer ) {
+			break;
+		}
 	}
 
-	// filenames buffer must be zero-terminated
-	if ( namePtr[ pk.namesLen - 1 ] != '\0' )
-	{
-		//Com_Printf( "not zero terminated filenames\n" );
-		goto __error;
+	if ( i < fs_numMappedFiles ) {
+		Sys_UnmapFile( buffer, fs_mappedFiles[ i ].length );
+		fs_mappedFiles[ i ] = fs_mappedFiles[ --fs_numMappedFiles ];
+	} else {
+		Hunk_FreeTempMemory( buffer );
 	}
 
-	curFile = pack->buildBuffer;
-	for ( i = 0; i < pk.numFiles; i++ )
-	{
-		if ( fread( &it, sizeof( it ), 1, f ) != 1 )
-		{
-			//Com_Printf( "error reading file item[%i]\n", i );
-			goto __error;
-		}
-		if ( it.name >= pk.namesLen )
-		{
-			//Com_Printf( "bad name offset: %i (expecting less than %i)\n", it.name, pk.namesLen );
-			goto __error;
-		}
+	// if all of our temp files are free, clear all of our space
+	if ( fs_loadStack == 0 ) {
+		Hunk_ClearTempMemory();
+	}
+}
 
-		filename_inzip = namePtr + it.name;
-		FS_ConvertFilename( filename_inzip );
-		if ( !FS_BannedPakFile( filename_inzip ) ) {
-			// store the file position in the zip
-			curFile->name = filename_inzip;
-			curFile->size = it.size;
-			curFile->pos = it.pos;
 
-			// update hash table
-			hash = FS_HashFileName( filename_inzip, pack->hashSize );
-			curFile->next = pack->hashTable[ hash ];
-			pack->hashTable[ hash ] = curFile;
-			curFile++;
-		} else {
-			pack->numfiles--;
-		}
+/*
+=============
+FS_MapFile
+
+Maps a loose file or a pk3 entry stored without compression read-only into memory.
+Returns -1 with a NULL buffer if the file doesn't exist or can't be mapped
+=============
+*/
+int FS_MapFile( const char *qpath, void **buffer ) {
+	fileHandleData_t *fd;
+	fileHandle_t	h;
+	unsigned long	pos;
+	int				stored;
+	int				len;
+	void			*data;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
 	}
 
-	if ( fread( pack->headerLongs + 1, ( pack->numHeaderLongs - 1 ) * sizeof( pack->headerLongs[0] ), 1, f ) != 1 )
-	{
-		//Com_Printf( "error reading headerLongs\n" );
-		goto __error;
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_MapFile with empty name" );
 	}
 
-	pack->checksumFeed = fs_checksumFeed;
-	pack->headerLongs[ 0 ] = LittleLong( fs_checksumFeed );
+	*buffer = NULL;
 
-	pack->checksum = Com_BlockChecksum( pack->headerLongs + 1, sizeof( pack->headerLongs[0] ) * ( pack->numHeaderLongs - 1 ) );
-	pack->checksum = LittleLong( pack->checksum );
+	if ( !fs_mmap->integer ) {
+		return -1;
+	}
 
-	pack->pure_checksum = Com_BlockChecksum( pack->headerLongs, sizeof( pack->headerLongs[0] ) * pack->numHeaderLongs );
-	pack->pure_checksum = LittleLong( pack->pure_checksum );
+	// journaled config files must go through FS_ReadFile
+	if ( com_journalDataFile != FS_INVALID_HANDLE && strstr( qpath, ".cfg" ) ) {
+		return -1;
+	}
 
-	// seek through unused content
-	if ( pk.contentLen > 0 )
-	{
-		if ( fseek( f, pk.contentLen, SEEK_CUR ) != 0 )
-			goto __error;
+	len = FS_FOpenFileRead( qpath, &h, false );
+	if ( h == FS_INVALID_HANDLE ) {
+		return -1;
 	}
-	else if ( pk.contentLen < 0 )
-	{
-		goto __error;
+
+	fd = &fsh[ h ];
+	data = NULL;
+
+	if ( fd->zipFile ) {
+		if ( unzGetCurrentFileDataPosition( fd->handleFiles.file.z, &pos, &stored ) == UNZ_OK && stored ) {
+			data = Sys_MapFile( ((unz_s *)fd->handleFiles.file.z)->file, (fileOffset_t)pos, len );
+		}
+	} else {
+		data = Sys_MapFile( fd->handleFiles.file.o, 0, len );
 	}
 
-	fs_paksCached++;
+	// mapping stays valid after the file is closed
+	FS_FCloseFile( h );
 
-	FS_InsertPK3ToCache( pack );
+	if ( !data ) {
+		return -1;
+	}
 
-	return true;
+	fs_loadCount++;
 
-__error:
-	FS_FreePak( pack );
-	return false;
+	*buffer = data;
+	return len;
 }
 
 
 /*
-============
-FS_SaveCache
-
-Called at the end of FS_Startup() after releasing unused paks
-============
+=============
+FS_UnmapFile
+=============
 */
-static bool FS_SaveCache( void )
-{
-	const char *filename = CACHE_FILE_NAME;
-	const char *ospath;
-	const searchpath_t *sp;
-	FILE *f;
+void FS_UnmapFile( void *buffer, int length ) {
+	if ( !buffer ) {
+		Com_Error( ERR_FATAL, "FS_UnmapFile( NULL )" );
+	}
 
-	if ( !fs_searchpaths )
-		return false;
+	Sys_UnmapFile( buffer, length );
+}
 
-	if ( !fs_cacheLoaded )
-	{
-		Com_DPrintf( "synced FS cache on startup\n" );
-		fs_cacheSynced = false;
-		fs_cacheLoaded = true;
-	}
-	else if ( CACHE_SYNC_CONDITION )
-	{
-		Com_DPrintf( "synced FS cache on readed=%i, released=%i, skipped=%i\n",
-			fs_paksReaded, fs_paksReleased, fs_paksSkipped );
-		fs_cacheSynced = false;
-	}
 
-	if ( fs_cacheSynced )
-		return true;
+/*
+======================================================================================
 
-	sp = fs_searchpaths;
+ASYNCHRONOUS FILE READS
 
-	ospath = FS_BuildOSPath( fs_homepath->string, filename, NULL );
+Requests are resolved against the search path by the caller, the I/O thread
+only probes directories, reads and inflates. Completed reads are handed back
+and their callbacks run on the main thread, so they never overlap with the
+rest of the engine.
 
-	f = Sys_FOpen( ospath, "wb" );
-	if ( f == NULL )
-		return false;
+======================================================================================
+*/
 
-	FS_WriteCacheHeader( f );
+#define MAX_ASYNC_READS		256
 
-	while ( sp != NULL )
-	{
-		if ( sp->pack )
-		{
-			FS_SavePackToFile( sp->pack, f );
-		}
-		sp = sp->next;
-	}
+#define READAHEAD_CHUNK		65536
 
-	fclose( f );
+// pak entry for FS_AsyncReadahead(), paks stay valid until the queue is drained
+typedef struct readaheadEntry_s {
+	const pack_t		*pak;
+	unsigned long		pos;			// file info position in pak
+} readaheadEntry_t;
+
+typedef struct asyncRead_s {
+	struct asyncRead_s	*next;
+	char				qpath[MAX_QPATH];
+	pack_t				*pak;			// winning pak, NULL if only directories may have it
+	unsigned long		pos;			// file info position in pak
+	unsigned long		size;			// file size in pak
+	int					numDirs;		// directories to probe in front of pak
+	bool				fromPak;		// set by the I/O thread
+	int					length;			// -1 if not found
+	byte				*buffer;		// malloc()'ed by the I/O thread
+	fsReadCallback_t	callback;
+	void				*arg;
+	struct readaheadEntry_s	*readahead;	// pak entries to read ahead instead of a file, no callback
+	int					numReadahead;
+} asyncRead_t;
+
+static	asyncRead_t		fs_asyncReads[ MAX_ASYNC_READS ];
+static	asyncRead_t		*fs_asyncFree;
+static	asyncRead_t		*fs_asyncPending;
+static	asyncRead_t		**fs_asyncPendingTail = &fs_asyncPending;
+static	asyncRead_t		*fs_asyncDone;
+static	asyncRead_t		**fs_asyncDoneTail = &fs_asyncDone;
+static	int				fs_asyncOutstanding;	// main thread only
+
+static	void			*fs_asyncThread;
+static	void			*fs_asyncLock;
+static	void			*fs_asyncWake;			// posted for each pending request
+static	void			*fs_asyncSignal;		// posted for each completed request
+static	volatile int	fs_asyncQuit;
 
-	fs_paksReleased = 0;
-	fs_paksSkipped = 0;
-	fs_paksReaded = 0;
 
-	fs_cacheSynced = true;
+/*
+=================
+FS_AsyncOpenPak
 
-	return true;
+Runs on the I/O thread, keeps the last opened pak in pakFile between requests
+=================
+*/
+static bool FS_AsyncOpenPak( const pack_t *pak, FILE **pakFile, const pack_t **openPak, unsigned long *byteBefore )
+{
+	if ( *openPak != pak ) {
+		if ( *pakFile ) {
+			fclose( *pakFile );
+		}
+		*openPak = NULL;
+		*pakFile = Sys_FOpen( pak->pakFilename, "rb" );
+		if ( *pakFile && unzGetByteBeforeZipfile( *pakFile, byteBefore ) == UNZ_OK ) {
+			*openPak = pak;
+		}
+	}
+
+	return ( *openPak == pak );
 }
 
 
 /*
-============
-FS_LoadCache
+=================
+FS_AsyncLoadFile
 
-Called at FS_Startup() before loading any pk3 file
-============
+Runs on the I/O thread, pakFile keeps the last opened pak between requests
+=================
 */
-static void FS_LoadCache( void )
+static void FS_AsyncLoadFile( asyncRead_t *r, FILE **pakFile, const pack_t **openPak, unsigned long *byteBefore )
 {
-	const char *filename = CACHE_FILE_NAME;
-	const char *ospath;
-	FILE *f;
-
-	fs_paksReaded = 0;
-	fs_paksReleased = 0;
+	char			temp[MAX_OSPATH*2+1];
+	char			ospath[sizeof(temp)+MAX_OSPATH];
+	const searchpath_t *search;
+	FILE			*f;
+	int				i;
 
-	if ( fs_cacheLoaded )
-		return;
+	r->length = -1;
+	r->buffer = NULL;
+	r->fromPak = false;
 
-	fs_paksCached = 0;
-	fs_paksSkipped = 0;
+	// loose files in front of the pak
+	for ( i = 0; i < r->numDirs; i++ ) {
+		search = fs_indexDirs[ i ];
+		if ( search->policy == DIR_DENY ) {
+			continue;
+		}
 
-	ospath = FS_BuildOSPath( fs_homepath->string, filename, NULL );
+		Com_sprintf( temp, sizeof( temp ), "%c%s%c%s", PATH_SEP, search->dir->gamedir, PATH_SEP, r->qpath );
+		FS_ReplaceSeparators( temp );
+		Com_sprintf( ospath, sizeof( ospath ), "%s%s", search->dir->path, temp );
 
-	f = Sys_FOpen( ospath, "rb" );
-	if ( f == NULL )
-		return;
+		f = Sys_FOpen( ospath, "rb" );
+		if ( f == NULL ) {
+			continue;
+		}
 
-	if ( !FS_ValidateCacheHeader( f ) )
-	{
+		r->length = FS_FileLength( f );
+		r->buffer = malloc( r->length + 1 );
+		if ( r->buffer == NULL || ( r->length > 0 && fread( r->buffer, r->length, 1, f ) != 1 ) ) {
+			free( r->buffer );
+			r->buffer = NULL;
+			r->length = -1;
+		}
 		fclose( f );
-		return;
+		break;
 	}
 
-	while ( FS_LoadPakFromFile( f ) )
-		;
-
-	fclose( f );
-
-	fs_cacheLoaded = true;
+	if ( i == r->numDirs && r->pak != NULL ) {
+		if ( FS_AsyncOpenPak( r->pak, pakFile, openPak, byteBefore ) ) {
+			r->buffer = malloc( r->size + 1 );
+			if ( r->buffer && unzReadEntry( *pakFile, *byteBefore, r->pos, r->buffer, r->size ) == UNZ_OK ) {
+				r->length = (int)r->size;
+				r->fromPak = true;
+			} else {
+				free( r->buffer );
+				r->buffer = NULL;
+			}
+		}
+	}
 
-	Com_Printf( "...found %i cached paks\n", fs_paksCached );
+	if ( r->buffer ) {
+		// guarantee that it will have a trailing 0 for string operations
+		r->buffer[ r->length ] = '\0';
+	}
 }
 
-#endif // USE_PK3_CACHE_FILE
-
-#endif // USE_PK3_CACHE
-
 
 /*
 =================
-FS_LoadZipFile
+FS_AsyncReadahead
 
-Creates a new pak_t in the search chain for the contents
-of a zip file.
+Runs on the I/O thread, brings local headers and compressed data of pak entries
+into the OS cache, by a readahead hint or by reading them where there is none
 =================
 */
-static pack_t *FS_LoadZipFile( const char *zipfile )
+static void FS_AsyncReadahead( asyncRead_t *r, FILE **pakFile, const pack_t **openPak, unsigned long *byteBefore )
 {
-	fileInPack_t	*curFile;
-	pack_t			*pack;
-	unzFile			uf;
-	int				err;
-	unz_global_info gi;
-	char			filename_inzip[MAX_ZPATH];
-	unz_file_info	file_info;
-	unsigned int	i, namelen, hashSize, size;
-	long			hash;
-	int				fs_numHeaderLongs;
-	int				*fs_headerLongs;
-	int				filecount;
-	char			*namePtr;
-	const char		*basename;
-	int				fileNameLen;
-	int				baseNameLen;
+	const readaheadEntry_t *e;
+	unsigned long	offset, length, n;
+	byte			*chunk;
+	int				i;
 
-#ifdef USE_PK3_CACHE
-	pack = FS_LoadCachedPK3( zipfile );
-	if ( pack )
-	{
-		// update pure checksum
-		if ( pack->checksumFeed != fs_checksumFeed )
-		{
-			pack->headerLongs[ 0 ] = LittleLong( fs_checksumFeed );
-			pack->pure_checksum = Com_BlockChecksum( pack->headerLongs, sizeof( pack->headerLongs[0] ) * pack->numHeaderLongs );
-			pack->pure_checksum = LittleLong( pack->pure_checksum );
-			pack->checksumFeed = fs_checksumFeed;
+	chunk = NULL;
+
+	for ( i = 0, e = r->readahead; i < r->numReadahead; i++, e++ ) {
+		if ( !FS_AsyncOpenPak( e->pak, pakFile, openPak, byteBefore ) ) {
+			continue;
 		}
 
-		pack->touched = true;
-		return pack; // loaded from cache
-	}
-#endif
+		if ( unzGetEntryRange( *pakFile, *byteBefore, e->pos, &offset, &length ) != UNZ_OK ) {
+			continue;
+		}
 
-	// extract basename from zip path
-	basename = strrchr( zipfile, PATH_SEP );
-	if ( basename == NULL ) {
-		basename = zipfile;
-	} else {
-		basename++;
-	}
+		if ( Sys_ReadAhead( *pakFile, offset, length ) ) {
+			continue;
+		}
 
-	fileNameLen = (int) strlen( zipfile ) + 1;
-	baseNameLen = (int) strlen( basename ) + 1;
-
-	uf = unzOpen( zipfile );
-	err = unzGetGlobalInfo( uf, &gi );
-
-	if ( err != UNZ_OK ) {
-		return NULL;
-	}
-
-	namelen = 0;
-	filecount = 0;
-	unzGoToFirstFile( uf );
-	for (i = 0; i < gi.number_entry; i++)
-	{
-		err = unzGetCurrentFileInfo(uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0);
-		filename_inzip[sizeof(filename_inzip)-1] = '\0';
-		if (err != UNZ_OK) {
+		if ( chunk == NULL && ( chunk = malloc( READAHEAD_CHUNK ) ) == NULL ) {
 			break;
 		}
-		if ( file_info.compression_method != 0 && file_info.compression_method != 8 /*Z_DEFLATED*/ ) {
-			Com_Printf( S_COLOR_YELLOW "%s|%s: unsupported compression method %i\n", basename, filename_inzip, (int)file_info.compression_method );
-			unzGoToNextFile( uf );
+
+		if ( fseek( *pakFile, offset, SEEK_SET ) != 0 ) {
 			continue;
-		} 
-		namelen += strlen( filename_inzip ) + 1;
-		unzGoToNextFile( uf );
-		filecount++;
-	}
+		}
 
-	if ( filecount == 0 ) {
-		unzClose( uf );
-		return NULL;
+		for ( ; length > 0; length -= n ) {
+			n = ( length < READAHEAD_CHUNK ) ? length : READAHEAD_CHUNK;
+			if ( fread( chunk, n, 1, *pakFile ) != 1 ) {
+				break;
+			}
+		}
 	}
 
-	// get the hash table size from the number of files in the zip
-	// because lots of custom pk3 files have less than 32 or 64 files
-	hashSize = FS_PakHashSize( filecount );
+	free( chunk );
+}
 
-	namelen = PAD( namelen, sizeof( int ) );
-	size = sizeof( *pack ) + hashSize * sizeof( pack->hashTable[0] ) + filecount * sizeof( pack->buildBuffer[0] ) + namelen;
-	size += PAD( fileNameLen, sizeof( int ) );
-	size += PAD( baseNameLen, sizeof( int ) );
-#ifdef USE_PK3_CACHE
-	size += ( filecount + 1 ) * sizeof( fs_headerLongs[0] );
-#endif
-	pack = Z_TagMalloc( size, TAG_PACK );
-	Com_Memset( pack, 0, size );
 
-	pack->handle = uf;
-	pack->numfiles = filecount;
-	pack->hashSize = hashSize;
-	pack->hashTable = (fileInPack_t **)( pack + 1 );
+/*
+=================
+FS_AsyncThread
+=================
+*/
+static void FS_AsyncThread( void *arg )
+{
+	const pack_t	*openPak = NULL;
+	FILE			*pakFile = NULL;
+	unsigned long	byteBefore = 0;
+	asyncRead_t		*r;
+	bool			idle;
 
-	pack->buildBuffer = (fileInPack_t*)( pack->hashTable + pack->hashSize );
-	namePtr = (char*)( pack->buildBuffer + filecount );
+	for ( ;; ) {
+		Sys_WaitSemaphore( fs_asyncWake );
 
-	pack->pakFilename = (char*)( namePtr + namelen );
-	pack->pakBasename = (char*)( pack->pakFilename + PAD( fileNameLen, sizeof( int ) ) );
+		if ( Sys_AtomicLoad( &fs_asyncQuit ) )
+			break;
 
-#ifdef USE_PK3_CACHE
-	fs_headerLongs = (int*)( pack->pakBasename + PAD( baseNameLen, sizeof( int ) ) );
-#else
-	fs_headerLongs = Z_Malloc( ( filecount + 1 ) * sizeof( fs_headerLongs[0] ) );
-#endif
+		Sys_LockMutex( fs_asyncLock );
+		r = fs_asyncPending;
+		fs_asyncPending = r->next;
+		if ( fs_asyncPending == NULL ) {
+			fs_asyncPendingTail = &fs_asyncPending;
+		}
+		Sys_UnlockMutex( fs_asyncLock );
 
-	fs_numHeaderLongs = 0;
-	fs_headerLongs[ fs_numHeaderLongs++ ] = LittleLong( fs_checksumFeed );
+		if ( r->readahead ) {
+			TRACE_BEGIN( "FS_AsyncReadahead" );
+			FS_AsyncReadahead( r, &pakFile, &openPak, &byteBefore );
+		} else {
+			TRACE_BEGIN_DETAIL( "FS_AsyncLoadFile", r->qpath );
+			FS_AsyncLoadFile( r, &pakFile, &openPak, &byteBefore );
+		}
+		TRACE_END();
+
+		Sys_LockMutex( fs_asyncLock );
+		r->next = NULL;
+		*fs_asyncDoneTail = r;
+		fs_asyncDoneTail = &r->next;
+		idle = ( fs_asyncPending == NULL );
+		// paks may be released or replaced once the queue is drained
+		if ( idle && pakFile ) {
+			fclose( pakFile );
+			pakFile = NULL;
+			openPak = NULL;
+		}
+		Sys_UnlockMutex( fs_asyncLock );
 
-	Com_Memcpy( pack->pakFilename, zipfile, fileNameLen );
-	Com_Memcpy( pack->pakBasename, basename, baseNameLen );
+		Sys_PostSemaphore( fs_asyncSignal );
+	}
 
-	// strip .pk3 if needed
-	FS_StripExt( pack->pakBasename, ".pk3" );
+	if ( pakFile ) {
+		fclose( pakFile );
+	}
+}
 
-	unzGoToFirstFile( uf );
-	curFile = pack->buildBuffer;
-	for ( i = 0; i < gi.number_entry; i++ )
-	{
-		err = unzGetCurrentFileInfo( uf, &file_info, filename_inzip, sizeof(filename_inzip), NULL, 0, NULL, 0 );
-		filename_inzip[sizeof(filename_inzip)-1] = '\0';
-		if (err != UNZ_OK) {
+
+/*
+=================
+FS_DeliverAsyncReads
+
+Runs callbacks of completed reads on the main thread. Requests are taken
+off the done list one at a time and released before the callback, so a
+callback that drops to Com_Error leaves the rest queued and counted
+=================
+*/
+static void FS_DeliverAsyncReads( void )
+{
+	char			qpath[MAX_QPATH];
+	fsReadCallback_t callback;
+	asyncRead_t		*r;
+	void			*arg;
+	byte			*buf, *data;
+	int				length;
+
+	for ( ;; ) {
+		Sys_LockMutex( fs_asyncLock );
+		r = fs_asyncDone;
+		if ( r ) {
+			fs_asyncDone = r->next;
+			if ( fs_asyncDone == NULL ) {
+				fs_asyncDoneTail = &fs_asyncDone;
+			}
+		}
+		Sys_UnlockMutex( fs_asyncLock );
+
+		if ( r == NULL ) {
 			break;
 		}
-		if ( file_info.compression_method != 0 && file_info.compression_method != 8 /*Z_DEFLATED*/ ) {
-			unzGoToNextFile( uf );
+
+		if ( r->readahead ) {
+			free( r->readahead );
+			r->readahead = NULL;
+			r->next = fs_asyncFree;
+			fs_asyncFree = r;
+			fs_asyncOutstanding--;
 			continue;
-		} 
-		if ( file_info.uncompressed_size > 0 ) {
-			fs_headerLongs[fs_numHeaderLongs++] = LittleLong( file_info.crc );
 		}
 
-		FS_ConvertFilename( filename_inzip );
-		if ( !FS_BannedPakFile( filename_inzip ) ) {
-			// store the file position in the zip
-			unzGetCurrentFileInfoPosition( uf, &curFile->pos );
-			curFile->size = file_info.uncompressed_size;
-			curFile->name = namePtr;
-			strcpy( curFile->name, filename_inzip );
-			namePtr += strlen( filename_inzip ) + 1;
-
-			// update hash table
-			hash = FS_HashFileName( filename_inzip, pack->hashSize );
-			curFile->next = pack->hashTable[ hash ];
-			pack->hashTable[ hash ] = curFile; 
-			curFile++;
-		} else {
-			pack->numfiles--;
+		if ( r->fromPak ) {
+			FS_MarkPakReference( r->pak, r->qpath );
 		}
 
-		unzGoToNextFile( uf );
-	}
+		if ( r->buffer && fs_debug->integer ) {
+			Com_Printf( "FS_ReadFileAsync: %s (found in '%s')\n", r->qpath,
+				r->fromPak ? r->pak->pakFilename : "directory" );
+		}
 
-	pack->checksum = Com_BlockChecksum( fs_headerLongs + 1, sizeof( fs_headerLongs[0] ) * ( fs_numHeaderLongs - 1 ) );
-	pack->checksum = LittleLong( pack->checksum );
+		Q_strncpyz( qpath, r->qpath, sizeof( qpath ) );
+		callback = r->callback;
+		arg = r->arg;
+		data = r->buffer;
+		length = r->length;
+		r->buffer = NULL;
 
-	pack->pure_checksum = Com_BlockChecksum( fs_headerLongs, sizeof( fs_headerLongs[0] ) * fs_numHeaderLongs );
-	pack->pure_checksum = LittleLong( pack->pure_checksum );
+		r->next = fs_asyncFree;
+		fs_asyncFree = r;
+		fs_asyncOutstanding--;
 
-#ifdef USE_PK3_CACHE
-	pack->headerLongs = fs_headerLongs;
-	pack->numHeaderLongs = fs_numHeaderLongs;
-	pack->checksumFeed = fs_checksumFeed;
-#else
-	Z_Free( fs_headerLongs );
-#endif
+		buf = NULL;
+		if ( data ) {
+			// hand out the same kind of buffer as FS_ReadFile
+			fs_loadCount++;
+			fs_loadStack++;
+			buf = Hunk_AllocateTempMemory( length + 1 );
+			Com_Memcpy( buf, data, length + 1 );
+			free( data );
+		}
 
-#ifdef USE_HANDLE_CACHE
-	FS_AddToHandleList( pack );
-#else
-	if ( fs_locked->integer == 0 )
-	{
-		unzClose( pack->handle );
-		pack->handle = NULL;
+		callback( qpath, buf, length, arg );
 	}
-#endif
-
-#ifdef USE_PK3_CACHE
-	FS_InsertPK3ToCache( pack );
-#ifdef USE_PK3_CACHE_FILE
-	fs_paksReaded++;
-#endif
-#endif
-
-	return pack;
 }
 
 
 /*
 =================
-FS_FreePak
+FS_RunAsyncReads
 
-Frees a pak structure and releases all associated resources
+Delivers reads completed since the last call
 =================
 */
-static void FS_FreePak( pack_t *pak )
+void FS_RunAsyncReads( void )
 {
-	if ( pak->handle )
-	{
-#ifdef USE_HANDLE_CACHE
-		if ( pak->next_h )
-			FS_RemoveFromHandleList( pak );
-#endif
-		unzClose( pak->handle );
-		pak->handle = NULL;
+	if ( fs_asyncOutstanding ) {
+		FS_DeliverAsyncReads();
 	}
-
-	Z_Free( pak );
 }
 
 
 /*
 =================
-FS_CompareZipChecksum
+FS_FinishAsyncReads
 
-Compares whether the given pak file matches a referenced checksum
+Blocks until all queued reads are delivered
 =================
 */
-bool FS_CompareZipChecksum(const char *zipfile)
+void FS_FinishAsyncReads( void )
 {
-	pack_t *thepak;
-	int index, checksum;
-	
-	thepak = FS_LoadZipFile( zipfile );
-	
-	if ( !thepak )
-		return false;
-	
-	checksum = thepak->checksum;
-#ifndef USE_PK3_CACHE
-	FS_FreePak(thepak);
-#endif
-	
-	for(index = 0; index < fs_numServerReferencedPaks; index++)
-	{
-		if(checksum == fs_serverReferencedPaks[index])
-			return true;
+	while ( fs_asyncOutstanding ) {
+		Sys_WaitSemaphore( fs_asyncSignal );
+		FS_DeliverAsyncReads();
 	}
-	
-	return false;
 }
 
 
 /*
 =================
-FS_GetZipChecksum
+FS_StartAsyncReads
 =================
 */
-int FS_GetZipChecksum( const char *zipfile ) 
+static bool FS_StartAsyncReads( void )
 {
-	pack_t *pak;
-	int checksum;
-	
-	pak = FS_LoadZipFile( zipfile );
-	
-	if ( !pak )
-		return 0xFFFFFFFF;
-	
-	checksum = pak->checksum;
-#ifndef USE_PK3_CACHE
-	FS_FreePak( pak );
-#endif
+	static bool failed = false;
+	int i;
 
-	return checksum;
-} 
+	if ( fs_asyncThread ) {
+		return true;
+	}
 
+	if ( failed ) {
+		return false;
+	}
 
-/*
-=================================================================================
+	fs_asyncFree = NULL;
+	for ( i = MAX_ASYNC_READS - 1; i >= 0; i-- ) {
+		fs_asyncReads[ i ].next = fs_asyncFree;
+		fs_asyncFree = &fs_asyncReads[ i ];
+	}
 
-DIRECTORY SCANNING FUNCTIONS
+	if ( !fs_asyncLock ) {
+		fs_asyncLock = Sys_CreateMutex();
+		fs_asyncWake = Sys_CreateSemaphore();
+		fs_asyncSignal = Sys_CreateSemaphore();
+	}
 
-=================================================================================
-*/
+	fs_asyncThread = Sys_CreateThread( FS_AsyncThread, NULL );
+	if ( !fs_asyncThread ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't start file I/O thread, reading synchronously\n" );
+		failed = true;
+		return false;
+	}
 
-static int FS_ReturnPath( const char *zname, char *zpath, int *depth ) {
-	int len, at, newdep;
+	return true;
+}
 
-	newdep = 0;
-	zpath[0] = '\0';
-	len = 0;
-	at = 0;
 
-	while(zname[at] != 0)
-	{
-		if (zname[at]=='/' || zname[at]=='\\') {
-			len = at;
-			newdep++;
-		}
-		at++;
+/*
+=================
+FS_StopAsyncReads
+
+Drains the queue and joins the I/O thread
+=================
+*/
+static void FS_StopAsyncReads( void )
+{
+	if ( !fs_asyncThread ) {
+		return;
 	}
-	strcpy(zpath, zname);
-	zpath[len] = '\0';
-	*depth = newdep;
 
-	return len;
-}
+	FS_FinishAsyncReads();
 
+	Sys_AtomicStore( &fs_asyncQuit, 1 );
+	Sys_PostSemaphore( fs_asyncWake );
+	Sys_JoinThread( fs_asyncThread );
+	Sys_AtomicStore( &fs_asyncQuit, 0 );
 
-char *FS_CopyString( const char *in ) {
-	char *out;
-	//out = S_Malloc( strlen( in ) + 1 );
-	out = Z_Malloc( strlen( in ) + 1 );
-	strcpy( out, in );
-	return out;
+	fs_asyncThread = NULL;
 }
 
 
 /*
-==================
-FS_AddFileToList
-==================
+=================
+FS_ReadFileAsync
+
+Queues qpath for the I/O thread, see qcommon.h
+=================
 */
-static int FS_AddFileToList( const char *name, char **list, int nfiles ) {
-	int		i;
+void FS_ReadFileAsync( const char *qpath, fsReadCallback_t callback, void *arg )
+{
+	const fileIndexEntry_t *entry;
+	asyncRead_t		*r;
+	void			*buf;
+	long			fullHash;
+	int				len, numDirs;
 
-	if ( nfiles == MAX_FOUND_FILES - 1 ) {
-		return nfiles;
-	}
-	for ( i = 0 ; i < nfiles ; i++ ) {
-		if ( !Q_stricmp( name, list[i] ) ) {
-			return nfiles; // already in list
-		}
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
 	}
-	list[ nfiles ] = FS_CopyString( name );
-	nfiles++;
 
-	return nfiles;
-}
+	if ( !qpath || !qpath[0] || !callback ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileAsync with empty name or callback" );
+	}
+
+	// qpaths are not supposed to have a leading slash
+	if ( qpath[0] == '/' || qpath[0] == '\\' ) {
+		qpath++;
+	}
+
+	// journaled configs, long names and thread failures go the old way
+	if ( ( com_journalDataFile != FS_INVALID_HANDLE && strstr( qpath, ".cfg" ) )
+		|| strlen( qpath ) >= MAX_QPATH || !FS_StartAsyncReads() ) {
+		len = FS_ReadFile( qpath, &buf );
+		callback( qpath, buf, len, arg );
+		return;
+	}
+
+	if ( FS_CheckDirTraversal( qpath ) || ( com_fullyInitialized && strstr( qpath, "q3key" ) ) ) {
+		callback( qpath, NULL, -1, arg );
+		return;
+	}
+
+	fullHash = FS_HashFileName( qpath, 0U );
+
+	// same rules as in FS_FOpenFileRead
+	for ( entry = FS_IndexNext( NULL, qpath, fullHash ); entry; entry = FS_IndexNext( entry, qpath, fullHash ) ) {
+		if ( FS_PakIsPure( entry->search->pack ) ) {
+			break;
+		}
+	}
+
+	for ( numDirs = 0; numDirs < fs_numIndexDirs; numDirs++ ) {
+		if ( entry && fs_indexDirs[ numDirs ]->order > entry->search->order ) {
+			break;
+		}
+	}
+
+	if ( !entry && !numDirs ) {
+		callback( qpath, NULL, -1, arg );
+		return;
+	}
+
+	if ( entry ) {
+		FS_ReadaheadRecord( entry->file->name );
+	}
+
+	// queue is full, wait for the I/O thread
+	if ( !fs_asyncFree ) {
+		FS_FinishAsyncReads();
+	}
+
+	r = fs_asyncFree;
+	fs_asyncFree = r->next;
+	fs_asyncOutstanding++;
+
+	Q_strncpyz( r->qpath, qpath, sizeof( r->qpath ) );
+	r->pak = entry ? entry->search->pack : NULL;
+	r->pos = entry ? entry->file->pos : 0;
+	r->size = entry ? entry->file->size : 0;
+	r->numDirs = numDirs;
+	r->callback = callback;
+	r->arg = arg;
+	r->readahead = NULL;
+	r->numReadahead = 0;
+	r->next = NULL;
+
+	Sys_LockMutex( fs_asyncLock );
+	*fs_asyncPendingTail = r;
+	fs_asyncPendingTail = &r->next;
+	Sys_UnlockMutex( fs_asyncLock );
+
+	Sys_PostSemaphore( fs_asyncWake );
+}
 
 
 /*
-===============
-FS_AllowListExternal
-===============
+======================================================================================
+
+MAP LOAD READAHEAD
+
+Pak entries opened between FS_BeginMapLoad() and FS_EndMapLoad() are recorded
+in first use order to fs_homepath/readahead/<game>/<map>.txt. Next load of the
+same map hands them to the I/O thread which asks the OS to read them ahead,
+so loaders find most of their data already in the page cache.
+
+======================================================================================
 */
-static bool FS_AllowListExternal( const char *extension ) 
-{
-	if ( !extension )
-		return false;
 
-	if ( !Q_stricmp( extension, ".shader" ) )
-		return false;
+#define READAHEAD_DIR			"readahead"
+#define MAX_READAHEAD_FILES		4096
+#define READAHEAD_HASH_SIZE		1024
+#define READAHEAD_NAMES_SIZE	( MAX_READAHEAD_FILES * 48 )
+#define READAHEAD_BATCH			64		// entries per I/O thread request
 
-	if ( !Q_stricmp( extension, ".shaderx" ) )
-		return false;
-	
-	if ( !Q_stricmp( extension, ".mtr" ) )
-		return false;
+#define RA_LISTED				1		// in the manifest of the previous load
+#define RA_OPENED				2		// opened during this load
 
-	return true;
+typedef struct {
+	int				name;			// offset in names
+	int				flags;
+	int				next;			// hash chain
+} readaheadFile_t;
+
+typedef struct {
+	bool			active;
+	char			mapname[MAX_QPATH];
+	int				startTime;
+	readaheadFile_t	files[ MAX_READAHEAD_FILES ];
+	int				numFiles;
+	int				hash[ READAHEAD_HASH_SIZE ];
+	int				order[ MAX_READAHEAD_FILES ];	// opened files in first use order
+	int				numOpened;
+	char			*names;
+	int				namesLen;
+	int				numQueued;		// listed files handed to the I/O thread
+	int64_t			queuedBytes;
+	int				lastTime;		// load time stored in the manifest, -1 if none
+	int				lastMode;		// fs_readahead value of that load
+} readahead_t;
+
+static readahead_t fs_ra;
+
+
+/*
+=================
+FS_ReadaheadPath
+=================
+*/
+static const char *FS_ReadaheadPath( const char *mapname ) {
+	char name[MAX_QPATH];
+	char *s;
+
+	Q_strncpyz( name, mapname, sizeof( name ) );
+	for ( s = name; *s != '\0'; s++ ) {
+		if ( *s == '/' || *s == '\\' || *s == ':' || *s == '.' ) {
+			*s = '_';
+		}
+	}
+
+	return FS_BuildOSPath( fs_homepath->string, READAHEAD_DIR, va( "%s/%s.txt", fs_gamedir, name ) );
 }
 
-static fnamecallback_f fnamecallback = NULL;
 
-void FS_SetFilenameCallback( fnamecallback_f func ) 
-{
-	fnamecallback = func;
+/*
+=================
+FS_ReadaheadFile
+
+Returns index of a recorded file, adds it if not found, -1 if out of space
+=================
+*/
+static int FS_ReadaheadFile( const char *name ) {
+	readaheadFile_t *f;
+	long hash;
+	int i, len;
+
+	hash = FS_HashFileName( name, READAHEAD_HASH_SIZE );
+	for ( i = fs_ra.hash[ hash ]; i >= 0; i = fs_ra.files[ i ].next ) {
+		if ( !Q_stricmp( fs_ra.names + fs_ra.files[ i ].name, name ) ) {
+			return i;
+		}
+	}
+
+	len = (int)strlen( name ) + 1;
+	if ( fs_ra.numFiles >= MAX_READAHEAD_FILES || fs_ra.namesLen + len > READAHEAD_NAMES_SIZE ) {
+		return -1;
+	}
+
+	f = &fs_ra.files[ fs_ra.numFiles ];
+	f->name = fs_ra.namesLen;
+	f->flags = 0;
+	f->next = fs_ra.hash[ hash ];
+	fs_ra.hash[ hash ] = fs_ra.numFiles;
+
+	Com_Memcpy( fs_ra.names + fs_ra.namesLen, name, len );
+	fs_ra.namesLen += len;
+
+	return fs_ra.numFiles++;
 }
 
 
 /*
-===============
-FS_ListFilteredFiles
+=================
+FS_ReadaheadRecord
 
-Returns a unique list of files that match the given criteria
-from all search paths
-===============
+Called for each pak entry opened while a map is loading
+=================
 */
-static char **FS_ListFilteredFiles( const char *path, const char *extension, const char *filter, int *numfiles, int flags ) {
-	int				nfiles;
-	char			**listCopy;
-	char			*list[MAX_FOUND_FILES];
-	const searchpath_t	*search;
-	int				i;
-	int				pathLength;
-	int				extLen;
-	int				length, pathDepth, temp;
-	pack_t			*pak;
-	fileInPack_t	*buildBuffer;
-	char			zpath[MAX_ZPATH];
-	bool			hasPatterns;
-	const char		*x;
+static void FS_ReadaheadRecord( const char *name ) {
+	int i;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	if ( !fs_ra.active ) {
+		return;
 	}
 
-	if  ( fs_numServerPaks && !( flags & FS_MATCH_STICK ) ) {
-		flags &= ~FS_MATCH_UNPURE;
-		if ( !FS_AllowListExternal( extension ) )
-			flags &= ~FS_MATCH_EXTERN;
+	i = FS_ReadaheadFile( name );
+	if ( i < 0 || fs_ra.files[ i ].flags & RA_OPENED ) {
+		return;
 	}
 
-	if ( !path ) {
-		*numfiles = 0;
-		return NULL;
+	fs_ra.files[ i ].flags |= RA_OPENED;
+	fs_ra.order[ fs_ra.numOpened++ ] = i;
+}
+
+
+/*
+=================
+FS_QueueReadaheadBatch
+=================
+*/
+static void FS_QueueReadaheadBatch( readaheadEntry_t *batch, int count ) {
+	asyncRead_t	*r;
+
+	r = fs_asyncFree;
+	fs_asyncFree = r->next;
+	fs_asyncOutstanding++;
+
+	r->qpath[0] = '\0';
+	r->pak = NULL;
+	r->callback = NULL;
+	r->arg = NULL;
+	r->readahead = batch;
+	r->numReadahead = count;
+	r->next = NULL;
+
+	Sys_LockMutex( fs_asyncLock );
+	*fs_asyncPendingTail = r;
+	fs_asyncPendingTail = &r->next;
+	Sys_UnlockMutex( fs_asyncLock );
+
+	Sys_PostSemaphore( fs_asyncWake );
+}
+
+
+/*
+=================
+FS_QueueReadahead
+
+Hands pak entries of the listed files to the I/O thread in manifest order,
+never waits for free request slots
+=================
+*/
+static void FS_QueueReadahead( void ) {
+	const fileIndexEntry_t *entry;
+	readaheadEntry_t *batch;
+	const char	*name;
+	long		fullHash;
+	int			i, n;
+
+	if ( !FS_StartAsyncReads() ) {
+		return;
 	}
 
-	if ( !extension ) {
-		extension = "";
+	// reclaim finished requests
+	FS_RunAsyncReads();
+
+	batch = NULL;
+	n = 0;
+	for ( i = 0; i < fs_ra.numFiles; i++ ) {
+		name = fs_ra.names + fs_ra.files[ i ].name;
+		fullHash = FS_HashFileName( name, 0U );
+
+		// same rules as in FS_FOpenFileRead
+		for ( entry = FS_IndexNext( NULL, name, fullHash ); entry; entry = FS_IndexNext( entry, name, fullHash ) ) {
+			if ( FS_PakIsPure( entry->search->pack ) ) {
+				break;
+			}
+		}
+		if ( entry == NULL ) {
+			continue;
+		}
+
+		if ( batch == NULL ) {
+			if ( !fs_asyncFree || ( batch = malloc( READAHEAD_BATCH * sizeof( batch[0] ) ) ) == NULL ) {
+				return;
+			}
+			n = 0;
+		}
+
+		batch[ n ].pak = entry->search->pack;
+		batch[ n ].pos = entry->file->pos;
+		n++;
+
+		fs_ra.numQueued++;
+		fs_ra.queuedBytes += entry->file->size;
+
+		if ( n == READAHEAD_BATCH ) {
+			FS_QueueReadaheadBatch( batch, n );
+			batch = NULL;
+		}
 	}
 
-	extLen = (int)strlen( extension );
-	hasPatterns = Com_HasPatterns( extension );
-	if ( hasPatterns && extension[0] == '.' && extension[1] != '\0' ) {
-		extension++;
+	if ( batch ) {
+		FS_QueueReadaheadBatch( batch, n );
 	}
+}
 
-	pathLength = strlen( path );
-	if ( pathLength > 0 && ( path[pathLength-1] == '\\' || path[pathLength-1] == '/' ) ) {
-		pathLength--;
+
+/*
+=================
+FS_LoadReadaheadManifest
+=================
+*/
+static void FS_LoadReadaheadManifest( void ) {
+	char		line[MAX_OSPATH];
+	FILE		*f;
+	int			i, len;
+
+	f = Sys_FOpen( FS_ReadaheadPath( fs_ra.mapname ), "rb" );
+	if ( f == NULL ) {
+		return;
 	}
-	nfiles = 0;
-	FS_ReturnPath(path, zpath, &pathDepth);
 
-	//
-	// search through the path, one element at a time, adding to list
-	//
-	for (search = fs_searchpaths ; search ; search = search->next) {
-		// is the element a pak file?
-		if ( search->pack && ( flags & FS_MATCH_PK3s ) ) {
+	while ( fgets( line, sizeof( line ), f ) ) {
+		len = (int)strlen( line );
+		while ( len > 0 && ( line[len-1] == '\n' || line[len-1] == '\r' ) ) {
+			line[--len] = '\0';
+		}
+		if ( len == 0 ) {
+			continue;
+		}
+		if ( line[0] == '/' && line[1] == '/' ) {
+			sscanf( line + 2, "%i %i", &fs_ra.lastTime, &fs_ra.lastMode );
+			continue;
+		}
+		if ( len >= MAX_QPATH || FS_CheckDirTraversal( line ) ) {
+			continue;
+		}
+		i = FS_ReadaheadFile( line );
+		if ( i < 0 ) {
+			break;
+		}
+		fs_ra.files[ i ].flags |= RA_LISTED;
+	}
 
-			//ZOID:  If we are pure, don't search for files on paks that
-			// aren't on the pure list
-			if ( !FS_PakIsPure( search->pack ) && !( flags & FS_MATCH_UNPURE ) ) {
-				continue;
-			}
+	fclose( f );
+}
 
-			// look through all the pak file elements
-			pak = search->pack;
-			buildBuffer = pak->buildBuffer;
-			for (i = 0; i < pak->numfiles; i++) {
-				const char *name;
-				int zpathLen, depth;
 
-				// check for directory match
-				name = buildBuffer[i].name;
-				//
-				if ( filter ) {
-					// case insensitive
-					if ( !Com_FilterPath( filter, name ) )
-						continue;
-					// unique the match
-					nfiles = FS_AddFileToList( name, list, nfiles );
-				}
-				else {
+/*
+=================
+FS_BeginMapLoad
 
-					zpathLen = FS_ReturnPath(name, zpath, &depth);
+Starts recording files opened by the map load and reads ahead the ones
+recorded last time, listen server calls it twice for the same map
+=================
+*/
+void FS_BeginMapLoad( const char *mapname ) {
 
-					if ( (depth-pathDepth)>2 || pathLength > zpathLen || Q_stricmpn( name, path, pathLength ) ) {
-						continue;
-					}
+	if ( fs_ra.active ) {
+		if ( !Q_stricmp( fs_ra.mapname, mapname ) ) {
+			return;
+		}
+		FS_CancelMapLoad();
+	}
 
-					// check for extension match
-					length = (int)strlen( name );
-
-					if ( fnamecallback ) {
-						// use custom filter
-						if ( !fnamecallback( name, length ) )
-							continue;
-					} else {
-						if ( length < extLen )
-							continue;
-						if ( *extension ) {
-							if ( hasPatterns ) {
-								x = strrchr( name, '.' );
-								if ( !x || !Com_FilterExt( extension, x+1 ) ) {
-									continue;
-								}
-							} else {
-								if ( Q_stricmp( name + length - extLen, extension ) ) {
-									continue;
-								}
-							}
-						}
-					}
-					// unique the match
+	if ( !fs_searchpaths || !fs_readahead->integer || !mapname[0] ) {
+		return;
+	}
 
-					temp = pathLength;
-					if (pathLength) {
-						temp++;		// include the '/'
-					}
-					nfiles = FS_AddFileToList( name + temp, list, nfiles );
-				}
-			}
-		} else if ( search->dir && ( flags & FS_MATCH_EXTERN ) && search->policy != DIR_DENY ) { // scan for files in the filesystem
-			const char *netpath;
-			int		numSysFiles;
-			char	**sysFiles;
-			const char *name;
+	fs_ra.names = Z_Malloc( READAHEAD_NAMES_SIZE );
+	fs_ra.namesLen = 0;
+	fs_ra.numFiles = 0;
+	fs_ra.numOpened = 0;
+	fs_ra.numQueued = 0;
+	fs_ra.queuedBytes = 0;
+	fs_ra.lastTime = -1;
+	fs_ra.lastMode = 0;
+	Com_Memset( fs_ra.hash, -1, sizeof( fs_ra.hash ) );
+	Q_strncpyz( fs_ra.mapname, mapname, sizeof( fs_ra.mapname ) );
 
-			netpath = FS_BuildOSPath( search->dir->path, search->dir->gamedir, path );
-			sysFiles = Sys_ListFiles( netpath, extension, filter, &numSysFiles, false );
-			for ( i = 0 ; i < numSysFiles ; i++ ) {
-				// unique the match
-				name = sysFiles[ i ];
-				length = strlen( name );
-				if ( fnamecallback ) {
-					// use custom filter
-					if ( !fnamecallback( name, length ) )
-						continue;
-				} // else - should be already filtered by Sys_ListFiles
+	fs_ra.active = true;
+	fs_ra.startTime = Sys_Milliseconds();
 
-				nfiles = FS_AddFileToList( name, list, nfiles );
-			}
-			Sys_FreeFileList( sysFiles );
-		}		
+	FS_LoadReadaheadManifest();
+
+	if ( fs_readahead->integer == 1 ) {
+		FS_QueueReadahead();
 	}
+}
 
-	// return a copy of the list
-	*numfiles = nfiles;
 
-	if ( !nfiles ) {
-		return NULL;
+/*
+=================
+FS_CancelMapLoad
+=================
+*/
+void FS_CancelMapLoad( void ) {
+	if ( fs_ra.active ) {
+		Z_Free( fs_ra.names );
+		fs_ra.names = NULL;
+		fs_ra.active = false;
+	}
+}
+
+
+/*
+=================
+FS_EndMapLoad
+
+Stores the files opened during the map load and prints how long it took
+compared to the previous load
+=================
+*/
+void FS_EndMapLoad( void ) {
+	const char	*ospath;
+	FILE		*f;
+	int			i, hits, loadTime;
+
+	if ( !fs_ra.active ) {
+		return;
+	}
+
+	loadTime = Sys_Milliseconds() - fs_ra.startTime;
+
+	hits = 0;
+	for ( i = 0; i < fs_ra.numOpened; i++ ) {
+		if ( fs_ra.files[ fs_ra.order[ i ] ].flags & RA_LISTED ) {
+			hits++;
+		}
+	}
+
+	Com_Printf( "map %s loaded in %i ms, %i pak files opened", fs_ra.mapname, loadTime, fs_ra.numOpened );
+	if ( fs_ra.numQueued ) {
+		Com_Printf( ", %i of them read ahead (%i files, %.1f MB)", hits, fs_ra.numQueued, fs_ra.queuedBytes / ( 1024.0 * 1024.0 ) );
+	}
+	Com_Printf( "\n" );
+	if ( fs_ra.lastTime >= 0 ) {
+		Com_Printf( "previous load: %i ms, %s\n", fs_ra.lastTime, fs_ra.lastMode == 1 ? "with readahead" : "without readahead" );
+	}
+
+	ospath = FS_ReadaheadPath( fs_ra.mapname );
+	FS_CreatePath( ospath );
+	f = Sys_FOpen( ospath, "wb" );
+	if ( f ) {
+		fprintf( f, "// %i %i\n", loadTime, fs_ra.numQueued ? 1 : 0 );
+		for ( i = 0; i < fs_ra.numOpened; i++ ) {
+			fprintf( f, "%s\n", fs_ra.names + fs_ra.files[ fs_ra.order[ i ] ].name );
+		}
+		fclose( f );
+	}
+
+	FS_CancelMapLoad();
+}
+
+
+
+/*
+============
+FS_WriteFile
+
+Filename are relative to the quake search path
+============
+*/
+void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
+	fileHandle_t f;
+
+	if ( !qpath || !buffer ) {
+		Com_Error( ERR_FATAL, "FS_WriteFile: NULL parameter" );
+	}
+
+	f = FS_FOpenFileWrite( qpath );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( "Failed to open %s\n", qpath );
+		return;
+	}
+
+	FS_Write( buffer, size, f );
+
+	FS_FCloseFile( f );
+}
+
+
+
+/*
+==========================================================================
+
+ZIP FILE LOADING
+
+==========================================================================
+*/
+static int FS_PakHashSize( const int filecount )
+{
+	int hashSize;
+
+	for ( hashSize = 2; hashSize < MAX_FILEHASH_SIZE; hashSize <<= 1 ) {
+		if ( hashSize >= filecount ) {
+			break;
+		}
+	}
+
+	return hashSize;
+}
+
+
+/*
+============
+FS_BannedPakFile
+
+Check if file should NOT be added to hash search table
+============
+*/
+static bool FS_BannedPakFile( const char *filename )
+{
+	if ( !strcmp( filename, "autoexec.cfg" ) || !strcmp( filename, Q3CONFIG_CFG ) )
+		return true;
+	else
+		return false;
+}
+
+
+/*
+=================
+FS_ConvertFilename
+
+lower case and replace '\\' ':' with '/'
+=================
+*/
+static void FS_ConvertFilename( char *name )
+{
+	int c;
+	while ( (c = *name) != '\0' ) {
+		if ( c <= 'Z' && c >= 'A' ) {
+			*name = c - 'A' + 'a';
+		} else if ( c == '\\' || c == ':' ) {
+			*name = '/';
+		}
+		name++;
+	}
+}
+
+
+#ifdef USE_PK3_CACHE
+
+#define PK3_HASH_SIZE 512
+
+static void FS_FreePak( pack_t *pak );
+
+static pack_t *pakHashTable[ PK3_HASH_SIZE ];
+
+#ifdef USE_PK3_CACHE_FILE
+
+#define CACHE_FILE_NAME "pk3cache.dat"
+
+#define CACHE_SYNC_CONDITION ( fs_paksReaded + fs_paksSkipped + fs_paksReleased >= 8 )
+
+static int fs_paksCached;	// readed from cache file
+static int fs_paksSkipped;	// outdated/non-existent cache file pk3 entries
+
+static int fs_paksReaded;	// actually readed from the disk
+static int fs_paksReleased;	// unreferenced paks since last FS restart
+
+static bool fs_cacheLoaded = false;
+static bool fs_cacheSynced = true;
+
+#pragma pack( push, 1 )
+
+// platform-specific 4-byte signature:
+// 0: [version] anything following depends from it
+// 1: [endianess] 0 - LSB, 1 - MSB
+// 2: [path separation] '/' or '\\'
+// 3: [size of file offset and file time]
+// non-matching header will cause whole file being ignored
+static const byte cache_header[ 4 ] = {
+	1, //version
+#ifdef Q3_LITTLE_ENDIAN
+	0x0,
+#else
+	0x1,
+#endif
+	PATH_SEP,
+	( ( sizeof( fileOffset_t ) - 1 ) << 4 ) | ( sizeof( fileTime_t ) - 1 )
+};
+
+typedef struct pk3cacheHeader_s {
+	int pakNameLen;		// full path
+	int namesLen;
+	int numFiles;
+	int numHeaderLongs; // including first uninitialized
+	int contentLen;
+	int checksum;		// regular checksum, pure one depends from feed
+	fileTime_t ctime;	// creation/status change time
+	fileTime_t mtime;	// modification time
+	fileOffset_t size;	// zip file size
+} pk3cacheHeader_t;
+
+typedef struct pk3cacheFileItem_s {
+	unsigned long name; // offset in namebuffer
+	unsigned long size;
+	unsigned long pos;	// info position in pk3 file
+} pk3cacheFileItem_t;
+
+#pragma pack( pop )
+
+#endif // USE_PK3_CACHE_FILE
+
+
+static int FS_HashPK3( const char *name )
+{
+	unsigned int c, hash = 0;
+	while ( (c = *name++) != '\0' )
+	{
+		hash = hash * 101 + c;
+	}
+	hash = hash ^ (hash >> 16);
+	return hash & (PK3_HASH_SIZE-1);
+}
+
+
+static pack_t *FS_FindInCache( const char *zipfile )
+{
+	pack_t *pack;
+	unsigned int hash;
+
+	hash = FS_HashPK3( zipfile );
+	pack = pakHashTable[ hash ];
+	while ( pack )
+	{
+		if ( !strcmp( zipfile, pack->pakFilename ) )
+		{
+			return pack;
+		}
+		pack = pack->next;
+	}
+
+	return NULL;
+}
+
+
+static void FS_AddToCache( pack_t *pack )
+{
+	pack->namehash = FS_HashPK3( pack->pakFilename );
+	pack->next = pakHashTable[ pack->namehash ];
+	pack->prev = NULL;
+	if ( pakHashTable[ pack->namehash ] )
+		pakHashTable[ pack->namehash ]->prev = pack;
+	pakHashTable[ pack->namehash ] = pack;
+}
+
+
+static void FS_RemoveFromCache( pack_t *pack )
+{
+	if ( !pack->next && !pack->prev && pakHashTable[ pack->namehash ] != pack )
+	{
+		Com_Error( ERR_FATAL, "Invalid pak link" );
+	} 
+
+	if ( pack->prev != NULL )
+		pack->prev->next = pack->next;
+	else
+		pakHashTable[ pack->namehash ] = pack->next;
+
+	if ( pack->next != NULL )
+		pack->next->prev = pack->prev;
+}
+
+
+static pack_t *FS_LoadCachedPK3( const char *zipfile )
+{
+	fileOffset_t size;
+	fileTime_t mtime;
+	fileTime_t ctime;
+	pack_t *pak;
+
+	pak = FS_FindInCache( zipfile );
+	if ( pak == NULL )
+		return NULL;
+	
+	if ( !Sys_GetFileStats( zipfile, &size, &mtime, &ctime ) )
+	{
+		FS_RemoveFromCache( pak );
+		FS_FreePak( pak );
+		return NULL;
+	}
+
+	if ( pak->size != size || pak->mtime != mtime || pak->ctime != ctime )
+	{
+		// release outdated information
+		FS_RemoveFromCache( pak );
+		FS_FreePak( pak );
+		return NULL;
+	}
+
+	return pak;
+}
+
+
+static void FS_InsertPK3ToCache( pack_t *pak )
+{
+	if ( Sys_GetFileStats( pak->pakFilename, &pak->size, &pak->mtime, &pak->ctime ) )
+	{
+		FS_AddToCache( pak );
+		pak->touched = true;
+	}
+}
+
+
+static void FS_ResetCacheReferences( void )
+{
+	pack_t *pak;
+	int i;
+	for ( i = 0; i < ARRAY_LEN( pakHashTable ); i++ )
+	{
+		pak = pakHashTable[ i ];
+		while ( pak )
+		{
+			pak->touched = false;
+			pak->referenced = 0;
+			pak = pak->next;
+		}
+	}
+}
+
+
+static void FS_FreeUnusedCache( void )
+{
+	pack_t *next, *pak;
+	int i;
+
+	for ( i = 0; i < ARRAY_LEN( pakHashTable ); i++ )
+	{
+		pak = pakHashTable[ i ];
+		while ( pak ) 
+		{
+			next = pak->next;
+			if ( !pak->touched )
+			{
+				FS_RemoveFromCache( pak );
+				FS_FreePak( pak );
+#ifdef USE_PK3_CACHE_FILE
+				fs_paksReleased++;
+#endif
+			}
+			pak = next;
+		}
+	}
+}
+
+#ifdef USE_PK3_CACHE_FILE
+
+static void FS_WriteCacheHeader( FILE *f )
+{
+	fwrite( cache_header, sizeof( cache_header ), 1, f );
+}
+
+
+static bool FS_ValidateCacheHeader( FILE *f )
+{
+	byte buf[ sizeof(cache_header) ];
+
+	if ( fread( buf, sizeof( buf ), 1, f ) != 1 )
+		return false;
+
+	if ( memcmp( buf, cache_header, sizeof( buf ) ) != 0 )
+		return false;
+
+	return true;
+}
+
+
+static bool FS_SavePackToFile( const pack_t *pak, FILE *f )
+{
+	const char *namePtr;
+	const char *pakName;
+	int i, pakNameLen;
+	pk3cacheHeader_t pk;
+	pk3cacheFileItem_t it;
+	int namesLen, contentLen;
+	
+	namePtr = (char*)(pak->buildBuffer + pak->numfiles);
+
+	pakName = pak->pakFilename;
+	pakNameLen = (int) strlen( pakName ) + 1;
+	pakNameLen = PAD( pakNameLen, sizeof( int ) );
+
+	namesLen = pakName - namePtr;
+
+	// file content length
+	contentLen = 0;
+#if 0
+	for ( i = 0; i < pak->numfiles; i++ )
+	{
+		if ( pak->buildBuffer[ i ].data && pak->buildBuffer[ i ].size ) 
+		{
+			contentLen += sizeof( int ) + PAD( pak->buildBuffer[ i ].size, sizeof( int ) );
+		}
+	}
+#endif
+
+	// pak filename length
+	pk.pakNameLen = pakNameLen;
+	// filenames length
+	pk.namesLen = namesLen;
+	// number of files
+	pk.numFiles = pak->numfiles;
+	// number of checksums
+	pk.numHeaderLongs = pak->numHeaderLongs;
+	// content of some files
+	pk.contentLen = contentLen;
+	// regular checksum
+	pk.checksum = pak->checksum;
+	// creation/status change time
+	pk.ctime = pak->ctime;
+	// modification time
+	pk.mtime = pak->mtime;
+	// pak file size
+	pk.size = pak->size;
+
+	// dump header
+	fwrite( &pk, sizeof( pk ), 1, f );
+
+	// pak filename
+	fwrite( pakName, pakNameLen, 1, f );
+
+	// filenames
+	fwrite( namePtr, namesLen, 1, f );
+
+	// file entries
+	for ( i = 0; i < pak->numfiles; i++ )
+	{
+		it.name = (unsigned long)(pak->buildBuffer[i].name - namePtr);
+		it.size = pak->buildBuffer[i].size;
+		it.pos = pak->buildBuffer[i].pos;
+		fwrite( &it, sizeof( it ), 1, f );
+	}
+
+	// pure checksums, excluding first uninitialized
+	fwrite( pak->headerLongs + 1, (pak->numHeaderLongs - 1) * sizeof( pak->headerLongs[0] ), 1, f );
+
+#if 0
+	if ( contentLen )
+	{
+		const fileInPack_t *currFile = pak->buildBuffer;
+		for ( i = 0; i < pak->numfiles; i++, currFile++ )
+		{
+			if ( currFile->data && currFile->size ) {
+				// file index
+				fwrite( &i, sizeof( i ), 1, f );
+				// file data
+				fwrite( currFile->data, PAD( currFile->size, sizeof( int ) ), 1, f );
+			}
+		}
+	}
+#endif
+
+	return true;
+}
+
+
+static bool FS_LoadPakFromFile( FILE *f )
+{
+	fileTime_t ctime, mtime;
+	fileOffset_t fsize;
+	fileInPack_t *curFile;
+	char pakName[ PAD( MAX_OSPATH*3+1, sizeof( int ) ) ];
+	char pakBase[ PAD( MAX_OSPATH, sizeof( int ) ) ], *basename;
+	char *filename_inzip;
+	pk3cacheHeader_t pk;
+	pk3cacheFileItem_t it;
+	pack_t *pack;
+	char *namePtr;
+	int size, i;
+	int pakBaseLen;
+	int hashSize;
+	long hash;
+
+	if ( fread( &pk, sizeof( pk ), 1, f ) != 1 )
+		return false; // probably EOF
+
+	// validate header data
+
+	if ( pk.pakNameLen > sizeof( pakName ) || pk.pakNameLen & 3 || pk.pakNameLen == 0 )
+	{
+		//Com_Printf( "bad pakNameLen: %08X\n", pk.pakNameLen );
+		return false;
+	}
+
+	if ( pk.namesLen & 3 || pk.namesLen < pk.numFiles )
+	{
+		//Com_Printf( "bad namesLen: %i\n", pk.namesLen );
+		return false;
+	}
+
+	if ( pk.numHeaderLongs == 0 || pk.numHeaderLongs > pk.numFiles + 1 )
+	{
+		//Com_Printf( "bad numHeaderLongs: %i\n", pk.numHeaderLongs );
+		return false;
+	}
+
+	if ( pk.contentLen & 3 || pk.contentLen < 0 )
+	{
+		//Com_Printf( "bad contentLen: %i\n", pk.contentLen );
+		return false;
+	}
+
+	// load filename
+	if ( fread( pakName, pk.pakNameLen, 1, f ) != 1 )
+	{
+		//Com_Printf( "error reading pakname\n" );
+		return false;
+	}
+
+	// pakName must be zero-terminated
+	if ( pakName[ pk.pakNameLen - 1 ] != '\0' )
+	{
+		//Com_Printf( "pakname is not zero-terminated!\n" );
+		return false;
+	}
+
+	if ( !Sys_GetFileStats( pakName, &fsize, &mtime, &ctime ) || fsize != pk.size || mtime != pk.mtime || ctime != pk.ctime )
+	{
+		const int seek_len = pk.namesLen + pk.numFiles * sizeof( it ) + (pk.numHeaderLongs-1) * sizeof( pack->headerLongs[0] ) + pk.contentLen;
+		if ( fseek( f, seek_len, SEEK_CUR ) != 0 )
+		{
+			return false;
+		}
+		else
+		{
+			fs_paksSkipped++;
+			return true; // just outdated info, we can continue
+		}
+	}
+
+	// extract basename from zip path
+	basename = strrchr( pakName, PATH_SEP );
+	if ( basename == NULL )
+		basename = pakName;
+	else
+		basename++;
+
+	Q_strncpyz( pakBase, basename, sizeof( pakBase ) );
+	FS_StripExt( pakBase, ".pk3" );
+	pakBaseLen = (int) strlen( pakBase ) + 1;
+	pakBaseLen = PAD( pakBaseLen, sizeof( int ) );
+
+	hashSize = FS_PakHashSize( pk.numFiles );
+
+	size = sizeof( *pack ) + pk.namesLen + pk.numFiles * sizeof( pack->buildBuffer[0] );
+	size += hashSize * sizeof( pack->hashTable[0] );
+	size += pk.pakNameLen;
+	size += pakBaseLen;
+	size += pk.numHeaderLongs * sizeof( pack->headerLongs[0] );
+
+	pack = Z_TagMalloc( size, TAG_PACK );
+	Com_Memset( pack, 0, size );
+
+	pack->mtime = pk.mtime;
+	pack->ctime = pk.ctime;
+	pack->size = pk.size;
+
+//	pack->handle = uf;
+	pack->numfiles = pk.numFiles;
+	pack->numHeaderLongs = pk.numHeaderLongs;
+
+	// setup memory layout
+	pack->hashSize = hashSize;
+	pack->hashTable = (fileInPack_t **)( pack + 1 );
+
+	pack->buildBuffer = (fileInPack_t*)( pack->hashTable + pack->hashSize );
+
+	namePtr = (char*)( pack->buildBuffer + pack->numfiles );
+
+	pack->pakFilename = (char*)( namePtr + pk.namesLen );
+	pack->pakBasename = (char*)( pack->pakFilename + pk.pakNameLen );
+	pack->headerLongs = (int*)( pack->pakBasename + pakBaseLen );
+
+	strcpy( pack->pakFilename, pakName );
+	strcpy( pack->pakBasename, pakBase );
+
+	if ( fread( namePtr, pk.namesLen, 1, f ) != 1 )
+	{
+		//Com_Printf( "error reading pak filenames\n" );
+		goto __error;
+	}
+
+	// filenames buffer must be zero-terminated
+	if ( namePtr[ pk.namesLen - 1 ] != '\0' )
+	{
+		//Com_Printf( "not zero terminated filenames\n" );
+		goto __error;
+	}
+
+	curFile = pack->buildBuffer;
+	for ( i = 0; i < pk.numFiles; i++ )
+	{
+		if ( fread( &it, sizeof( it ), 1, f ) != 1 )
+		{
+			//Com_Printf( "error reading file item[%i]\n", i );
+			goto __error;
+		}
+		if ( it.name >= pk.namesLen )
+		{
+			//Com_Printf( "bad name offset: %i (expecting less than %i)\n", it.name, pk.namesLen );
+			goto __error;
+		}
+
+		filename_inzip = namePtr + it.name;
+		FS_ConvertFilename( filename_inzip );
+		if ( !FS_BannedPakFile( filename_inzip ) ) {
+			// store the file position in the zip
+			curFile->name = filename_inzip;
+			curFile->size = it.size;
+			curFile->pos = it.pos;
+
+			// update hash table
+			hash = FS_HashFileName( filename_inzip, pack->hashSize );
+			curFile->next = pack->hashTable[ hash ];
+			pack->hashTable[ hash ] = curFile;
+			curFile++;
+		} else {
+			pack->numfiles--;
+		}
+	}
+
+	if ( fread( pack->headerLongs + 1, ( pack->numHeaderLongs - 1 ) * sizeof( pack->headerLongs[0] ), 1, f ) != 1 )
+	{
+		//Com_Printf( "error reading headerLongs\n" );
+		goto __error;
+	}
+
+	// pure checksum is computed by FS_UpdatePureChecksums() once the feed is known
+	pack->checksum = pk.checksum;
+
+	// seek through unused content
+	if ( pk.contentLen > 0 )
+	{
+		if ( fseek( f, pk.contentLen, SEEK_CUR ) != 0 )
+			goto __error;
+	}
+	else if ( pk.contentLen < 0 )
+	{
+		goto __error;
+	}
+
+	fs_paksCached++;
+
+	FS_InsertPK3ToCache( pack );
+
+	return true;
+
+__error:
+	FS_FreePak( pack );
+	return false;
+}
+
+
+/*
+============
+FS_SaveCache
+
+Called at the end of FS_Startup() after releasing unused paks
+============
+*/
+static bool FS_SaveCache( void )
+{
+	const char *filename = CACHE_FILE_NAME;
+	const char *ospath;
+	const searchpath_t *sp;
+	FILE *f;
+
+	if ( !fs_searchpaths )
+		return false;
+
+	if ( !fs_cacheLoaded )
+	{
+		Com_DPrintf( "synced FS cache on startup\n" );
+		fs_cacheSynced = false;
+		fs_cacheLoaded = true;
+	}
+	else if ( CACHE_SYNC_CONDITION )
+	{
+		Com_DPrintf( "synced FS cache on readed=%i, released=%i, skipped=%i\n",
+			fs_paksReaded, fs_paksReleased, fs_paksSkipped );
+		fs_cacheSynced = false;
+	}
+
+	if ( fs_cacheSynced )
+		return true;
+
+	sp = fs_searchpaths;
+
+	ospath = FS_BuildOSPath( fs_homepath->string, filename, NULL );
+
+	f = Sys_FOpen( ospath, "wb" );
+	if ( f == NULL )
+		return false;
+
+	FS_WriteCacheHeader( f );
+
+	while ( sp != NULL )
+	{
+		if ( sp->pack )
+		{
+			FS_SavePackToFile( sp->pack, f );
+		}
+		sp = sp->next;
+	}
+
+	fclose( f );
+
+	fs_paksReleased = 0;
+	fs_paksSkipped = 0;
+	fs_paksReaded = 0;
+
+	fs_cacheSynced = true;
+
+	return true;
+}
+
+
+/*
+============
+FS_LoadCache
+
+Called at FS_Startup() before loading any pk3 file
+============
+*/
+static void FS_LoadCache( void )
+{
+	const char *filename = CACHE_FILE_NAME;
+	const char *ospath;
+	FILE *f;
+
+	fs_paksReaded = 0;
+	fs_paksReleased = 0;
+
+	if ( fs_cacheLoaded )
+		return;
+
+	fs_paksCached = 0;
+	fs_paksSkipped = 0;
+
+	ospath = FS_BuildOSPath( fs_homepath->string, filename, NULL );
+
+	f = Sys_FOpen( ospath, "rb" );
+	if ( f == NULL )
+		return;
+
+	if ( !FS_ValidateCacheHeader( f ) )
+	{
+		fclose( f );
+		return;
+	}
+
+	while ( FS_LoadPakFromFile( f ) )
+		;
+
+	fclose( f );
+
+	fs_cacheLoaded = true;
+
+	Com_Printf( "...found %i cached paks\n", fs_paksCached );
+}
+
+#endif // USE_PK3_CACHE_FILE
+
+#endif // USE_PK3_CACHE
+
+
+/*
+=================
+FS_LoadCachedZipFile
+
+Returns pack from the pk3 cache if the file is unchanged since it was scanned
+=================
+*/
+static pack_t *FS_LoadCachedZipFile( const char *zipfile )
+{
+#ifdef USE_PK3_CACHE
+	pack_t *pack;
+
+	pack = FS_LoadCachedPK3( zipfile );
+	if ( pack )
+	{
+		pack->touched = true;
+		return pack; // loaded from cache
+	}
+#endif
+
+	return NULL;
+}
+
+
+/*
+=================
+FS_ScanZipFile
+
+Walks central directory of an opened zip file and stores every entry in scan.
+Uses only the zip handle and malloc() so it is safe to run on a worker thread,
+scan->numEntries is zero on failure
+=================
+*/
+static void FS_ScanZipFile( zipScan_t *scan )
+{
+	char			filename_inzip[MAX_ZPATH];
+	unz_file_info	file_info;
+	unz_global_info gi;
+	zipScanEntry_t	*entry;
+	unzFile			uf;
+	unsigned int	i;
+	int				len;
+	char			*names;
+	int				namesSize;
+
+	scan->entries = NULL;
+	scan->numEntries = 0;
+	scan->names = NULL;
+
+	uf = scan->handle;
+	if ( unzGetGlobalInfo( uf, &gi ) != UNZ_OK || gi.number_entry == 0 )
+		return;
+
+	scan->entries = malloc( gi.number_entry * sizeof( scan->entries[0] ) );
+	namesSize = gi.number_entry * 32;
+	scan->names = malloc( namesSize );
+	if ( scan->entries == NULL || scan->names == NULL )
+		return;
+
+	len = 0;
+	unzGoToFirstFile( uf );
+	for ( i = 0; i < gi.number_entry; i++ )
+	{
+		if ( unzGetCurrentFileInfo( uf, &file_info, filename_inzip, sizeof( filename_inzip ), NULL, 0, NULL, 0 ) != UNZ_OK )
+			break;
+		filename_inzip[sizeof(filename_inzip)-1] = '\0';
+
+		entry = scan->entries + scan->numEntries;
+		entry->name = len;
+		entry->size = file_info.uncompressed_size;
+		entry->crc = file_info.crc;
+		entry->method = (int)file_info.compression_method;
+		unzGetCurrentFileInfoPosition( uf, &entry->pos );
+
+		len += (int)strlen( filename_inzip ) + 1;
+		if ( len > namesSize )
+		{
+			namesSize = len * 2;
+			names = realloc( scan->names, namesSize );
+			if ( names == NULL )
+				break;
+			scan->names = names;
+		}
+		strcpy( scan->names + entry->name, filename_inzip );
+		scan->numEntries++;
+
+		unzGoToNextFile( uf );
+	}
+}
+
+
+/*
+=================
+FS_FreeZipScan
+=================
+*/
+static void FS_FreeZipScan( zipScan_t *scan )
+{
+	free( scan->entries );
+	free( scan->names );
+	scan->entries = NULL;
+	scan->names = NULL;
+	scan->numEntries = 0;
+}
+
+
+/*
+=================
+FS_BuildZipPack
+
+Creates a new pak_t for the zip file from its scanned central directory,
+takes ownership of the zip handle
+=================
+*/
+static pack_t *FS_BuildZipPack( const char *zipfile, const zipScan_t *scan )
+{
+	const zipScanEntry_t *entry;
+	fileInPack_t	*curFile;
+	pack_t			*pack;
+	unzFile			uf;
+	char			filename_inzip[MAX_ZPATH];
+	unsigned int	namelen, hashSize, size;
+	long			hash;
+	int				fs_numHeaderLongs;
+	int				*fs_headerLongs;
+	int				filecount;
+	char			*namePtr;
+	const char		*basename;
+	int				fileNameLen;
+	int				baseNameLen;
+	int				i;
+
+	// extract basename from zip path
+	basename = strrchr( zipfile, PATH_SEP );
+	if ( basename == NULL ) {
+		basename = zipfile;
+	} else {
+		basename++;
+	}
+
+	fileNameLen = (int) strlen( zipfile ) + 1;
+	baseNameLen = (int) strlen( basename ) + 1;
+
+	uf = scan->handle;
+
+	namelen = 0;
+	filecount = 0;
+	for ( i = 0, entry = scan->entries; i < scan->numEntries; i++, entry++ )
+	{
+		if ( entry->method != 0 && entry->method != 8 /*Z_DEFLATED*/ ) {
+			Com_Printf( S_COLOR_YELLOW "%s|%s: unsupported compression method %i\n", basename, scan->names + entry->name, entry->method );
+			continue;
+		} 
+		namelen += strlen( scan->names + entry->name ) + 1;
+		filecount++;
+	}
+
+	if ( filecount == 0 ) {
+		unzClose( uf );
+		return NULL;
+	}
+
+	// get the hash table size from the number of files in the zip
+	// because lots of custom pk3 files have less than 32 or 64 files
+	hashSize = FS_PakHashSize( filecount );
+
+	namelen = PAD( namelen, sizeof( int ) );
+	size = sizeof( *pack ) + hashSize * sizeof( pack->hashTable[0] ) + filecount * sizeof( pack->buildBuffer[0] ) + namelen;
+	size += PAD( fileNameLen, sizeof( int ) );
+	size += PAD( baseNameLen, sizeof( int ) );
+#ifdef USE_PK3_CACHE
+	size += ( filecount + 1 ) * sizeof( fs_headerLongs[0] );
+#endif
+	pack = Z_TagMalloc( size, TAG_PACK );
+	Com_Memset( pack, 0, size );
+
+	pack->handle = uf;
+	pack->numfiles = filecount;
+	pack->hashSize = hashSize;
+	pack->hashTable = (fileInPack_t **)( pack + 1 );
+
+	pack->buildBuffer = (fileInPack_t*)( pack->hashTable + pack->hashSize );
+	namePtr = (char*)( pack->buildBuffer + filecount );
+
+	pack->pakFilename = (char*)( namePtr + namelen );
+	pack->pakBasename = (char*)( pack->pakFilename + PAD( fileNameLen, sizeof( int ) ) );
+
+#ifdef USE_PK3_CACHE
+	fs_headerLongs = (int*)( pack->pakBasename + PAD( baseNameLen, sizeof( int ) ) );
+#else
+	fs_headerLongs = Z_Malloc( ( filecount + 1 ) * sizeof( fs_headerLongs[0] ) );
+#endif
+
+	fs_numHeaderLongs = 0;
+	fs_headerLongs[ fs_numHeaderLongs++ ] = LittleLong( fs_checksumFeed );
+
+	Com_Memcpy( pack->pakFilename, zipfile, fileNameLen );
+	Com_Memcpy( pack->pakBasename, basename, baseNameLen );
+
+	// strip .pk3 if needed
+	FS_StripExt( pack->pakBasename, ".pk3" );
+
+	curFile = pack->buildBuffer;
+	for ( i = 0, entry = scan->entries; i < scan->numEntries; i++, entry++ )
+	{
+		if ( entry->method != 0 && entry->method != 8 /*Z_DEFLATED*/ ) {
+			continue;
+		} 
+		if ( entry->size > 0 ) {
+			fs_headerLongs[fs_numHeaderLongs++] = LittleLong( entry->crc );
+		}
+
+		Q_strncpyz( filename_inzip, scan->names + entry->name, sizeof( filename_inzip ) );
+		FS_ConvertFilename( filename_inzip );
+		if ( !FS_BannedPakFile( filename_inzip ) ) {
+			// store the file position in the zip
+			curFile->pos = entry->pos;
+			curFile->size = entry->size;
+			curFile->name = namePtr;
+			strcpy( curFile->name, filename_inzip );
+			namePtr += strlen( filename_inzip ) + 1;
+
+			// update hash table
+			hash = FS_HashFileName( filename_inzip, pack->hashSize );
+			curFile->next = pack->hashTable[ hash ];
+			pack->hashTable[ hash ] = curFile; 
+			curFile++;
+		} else {
+			pack->numfiles--;
+		}
+	}
+
+	pack->checksum = Com_BlockChecksum( fs_headerLongs + 1, sizeof( fs_headerLongs[0] ) * ( fs_numHeaderLongs - 1 ) );
+	pack->checksum = LittleLong( pack->checksum );
+
+#ifdef USE_PK3_CACHE
+	// pure checksum is computed by FS_UpdatePureChecksums()
+	pack->headerLongs = fs_headerLongs;
+	pack->numHeaderLongs = fs_numHeaderLongs;
+#else
+	pack->pure_checksum = Com_BlockChecksum( fs_headerLongs, sizeof( fs_headerLongs[0] ) * fs_numHeaderLongs );
+	pack->pure_checksum = LittleLong( pack->pure_checksum );
+
+	Z_Free( fs_headerLongs );
+#endif
+
+#ifdef USE_HANDLE_CACHE
+	FS_AddToHandleList( pack );
+#else
+	if ( fs_locked->integer == 0 )
+	{
+		unzClose( pack->handle );
+		pack->handle = NULL;
+	}
+#endif
+
+#ifdef USE_PK3_CACHE
+	FS_InsertPK3ToCache( pack );
+#ifdef USE_PK3_CACHE_FILE
+	fs_paksReaded++;
+#endif
+#endif
+
+	return pack;
+}
+
+
+/*
+=================
+FS_LoadZipFile
+
+Creates a new pak_t in the search chain for the contents
+of a zip file.
+=================
+*/
+static pack_t *FS_LoadZipFile( const char *zipfile )
+{
+	zipScan_t	scan;
+	pack_t		*pack;
+
+	pack = FS_LoadCachedZipFile( zipfile );
+	if ( pack )
+		return pack;
+
+	scan.handle = unzOpen( zipfile );
+	if ( scan.handle == NULL )
+		return NULL;
+
+	FS_ScanZipFile( &scan );
+	pack = FS_BuildZipPack( zipfile, &scan );
+	FS_FreeZipScan( &scan );
+
+	return pack;
+}
+
+
+/*
+=================
+FS_RunWorkerItems
+
+Takes items of the current job until there are none left
+=================
+*/
+static void FS_RunWorkerItems( void )
+{
+	int i;
+
+	while ( ( i = Sys_AtomicIncrement( &fs_workerNext ) - 1 ) < fs_workerCount )
+	{
+		fs_workerFunc( fs_workerData, i );
+	}
+}
+
+
+/*
+=================
+FS_WorkerThread
+=================
+*/
+static void FS_WorkerThread( void *arg )
+{
+	for ( ;; )
+	{
+		Sys_WaitSemaphore( fs_workerWake );
+
+		if ( Sys_AtomicLoad( &fs_workerQuit ) )
+			break;
+
+		FS_RunWorkerItems();
+
+		Sys_PostSemaphore( fs_workerDone );
+	}
+}
+
+
+/*
+=================
+FS_StopWorkers
+=================
+*/
+static void FS_StopWorkers( void )
+{
+	int i;
+
+	if ( fs_numWorkers == 0 )
+		return;
+
+	Sys_AtomicStore( &fs_workerQuit, 1 );
+	for ( i = 0; i < fs_numWorkers; i++ )
+	{
+		Sys_PostSemaphore( fs_workerWake );
+	}
+	for ( i = 0; i < fs_numWorkers; i++ )
+	{
+		Sys_JoinThread( fs_workerThreads[ i ] );
+		fs_workerThreads[ i ] = NULL;
+	}
+	Sys_AtomicStore( &fs_workerQuit, 0 );
+
+	fs_numWorkers = 0;
+}
+
+
+/*
+=================
+FS_StartWorkers
+
+Keeps fs_scanThreads-1 workers running, they are only recreated when the
+cvar changes
+=================
+*/
+static void FS_StartWorkers( void )
+{
+	static int failed = -1;
+	int numThreads;
+
+	numThreads = fs_scanThreads->integer;
+	if ( numThreads <= 0 )
+		numThreads = Sys_NumCPUs();
+	if ( numThreads > MAX_SCAN_THREADS )
+		numThreads = MAX_SCAN_THREADS;
+
+	// don't retry the same count after thread creation failed
+	if ( numThreads - 1 == fs_numWorkers || numThreads == failed )
+		return;
+
+	FS_StopWorkers();
+
+	if ( !fs_workerWake ) {
+		fs_workerWake = Sys_CreateSemaphore();
+		fs_workerDone = Sys_CreateSemaphore();
+	}
+
+	while ( fs_numWorkers < numThreads - 1 )
+	{
+		fs_workerThreads[ fs_numWorkers ] = Sys_CreateThread( FS_WorkerThread, NULL );
+		if ( !fs_workerThreads[ fs_numWorkers ] ) {
+			failed = numThreads;
+			break;
+		}
+		fs_numWorkers++;
+	}
+}
+
+
+/*
+=================
+FS_RunWorkerJob
+
+Calls func( data, i ) for every i below count on the main thread and at most
+maxThreads-1 workers, returns the number of threads used
+=================
+*/
+static int FS_RunWorkerJob( fsWorkerFunc_t func, void *data, int count, int maxThreads )
+{
+	int i, n;
+
+	if ( count <= 0 )
+		return 0;
+
+	FS_StartWorkers();
+
+	n = maxThreads - 1;
+	if ( n > fs_numWorkers )
+		n = fs_numWorkers;
+	if ( n > count - 1 )
+		n = count - 1;
+
+	fs_workerFunc = func;
+	fs_workerData = data;
+	fs_workerCount = count;
+	Sys_AtomicStore( &fs_workerNext, 0 );
+
+	for ( i = 0; i < n; i++ )
+	{
+		Sys_PostSemaphore( fs_workerWake );
+	}
+
+	FS_RunWorkerItems();
+
+	for ( i = 0; i < n; i++ )
+	{
+		Sys_WaitSemaphore( fs_workerDone );
+	}
+
+	return n + 1;
+}
+
+
+/*
+=================
+FS_OpenScanZip
+
+Runs on a worker thread
+=================
+*/
+static void FS_OpenScanZip( void *data, int index )
+{
+	zipScan_t *scan = (zipScan_t *)data + index;
+
+	if ( unzOpenInto( scan->ospath, &scan->zip ) != UNZ_OK ) {
+		scan->handle = NULL;
+		scan->entries = NULL;
+		scan->names = NULL;
+		scan->numEntries = 0;
+		return;
+	}
+
+	scan->handle = (unzFile)&scan->zip;
+	FS_ScanZipFile( scan );
+}
+
+
+/*
+=================
+FS_LoadZipFiles
+
+Loads sorted list of pk3 files from the same directory, paks[i] is NULL
+for files which are not valid pk3s. Archives missing in the pk3 cache are
+opened and their central directories walked by fs_scanThreads workers in
+batches, packs are built afterwards in the list order so the result does
+not depend on the thread count
+=================
+*/
+static void FS_LoadZipFiles( const char *path, const char *dir, char **pakfiles, int numfiles, pack_t **paks )
+{
+	static zipScan_t scans[ MAX_SCAN_BATCH ];
+	int				index[ MAX_SCAN_BATCH ];
+	const char		*pakfile;
+	unz_s			*handle;
+	int				numScans;
+	int				start, end;
+	int				i, n;
+	int64_t			t0, t1;
+
+	for ( start = 0; start < numfiles; start = end )
+	{
+		t0 = Sys_Microseconds();
+
+		// pick cached packs, the rest is opened by workers
+		numScans = 0;
+		for ( end = start; end < numfiles && numScans < MAX_SCAN_BATCH; end++ )
+		{
+			paks[ end ] = NULL;
+
+			if ( !FS_IsExt( pakfiles[ end ], ".pk3", (int) strlen( pakfiles[ end ] ) ) )
+				continue;
+
+			pakfile = FS_BuildOSPath( path, dir, pakfiles[ end ] );
+			paks[ end ] = FS_LoadCachedZipFile( pakfile );
+			if ( paks[ end ] ) {
+				fs_startupTimes.cached++;
+				continue;
+			}
+
+			scans[ numScans ].ospath = CopyString( pakfile );
+			index[ numScans++ ] = end;
+		}
+
+		t1 = Sys_Microseconds();
+		fs_startupTimes.open += t1 - t0;
+		t0 = t1;
+
+		n = FS_RunWorkerJob( FS_OpenScanZip, scans, numScans, MAX_SCAN_THREADS );
+		if ( n > fs_startupTimes.threads )
+			fs_startupTimes.threads = n;
+
+		t1 = Sys_Microseconds();
+		fs_startupTimes.scan += t1 - t0;
+		t0 = t1;
+
+		// build packs in list order
+		for ( i = 0; i < numScans; i++ )
+		{
+			if ( scans[ i ].handle != NULL ) {
+				// zone allocations are not allowed on workers
+				handle = Z_Malloc( sizeof( *handle ) );
+				*handle = scans[ i ].zip;
+				scans[ i ].handle = (unzFile)handle;
+
+				paks[ index[ i ] ] = FS_BuildZipPack( scans[ i ].ospath, &scans[ i ] );
+				FS_FreeZipScan( &scans[ i ] );
+				fs_startupTimes.scanned++;
+			}
+			Z_Free( scans[ i ].ospath );
+		}
+
+		fs_startupTimes.build += Sys_Microseconds() - t0;
+	}
+}
+
+
+#ifdef USE_PK3_CACHE
+/*
+=================
+FS_PureChecksumPak
+
+Runs on a worker thread
+=================
+*/
+static void FS_PureChecksumPak( void *data, int index )
+{
+	pack_t *pak = ((pack_t **)data)[ index ];
+
+	pak->headerLongs[ 0 ] = LittleLong( fs_checksumFeed );
+	pak->pure_checksum = Com_BlockChecksum( pak->headerLongs, sizeof( pak->headerLongs[0] ) * pak->numHeaderLongs );
+	pak->pure_checksum = LittleLong( pak->pure_checksum );
+	pak->checksumFeed = fs_checksumFeed;
+	pak->pureValid = true;
+}
+
+
+/*
+=================
+FS_UpdatePureChecksums
+
+Computes pure checksums of the paks in the search path which are new
+or were computed for another feed. The pure checksum is the hash of the
+entry CRCs prefixed with the feed so it can't be stored in the pk3 cache,
+with thousands of paks it is spread over fs_scanThreads workers
+=================
+*/
+static void FS_UpdatePureChecksums( void )
+{
+	searchpath_t	*sp;
+	pack_t			**paks;
+	int				numPaks;
+
+	numPaks = 0;
+	for ( sp = fs_searchpaths; sp; sp = sp->next )
+	{
+		if ( sp->pack && ( !sp->pack->pureValid || sp->pack->checksumFeed != fs_checksumFeed ) )
+			numPaks++;
+	}
+
+	if ( numPaks == 0 )
+		return;
+
+	paks = Z_Malloc( numPaks * sizeof( paks[0] ) );
+	numPaks = 0;
+	for ( sp = fs_searchpaths; sp; sp = sp->next )
+	{
+		if ( sp->pack && ( !sp->pack->pureValid || sp->pack->checksumFeed != fs_checksumFeed ) )
+			paks[ numPaks++ ] = sp->pack;
+	}
+
+	// waking workers is not worth it for a few short hashes
+	FS_RunWorkerJob( FS_PureChecksumPak, paks, numPaks, ( numPaks + MIN_PURE_PAKS_PER_THREAD - 1 ) / MIN_PURE_PAKS_PER_THREAD );
+
+	fs_startupTimes.pureCount += numPaks;
+
+	Z_Free( paks );
+}
+#endif // USE_PK3_CACHE
+
+
+/*
+=================
+FS_FreePak
+
+Frees a pak structure and releases all associated resources
+=================
+*/
+static void FS_FreePak( pack_t *pak )
+{
+	if ( pak->handle )
+	{
+#ifdef USE_HANDLE_CACHE
+		if ( pak->next_h )
+			FS_RemoveFromHandleList( pak );
+#endif
+		unzClose( pak->handle );
+		pak->handle = NULL;
+	}
+
+	Z_Free( pak );
+}
+
+
+/*
+=================
+FS_CompareZipChecksum
+
+Compares whether the given pak file matches a referenced checksum
+=================
+*/
+bool FS_CompareZipChecksum(const char *zipfile)
+{
+	pack_t *thepak;
+	int index, checksum;
+	
+	thepak = FS_LoadZipFile( zipfile );
+	
+	if ( !thepak )
+		return false;
+	
+	checksum = thepak->checksum;
+#ifndef USE_PK3_CACHE
+	FS_FreePak(thepak);
+#endif
+	
+	for(index = 0; index < fs_numServerReferencedPaks; index++)
+	{
+		if(checksum == fs_serverReferencedPaks[index])
+			return true;
+	}
+	
+	return false;
+}
+
+
+/*
+=================
+FS_GetZipChecksum
+=================
+*/
+int FS_GetZipChecksum( const char *zipfile ) 
+{
+	pack_t *pak;
+	int checksum;
+	
+	pak = FS_LoadZipFile( zipfile );
+	
+	if ( !pak )
+		return 0xFFFFFFFF;
+	
+	checksum = pak->checksum;
+#ifndef USE_PK3_CACHE
+	FS_FreePak( pak );
+#endif
+
+	return checksum;
+} 
+
+
+/*
+=================================================================================
+
+DIRECTORY SCANNING FUNCTIONS
+
+=================================================================================
+*/
+
+static int FS_ReturnPath( const char *zname, char *zpath, int *depth ) {
+	int len, at, newdep;
+
+	newdep = 0;
+	zpath[0] = '\0';
+	len = 0;
+	at = 0;
+
+	while(zname[at] != 0)
+	{
+		if (zname[at]=='/' || zname[at]=='\\') {
+			len = at;
+			newdep++;
+		}
+		at++;
+	}
+	strcpy(zpath, zname);
+	zpath[len] = '\0';
+	*depth = newdep;
+
+	return len;
+}
+
+
+static fnamecallback_f fnamecallback = NULL;
+
+
+char *FS_CopyString( const char *in ) {
+	char *out;
+	//out = S_Malloc( strlen( in ) + 1 );
+	out = Z_Malloc( strlen( in ) + 1 );
+	strcpy( out, in );
+	return out;
+}
+
+
+#define FOUND_FILES_HASH_SIZE 4096
+
+// case insensitive set of the names in a list being built
+typedef struct {
+	int		head[ FOUND_FILES_HASH_SIZE ];
+	int		next[ MAX_FOUND_FILES ];
+} foundFilesHash_t;
+
+
+/*
+==================
+FS_AddFileToList
+==================
+*/
+static int FS_AddFileToList( const char *name, char **list, int nfiles, foundFilesHash_t *found ) {
+	long	hash;
+	int		i;
+
+	if ( nfiles == MAX_FOUND_FILES - 1 ) {
+		return nfiles;
+	}
+	hash = FS_HashFileName( name, FOUND_FILES_HASH_SIZE );
+	for ( i = found->head[ hash ] ; i >= 0 ; i = found->next[ i ] ) {
+		if ( !Q_stricmp( name, list[i] ) ) {
+			return nfiles; // already in list
+		}
+	}
+	list[ nfiles ] = FS_CopyString( name );
+	found->next[ nfiles ] = found->head[ hash ];
+	found->head[ hash ] = nfiles;
+	nfiles++;
+
+	return nfiles;
+}
+
+
+/*
+==================
+FS_ListMatchExtension
+==================
+*/
+static bool FS_ListMatchExtension( const char *name, const char *extension, int extLen, bool hasPatterns ) {
+	const char *x;
+	int length;
+
+	length = (int)strlen( name );
+
+	if ( fnamecallback ) {
+		// use custom filter
+		return fnamecallback( name, length );
+	}
+
+	if ( length < extLen )
+		return false;
+
+	if ( *extension ) {
+		if ( hasPatterns ) {
+			x = strrchr( name, '.' );
+			if ( !x || !Com_FilterExt( extension, x+1 ) ) {
+				return false;
+			}
+		} else {
+			if ( Q_stricmp( name + length - extLen, extension ) ) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+===============
+FS_AllowListExternal
+===============
+*/
+static bool FS_AllowListExternal( const char *extension ) 
+{
+	if ( !extension )
+		return false;
+
+	if ( !Q_stricmp( extension, ".shader" ) )
+		return false;
+
+	if ( !Q_stricmp( extension, ".shaderx" ) )
+		return false;
+	
+	if ( !Q_stricmp( extension, ".mtr" ) )
+		return false;
+
+	return true;
+}
+
+void FS_SetFilenameCallback( fnamecallback_f func ) 
+{
+	fnamecallback = func;
+}
+
+
+/*
+===============
+FS_NextIndexedSearch
+
+Returns the search path after search which still has directory links
+in the chain or is a directory, skipping paks without candidates
+===============
+*/
+static const searchpath_t *FS_NextIndexedSearch( const searchpath_t *search, const fileIndexDirLink_t **link, int *dirNum ) {
+	const searchpath_t *next;
+
+	while ( *link && (*link)->entry->search->order <= search->order ) {
+		*link = (*link)->next;
+	}
+	while ( *dirNum < fs_numIndexDirs && fs_indexDirs[ *dirNum ]->order <= search->order ) {
+		(*dirNum)++;
+	}
+
+	next = *link ? (*link)->entry->search : NULL;
+	if ( *dirNum < fs_numIndexDirs && ( next == NULL || fs_indexDirs[ *dirNum ]->order < next->order ) ) {
+		next = fs_indexDirs[ *dirNum ];
+	}
+
+	return next;
+}
+
+
+/*
+===============
+FS_ListFilteredFiles
+
+Returns a unique list of files that match the given criteria
+from all search paths.
+Plain directory listings take pak entries from the directory links
+of the file index, others check every file of every pak
+===============
+*/
+static char **FS_ListFilteredFiles( const char *path, const char *extension, const char *filter, int *numfiles, int flags ) {
+	int				nfiles;
+	char			**listCopy;
+	char			*list[MAX_FOUND_FILES];
+	foundFilesHash_t	found;
+	const searchpath_t	*search;
+	const fileIndexDirLink_t	*link;
+	int				i;
+	int				pathLength;
+	int				extLen;
+	int				pathDepth, temp;
+	pack_t			*pak;
+	fileInPack_t	*buildBuffer;
+	char			zpath[MAX_ZPATH];
+	bool			hasPatterns;
+	bool			useIndex;
+	int				dirNum;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if  ( fs_numServerPaks && !( flags & FS_MATCH_STICK ) ) {
+		flags &= ~FS_MATCH_UNPURE;
+		if ( !FS_AllowListExternal( extension ) )
+			flags &= ~FS_MATCH_EXTERN;
+	}
+
+	if ( !path ) {
+		*numfiles = 0;
+		return NULL;
+	}
+
+	if ( !extension ) {
+		extension = "";
+	}
+
+	extLen = (int)strlen( extension );
+	hasPatterns = Com_HasPatterns( extension );
+	if ( hasPatterns && extension[0] == '.' && extension[1] != '\0' ) {
+		extension++;
+	}
+
+	pathLength = strlen( path );
+	if ( pathLength > 0 && ( path[pathLength-1] == '\\' || path[pathLength-1] == '/' ) ) {
+		pathLength--;
+	}
+	nfiles = 0;
+	FS_ReturnPath(path, zpath, &pathDepth);
+	Com_Memset( found.head, -1, sizeof( found.head ) );
+
+	// with trailing separator pathDepth allows one more level than the links cover
+	useIndex = ( fs_dirIndex != NULL && filter == NULL && pathLength > 0 && path[ pathLength ] == '\0' );
+	link = NULL;
+	dirNum = 0;
+	if ( useIndex ) {
+		link = fs_dirIndex[ FS_HashDirName( path, pathLength ) & ( fs_fileIndexSize - 1 ) ];
+	}
+
+	//
+	// search through the path, one element at a time, adding to list
+	//
+	for ( search = fs_searchpaths ; search ; search = useIndex ? FS_NextIndexedSearch( search, &link, &dirNum ) : search->next ) {
+		// is the element a pak file?
+		if ( search->pack && ( flags & FS_MATCH_PK3s ) ) {
+
+			//ZOID:  If we are pure, don't search for files on paks that
+			// aren't on the pure list
+			if ( !FS_PakIsPure( search->pack ) && !( flags & FS_MATCH_UNPURE ) ) {
+				continue;
+			}
+
+			pak = search->pack;
+
+			if ( useIndex ) {
+				// links are chained in search order
+				for ( ; link && link->entry->search == search; link = link->next ) {
+					const char *name = link->entry->file->name;
+
+					// different directory in the same hash slot
+					if ( link->dirLen != pathLength || Q_stricmpn( name, path, pathLength ) ) {
+						continue;
+					}
+
+					if ( !FS_ListMatchExtension( name, extension, extLen, hasPatterns ) ) {
+						continue;
+					}
+
+					// unique the match
+					nfiles = FS_AddFileToList( name + pathLength + 1, list, nfiles, &found );
+				}
+				continue;
+			}
+
+			// look through all the pak file elements
+			buildBuffer = pak->buildBuffer;
+			for (i = 0; i < pak->numfiles; i++) {
+				const char *name;
+				int zpathLen, depth;
+
+				// check for directory match
+				name = buildBuffer[i].name;
+				//
+				if ( filter ) {
+					// case insensitive
+					if ( !Com_FilterPath( filter, name ) )
+						continue;
+					// unique the match
+					nfiles = FS_AddFileToList( name, list, nfiles, &found );
+				}
+				else {
+
+					zpathLen = FS_ReturnPath(name, zpath, &depth);
+
+					if ( (depth-pathDepth)>2 || pathLength > zpathLen || Q_stricmpn( name, path, pathLength ) ) {
+						continue;
+					}
+
+					// check for extension match
+					if ( !FS_ListMatchExtension( name, extension, extLen, hasPatterns ) ) {
+						continue;
+					}
+
+					// unique the match
+
+					temp = pathLength;
+					if (pathLength) {
+						temp++;		// include the '/'
+					}
+					nfiles = FS_AddFileToList( name + temp, list, nfiles, &found );
+				}
+			}
+		} else if ( search->dir && ( flags & FS_MATCH_EXTERN ) && search->policy != DIR_DENY ) { // scan for files in the filesystem
+			const char *netpath;
+			int		numSysFiles;
+			char	**sysFiles;
+			const char *name;
+
+			netpath = FS_BuildOSPath( search->dir->path, search->dir->gamedir, path );
+			sysFiles = Sys_ListFiles( netpath, extension, filter, &numSysFiles, false );
+			for ( i = 0 ; i < numSysFiles ; i++ ) {
+				// unique the match
+				name = sysFiles[ i ];
+				if ( fnamecallback ) {
+					// use custom filter
+					if ( !fnamecallback( name, (int)strlen( name ) ) )
+						continue;
+				} // else - should be already filtered by Sys_ListFiles
+
+				nfiles = FS_AddFileToList( name, list, nfiles, &found );
+			}
+			Sys_FreeFileList( sysFiles );
+		}		
+	}
+
+	// return a copy of the list
+	*numfiles = nfiles;
+
+	if ( !nfiles ) {
+		return NULL;
+	}
+
+	listCopy = Z_Malloc( ( nfiles + 1 ) * sizeof( listCopy[0] ) );
+	for ( i = 0 ; i < nfiles ; i++ ) {
+		listCopy[i] = list[i];
+	}
+	listCopy[i] = NULL;
+
+	return listCopy;
+}
+
+
+/*
+=================
+FS_ListFiles
+=================
+*/
+char **FS_ListFiles( const char *path, const char *extension, int *numfiles ) 
+{
+	return FS_ListFilteredFiles( path, extension, NULL, numfiles, FS_MATCH_ANY );
+}
+
+
+/*
+=================
+FS_FreeFileList
+=================
+*/
+void FS_FreeFileList( char **list ) {
+	int		i;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !list ) {
+		return;
+	}
+
+	for ( i = 0 ; list[i] ; i++ ) {
+		Z_Free( list[i] );
+	}
+
+	Z_Free( list );
+}
+
+
+/*
+================
+FS_GetFileList
+================
+*/
+int	FS_GetFileList( const char *path, const char *extension, char *listbuf, int bufsize ) {
+	int		nFiles, i, nTotal, nLen;
+	char **pFiles = NULL;
+
+	*listbuf = '\0';
+	nFiles = 0;
+	nTotal = 0;
+
+	if (Q_stricmp(path, "$modlist") == 0) {
+		return FS_GetModList(listbuf, bufsize);
+	}
+
+	pFiles = FS_ListFiles(path, extension, &nFiles);
+
+	for (i =0; i < nFiles; i++) {
+		nLen = strlen(pFiles[i]) + 1;
+		if (nTotal + nLen + 1 < bufsize) {
+			strcpy(listbuf, pFiles[i]);
+			listbuf += nLen;
+			nTotal += nLen;
+		}
+		else {
+			nFiles = i;
+			break;
+		}
+	}
+
+	FS_FreeFileList(pFiles);
+
+	return nFiles;
+}
+
+
+/*
+=======================
+Sys_ConcatenateFileLists
+
+mkv: Naive implementation. Concatenates three lists into a
+     new list, and frees the old lists from the heap.
+bk001129 - from cvs1.17 (mkv)
+
+FIXME TTimo those two should move to common.c next to Sys_ListFiles
+=======================
+ */
+static unsigned int Sys_CountFileList( char **list )
+{
+	int i = 0;
+
+	if ( list )
+	{
+		while ( *list )
+		{
+			list++;
+			i++;
+		}
+	}
+
+	return i;
+}
+
+
+static char** Sys_ConcatenateFileLists( char **list0, char **list1 )
+{
+	int totalLength;
+	char **src, **dst, **cat;
+
+	totalLength = Sys_CountFileList( list0 );
+	totalLength += Sys_CountFileList( list1 );
+
+	/* Create new list. */
+	dst = cat = Z_Malloc( ( totalLength + 1 ) * sizeof( char* ) );
+
+	/* Copy over lists. */
+	if ( list0 )
+	{
+		for (src = list0; *src; src++, dst++)
+			*dst = *src;
+	}
+
+	if ( list1 )
+	{
+		for ( src = list1; *src; src++, dst++ )
+			*dst = *src;
+	}
+
+	// Terminate the list
+	*dst = NULL;
+
+	// Free our old lists.
+	// NOTE: not freeing their content, it's been merged in dst and still being used
+	if ( list0 ) Z_Free( list0 );
+	if ( list1 ) Z_Free( list1 );
+
+	return cat;
+}
+
+
+/*
+================
+FS_GetModDescription
+================
+*/
+static void FS_GetModDescription( const char *modDir, char *description, int descriptionLen ) {
+	fileHandle_t	descHandle;
+	char			descPath[MAX_QPATH];
+	int				nDescLen;
+
+	Com_sprintf( descPath, sizeof ( descPath ), "%s%cdescription.txt", modDir, PATH_SEP );
+	FS_ReplaceSeparators( descPath );
+	nDescLen = FS_SV_FOpenFileRead( descPath, &descHandle );
+
+	if ( descHandle != FS_INVALID_HANDLE ) {
+		if ( nDescLen > 0 ) {
+			if ( nDescLen > descriptionLen - 1 )
+				nDescLen = descriptionLen - 1;
+			nDescLen = FS_Read( description, nDescLen, descHandle );
+			if ( nDescLen >= 0 ) {
+				description[ nDescLen ] = '\0';
+			}
+		} else {
+			Q_strncpyz( description, modDir, descriptionLen );
+		}
+		FS_FCloseFile( descHandle ); 
+	} else {
+		Q_strncpyz( description, modDir, descriptionLen );
+	}
+}
+
+
+/*
+================
+FS_IsBaseGame
+================
+*/
+static bool FS_IsBaseGame( const char *game )
+{
+	int i;
+
+	if ( game == NULL || *game == '\0' ) {
+		return true;
+	}
+
+	for ( i = 0; i < basegame_cnt; i++ ) {
+		if ( Q_stricmp( basegames[i], game ) == 0 ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*
+================
+FS_GetModList
+
+Returns a list of mod directory names
+A mod directory is a peer to baseq3 with a pk3 in it
+================
+*/
+static int FS_GetModList( char *listbuf, int bufsize ) {
+	int i, j, k;
+	int	nMods, nTotal, nLen, nPaks, nPotential, nDescLen;
+	int nDirs, nPakDirs;
+	char **pFiles = NULL;
+	char **pPaks = NULL;
+	char **pDirs = NULL;
+	const char *name, *path;
+	char description[ MAX_OSPATH ];
+
+	int dummy;
+	char **pFiles0 = NULL;
+	bool bDrop = false;
+
+	// paths to search for mods
+	cvar_t *const *paths[] = { &fs_basepath, &fs_homepath, &fs_steampath };
+
+	*listbuf = '\0';
+	nMods = nTotal = 0;
+
+	// iterate through paths and get list of potential mods
+	for (i = 0; i < ARRAY_LEN( paths ); i++) {
+		if ( !*paths[ i ] || !(*paths[i])->string[0] )
+			continue;
+		pFiles0 = Sys_ListFiles( (*paths[i])->string, NULL, NULL, &dummy, true );
+		// Sys_ConcatenateFileLists frees the lists so Sys_FreeFileList isn't required
+		pFiles = Sys_ConcatenateFileLists( pFiles, pFiles0 );
+	}
+
+	nPotential = Sys_CountFileList( pFiles );
+
+	for ( i = 0 ; i < nPotential ; i++ ) {
+		name = pFiles[i];
+		// NOTE: cleaner would involve more changes
+		// ignore duplicate mod directories
+		if ( i != 0 ) {
+			bDrop = false;
+			for ( j = 0; j < i; j++ ) {
+				if ( Q_stricmp( pFiles[j], name ) == 0 ) {
+					// this one can be dropped
+					bDrop = true;
+					break;
+				}
+			}
+		}
+
+		// we also drop BASEGAME, "." and ".."
+		if ( bDrop || strcmp(name, "." ) == 0 || strcmp( name, ".." ) == 0 ) {
+			continue;
+		}
+
+		if ( FS_IsBaseGame( name ) ) {
+			continue;
+		}
+
+		// in order to be a valid mod the directory must contain at least one .pk3
+		// we didn't keep the information when we merged the directory names, as to what OS Path it was found under
+		// so we will try each of them here
+		nPaks = nPakDirs = 0;
+		for ( j = 0; j < ARRAY_LEN( paths ); j++ ) {
+			if ( !*paths[ j ] || !(*paths[ j ])->string[0] )
+				break;
+			path = FS_BuildOSPath( (*paths[j])->string, name, NULL );
+
+			nPaks = nDirs = nPakDirs = 0;
+			pPaks = Sys_ListFiles( path, ".pk3", NULL, &nPaks, false );
+			pDirs = Sys_ListFiles( path, "/", NULL, &nDirs, false );
+			for ( k = 0; k < nDirs; k++ ) {
+				// we only want to count directories ending with ".pk3dir"
+				if ( FS_IsExt( pDirs[k], ".pk3dir", strlen( pDirs[k] ) ) ) {
+					nPakDirs++;
+				}
+			}
+
+			// we only use Sys_ListFiles to check whether files are present
+			Sys_FreeFileList( pDirs );
+			Sys_FreeFileList( pPaks );
+			if ( nPaks > 0 || nPakDirs > 0 ) {
+				break;
+			}
+		}
+
+		if ( nPaks > 0 || nPakDirs > 0 ) {
+			nLen = strlen( name ) + 1;
+			// nLen is the length of the mod path
+			// we need to see if there is a description available
+			FS_GetModDescription( name, description, sizeof( description ) );
+			nDescLen = strlen( description ) + 1;
+
+			if ( nTotal + nLen + 1 + nDescLen + 1 < bufsize ) {
+				strcpy( listbuf, name );
+				listbuf += nLen;
+				strcpy( listbuf, description );
+				listbuf += nDescLen;
+				nTotal += nLen + nDescLen;
+				nMods++;
+			} else {
+				break;
+			}
+		}
+	}
+	Sys_FreeFileList( pFiles );
+
+	return nMods;
+}
+
+
+//============================================================================
+
+/*
+================
+FS_Dir_f
+================
+*/
+static void FS_Dir_f( void ) {
+	const char *path;
+	const char *extension;
+	char **dirnames;
+	int ndirs;
+	int i;
+
+	if ( Cmd_Argc() < 2 || Cmd_Argc() > 3 ) {
+		Com_Printf( "usage: dir <directory> [extension]\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() == 2 ) {
+		path = Cmd_Argv( 1 );
+		extension = "";
+	} else {
+		path = Cmd_Argv( 1 );
+		extension = Cmd_Argv( 2 );
+	}
+
+	Com_Printf( "Directory of %s %s\n", path, extension );
+	Com_Printf( "---------------\n" );
+
+	dirnames = FS_ListFiles( path, extension, &ndirs );
+
+	for ( i = 0; i < ndirs; i++ ) {
+		Com_Printf( "%s\n", dirnames[i] );
+	}
+	FS_FreeFileList( dirnames );
+}
+
+
+/*
+===========
+FS_ConvertPath
+===========
+*/
+static void FS_ConvertPath( char *s ) {
+	while (*s) {
+		if ( *s == '\\' || *s == ':' ) {
+			*s = '/';
+		}
+		s++;
 	}
+}
 
-	listCopy = Z_Malloc( ( nfiles + 1 ) * sizeof( listCopy[0] ) );
-	for ( i = 0 ; i < nfiles ; i++ ) {
-		listCopy[i] = list[i];
-	}
-	listCopy[i] = NULL;
 
-	return listCopy;
+/*
+===========
+FS_PathCmp
+
+Ignore case and separator char distinctions
+===========
+*/
+static int FS_PathCmp( const char *s1, const char *s2 ) {
+	int		c1, c2;
+	
+	do {
+		c1 = *s1++;
+		c2 = *s2++;
+
+		if (c1 >= 'a' && c1 <= 'z') {
+			c1 -= ('a' - 'A');
+		}
+		if (c2 >= 'a' && c2 <= 'z') {
+			c2 -= ('a' - 'A');
+		}
+
+		if ( c1 == '\\' || c1 == ':' ) {
+			c1 = '/';
+		}
+		if ( c2 == '\\' || c2 == ':' ) {
+			c2 = '/';
+		}
+		
+		if (c1 < c2) {
+			return -1;		// strings not equal
+		}
+		if (c1 > c2) {
+			return 1;
+		}
+	} while (c1);
+	
+	return 0;		// strings are equal
 }
 
 
 /*
-=================
-FS_ListFiles
-=================
+================
+FS_SortFileList
+================
 */
-char **FS_ListFiles( const char *path, const char *extension, int *numfiles ) 
-{
-	return FS_ListFilteredFiles( path, extension, NULL, numfiles, FS_MATCH_ANY );
+static void FS_SortFileList( char **list, int n ) {
+	const char *m;
+	char *temp;
+	int i, j;
+	i = 0;
+	j = n;
+	m = list[ n >> 1 ];
+	do {
+		while ( FS_PathCmp( list[i], m ) < 0 ) i++;
+		while ( FS_PathCmp( list[j], m ) > 0 ) j--;
+		if ( i <= j ) {
+			temp = list[i];
+			list[i] = list[j];
+			list[j] = temp;
+			i++; 
+			j--;
+		}
+	} while ( i <= j );
+	if ( j > 0 ) FS_SortFileList( list, j );
+	if ( n > i ) FS_SortFileList( list+i, n-i );
 }
 
 
 /*
-=================
-FS_FreeFileList
-=================
+================
+FS_NewDir_f
+================
 */
-void FS_FreeFileList( char **list ) {
+static void FS_NewDir_f( void ) {
+	const char *filter;
+	char	**dirnames;
+	char	dirname[ MAX_STRING_CHARS ];
+	int		ndirs;
 	int		i;
 
-	if ( !fs_searchpaths ) {
-		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
-	}
-
-	if ( !list ) {
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: fdir <filter>\n" );
+		Com_Printf( "example: fdir *q3dm*.bsp\n");
 		return;
 	}
 
-	for ( i = 0 ; list[i] ; i++ ) {
-		Z_Free( list[i] );
+	filter = Cmd_Argv( 1 );
+
+	Com_Printf( "---------------\n" );
+
+	dirnames = FS_ListFilteredFiles( "", "", filter, &ndirs, FS_MATCH_ANY );
+
+	if ( ndirs >= 2 )
+		FS_SortFileList( dirnames, ndirs - 1 );
+
+	for ( i = 0; i < ndirs; i++ ) {
+		Q_strncpyz( dirname, dirnames[i], sizeof( dirname ) );
+		FS_ConvertPath( dirname );
+		Com_Printf( "%s\n", dirname );
 	}
 
-	Z_Free( list );
+	Com_Printf( "%d files listed\n", ndirs );
+	FS_FreeFileList( dirnames );
 }
 
 
 /*
-================
-FS_GetFileList
-================
+============
+FS_Path_f
+============
 */
-int	FS_GetFileList( const char *path, const char *extension, char *listbuf, int bufsize ) {
-	int		nFiles, i, nTotal, nLen;
-	char **pFiles = NULL;
-
-	*listbuf = '\0';
-	nFiles = 0;
-	nTotal = 0;
+static void FS_Path_f( void ) {
+	const searchpath_t *s;
+	int i;
 
-	if (Q_stricmp(path, "$modlist") == 0) {
-		return FS_GetModList(listbuf, bufsize);
+	Com_Printf( "Current search path:\n" );
+	for ( s = fs_searchpaths; s; s = s->next ) {
+		if ( s->pack ) {
+			Com_Printf( "%s (%i files)\n", s->pack->pakFilename, s->pack->numfiles );
+			if ( fs_numServerPaks ) {
+				if ( !FS_PakIsPure( s->pack ) ) {
+					Com_Printf( S_COLOR_YELLOW "    not on the pure list\n" );
+				} else {
+					Com_Printf( "    on the pure list\n" );
+				}
+			}
+		} else {
+			Com_Printf( "%s%c%s\n", s->dir->path, PATH_SEP, s->dir->gamedir );
+		}
 	}
 
-	pFiles = FS_ListFiles(path, extension, &nFiles);
-
-	for (i =0; i < nFiles; i++) {
-		nLen = strlen(pFiles[i]) + 1;
-		if (nTotal + nLen + 1 < bufsize) {
-			strcpy(listbuf, pFiles[i]);
-			listbuf += nLen;
-			nTotal += nLen;
-		}
-		else {
-			nFiles = i;
-			break;
+	Com_Printf( "\n" );
+	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
+		if ( fsh[i].handleFiles.file.o ) {
+			Com_Printf( "handle %i: %s\n", i, fsh[i].name );
 		}
 	}
-
-	FS_FreeFileList(pFiles);
-
-	return nFiles;
 }
 
 
 /*
-=======================
-Sys_ConcatenateFileLists
-
-mkv: Naive implementation. Concatenates three lists into a
-     new list, and frees the old lists from the heap.
-bk001129 - from cvs1.17 (mkv)
+============
+FS_TouchFile_f
 
-FIXME TTimo those two should move to common.c next to Sys_ListFiles
-=======================
- */
-static unsigned int Sys_CountFileList( char **list )
-{
-	int i = 0;
+The only purpose of this function is to allow game script files to copy
+arbitrary files furing an "fs_copyfiles 1" run.
+============
+*/
+static void FS_TouchFile_f( void ) {
+	fileHandle_t	f;
 
-	if ( list )
-	{
-		while ( *list )
-		{
-			list++;
-			i++;
-		}
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "Usage: touchFile <file>\n" );
+		return;
 	}
 
-	return i;
+	FS_FOpenFileRead( Cmd_Argv( 1 ), &f, false );
+	if ( f != FS_INVALID_HANDLE ) {
+		FS_FCloseFile( f );
+	}
 }
 
 
-static char** Sys_ConcatenateFileLists( char **list0, char **list1 )
-{
-	int totalLength;
-	char **src, **dst, **cat;
-
-	totalLength = Sys_CountFileList( list0 );
-	totalLength += Sys_CountFileList( list1 );
-
-	/* Create new list. */
-	dst = cat = Z_Malloc( ( totalLength + 1 ) * sizeof( char* ) );
-
-	/* Copy over lists. */
-	if ( list0 )
-	{
-		for (src = list0; *src; src++, dst++)
-			*dst = *src;
-	}
-
-	if ( list1 )
-	{
-		for ( src = list1; *src; src++, dst++ )
-			*dst = *src;
+/*
+============
+FS_CompleteFileName
+============
+*/
+static void FS_CompleteFileName( const char *args, int argNum ) {
+	if( argNum == 2 ) {
+		Field_CompleteFilename( "", "", false, FS_MATCH_ANY );
 	}
+}
 
-	// Terminate the list
-	*dst = NULL;
 
-	// Free our old lists.
-	// NOTE: not freeing their content, it's been merged in dst and still being used
-	if ( list0 ) Z_Free( list0 );
-	if ( list1 ) Z_Free( list1 );
+/*
+============
+FS_Which_f
+============
+*/
+static void FS_Which_f( void ) {
+	const searchpath_t *search;
+	char			*netpath;
+	pack_t			*pak;
+	fileInPack_t	*pakFile;
+	directory_t		*dir;
+	long			hash;
+	FILE			*temp;
+	const char			*filename;
+	char			buf[ MAX_OSPATH*2 + 1 ];
+	int				numfound;
 
-	return cat;
-}
+	hash = 0;
+	numfound = 0;
+	filename = Cmd_Argv(1);
 
+	if ( !filename[0] ) {
+		Com_Printf( "Usage: which <file>\n" );
+		return;
+	}
 
-/*
-================
-FS_GetModDescription
-================
-*/
-static void FS_GetModDescription( const char *modDir, char *description, int descriptionLen ) {
-	fileHandle_t	descHandle;
-	char			descPath[MAX_QPATH];
-	int				nDescLen;
+	// qpaths are not supposed to have a leading slash
+	if ( filename[0] == '/' || filename[0] == '\\' ) {
+		filename++;
+	}
 
-	Com_sprintf( descPath, sizeof ( descPath ), "%s%cdescription.txt", modDir, PATH_SEP );
-	FS_ReplaceSeparators( descPath );
-	nDescLen = FS_SV_FOpenFileRead( descPath, &descHandle );
+	// just wants to see if file is there
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			hash = FS_HashFileName(filename, search->pack->hashSize);
+		}
+		// is the element a pak file?
+		if ( search->pack && search->pack->hashTable[hash] ) {
+			// look through all the pak file elements
+			pak = search->pack;
+			pakFile = pak->hashTable[hash];
+			do {
+				// case and separator insensitive comparisons
+				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
+					// found it!
+					Com_Printf( "File \"%s\" found in \"%s\"\n", filename, pak->pakFilename );
+					if ( ++numfound >= 32 ) {
+						return;
+					}
+				}
+				pakFile = pakFile->next;
+			} while(pakFile != NULL);
+		} else if ( search->dir ) {
+			dir = search->dir;
 
-	if ( descHandle != FS_INVALID_HANDLE ) {
-		if ( nDescLen > 0 ) {
-			if ( nDescLen > descriptionLen - 1 )
-				nDescLen = descriptionLen - 1;
-			nDescLen = FS_Read( description, nDescLen, descHandle );
-			if ( nDescLen >= 0 ) {
-				description[ nDescLen ] = '\0';
+			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
+			temp = Sys_FOpen( netpath, "rb" );
+			if ( !temp ) {
+				continue;
+			}
+			fclose(temp);
+			Com_sprintf( buf, sizeof( buf ), "%s%c%s", dir->path, PATH_SEP, dir->gamedir );
+			FS_ReplaceSeparators( buf );
+			Com_Printf( "File \"%s\" found at \"%s\"\n", filename, buf );
+			if ( ++numfound >= 32 ) {
+				return;
 			}
-		} else {
-			Q_strncpyz( description, modDir, descriptionLen );
 		}
-		FS_FCloseFile( descHandle ); 
-	} else {
-		Q_strncpyz( description, modDir, descriptionLen );
+	}
+
+	if ( !numfound ) {
+		Com_Printf( "File not found: \"%s\"\n", filename );
 	}
 }
 
 
+//===========================================================================
+
 /*
 ================
-FS_IsBaseGame
+FS_AddGameDirectory
+
+Sets fs_gamedir, adds the directory to the head of the path,
+then loads the zip headers
 ================
 */
-static bool FS_IsBaseGame( const char *game )
-{
-	int i;
-
-	if ( game == NULL || *game == '\0' ) {
-		return true;
-	}
+static void FS_AddGameDirectory( const char *path, const char *dir ) {
+	const searchpath_t *sp;
+	int				len;
+	searchpath_t	*search;
+	const char		*gamedir;
+	pack_t			*pak;
+	char			curpath[MAX_OSPATH*2 + 1];
+	int				numfiles;
+	char			**pakfiles;
+	pack_t			**paks;
+	int				pakfilesi;
+	int				numdirs;
+	char			**pakdirs;
+	int				pakdirsi;
+	int				pakwhich;
+	int				path_len;
+	int				dir_len;
+	int64_t			t0;
 
-	for ( i = 0; i < basegame_cnt; i++ ) {
-		if ( Q_stricmp( basegames[i], game ) == 0 ) {
-			return true;
+	for ( sp = fs_searchpaths ; sp ; sp = sp->next ) {
+		if ( sp->dir && !Q_stricmp( sp->dir->path, path ) && !Q_stricmp( sp->dir->gamedir, dir )) {
+			return;	// we've already got this one
 		}
 	}
+	
+	Q_strncpyz( fs_gamedir, dir, sizeof( fs_gamedir ) );
 
-	return false;
-}
+	//
+	// add the directory to the search path
+	//
+	path_len = (int) strlen( path ) + 1;
+	path_len = PAD( path_len, sizeof( int ) );
+	dir_len = (int) strlen( dir ) + 1;
+	dir_len = PAD( dir_len, sizeof( int ) );
+	len = sizeof( *search ) + sizeof( *search->dir ) + path_len + dir_len;
 
+	search = Z_TagMalloc( len, TAG_SEARCH_PATH );
+	Com_Memset( search, 0, len );
+	search->dir = (directory_t*)( search + 1 );
+	search->dir->path = (char*)( search->dir + 1 );
+	search->dir->gamedir = (char*)( search->dir->path + path_len );
 
-/*
-================
-FS_GetModList
+	strcpy( search->dir->path, path );
+	strcpy( search->dir->gamedir, dir );
+	search->dir->watch = -1;
+	gamedir = search->dir->gamedir;
 
-Returns a list of mod directory names
-A mod directory is a peer to baseq3 with a pk3 in it
-================
-*/
-static int FS_GetModList( char *listbuf, int bufsize ) {
-	int i, j, k;
-	int	nMods, nTotal, nLen, nPaks, nPotential, nDescLen;
-	int nDirs, nPakDirs;
-	char **pFiles = NULL;
-	char **pPaks = NULL;
-	char **pDirs = NULL;
-	const char *name, *path;
-	char description[ MAX_OSPATH ];
+	search->next = fs_searchpaths;
+	fs_searchpaths = search;
+	fs_dirCount++;
 
-	int dummy;
-	char **pFiles0 = NULL;
-	bool bDrop = false;
+	// find all pak files in this directory
+	Q_strncpyz( curpath, FS_BuildOSPath( path, dir, NULL ), sizeof( curpath ) );
 
-	// paths to search for mods
-	cvar_t *const *paths[] = { &fs_basepath, &fs_homepath, &fs_steampath };
+	t0 = Sys_Microseconds();
 
-	*listbuf = '\0';
-	nMods = nTotal = 0;
+	// Get .pk3 files
+	pakfiles = Sys_ListFiles(curpath, ".pk3", NULL, &numfiles, false);
 
-	// iterate through paths and get list of potential mods
-	for (i = 0; i < ARRAY_LEN( paths ); i++) {
-		if ( !*paths[ i ] || !(*paths[i])->string[0] )
-			continue;
-		pFiles0 = Sys_ListFiles( (*paths[i])->string, NULL, NULL, &dummy, true );
-		// Sys_ConcatenateFileLists frees the lists so Sys_FreeFileList isn't required
-		pFiles = Sys_ConcatenateFileLists( pFiles, pFiles0 );
-	}
+	if ( numfiles >= 2 )
+		FS_SortFileList( pakfiles, numfiles - 1 );
 
-	nPotential = Sys_CountFileList( pFiles );
+	pakfilesi = 0;
+	pakdirsi = 0;
 
-	for ( i = 0 ; i < nPotential ; i++ ) {
-		name = pFiles[i];
-		// NOTE: cleaner would involve more changes
-		// ignore duplicate mod directories
-		if ( i != 0 ) {
-			bDrop = false;
-			for ( j = 0; j < i; j++ ) {
-				if ( Q_stricmp( pFiles[j], name ) == 0 ) {
-					// this one can be dropped
-					bDrop = true;
-					break;
-				}
-			}
+	if ( fs_numServerPaks ) {
+		numdirs = 0;
+		pakdirs = NULL;
+	} else {
+		// Get top level directories (we'll filter them later since the Sys_ListFiles filtering is terrible)
+		pakdirs = Sys_ListFiles( curpath, "/", NULL, &numdirs, false );
+		if ( numdirs >= 2 ) {
+			FS_SortFileList( pakdirs, numdirs - 1 );
 		}
+	}
 
-		// we also drop BASEGAME, "." and ".."
-		if ( bDrop || strcmp(name, "." ) == 0 || strcmp( name, ".." ) == 0 ) {
-			continue;
-		}
+	fs_startupTimes.list += Sys_Microseconds() - t0;
 
-		if ( FS_IsBaseGame( name ) ) {
-			continue;
+	paks = NULL;
+	if ( numfiles > 0 ) {
+		paks = Z_Malloc( numfiles * sizeof( paks[0] ) );
+		FS_LoadZipFiles( path, dir, pakfiles, numfiles, paks );
+	}
+
+	while (( pakfilesi < numfiles) || (pakdirsi < numdirs) ) 
+	{
+		// Check if a pakfile or pakdir comes next
+		if (pakfilesi >= numfiles) {
+			// We've used all the pakfiles, it must be a pakdir.
+			pakwhich = 0;
+		}
+		else if (pakdirsi >= numdirs) {
+			// We've used all the pakdirs, it must be a pakfile.
+			pakwhich = 1;
+		}
+		else {
+			// Could be either, compare to see which name comes first
+			pakwhich = (FS_PathCmp( pakfiles[pakfilesi], pakdirs[pakdirsi] ) < 0);
 		}
 
-		// in order to be a valid mod the directory must contain at least one .pk3
-		// we didn't keep the information when we merged the directory names, as to what OS Path it was found under
-		// so we will try each of them here
-		nPaks = nPakDirs = 0;
-		for ( j = 0; j < ARRAY_LEN( paths ); j++ ) {
-			if ( !*paths[ j ] || !(*paths[ j ])->string[0] )
-				break;
-			path = FS_BuildOSPath( (*paths[j])->string, name, NULL );
+		if ( pakwhich ) {
 
-			nPaks = nDirs = nPakDirs = 0;
-			pPaks = Sys_ListFiles( path, ".pk3", NULL, &nPaks, false );
-			pDirs = Sys_ListFiles( path, "/", NULL, &nDirs, false );
-			for ( k = 0; k < nDirs; k++ ) {
-				// we only want to count directories ending with ".pk3dir"
-				if ( FS_IsExt( pDirs[k], ".pk3dir", strlen( pDirs[k] ) ) ) {
-					nPakDirs++;
-				}
+			len = strlen( pakfiles[pakfilesi] );
+			if ( !FS_IsExt( pakfiles[pakfilesi], ".pk3", len ) ) {
+				// not a pk3 file
+				pakfilesi++;
+				continue;
+			}
+
+			// The next .pk3 file is before the next .pk3dir
+			if ( (pak = paks[pakfilesi]) == NULL ) {
+				// This isn't a .pk3! Next!
+				pakfilesi++;
+				continue;
 			}
 
-			// we only use Sys_ListFiles to check whether files are present
-			Sys_FreeFileList( pDirs );
-			Sys_FreeFileList( pPaks );
-			if ( nPaks > 0 || nPakDirs > 0 ) {
-				break;
-			}
-		}
+			// store the game name for downloading
+			pak->pakGamename = gamedir;
+
+			pak->index = fs_packCount;
+			pak->referenced = 0;
+			pak->exclude = false;
+
+			fs_packFiles += pak->numfiles;
+			fs_packCount++;
+
+			search = Z_TagMalloc( sizeof( *search ), TAG_SEARCH_PACK );
+			Com_Memset( search, 0, sizeof( *search ) );
+			search->pack = pak;
+
+			search->next = fs_searchpaths;
+			fs_searchpaths = search;
+
+			pakfilesi++;
+		} else {
 
-		if ( nPaks > 0 || nPakDirs > 0 ) {
-			nLen = strlen( name ) + 1;
-			// nLen is the length of the mod path
-			// we need to see if there is a description available
-			FS_GetModDescription( name, description, sizeof( description ) );
-			nDescLen = strlen( description ) + 1;
+			len = strlen(pakdirs[pakdirsi]);
 
-			if ( nTotal + nLen + 1 + nDescLen + 1 < bufsize ) {
-				strcpy( listbuf, name );
-				listbuf += nLen;
-				strcpy( listbuf, description );
-				listbuf += nDescLen;
-				nTotal += nLen + nDescLen;
-				nMods++;
-			} else {
-				break;
+			// The next .pk3dir is before the next .pk3 file
+			// But wait, this could be any directory, we're filtering to only ending with ".pk3dir" here.
+			if (!FS_IsExt(pakdirs[pakdirsi], ".pk3dir", len)) {
+				// This isn't a .pk3dir! Next!
+				pakdirsi++;
+				continue;
 			}
+
+			// add the directory to the search path
+			path_len = (int) strlen( curpath ) + 1; 
+			path_len = PAD( path_len, sizeof( int ) );
+			dir_len = PAD( len + 1, sizeof( int ) );
+			len = sizeof( *search ) + sizeof( *search->dir ) + path_len + dir_len;
+
+			search = Z_TagMalloc( len, TAG_SEARCH_DIR );
+			Com_Memset( search, 0, len );
+			search->dir = (directory_t*)(search + 1);
+			search->dir->path = (char*)( search->dir + 1 );
+			search->dir->gamedir = (char*)( search->dir->path + path_len );
+			search->policy = DIR_ALLOW;
+
+			strcpy( search->dir->path, curpath );				// c:\quake3\baseq3
+			strcpy( search->dir->gamedir, pakdirs[ pakdirsi ] );// mypak.pk3dir
+
+			search->next = fs_searchpaths;
+			fs_searchpaths = search;
+			fs_pk3dirCount++;
+
+			pakdirsi++;
 		}
 	}
-	Sys_FreeFileList( pFiles );
 
-	return nMods;
+	// done
+	if ( paks ) {
+		Z_Free( paks );
+	}
+	Sys_FreeFileList( pakdirs );
+	Sys_FreeFileList( pakfiles );
 }
 
 
-//============================================================================
-
 /*
 ================
-FS_Dir_f
+FS_idPak
 ================
 */
-static void FS_Dir_f( void ) {
-	const char *path;
-	const char *extension;
-	char **dirnames;
-	int ndirs;
+bool FS_idPak(const char *pak, const char *base, int numPaks)
+{
 	int i;
 
-	if ( Cmd_Argc() < 2 || Cmd_Argc() > 3 ) {
-		Com_Printf( "usage: dir <directory> [extension]\n" );
-		return;
-	}
-
-	if ( Cmd_Argc() == 2 ) {
-		path = Cmd_Argv( 1 );
-		extension = "";
-	} else {
-		path = Cmd_Argv( 1 );
-		extension = Cmd_Argv( 2 );
+	for (i = 0; i < NUM_ID_PAKS; i++) {
+		if ( !FS_FilenameCompare(pak, va("%s/pak%d", base, i)) ) {
+			break;
+		}
 	}
-
-	Com_Printf( "Directory of %s %s\n", path, extension );
-	Com_Printf( "---------------\n" );
-
-	dirnames = FS_ListFiles( path, extension, &ndirs );
-
-	for ( i = 0; i < ndirs; i++ ) {
-		Com_Printf( "%s\n", dirnames[i] );
+	if (i < numPaks) {
+		return true;
 	}
-	FS_FreeFileList( dirnames );
+	return false;
 }
 
 
 /*
-===========
-FS_ConvertPath
-===========
+================
+FS_InvalidGameDir
+return true if path is a reference to current directory or directory traversal
+or a sub-directory
+================
 */
-static void FS_ConvertPath( char *s ) {
-	while (*s) {
-		if ( *s == '\\' || *s == ':' ) {
-			*s = '/';
-		}
-		s++;
+bool FS_InvalidGameDir( const char *gamedir ) 
+{
+	if ( !strcmp( gamedir, "." ) || !strcmp( gamedir, ".." )
+		|| strchr( gamedir, '/' ) || strchr( gamedir, '\\' ) ) {
+		return true;
 	}
+
+	return false;
 }
 
 
 /*
-===========
-FS_PathCmp
+================
+FS_ComparePaks
 
-Ignore case and separator char distinctions
-===========
+----------------
+dlstring == true
+
+Returns a list of pak files that we should download from the server. They all get stored
+in the current gamedir and an FS_Restart will be fired up after we download them all.
+
+The string is the format:
+
+@remotename@localname [repeat]
+
+static int		fs_numServerReferencedPaks;
+static int		fs_serverReferencedPaks[MAX_REF_PAKS];
+static char		*fs_serverReferencedPakNames[MAX_REF_PAKS];
+
+----------------
+dlstring == false
+
+we are not interested in a download string format, we want something human-readable
+(this is used for diagnostics while connecting to a pure server)
+
+================
 */
-static int FS_PathCmp( const char *s1, const char *s2 ) {
-	int		c1, c2;
-	
-	do {
-		c1 = *s1++;
-		c2 = *s2++;
+bool FS_ComparePaks( char *neededpaks, int len, bool dlstring ) {
+	const searchpath_t	*sp;
+	bool havepak;
+	char *origpos = neededpaks;
+	int i;
 
-		if (c1 >= 'a' && c1 <= 'z') {
-			c1 -= ('a' - 'A');
-		}
-		if (c2 >= 'a' && c2 <= 'z') {
-			c2 -= ('a' - 'A');
-		}
+	if (!fs_numServerReferencedPaks)
+		return false; // Server didn't send any pack information along
 
-		if ( c1 == '\\' || c1 == ':' ) {
-			c1 = '/';
-		}
-		if ( c2 == '\\' || c2 == ':' ) {
-			c2 = '/';
+	*neededpaks = '\0';
+
+	for ( i = 0 ; i < fs_numServerReferencedPaks ; i++ )
+	{
+		// Ok, see if we have this pak file
+		havepak = false;
+
+		// never autodownload any of the id paks
+		if ( FS_idPak(fs_serverReferencedPakNames[i], BASEGAME, NUM_ID_PAKS) || FS_idPak(fs_serverReferencedPakNames[i], BASETA, NUM_TA_PAKS) ) {
+			continue;
 		}
-		
-		if (c1 < c2) {
-			return -1;		// strings not equal
+
+		// Make sure the server cannot make us write to non-quake3 directories.
+		if ( FS_CheckDirTraversal( fs_serverReferencedPakNames[i] ) ) {
+			Com_Printf( "WARNING: Invalid download name %s\n", fs_serverReferencedPakNames[i] );
+			continue;
 		}
-		if (c1 > c2) {
-			return 1;
+
+		for ( sp = fs_searchpaths ; sp ; sp = sp->next ) {
+			if ( sp->pack && sp->pack->checksum == fs_serverReferencedPaks[i] ) {
+				havepak = true; // This is it!
+				break;
+			}
 		}
-	} while (c1);
+
+		if ( !havepak && fs_serverReferencedPakNames[i] && *fs_serverReferencedPakNames[i] ) { 
+			// Don't got it
+
+      if (dlstring)
+      {
+		// We need this to make sure we won't hit the end of the buffer or the server could
+		// overwrite non-pk3 files on clients by writing so much crap into neededpaks that
+		// Q_strcat cuts off the .pk3 extension.
 	
-	return 0;		// strings are equal
+		origpos += strlen(origpos);
+	
+        // Remote name
+        Q_strcat( neededpaks, len, "@");
+        Q_strcat( neededpaks, len, fs_serverReferencedPakNames[i] );
+        Q_strcat( neededpaks, len, ".pk3" );
+
+        // Local name
+        Q_strcat( neededpaks, len, "@");
+        // Do we have one with the same name?
+        if ( FS_SV_FileExists( va( "%s.pk3", fs_serverReferencedPakNames[i] ) ) )
+        {
+          char st[MAX_ZPATH];
+          // We already have one called this, we need to download it to another name
+          // Make something up with the checksum in it
+          Com_sprintf( st, sizeof( st ), "%s.%08x.pk3", fs_serverReferencedPakNames[i], fs_serverReferencedPaks[i] );
+          Q_strcat( neededpaks, len, st );
+        } else
+        {
+          Q_strcat( neededpaks, len, fs_serverReferencedPakNames[i] );
+          Q_strcat( neededpaks, len, ".pk3" );
+        }
+        
+        // Find out whether it might have overflowed the buffer and don't add this file to the
+        // list if that is the case.
+        if(strlen(origpos) + (origpos - neededpaks) >= len - 1)
+	{
+		*origpos = '\0';
+		break;
+	}
+      }
+      else
+      {
+        Q_strcat( neededpaks, len, fs_serverReferencedPakNames[i] );
+			  Q_strcat( neededpaks, len, ".pk3" );
+        // Do we have one with the same name?
+        if ( FS_SV_FileExists( va( "%s.pk3", fs_serverReferencedPakNames[i] ) ) )
+        {
+          Q_strcat( neededpaks, len, " (local file exists with wrong checksum)");
+        }
+        Q_strcat( neededpaks, len, "\n");
+      }
+		}
+	}
+
+	if ( *neededpaks ) {
+		return true;
+	}
+
+	return false; // We have them all
 }
 
 
 /*
 ================
-FS_SortFileList
+FS_Shutdown
+
+Frees all resources.
 ================
 */
-static void FS_SortFileList( char **list, int n ) {
-	const char *m;
-	char *temp;
-	int i, j;
-	i = 0;
-	j = n;
-	m = list[ n >> 1 ];
-	do {
-		while ( FS_PathCmp( list[i], m ) < 0 ) i++;
-		while ( FS_PathCmp( list[j], m ) > 0 ) j--;
-		if ( i <= j ) {
-			temp = list[i];
-			list[i] = list[j];
-			list[j] = temp;
-			i++; 
-			j--;
-		}
-	} while ( i <= j );
-	if ( j > 0 ) FS_SortFileList( list, j );
-	if ( n > i ) FS_SortFileList( list+i, n-i );
-}
+void FS_Shutdown( bool closemfp )
+{
+	searchpath_t	*p, *next;
+	int i;
 
+	// queued reads still refer to the search path
+	FS_FinishAsyncReads();
 
-/*
-================
-FS_NewDir_f
-================
-*/
-static void FS_NewDir_f( void ) {
-	const char *filter;
-	char	**dirnames;
-	char	dirname[ MAX_STRING_CHARS ];
-	int		ndirs;
-	int		i;
+#ifdef USE_PK3_CACHE
+	FS_StopPakWatch();
+#endif
 
-	if ( Cmd_Argc() < 2 ) {
-		Com_Printf( "usage: fdir <filter>\n" );
-		Com_Printf( "example: fdir *q3dm*.bsp\n");
-		return;
+#ifdef USE_CONTENT_CACHE
+	// keep the order of use of files served since the last save
+	if ( fs_cc.loaded ) {
+		FS_SaveContentCacheIndex();
 	}
+#endif
 
-	filter = Cmd_Argv( 1 );
-
-	Com_Printf( "---------------\n" );
+	// close opened files
+	if ( closemfp ) 
+	{
+		FS_StopAsyncReads();
+		FS_StopWorkers();
 
-	dirnames = FS_ListFilteredFiles( "", "", filter, &ndirs, FS_MATCH_ANY );
+		for ( i = 1; i < MAX_FILE_HANDLES; i++ )
+		{
+			if ( !fsh[i].handleFiles.file.v  )
+				continue;
 
-	if ( ndirs >= 2 )
-		FS_SortFileList( dirnames, ndirs - 1 );
+			FS_FCloseFile( i );
+		}
+	}
 
-	for ( i = 0; i < ndirs; i++ ) {
-		Q_strncpyz( dirname, dirnames[i], sizeof( dirname ) );
-		FS_ConvertPath( dirname );
-		Com_Printf( "%s\n", dirname );
+#ifdef DELAY_WRITECONFIG
+	if ( fs_searchpaths )
+	{
+		Com_WriteConfiguration();
 	}
+#endif
 
-	Com_Printf( "%d files listed\n", ndirs );
-	FS_FreeFileList( dirnames );
-}
+#ifdef USE_PK3_CACHE
+	FS_ResetCacheReferences();
+#endif
 
+#ifdef USE_CONTENT_CACHE
+	FS_SaveContentCacheIndex();
+#endif
 
-/*
-============
-FS_Path_f
-============
-*/
-static void FS_Path_f( void ) {
-	const searchpath_t *s;
-	int i;
+	// free everything
+	for( p = fs_searchpaths; p; p = next )
+	{
+		next = p->next;
 
-	Com_Printf( "Current search path:\n" );
-	for ( s = fs_searchpaths; s; s = s->next ) {
-		if ( s->pack ) {
-			Com_Printf( "%s (%i files)\n", s->pack->pakFilename, s->pack->numfiles );
-			if ( fs_numServerPaks ) {
-				if ( !FS_PakIsPure( s->pack ) ) {
-					Com_Printf( S_COLOR_YELLOW "    not on the pure list\n" );
-				} else {
-					Com_Printf( "    on the pure list\n" );
-				}
-			}
-		} else {
-			Com_Printf( "%s%c%s\n", s->dir->path, PATH_SEP, s->dir->gamedir );
+		if ( p->pack )
+		{
+#ifdef USE_PK3_CACHE
+#ifdef USE_HANDLE_CACHE
+			if ( p->pack->next_h )
+				FS_RemoveFromHandleList( p->pack );
+#endif
+#else
+			FS_FreePak( p->pack );
+#endif
+			p->pack = NULL;
 		}
-	}
 
-	Com_Printf( "\n" );
-	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
-		if ( fsh[i].handleFiles.file.o ) {
-			Com_Printf( "handle %i: %s\n", i, fsh[i].name );
-		}
+		Z_Free( p );
 	}
-}
-
-
-/*
-============
-FS_TouchFile_f
 
-The only purpose of this function is to allow game script files to copy
-arbitrary files furing an "fs_copyfiles 1" run.
-============
-*/
-static void FS_TouchFile_f( void ) {
-	fileHandle_t	f;
+	FS_FreeFileIndex();
 
-	if ( Cmd_Argc() != 2 ) {
-		Com_Printf( "Usage: touchFile <file>\n" );
-		return;
-	}
+#ifdef USE_PK3_CACHE
+	FS_FreeRetiredPaks();
+#endif
 
-	FS_FOpenFileRead( Cmd_Argv( 1 ), &f, false );
-	if ( f != FS_INVALID_HANDLE ) {
-		FS_FCloseFile( f );
-	}
-}
+	// any FS_ calls will now be an error until reinitialized
+	fs_searchpaths = NULL;
+	fs_packFiles = 0;
 
+	fs_pk3dirCount = 0;
+	fs_packCount = 0;
+	fs_dirCount = 0;
 
-/*
-============
-FS_CompleteFileName
-============
-*/
-static void FS_CompleteFileName( const char *args, int argNum ) {
-	if( argNum == 2 ) {
-		Field_CompleteFilename( "", "", false, FS_MATCH_ANY );
-	}
+	Cmd_RemoveCommand( "path" );
+	Cmd_RemoveCommand( "dir" );
+	Cmd_RemoveCommand( "fdir" );
+	Cmd_RemoveCommand( "touchFile" );
+	Cmd_RemoveCommand( "which" );
+	Cmd_RemoveCommand( "lsof" );
+	Cmd_RemoveCommand( "fs_restart" );
+	Cmd_RemoveCommand( "fs_inflatebench" );
+	Cmd_RemoveCommand( "fs_listbench" );
+#ifdef USE_PK3_CACHE
+	Cmd_RemoveCommand( "fs_rescan" );
+#endif
+#ifdef USE_CONTENT_CACHE
+	Cmd_RemoveCommand( "fs_contentcache" );
+#endif
 }
 
 
 /*
-============
-FS_Which_f
-============
+================
+FS_ReorderSearchPaths
+================
 */
-static void FS_Which_f( void ) {
-	const searchpath_t *search;
-	char			*netpath;
-	pack_t			*pak;
-	fileInPack_t	*pakFile;
-	directory_t		*dir;
-	long			hash;
-	FILE			*temp;
-	const char			*filename;
-	char			buf[ MAX_OSPATH*2 + 1 ];
-	int				numfound;
-
-	hash = 0;
-	numfound = 0;
-	filename = Cmd_Argv(1);
+static void FS_ReorderSearchPaths( void ) {
+	searchpath_t **list, **paks, **dirs;
+	searchpath_t *path;
+	int i, ndirs, npaks, cnt;
 
-	if ( !filename[0] ) {
-		Com_Printf( "Usage: which <file>\n" );
+	cnt = fs_packCount + fs_dirCount + fs_pk3dirCount;
+	if ( cnt == 0 )
 		return;
-	}
-
-	// qpaths are not supposed to have a leading slash
-	if ( filename[0] == '/' || filename[0] == '\\' ) {
-		filename++;
-	}
 
-	// just wants to see if file is there
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		if ( search->pack ) {
-			hash = FS_HashFileName(filename, search->pack->hashSize);
-		}
-		// is the element a pak file?
-		if ( search->pack && search->pack->hashTable[hash] ) {
-			// look through all the pak file elements
-			pak = search->pack;
-			pakFile = pak->hashTable[hash];
-			do {
-				// case and separator insensitive comparisons
-				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					// found it!
-					Com_Printf( "File \"%s\" found in \"%s\"\n", filename, pak->pakFilename );
-					if ( ++numfound >= 32 ) {
-						return;
-					}
-				}
-				pakFile = pakFile->next;
-			} while(pakFile != NULL);
-		} else if ( search->dir ) {
-			dir = search->dir;
+	// relink path chains in following order:
+	// 1. pk3dirs @ pak files
+	// 2. directories
+	list = (searchpath_t **)Z_Malloc( cnt * sizeof( list[0] ) );
+	paks = list;
+	dirs = list + fs_pk3dirCount + fs_packCount;
 
-			netpath = FS_BuildOSPath( dir->path, dir->gamedir, filename );
-			temp = Sys_FOpen( netpath, "rb" );
-			if ( !temp ) {
-				continue;
-			}
-			fclose(temp);
-			Com_sprintf( buf, sizeof( buf ), "%s%c%s", dir->path, PATH_SEP, dir->gamedir );
-			FS_ReplaceSeparators( buf );
-			Com_Printf( "File \"%s\" found at \"%s\"\n", filename, buf );
-			if ( ++numfound >= 32 ) {
-				return;
-			}
+	npaks = ndirs = 0;
+	path = fs_searchpaths;
+	while ( path ) {
+		if ( path->pack || path->policy != DIR_STATIC ) {
+			paks[npaks++] = path;
+		} else {
+			dirs[ndirs++] = path;
 		}
+		path = path->next;
 	}
 
-	if ( !numfound ) {
-		Com_Printf( "File not found: \"%s\"\n", filename );
+	fs_searchpaths = list[0];
+	for ( i = 0; i < cnt-1; i++ ) {
+		list[i]->next = list[i+1];
 	}
-}
+	list[cnt-1]->next = NULL;
 
+	Z_Free( list );
+}
 
-//===========================================================================
 
 /*
 ================
-FS_AddGameDirectory
-
-Sets fs_gamedir, adds the directory to the head of the path,
-then loads the zip headers
+FS_ReorderPurePaks
+NOTE TTimo: the reordering that happens here is not reflected in the cvars (\cvarlist *pak*)
+  this can lead to misleading situations, see https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=540
 ================
 */
-static void FS_AddGameDirectory( const char *path, const char *dir ) {
-	const searchpath_t *sp;
-	int				len;
-	searchpath_t	*search;
-	const char		*gamedir;
-	pack_t			*pak;
-	char			curpath[MAX_OSPATH*2 + 1];
-	char			*pakfile;
-	int				numfiles;
-	char			**pakfiles;
-	int				pakfilesi;
-	int				numdirs;
-	char			**pakdirs;
-	int				pakdirsi;
-	int				pakwhich;
-	int				path_len;
-	int				dir_len;
+static void FS_ReorderPurePaks( void )
+{
+	searchpath_t *s;
+	int i;
+	searchpath_t **p_insert_index, // for linked list reordering
+		**p_previous; // when doing the scan
+	
+	fs_reordered = false;
 
-	for ( sp = fs_searchpaths ; sp ; sp = sp->next ) {
-		if ( sp->dir && !Q_stricmp( sp->dir->path, path ) && !Q_stricmp( sp->dir->gamedir, dir )) {
-			return;	// we've already got this one
+	// only relevant when connected to pure server
+	if ( !fs_numServerPaks )
+		return;
+	
+	p_insert_index = &fs_searchpaths; // we insert in order at the beginning of the list 
+	for ( i = 0 ; i < fs_numServerPaks ; i++ ) {
+		p_previous = p_insert_index; // track the pointer-to-current-item
+		for (s = *p_insert_index; s; s = s->next) {
+			// the part of the list before p_insert_index has been sorted already
+			if (s->pack && fs_serverPaks[i] == s->pack->checksum) {
+				fs_reordered = true;
+				// move this element to the insert list
+				*p_previous = s->next;
+				s->next = *p_insert_index;
+				*p_insert_index = s;
+				// increment insert list
+				p_insert_index = &s->next;
+				break; // iterate to next server pack
+			}
+			p_previous = &s->next;
 		}
 	}
-	
-	Q_strncpyz( fs_gamedir, dir, sizeof( fs_gamedir ) );
-
-	//
-	// add the directory to the search path
-	//
-	path_len = (int) strlen( path ) + 1;
-	path_len = PAD( path_len, sizeof( int ) );
-	dir_len = (int) strlen( dir ) + 1;
-	dir_len = PAD( dir_len, sizeof( int ) );
-	len = sizeof( *search ) + sizeof( *search->dir ) + path_len + dir_len;
+}
 
-	search = Z_TagMalloc( len, TAG_SEARCH_PATH );
-	Com_Memset( search, 0, len );
-	search->dir = (directory_t*)( search + 1 );
-	search->dir->path = (char*)( search->dir + 1 );
-	search->dir->gamedir = (char*)( search->dir->path + path_len );
 
-	strcpy( search->dir->path, path );
-	strcpy( search->dir->gamedir, dir );
-	gamedir = search->dir->gamedir;
+/*
+================
+FS_OwnerName
+================
+*/
+static const char *FS_OwnerName( handleOwner_t owner ) 
+{
+	static const char *s[4]= { "SY", "QA", "CG", "UI" };
+	if ( owner < H_SYSTEM || owner > H_Q3UI )
+		return "??";
+	return s[owner];
+}
 
-	search->next = fs_searchpaths;
-	fs_searchpaths = search;
-	fs_dirCount++;
 
-	// find all pak files in this directory
-	Q_strncpyz( curpath, FS_BuildOSPath( path, dir, NULL ), sizeof( curpath ) );
+/*
+================
+FS_ListOpenFiles
+================
+*/
+static void FS_ListOpenFiles_f( void ) {
+	int i;
+	fileHandleData_t *fh;
+	fh = fsh;
+	for ( i = 0; i < MAX_FILE_HANDLES; i++, fh++ ) {
+		if ( !fh->handleFiles.file.v )
+			continue;
+		Com_Printf( "%2i %2s %s\n", i, FS_OwnerName(fh->owner), fh->name );
+	}
+}
 
-	// Get .pk3 files
-	pakfiles = Sys_ListFiles(curpath, ".pk3", NULL, &numfiles, false);
 
-	if ( numfiles >= 2 )
-		FS_SortFileList( pakfiles, numfiles - 1 );
+/*
+=====================
+FS_LoadedPakPureChecksums
+=====================
+*/
+static int fs_numPureChecksums;
+static int fs_pureChecksum[ MAX_FOUND_FILES ];
 
-	pakfilesi = 0;
-	pakdirsi = 0;
+static void FS_LoadedPakPureChecksums( void )
+{
+	const searchpath_t *search;
 
-	if ( fs_numServerPaks ) {
-		numdirs = 0;
-		pakdirs = NULL;
-	} else {
-		// Get top level directories (we'll filter them later since the Sys_ListFiles filtering is terrible)
-		pakdirs = Sys_ListFiles( curpath, "/", NULL, &numdirs, false );
-		if ( numdirs >= 2 ) {
-			FS_SortFileList( pakdirs, numdirs - 1 );
+	fs_numPureChecksums = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			if ( fs_numPureChecksums >= ARRAY_LEN( fs_pureChecksum ) ) {
+				Com_DPrintf( "WARNING: pure checksums overflowed\n" );
+				fs_numPureChecksums = 0;
+				return;
+			}
+			fs_pureChecksum[ fs_numPureChecksums ] = search->pack->pure_checksum;
+			fs_numPureChecksums++;
 		}
 	}
+}
 
-	while (( pakfilesi < numfiles) || (pakdirsi < numdirs) ) 
-	{
-		// Check if a pakfile or pakdir comes next
-		if (pakfilesi >= numfiles) {
-			// We've used all the pakfiles, it must be a pakdir.
-			pakwhich = 0;
-		}
-		else if (pakdirsi >= numdirs) {
-			// We've used all the pakdirs, it must be a pakfile.
-			pakwhich = 1;
-		}
-		else {
-			// Could be either, compare to see which name comes first
-			pakwhich = (FS_PathCmp( pakfiles[pakfilesi], pakdirs[pakdirsi] ) < 0);
-		}
 
-		if ( pakwhich ) {
+/*
+================
+FS_IsPureChecksum
+================
+*/
+bool FS_IsPureChecksum( int sum )
+{
+	int i;
 
-			len = strlen( pakfiles[pakfilesi] );
-			if ( !FS_IsExt( pakfiles[pakfilesi], ".pk3", len ) ) {
-				// not a pk3 file
-				pakfilesi++;
-				continue;
-			}
+	if ( fs_numPureChecksums == 0 )
+		return true;
+	
+	for ( i = 0; i < fs_numPureChecksums; i++ )
+		if ( fs_pureChecksum[i] == sum )
+			return true;
 
-			// The next .pk3 file is before the next .pk3dir
-			pakfile = FS_BuildOSPath( path, dir, pakfiles[pakfilesi] );
-			if ( (pak = FS_LoadZipFile( pakfile ) ) == NULL ) {
-				// This isn't a .pk3! Next!
-				pakfilesi++;
-				continue;
-			}
+	return false;
+}
 
-			// store the game name for downloading
-			pak->pakGamename = gamedir;
 
-			pak->index = fs_packCount;
-			pak->referenced = 0;
-			pak->exclude = false;
+#ifdef USE_PK3_CACHE
+/*
+=================================================================================
 
-			fs_packFiles += pak->numfiles;
-			fs_packCount++;
+INCREMENTAL PAK UPDATES
 
-			search = Z_TagMalloc( sizeof( *search ), TAG_SEARCH_PACK );
-			Com_Memset( search, 0, sizeof( *search ) );
-			search->pack = pak;
+pk3 files added to, replaced in or removed from the game directories are
+applied to the search path in place: unchanged packs stay loaded, new ones are
+scanned and inserted where FS_AddGameDirectory() would have put them, then the
+file index and pure checksums are refreshed. Removed packs with open file
+handles are kept aside until the last handle is closed. While a server is
+running, paks it may have announced to clients (referenced ones, or all of
+them on a pure server) are not removed or replaced before the next map load.
 
-			search->next = fs_searchpaths;
-			fs_searchpaths = search;
+=================================================================================
+*/
 
-			pakfilesi++;
-		} else {
+#define MAX_PAK_CHANGES		64
+#define PAK_CHANGE_DELAY	1000	// msec without notifications before changes are applied
 
-			len = strlen(pakdirs[pakdirsi]);
+typedef struct {
+	int			watch;
+	char		name[ MAX_OSPATH ];
+} pakChange_t;
+
+static struct {
+	bool		watching;
+	bool		all;			// notifications were lost, rescan every directory
+	int			time;			// time of the last notification
+	int			numChanges;
+	pakChange_t	changes[ MAX_PAK_CHANGES ];
+	int			added;
+	int			removed;
+	int			replaced;
+	int			deferred;		// paks in use left for the next map load
+	bool		mapLoad;		// paks in use may change
+} fs_pakWatch;
+
+static searchpath_t *fs_retiredPaks;	// removed from the search path but still in use
 
-			// The next .pk3dir is before the next .pk3 file
-			// But wait, this could be any directory, we're filtering to only ending with ".pk3dir" here.
-			if (!FS_IsExt(pakdirs[pakdirsi], ".pk3dir", len)) {
-				// This isn't a .pk3dir! Next!
-				pakdirsi++;
-				continue;
-			}
 
-			// add the directory to the search path
-			path_len = (int) strlen( curpath ) + 1; 
-			path_len = PAD( path_len, sizeof( int ) );
-			dir_len = PAD( len + 1, sizeof( int ) );
-			len = sizeof( *search ) + sizeof( *search->dir ) + path_len + dir_len;
+/*
+=================
+FS_PakFileName
 
-			search = Z_TagMalloc( len, TAG_SEARCH_DIR );
-			Com_Memset( search, 0, len );
-			search->dir = (directory_t*)(search + 1);
-			search->dir->path = (char*)( search->dir + 1 );
-			search->dir->gamedir = (char*)( search->dir->path + path_len );
-			search->policy = DIR_ALLOW;
+Returns file name of the pak as listed in its directory
+=================
+*/
+static const char *FS_PakFileName( const pack_t *pak )
+{
+	const char *s, *name;
 
-			strcpy( search->dir->path, curpath );				// c:\quake3\baseq3
-			strcpy( search->dir->gamedir, pakdirs[ pakdirsi ] );// mypak.pk3dir
+	name = pak->pakFilename;
+	for ( s = name; *s != '\0'; s++ ) {
+		if ( *s == '/' || *s == '\\' )
+			name = s + 1;
+	}
 
-			search->next = fs_searchpaths;
-			fs_searchpaths = search;
-			fs_pk3dirCount++;
+	return name;
+}
 
-			pakdirsi++;
+
+/*
+=================
+FS_PakOwner
+
+Returns game directory which added pack or pk3dir search path element
+=================
+*/
+static const searchpath_t *FS_PakOwner( const searchpath_t *search, const searchpath_t **dirs, int numDirs )
+{
+	int i;
+
+	for ( i = 0; i < numDirs; i++ ) {
+		if ( search->pack ) {
+			if ( search->pack->pakGamename == dirs[ i ]->dir->gamedir )
+				return dirs[ i ];
+		} else if ( !Q_stricmp( search->dir->path, FS_BuildOSPath( dirs[ i ]->dir->path, dirs[ i ]->dir->gamedir, NULL ) ) ) {
+			return dirs[ i ];
 		}
 	}
 
-	// done
-	Sys_FreeFileList( pakdirs );
-	Sys_FreeFileList( pakfiles );
+	return NULL;
 }
 
 
 /*
-================
-FS_idPak
-================
+=================
+FS_InsertPak
+
+Links pack search path element in the order set by FS_AddGameDirectory():
+directories added later come first and their paks are in descending name order
+=================
 */
-bool FS_idPak(const char *pak, const char *base, int numPaks)
+static void FS_InsertPak( const searchpath_t *dirSearch, searchpath_t *search )
 {
-	int i;
+	const searchpath_t **dirs, *owner;
+	searchpath_t **p, *s;
+	const char *name, *sname;
+	int numDirs;
+
+	name = FS_PakFileName( search->pack );
+
+	dirs = Z_Malloc( fs_dirCount * sizeof( dirs[0] ) );
+	numDirs = 0;
+	for ( s = fs_searchpaths; s && numDirs < fs_dirCount; s = s->next ) {
+		if ( s->dir && s->policy == DIR_STATIC ) {
+			dirs[ numDirs++ ] = s;
+		}
+	}
 
-	for (i = 0; i < NUM_ID_PAKS; i++) {
-		if ( !FS_FilenameCompare(pak, va("%s/pak%d", base, i)) ) {
+	for ( p = &fs_searchpaths; ( s = *p ) != NULL; p = &s->next ) {
+		if ( s->dir && s->policy == DIR_STATIC )
+			break; // end of pak section
+		owner = FS_PakOwner( s, dirs, numDirs );
+		if ( owner == NULL )
+			continue;
+		if ( owner == dirSearch ) {
+			sname = s->pack ? FS_PakFileName( s->pack ) : s->dir->gamedir;
+			if ( FS_PathCmp( name, sname ) > 0 )
+				break;
+		} else if ( owner->order > dirSearch->order ) {
 			break;
 		}
 	}
-	if (i < numPaks) {
-		return true;
-	}
-	return false;
+
+	search->next = *p;
+	*p = search;
+
+	Z_Free( (void *)dirs );
 }
 
 
 /*
-================
-FS_InvalidGameDir
-return true if path is a reference to current directory or directory traversal
-or a sub-directory
-================
+=================
+FS_FreeRetiredPaks
+=================
 */
-bool FS_InvalidGameDir( const char *gamedir ) 
+static void FS_FreeRetiredPaks( void )
 {
-	if ( !strcmp( gamedir, "." ) || !strcmp( gamedir, ".." )
-		|| strchr( gamedir, '/' ) || strchr( gamedir, '\\' ) ) {
-		return true;
-	}
+	searchpath_t **p, *s;
 
-	return false;
+	for ( p = &fs_retiredPaks; ( s = *p ) != NULL; ) {
+		if ( s->pack->handleUsed == 0 ) {
+			*p = s->next;
+			FS_FreePak( s->pack );
+			Z_Free( s );
+		} else {
+			p = &s->next;
+		}
+	}
 }
 
 
 /*
-================
-FS_ComparePaks
+=================
+FS_RemoveMarkedPaks
 
-----------------
-dlstring == true
+Unlinks packs marked with order -1 from the search path and the pk3 cache
+=================
+*/
+static void FS_RemoveMarkedPaks( void )
+{
+	searchpath_t **p, *s;
 
-Returns a list of pak files that we should download from the server. They all get stored
-in the current gamedir and an FS_Restart will be fired up after we download them all.
+	for ( p = &fs_searchpaths; ( s = *p ) != NULL; ) {
+		if ( s->pack == NULL || s->order != -1 ) {
+			p = &s->next;
+			continue;
+		}
 
-The string is the format:
+		*p = s->next;
 
-@remotename@localname [repeat]
+		fs_packFiles -= s->pack->numfiles;
+		fs_packCount--;
 
-static int		fs_numServerReferencedPaks;
-static int		fs_serverReferencedPaks[MAX_REF_PAKS];
-static char		*fs_serverReferencedPakNames[MAX_REF_PAKS];
+		FS_RemoveFromCache( s->pack );
 
-----------------
-dlstring == false
+		s->next = fs_retiredPaks;
+		fs_retiredPaks = s;
+	}
 
-we are not interested in a download string format, we want something human-readable
-(this is used for diagnostics while connecting to a pure server)
+	FS_FreeRetiredPaks();
+}
 
-================
+
+/*
+=================
+FS_PakFileChanged
+=================
 */
-bool FS_ComparePaks( char *neededpaks, int len, bool dlstring ) {
-	const searchpath_t	*sp;
-	bool havepak;
-	char *origpos = neededpaks;
-	int i;
+static bool FS_PakFileChanged( const pack_t *pak )
+{
+	fileOffset_t size;
+	fileTime_t mtime;
+	fileTime_t ctime;
 
-	if (!fs_numServerReferencedPaks)
-		return false; // Server didn't send any pack information along
+	if ( !Sys_GetFileStats( pak->pakFilename, &size, &mtime, &ctime ) )
+		return true;
 
-	*neededpaks = '\0';
+	return pak->size != size || pak->mtime != mtime || pak->ctime != ctime;
+}
 
-	for ( i = 0 ; i < fs_numServerReferencedPaks ; i++ )
-	{
-		// Ok, see if we have this pak file
-		havepak = false;
 
-		// never autodownload any of the id paks
-		if ( FS_idPak(fs_serverReferencedPakNames[i], BASEGAME, NUM_ID_PAKS) || FS_idPak(fs_serverReferencedPakNames[i], BASETA, NUM_TA_PAKS) ) {
-			continue;
+/*
+=================
+FS_PakInUse
+
+Returns true if the pak can't be removed or replaced before the next map
+load: sv_paks and sv_referencedPaks announced to clients must stay valid
+=================
+*/
+static bool FS_PakInUse( const pack_t *pak )
+{
+	if ( fs_pakWatch.mapLoad || !com_sv_running || !com_sv_running->integer )
+		return false;
+
+	return pak->referenced || Cvar_VariableIntegerValue( "sv_pure" );
+}
+
+
+/*
+=================
+FS_UpdateGameDirectory
+
+Compares loaded paks of the game directory with sorted list of pk3 names,
+reloads changed ones and adds new ones. If the list is complete directory
+listing, paks which are not in it are removed, otherwise only listed names
+are checked
+=================
+*/
+static void FS_UpdateGameDirectory( searchpath_t *dirSearch, char **names, int numNames, bool complete )
+{
+	searchpath_t	*search;
+	searchpath_t	**loaded;
+	pack_t			**paks;
+	char			**added;
+	bool			*replaced;
+	int				numLoaded, numAdded;
+	int				index, i, j, c;
+
+	// loaded paks of this directory in ascending name order
+	numLoaded = 0;
+	index = 0;
+	for ( search = fs_searchpaths; search; search = search->next ) {
+		if ( search->pack ) {
+			if ( search->pack->index >= index )
+				index = search->pack->index + 1;
+			if ( search->pack->pakGamename == dirSearch->dir->gamedir )
+				numLoaded++;
 		}
+	}
 
-		// Make sure the server cannot make us write to non-quake3 directories.
-		if ( FS_CheckDirTraversal( fs_serverReferencedPakNames[i] ) ) {
-			Com_Printf( "WARNING: Invalid download name %s\n", fs_serverReferencedPakNames[i] );
-			continue;
+	loaded = Z_Malloc( ( numLoaded + numNames + 1 ) * ( sizeof( loaded[0] ) + sizeof( added[0] ) + sizeof( paks[0] ) + sizeof( replaced[0] ) ) );
+	added = (char **)( loaded + numLoaded + 1 );
+	paks = (pack_t **)( added + numNames + 1 );
+	replaced = (bool *)( paks + numNames + 1 );
+
+	i = numLoaded;
+	for ( search = fs_searchpaths; search; search = search->next ) {
+		if ( search->pack && search->pack->pakGamename == dirSearch->dir->gamedir ) {
+			loaded[ --i ] = search;
 		}
+	}
 
-		for ( sp = fs_searchpaths ; sp ; sp = sp->next ) {
-			if ( sp->pack && sp->pack->checksum == fs_serverReferencedPaks[i] ) {
-				havepak = true; // This is it!
-				break;
+	numAdded = 0;
+	i = j = 0;
+	while ( i < numNames || ( complete && j < numLoaded ) ) {
+		if ( j >= numLoaded )
+			c = -1;
+		else if ( i >= numNames )
+			c = 1;
+		else
+			c = FS_PathCmp( names[ i ], FS_PakFileName( loaded[ j ]->pack ) );
+
+		if ( c > 0 ) {
+			// not listed
+			if ( complete ) {
+				if ( FS_PakInUse( loaded[ j ]->pack ) ) {
+					fs_pakWatch.deferred++;
+				} else {
+					loaded[ j ]->order = -1;
+					fs_pakWatch.removed++;
+				}
+			}
+			j++;
+		} else if ( c < 0 ) {
+			// not loaded
+			replaced[ numAdded ] = false;
+			added[ numAdded++ ] = names[ i ];
+			i++;
+		} else {
+			if ( FS_PakFileChanged( loaded[ j ]->pack ) ) {
+				if ( FS_PakInUse( loaded[ j ]->pack ) ) {
+					fs_pakWatch.deferred++;
+				} else {
+					loaded[ j ]->order = -1;
+					replaced[ numAdded ] = true;
+					added[ numAdded++ ] = names[ i ];
+				}
 			}
+			i++;
+			j++;
 		}
+	}
 
-		if ( !havepak && fs_serverReferencedPakNames[i] && *fs_serverReferencedPakNames[i] ) { 
-			// Don't got it
-
-      if (dlstring)
-      {
-		// We need this to make sure we won't hit the end of the buffer or the server could
-		// overwrite non-pk3 files on clients by writing so much crap into neededpaks that
-		// Q_strcat cuts off the .pk3 extension.
-	
-		origpos += strlen(origpos);
-	
-        // Remote name
-        Q_strcat( neededpaks, len, "@");
-        Q_strcat( neededpaks, len, fs_serverReferencedPakNames[i] );
-        Q_strcat( neededpaks, len, ".pk3" );
+	FS_RemoveMarkedPaks();
 
-        // Local name
-        Q_strcat( neededpaks, len, "@");
-        // Do we have one with the same name?
-        if ( FS_SV_FileExists( va( "%s.pk3", fs_serverReferencedPakNames[i] ) ) )
-        {
-          char st[MAX_ZPATH];
-          // We already have one called this, we need to download it to another name
-          // Make something up with the checksum in it
-          Com_sprintf( st, sizeof( st ), "%s.%08x.pk3", fs_serverReferencedPakNames[i], fs_serverReferencedPaks[i] );
-          Q_strcat( neededpaks, len, st );
-        } else
-        {
-          Q_strcat( neededpaks, len, fs_serverReferencedPakNames[i] );
-          Q_strcat( neededpaks, len, ".pk3" );
-        }
-        
-        // Find out whether it might have overflowed the buffer and don't add this file to the
-        // list if that is the case.
-        if(strlen(origpos) + (origpos - neededpaks) >= len - 1)
-	{
-		*origpos = '\0';
-		break;
+	if ( numAdded > 0 ) {
+		FS_LoadZipFiles( dirSearch->dir->path, dirSearch->dir->gamedir, added, numAdded, paks );
 	}
-      }
-      else
-      {
-        Q_strcat( neededpaks, len, fs_serverReferencedPakNames[i] );
-			  Q_strcat( neededpaks, len, ".pk3" );
-        // Do we have one with the same name?
-        if ( FS_SV_FileExists( va( "%s.pk3", fs_serverReferencedPakNames[i] ) ) )
-        {
-          Q_strcat( neededpaks, len, " (local file exists with wrong checksum)");
-        }
-        Q_strcat( neededpaks, len, "\n");
-      }
+
+	for ( i = 0; i < numAdded; i++ ) {
+		if ( paks[ i ] == NULL ) {
+			// removed or not a valid pk3 (yet)
+			if ( replaced[ i ] )
+				fs_pakWatch.removed++;
+			continue;
 		}
-	}
 
-	if ( *neededpaks ) {
-		return true;
+		if ( replaced[ i ] )
+			fs_pakWatch.replaced++;
+		else
+			fs_pakWatch.added++;
+
+		paks[ i ]->pakGamename = dirSearch->dir->gamedir;
+		paks[ i ]->index = index++;
+		paks[ i ]->referenced = 0;
+		paks[ i ]->exclude = false;
+
+		fs_packFiles += paks[ i ]->numfiles;
+		fs_packCount++;
+
+		search = Z_TagMalloc( sizeof( *search ), TAG_SEARCH_PACK );
+		Com_Memset( search, 0, sizeof( *search ) );
+		search->pack = paks[ i ];
+
+		FS_InsertPak( dirSearch, search );
 	}
 
-	return false; // We have them all
+	Z_Free( loaded );
 }
 
 
 /*
-================
-FS_Shutdown
+=================
+FS_ApplyPakChanges
 
-Frees all resources.
-================
+Updates paks named by change notifications or, if all is set, rescans
+every game directory. Returns number of changed paks
+=================
 */
-void FS_Shutdown( bool closemfp )
+static int FS_ApplyPakChanges( bool all )
 {
-	searchpath_t	*p, *next;
-	int i;
+	int				deferred;
+	searchpath_t	*dirSearch;
+	const char		*path;
+	char			*names[ MAX_PAK_CHANGES ];
+	char			**list;
+	int				numNames, numChanges;
+	int				i;
+	int64_t			t0;
 
-	// close opened files
-	if ( closemfp ) 
-	{
-		for ( i = 1; i < MAX_FILE_HANDLES; i++ )
-		{
-			if ( !fsh[i].handleFiles.file.v  )
-				continue;
+	if ( fs_numServerPaks ) {
+		// search order follows the pure server, leave it until the next restart
+		Com_DPrintf( "pk3 changes ignored while connected to a pure server\n" );
+		fs_pakWatch.numChanges = 0;
+		fs_pakWatch.all = false;
+		return 0;
+	}
 
-			FS_FCloseFile( i );
+	t0 = Sys_Microseconds();
+
+	// queued reads refer to the packs
+	FS_FinishAsyncReads();
+
+	// loaded data must not change or fault with the pk3
+	FS_DetachMappedEntries();
+
+	fs_pakWatch.added = 0;
+	fs_pakWatch.removed = 0;
+	fs_pakWatch.replaced = 0;
+
+	// a complete rescan finds the deferred changes again
+	deferred = all ? 0 : fs_pakWatch.deferred;
+	fs_pakWatch.deferred = 0;
+
+	for ( dirSearch = fs_searchpaths; dirSearch; dirSearch = dirSearch->next ) {
+		if ( !dirSearch->dir || dirSearch->policy != DIR_STATIC )
+			continue;
+
+		if ( all ) {
+			path = FS_BuildOSPath( dirSearch->dir->path, dirSearch->dir->gamedir, NULL );
+			list = Sys_ListFiles( path, ".pk3", NULL, &numNames, false );
+			if ( numNames >= 2 )
+				FS_SortFileList( list, numNames - 1 );
+			FS_UpdateGameDirectory( dirSearch, list, numNames, true );
+			Sys_FreeFileList( list );
+			continue;
+		}
+
+		numNames = 0;
+		for ( i = 0; i < fs_pakWatch.numChanges; i++ ) {
+			if ( fs_pakWatch.changes[ i ].watch == dirSearch->dir->watch )
+				names[ numNames++ ] = fs_pakWatch.changes[ i ].name;
+		}
+
+		if ( numNames > 0 ) {
+			if ( numNames >= 2 )
+				FS_SortFileList( names, numNames - 1 );
+			FS_UpdateGameDirectory( dirSearch, names, numNames, false );
 		}
 	}
 
-#ifdef DELAY_WRITECONFIG
-	if ( fs_searchpaths )
-	{
-		Com_WriteConfiguration();
+	fs_pakWatch.numChanges = 0;
+	fs_pakWatch.all = false;
+
+	if ( fs_pakWatch.deferred ) {
+		Com_Printf( "%i pk3 files in use by the server will be updated on the next map load\n", fs_pakWatch.deferred );
 	}
-#endif
+	fs_pakWatch.deferred += deferred;
 
-#ifdef USE_PK3_CACHE
-	FS_ResetCacheReferences();
-#endif
+	numChanges = fs_pakWatch.added + fs_pakWatch.removed + fs_pakWatch.replaced;
+	if ( numChanges == 0 )
+		return 0;
 
-	// free everything
-	for( p = fs_searchpaths; p; p = next )
-	{
-		next = p->next;
+	FS_BuildFileIndex();
 
-		if ( p->pack )
-		{
-#ifdef USE_PK3_CACHE
-#ifdef USE_HANDLE_CACHE
-			if ( p->pack->next_h )
-				FS_RemoveFromHandleList( p->pack );
-#endif
-#else
-			FS_FreePak( p->pack );
+	FS_UpdatePureChecksums();
+	FS_LoadedPakPureChecksums();
+
+#ifdef USE_PK3_CACHE_FILE
+	FS_SaveCache();
 #endif
-			p->pack = NULL;
-		}
 
-		Z_Free( p );
-	}
+	Com_Printf( "%i pk3 files added, %i replaced, %i removed in %.2f ms, %d files in %d pk3 files\n",
+		fs_pakWatch.added, fs_pakWatch.replaced, fs_pakWatch.removed,
+		( Sys_Microseconds() - t0 ) / 1000.0, fs_packFiles, fs_packCount );
 
-	// any FS_ calls will now be an error until reinitialized
-	fs_searchpaths = NULL;
-	fs_packFiles = 0;
+	return numChanges;
+}
 
-	fs_pk3dirCount = 0;
-	fs_packCount = 0;
-	fs_dirCount = 0;
 
-	Cmd_RemoveCommand( "path" );
-	Cmd_RemoveCommand( "dir" );
-	Cmd_RemoveCommand( "fdir" );
-	Cmd_RemoveCommand( "touchFile" );
-	Cmd_RemoveCommand( "which" );
-	Cmd_RemoveCommand( "lsof" );
-	Cmd_RemoveCommand( "fs_restart" );
+/*
+=================
+FS_StopPakWatch
+=================
+*/
+static void FS_StopPakWatch( void )
+{
+	Sys_UnwatchDirectories();
+
+	fs_pakWatch.watching = false;
+	fs_pakWatch.all = false;
+	fs_pakWatch.numChanges = 0;
 }
 
 
 /*
-================
-FS_ReorderSearchPaths
-================
+=================
+FS_StartPakWatch
+=================
 */
-static void FS_ReorderSearchPaths( void ) {
-	searchpath_t **list, **paks, **dirs;
-	searchpath_t *path;
-	int i, ndirs, npaks, cnt;
+static void FS_StartPakWatch( void )
+{
+	searchpath_t *dirSearch;
+	int numDirs, numWatched;
 
-	cnt = fs_packCount + fs_dirCount + fs_pk3dirCount;
-	if ( cnt == 0 )
-		return;
+	FS_StopPakWatch();
 
-	// relink path chains in following order:
-	// 1. pk3dirs @ pak files
-	// 2. directories
-	list = (searchpath_t **)Z_Malloc( cnt * sizeof( list[0] ) );
-	paks = list;
-	dirs = list + fs_pk3dirCount + fs_packCount;
+	fs_watch->modified = false;
+	if ( !fs_watch->integer )
+		return;
 
-	npaks = ndirs = 0;
-	path = fs_searchpaths;
-	while ( path ) {
-		if ( path->pack || path->policy != DIR_STATIC ) {
-			paks[npaks++] = path;
-		} else {
-			dirs[ndirs++] = path;
+	numDirs = 0;
+	numWatched = 0;
+	for ( dirSearch = fs_searchpaths; dirSearch; dirSearch = dirSearch->next ) {
+		if ( !dirSearch->dir || dirSearch->policy != DIR_STATIC )
+			continue;
+		dirSearch->dir->watch = Sys_WatchDirectory( FS_BuildOSPath( dirSearch->dir->path, dirSearch->dir->gamedir, NULL ) );
+		numDirs++;
+		if ( dirSearch->dir->watch != -1 ) {
+			numWatched++;
 		}
-		path = path->next;
 	}
 
-	fs_searchpaths = list[0];
-	for ( i = 0; i < cnt-1; i++ ) {
-		list[i]->next = list[i+1];
+	if ( numWatched == 0 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: pk3 change notification is not available, use \\fs_rescan\n" );
+		return;
 	}
-	list[cnt-1]->next = NULL;
 
-	Z_Free( list );
+	Com_DPrintf( "watching %i of %i game directories for pk3 changes\n", numWatched, numDirs );
+	fs_pakWatch.watching = true;
 }
 
 
 /*
-================
-FS_ReorderPurePaks
-NOTE TTimo: the reordering that happens here is not reflected in the cvars (\cvarlist *pak*)
-  this can lead to misleading situations, see https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=540
-================
+=================
+FS_CheckPakChanges
+
+Collects change notifications of the game directories and applies them
+once the directories are quiet for PAK_CHANGE_DELAY, so files which are
+still being copied are not scanned over and over
+=================
 */
-static void FS_ReorderPurePaks( void )
+void FS_CheckPakChanges( void )
 {
-	searchpath_t *s;
-	int i;
-	searchpath_t **p_insert_index, // for linked list reordering
-		**p_previous; // when doing the scan
-	
-	fs_reordered = false;
+	const char *name;
+	int watch, i;
 
-	// only relevant when connected to pure server
-	if ( !fs_numServerPaks )
+	if ( !fs_searchpaths )
 		return;
-	
-	p_insert_index = &fs_searchpaths; // we insert in order at the beginning of the list 
-	for ( i = 0 ; i < fs_numServerPaks ; i++ ) {
-		p_previous = p_insert_index; // track the pointer-to-current-item
-		for (s = *p_insert_index; s; s = s->next) {
-			// the part of the list before p_insert_index has been sorted already
-			if (s->pack && fs_serverPaks[i] == s->pack->checksum) {
-				fs_reordered = true;
-				// move this element to the insert list
-				*p_previous = s->next;
-				s->next = *p_insert_index;
-				*p_insert_index = s;
-				// increment insert list
-				p_insert_index = &s->next;
-				break; // iterate to next server pack
-			}
-			p_previous = &s->next;
+
+	if ( fs_retiredPaks )
+		FS_FreeRetiredPaks();
+
+	if ( fs_watch->modified )
+		FS_StartPakWatch();
+
+	if ( !fs_pakWatch.watching )
+		return;
+
+	// pk3 files may be rewritten at any time now, do not let views
+	// returned by FS_ReadFile outlive the frame they were loaded in
+	FS_DetachMappedEntries();
+
+	while ( ( name = Sys_NextDirectoryChange( &watch ) ) != NULL ) {
+		fs_pakWatch.time = Sys_Milliseconds();
+
+		if ( name[0] == '\0' ) {
+			fs_pakWatch.all = true;
+			continue;
 		}
-	}
-}
 
+		if ( !FS_IsExt( name, ".pk3", (int) strlen( name ) ) )
+			continue;
 
-/*
-================
-FS_OwnerName
-================
-*/
-static const char *FS_OwnerName( handleOwner_t owner ) 
-{
-	static const char *s[4]= { "SY", "QA", "CG", "UI" };
-	if ( owner < H_SYSTEM || owner > H_Q3UI )
-		return "??";
-	return s[owner];
-}
+		for ( i = 0; i < fs_pakWatch.numChanges; i++ ) {
+			if ( fs_pakWatch.changes[ i ].watch == watch && !strcmp( fs_pakWatch.changes[ i ].name, name ) )
+				break;
+		}
 
+		if ( i < fs_pakWatch.numChanges )
+			continue;
 
-/*
-================
-FS_ListOpenFiles
-================
-*/
-static void FS_ListOpenFiles_f( void ) {
-	int i;
-	fileHandleData_t *fh;
-	fh = fsh;
-	for ( i = 0; i < MAX_FILE_HANDLES; i++, fh++ ) {
-		if ( !fh->handleFiles.file.v )
+		if ( fs_pakWatch.numChanges >= MAX_PAK_CHANGES || strlen( name ) >= sizeof( fs_pakWatch.changes[0].name ) ) {
+			fs_pakWatch.all = true;
 			continue;
-		Com_Printf( "%2i %2s %s\n", i, FS_OwnerName(fh->owner), fh->name );
+		}
+
+		fs_pakWatch.changes[ i ].watch = watch;
+		strcpy( fs_pakWatch.changes[ i ].name, name );
+		fs_pakWatch.numChanges++;
 	}
+
+	if ( fs_pakWatch.numChanges == 0 && !fs_pakWatch.all )
+		return;
+
+	if ( Sys_Milliseconds() - fs_pakWatch.time < PAK_CHANGE_DELAY )
+		return;
+
+	FS_ApplyPakChanges( fs_pakWatch.all );
 }
 
 
 /*
-=====================
-FS_LoadedPakPureChecksums
-=====================
-*/
-static int fs_numPureChecksums;
-static int fs_pureChecksum[ MAX_FOUND_FILES ];
+=================
+FS_ApplyDeferredPakChanges
 
-static void FS_LoadedPakPureChecksums( void )
+Called by the server before a new map is loaded, while nothing refers to
+the paks it announced for the previous one
+=================
+*/
+void FS_ApplyDeferredPakChanges( void )
 {
-	const searchpath_t *search;
+	if ( !fs_searchpaths || !fs_pakWatch.deferred )
+		return;
 
-	fs_numPureChecksums = 0;
-	for ( search = fs_searchpaths ; search ; search = search->next ) {
-		if ( search->pack ) {
-			if ( fs_numPureChecksums >= ARRAY_LEN( fs_pureChecksum ) ) {
-				Com_DPrintf( "WARNING: pure checksums overflowed\n" );
-				fs_numPureChecksums = 0;
-				return;
-			}
-			fs_pureChecksum[ fs_numPureChecksums ] = search->pack->pure_checksum;
-			fs_numPureChecksums++;
-		}
-	}
+	fs_pakWatch.mapLoad = true;
+	FS_ApplyPakChanges( true );
+	fs_pakWatch.mapLoad = false;
 }
 
 
 /*
-================
-FS_IsPureChecksum
-================
+=================
+FS_Rescan_f
+=================
 */
-bool FS_IsPureChecksum( int sum )
+static void FS_Rescan_f( void )
 {
-	int i;
-
-	if ( fs_numPureChecksums == 0 )
-		return true;
-	
-	for ( i = 0; i < fs_numPureChecksums; i++ )
-		if ( fs_pureChecksum[i] == sum )
-			return true;
-
-	return false;
+	if ( FS_ApplyPakChanges( true ) == 0 ) {
+		Com_Printf( "no pk3 changes found\n" );
+	}
 }
+#else
+void FS_CheckPakChanges( void ) {
+}
+#endif // USE_PK3_CACHE
 
 
 /*
@@ -4669,11 +7741,31 @@ FS_Startup
 static void FS_Startup( void ) {
 	const char *homePath;
 	int i, start, end;
+	int64_t t0, t1;
 
 	Com_Printf( "----- FS_Startup -----\n" );
 
 	fs_debug = Cvar_Get( "fs_debug", "0", 0 );
 	Cvar_SetDescription( fs_debug, "Debugging tool for the filesystem. Run the game in debug mode. Prints additional information regarding read files into the console." );
+	fs_mmap = Cvar_Get( "fs_mmap", "1", 0 );
+	Cvar_CheckRange( fs_mmap, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( fs_mmap, "Map loose files and pk3 entries stored without compression into memory instead of reading them, where supported.\nApplies to collision maps and to large stored pk3 entries loaded with FS_ReadFile." );
+#ifdef USE_CONTENT_CACHE
+	fs_contentCache = Cvar_Get( "fs_contentCache", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_contentCache, "0", "65536", CV_INTEGER );
+	Cvar_SetDescription( fs_contentCache, "Size limit in megabytes of the on-disk cache of large decompressed pk3 entries, 0 - disabled.\nCached entries are mapped by FS_ReadFile instead of being inflated again, use \\fs_contentcache to see its statistics." );
+#endif
+	fs_scanThreads = Cvar_Get( "fs_scanThreads", "0", 0 );
+	Cvar_CheckRange( fs_scanThreads, "0", XSTRING( MAX_SCAN_THREADS ), CV_INTEGER );
+	Cvar_SetDescription( fs_scanThreads, "Number of threads used to read pk3 file directories and compute pure checksums on filesystem startup, 0 - number of CPU cores.\nUse \\fs_restart to see the startup timing breakdown." );
+	fs_readahead = Cvar_Get( "fs_readahead", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_readahead, "0", "2", CV_INTEGER );
+	Cvar_SetDescription( fs_readahead, "Map load readahead:\n 0 - disabled\n 1 - record pak files opened during map load and read them ahead next time\n 2 - record only, to compare load times" );
+#ifdef USE_PK3_CACHE
+	fs_watch = Cvar_Get( "fs_watch", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_watch, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( fs_watch, "Watch game directories for added, replaced or removed pk3 files and update the search path in place, without filesystem restart.\nWhere change notification is not available use \\fs_rescan instead." );
+#endif
 	fs_copyfiles = Cvar_Get( "fs_copyfiles", "0", CVAR_INIT );
 	Cvar_SetDescription( fs_copyfiles, "Whether or not to copy files when loading them into the game. Every file found in the cdpath will be copied over." );
 	fs_basepath = Cvar_Get( "fs_basepath", Sys_DefaultBasePath(), CVAR_INIT | CVAR_PROTECTED | CVAR_PRIVATE );
@@ -4730,12 +7822,17 @@ static void FS_Startup( void ) {
 
 	start = Sys_Milliseconds();
 
+	Com_Memset( &fs_startupTimes, 0, sizeof( fs_startupTimes ) );
+	t0 = Sys_Microseconds();
+
 #ifdef USE_PK3_CACHE
 #ifdef USE_PK3_CACHE_FILE
 	FS_LoadCache();
 #endif
 #endif
 
+	fs_startupTimes.cacheLoad = Sys_Microseconds() - t0;
+
 	// add search path elements in reverse priority order
 	if (fs_steampath->string[0]) {
 		// handle multiple basegames:
@@ -4784,6 +7881,8 @@ static void FS_Startup( void ) {
 		}
 	}
 
+	t1 = Sys_Microseconds();
+
 	// reorder search paths to minimize further changes
 	FS_ReorderSearchPaths();
 
@@ -4791,9 +7890,21 @@ static void FS_Startup( void ) {
 	// reorder the pure pk3 files according to server order
 	FS_ReorderPurePaks();
 
+	// index pak entries in the final search order
+	FS_BuildFileIndex();
+
+	fs_startupTimes.order = Sys_Microseconds() - t1;
+	t1 = Sys_Microseconds();
+
+#ifdef USE_PK3_CACHE
+	FS_UpdatePureChecksums();
+#endif
+
 	// get the pure checksums of the pk3 files loaded by the server
 	FS_LoadedPakPureChecksums();
 
+	fs_startupTimes.pure = Sys_Microseconds() - t1;
+
 	end = Sys_Milliseconds();
 
 	Com_ReadCDKey( basegame );
@@ -4809,7 +7920,15 @@ static void FS_Startup( void ) {
 	Cmd_AddCommand( "lsof", FS_ListOpenFiles_f );
  	Cmd_AddCommand( "which", FS_Which_f );
 	Cmd_SetCommandCompletionFunc( "which", FS_CompleteFileName );
-	Cmd_AddCommand( "fs_restart", FS_Reload );
+	Cmd_AddCommand( "fs_restart", FS_Restart_f );
+	Cmd_AddCommand( "fs_inflatebench", FS_InflateBench_f );
+	Cmd_AddCommand( "fs_listbench", FS_ListBench_f );
+#ifdef USE_PK3_CACHE
+	Cmd_AddCommand( "fs_rescan", FS_Rescan_f );
+#endif
+#ifdef USE_CONTENT_CACHE
+	Cmd_AddCommand( "fs_contentcache", FS_ContentCache_f );
+#endif
 
 	// print the current search paths
 	//FS_Path_f();
@@ -4831,11 +7950,20 @@ static void FS_Startup( void ) {
 	}
 #endif
 
+	t1 = Sys_Microseconds();
+
 #ifdef USE_PK3_CACHE
 	FS_FreeUnusedCache();
 #ifdef USE_PK3_CACHE_FILE
 	FS_SaveCache();
 #endif
+#endif
+
+	fs_startupTimes.cacheSave = Sys_Microseconds() - t1;
+	fs_startupTimes.total = Sys_Microseconds() - t0;
+
+#ifdef USE_PK3_CACHE
+	FS_StartPakWatch();
 #endif
 }
 
@@ -5470,6 +8598,185 @@ void FS_Reload( void )
 }
 
 
+/*
+=================
+FS_Restart_f
+
+Restarts the filesystem and prints where the startup time went
+=================
+*/
+static void FS_Restart_f( void )
+{
+	const fsStartupTimes_t *t = &fs_startupTimes;
+
+	FS_Reload();
+
+	Com_Printf( "FS_Startup: %i paks from cache, %i scanned with %i thread(s)\n", t->cached, t->scanned, t->threads );
+	Com_Printf( "%8.2f ms cache load\n", t->cacheLoad / 1000.0 );
+	Com_Printf( "%8.2f ms directory listing\n", t->list / 1000.0 );
+	Com_Printf( "%8.2f ms pk3 cache lookup\n", t->open / 1000.0 );
+	Com_Printf( "%8.2f ms pk3 open and scan\n", t->scan / 1000.0 );
+	Com_Printf( "%8.2f ms pk3 build\n", t->build / 1000.0 );
+	Com_Printf( "%8.2f ms search path order\n", t->order / 1000.0 );
+	Com_Printf( "%8.2f ms pure checksums (%i paks)\n", t->pure / 1000.0, t->pureCount );
+	Com_Printf( "%8.2f ms cache save\n", t->cacheSave / 1000.0 );
+	Com_Printf( "%8.2f ms total\n", t->total / 1000.0 );
+}
+
+
+/*
+============
+FS_InflateBench_f
+
+Reads every entry of the loaded pk3 files, optionally filtered by pak name,
+with the streaming unzip reader and with the whole-entry path of FS_ReadFile,
+compares the results and checks them against the CRC stored in the archive
+============
+*/
+static void FS_InflateBench_f( void )
+{
+	static const char *methodNames[ 2 ] = { "stored", "deflated" };
+	const searchpath_t *sp;
+	const pack_t	*pak;
+	unz_file_info	info;
+	unzFile			uf;
+	byte			*streamed, *whole;
+	unsigned long	bufferSize;
+	int64_t			t0, t1, t2, t3;
+	int64_t			streamTime[ 2 ], wholeTime[ 2 ], crcTime;
+	double			bytes[ 2 ], mb;
+	int				entries[ 2 ], failed, mismatched, badCrc;
+	int				i, m, paks;
+
+	streamed = whole = NULL;
+	bufferSize = 0;
+	Com_Memset( streamTime, 0, sizeof( streamTime ) );
+	Com_Memset( wholeTime, 0, sizeof( wholeTime ) );
+	Com_Memset( bytes, 0, sizeof( bytes ) );
+	Com_Memset( entries, 0, sizeof( entries ) );
+	crcTime = 0;
+	failed = mismatched = badCrc = paks = 0;
+
+	for ( sp = fs_searchpaths; sp; sp = sp->next ) {
+		pak = sp->pack;
+		if ( !pak || ( Cmd_Argc() > 1 && !Com_FilterPath( Cmd_Argv( 1 ), pak->pakBasename ) ) ) {
+			continue;
+		}
+		uf = unzOpen( pak->pakFilename );
+		if ( !uf ) {
+			continue;
+		}
+		paks++;
+		for ( i = 0; i < pak->numfiles; i++ ) {
+			if ( unzSetCurrentFileInfoPosition( uf, pak->buildBuffer[ i ].pos ) != UNZ_OK ||
+				unzGetCurrentFileInfo( uf, &info, NULL, 0, NULL, 0, NULL, 0 ) != UNZ_OK || !info.uncompressed_size ) {
+				continue;
+			}
+			if ( info.uncompressed_size > bufferSize ) {
+				free( streamed );
+				free( whole );
+				bufferSize = info.uncompressed_size;
+				streamed = malloc( bufferSize );
+				whole = malloc( bufferSize );
+				if ( !streamed || !whole ) {
+					Com_Printf( S_COLOR_YELLOW "WARNING: failed to allocate %lu bytes\n", bufferSize );
+					free( streamed );
+					free( whole );
+					unzClose( uf );
+					return;
+				}
+			}
+			m = ( info.compression_method != 0 );
+
+			// the first read only brings the data into the page cache
+			unzOpenCurrentFile( uf );
+			unzReadCurrentFile( uf, streamed, info.uncompressed_size );
+			unzCloseCurrentFile( uf );
+
+			t0 = Sys_Microseconds();
+			unzOpenCurrentFile( uf );
+			unzReadCurrentFile( uf, streamed, info.uncompressed_size );
+			unzCloseCurrentFile( uf );
+			t1 = Sys_Microseconds();
+			unzOpenCurrentFile( uf );
+			if ( unzReadCurrentFileEntire( uf, whole, info.uncompressed_size ) != UNZ_OK ) {
+				Com_Printf( "%s/%s: whole-entry read failed\n", pak->pakBasename, pak->buildBuffer[ i ].name );
+				unzCloseCurrentFile( uf );
+				failed++;
+				continue;
+			}
+			unzCloseCurrentFile( uf );
+			t2 = Sys_Microseconds();
+			if ( crc32_buffer( whole, info.uncompressed_size ) != (unsigned int)info.crc ) {
+				Com_Printf( "%s/%s: CRC mismatch\n", pak->pakBasename, pak->buildBuffer[ i ].name );
+				badCrc++;
+			}
+			t3 = Sys_Microseconds();
+
+			if ( memcmp( streamed, whole, info.uncompressed_size ) != 0 ) {
+				Com_Printf( "%s/%s: output differs from the streaming reader\n", pak->pakBasename, pak->buildBuffer[ i ].name );
+				mismatched++;
+			}
+
+			streamTime[ m ] += t1 - t0;
+			wholeTime[ m ] += t2 - t1;
+			crcTime += t3 - t2;
+			bytes[ m ] += info.uncompressed_size;
+			entries[ m ]++;
+		}
+		unzClose( uf );
+	}
+
+	free( streamed );
+	free( whole );
+
+	Com_Printf( "%i paks, %i entries\n", paks, entries[ 0 ] + entries[ 1 ] );
+	Com_Printf( "%-9s %8s %9s %16s %16s\n", "", "entries", "MB", "streaming MB/s", "whole MB/s" );
+	for ( m = 0; m < 2; m++ ) {
+		mb = bytes[ m ] / ( 1024.0 * 1024.0 );
+		Com_Printf( "%-9s %8i %9.2f %16.1f %16.1f\n", methodNames[ m ], entries[ m ], mb,
+			streamTime[ m ] ? mb * 1e6 / streamTime[ m ] : 0.0, wholeTime[ m ] ? mb * 1e6 / wholeTime[ m ] : 0.0 );
+	}
+	mb = ( bytes[ 0 ] + bytes[ 1 ] ) / ( 1024.0 * 1024.0 );
+	Com_Printf( "crc32: %.1f MB/s\n", crcTime ? mb * 1e6 / crcTime : 0.0 );
+	Com_Printf( "%i failed, %i mismatched, %i bad CRC\n", failed, mismatched, badCrc );
+}
+
+
+/*
+============
+FS_ListBench_f
+
+Times FS_ListFiles() for the given directory and extension,
+defaults to the map list
+============
+*/
+static void FS_ListBench_f( void )
+{
+	const char	*path, *extension;
+	char		**list;
+	int			numfiles, count, i;
+	int64_t		t0, t;
+
+	path = Cmd_Argc() > 1 ? Cmd_Argv( 1 ) : "maps";
+	extension = Cmd_Argc() > 2 ? Cmd_Argv( 2 ) : ".bsp";
+	count = Cmd_Argc() > 3 ? atoi( Cmd_Argv( 3 ) ) : 10;
+	if ( count <= 0 )
+		count = 1;
+
+	numfiles = 0;
+	t = 0;
+	for ( i = 0; i < count; i++ ) {
+		t0 = Sys_Microseconds();
+		list = FS_ListFiles( path, extension, &numfiles );
+		t += Sys_Microseconds() - t0;
+		FS_FreeFileList( list );
+	}
+
+	Com_Printf( "%s/*%s: %i files in %i paks, %.3f ms per listing\n", path, extension, numfiles, fs_packCount, t / ( count * 1000.0 ) );
+}
+
+
 /*
 =================
 FS_ConditionalRestart
@@ -5490,7 +8797,11 @@ bool FS_ConditionalRestart( int checksumFeed, bool clientRestart )
 	}
 	else if( fs_numServerPaks && !fs_reordered ) 
 	{
+		// queued reads refer to the search order
+		FS_FinishAsyncReads();
 		FS_ReorderPurePaks();
+		if ( fs_reordered )
+			FS_BuildFileIndex();
 	}
 	
 	return false;
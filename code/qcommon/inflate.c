@@ -0,0 +1,610 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+#include "inflate.h"
+
+/*
+===============================================================================
+
+WHOLE BUFFER INFLATE
+
+pk3 entries are always read completely into a buffer of known size, so unlike
+the streaming zlib inflate in unzip.c this decoder never has to suspend in the
+middle of a symbol.  That allows a 64-bit bit buffer that is refilled a word
+at a time and holds enough bits for a whole length/distance pair, and codes
+that are resolved with one table lookup (two for the rare long codes).
+
+Table entries are packed into 32 bits:
+	bits  0..3		number of bits consumed by the entry
+	bits  4..7		extra bits that follow the code, or subtable index bits
+	bits  8..10		entry type
+	bits 16..31		literal, base length or distance, or subtable offset
+
+===============================================================================
+*/
+
+#define MAX_CODE_BITS		15
+
+#define LITLEN_BITS			10
+#define DIST_BITS			8
+#define PRECODE_BITS		7
+
+#define NUM_LITLEN_SYMS		288
+#define NUM_DIST_SYMS		32
+#define NUM_PRECODE_SYMS	19
+
+// primary table plus at most one subtable for every long code
+#define LITLEN_TABLE_SIZE	( ( 1 << LITLEN_BITS ) + NUM_LITLEN_SYMS * ( 1 << ( MAX_CODE_BITS - LITLEN_BITS ) ) )
+#define DIST_TABLE_SIZE		( ( 1 << DIST_BITS ) + NUM_DIST_SYMS * ( 1 << ( MAX_CODE_BITS - DIST_BITS ) ) )
+
+// zero bytes that may be shifted in past the end of a valid stream
+#define MAX_OVERREAD		16
+
+typedef enum {
+	E_LITERAL,
+	E_BASE,
+	E_SUBTABLE,
+	E_END,
+	E_INVALID
+} entryType_t;
+
+typedef enum {
+	T_PRECODE,
+	T_LITLEN,
+	T_DIST
+} tableType_t;
+
+#define ENTRY( type, extra, value )	( (uint32_t)(value) << 16 | (uint32_t)(type) << 8 | (uint32_t)(extra) << 4 )
+#define ENTRY_BITS( e )				( (e) & 15 )
+#define ENTRY_EXTRA( e )			( ( (e) >> 4 ) & 15 )
+#define ENTRY_TYPE( e )				( ( (e) >> 8 ) & 7 )
+#define ENTRY_VALUE( e )			( (e) >> 16 )
+
+#define BITMASK( n )				( ( (uint64_t)1 << (n) ) - 1 )
+
+typedef struct {
+	uint32_t	litlen[ LITLEN_TABLE_SIZE ];
+	uint32_t	dist[ DIST_TABLE_SIZE ];
+	uint32_t	precode[ 1 << PRECODE_BITS ];
+	uint8_t		lens[ NUM_LITLEN_SYMS + NUM_DIST_SYMS ];
+} inflateTables_t;
+
+static const uint16_t lengthBase[ 29 ] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t lengthExtra[ 29 ] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t distBase[ 30 ] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8_t distExtra[ 30 ] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const uint8_t precodeOrder[ NUM_PRECODE_SYMS ] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// BuildTable output for the fixed codes (9-bit literal/length and
+// 5-bit distance tables), most small entries use nothing else
+#define FIXED_LITLEN_BITS	9
+#define FIXED_DIST_BITS		5
+
+static const uint32_t fixedLitlen[ 512 ] = {
+	0x00000307, 0x00500008, 0x00100008, 0x00730148, 0x001f0127, 0x00700008, 0x00300008, 0x00c00009,
+	0x000a0107, 0x00600008, 0x00200008, 0x00a00009, 0x00000008, 0x00800008, 0x00400008, 0x00e00009,
+	0x00060107, 0x00580008, 0x00180008, 0x00900009, 0x003b0137, 0x00780008, 0x00380008, 0x00d00009,
+	0x00110117, 0x00680008, 0x00280008, 0x00b00009, 0x00080008, 0x00880008, 0x00480008, 0x00f00009,
+	0x00040107, 0x00540008, 0x00140008, 0x00e30158, 0x002b0137, 0x00740008, 0x00340008, 0x00c80009,
+	0x000d0117, 0x00640008, 0x00240008, 0x00a80009, 0x00040008, 0x00840008, 0x00440008, 0x00e80009,
+	0x00080107, 0x005c0008, 0x001c0008, 0x00980009, 0x00530147, 0x007c0008, 0x003c0008, 0x00d80009,
+	0x00170127, 0x006c0008, 0x002c0008, 0x00b80009, 0x000c0008, 0x008c0008, 0x004c0008, 0x00f80009,
+	0x00030107, 0x00520008, 0x00120008, 0x00a30158, 0x00230137, 0x00720008, 0x00320008, 0x00c40009,
+	0x000b0117, 0x00620008, 0x00220008, 0x00a40009, 0x00020008, 0x00820008, 0x00420008, 0x00e40009,
+	0x00070107, 0x005a0008, 0x001a0008, 0x00940009, 0x00430147, 0x007a0008, 0x003a0008, 0x00d40009,
+	0x00130127, 0x006a0008, 0x002a0008, 0x00b40009, 0x000a0008, 0x008a0008, 0x004a0008, 0x00f40009,
+	0x00050107, 0x00560008, 0x00160008, 0x00000408, 0x00330137, 0x00760008, 0x00360008, 0x00cc0009,
+	0x000f0117, 0x00660008, 0x00260008, 0x00ac0009, 0x00060008, 0x00860008, 0x00460008, 0x00ec0009,
+	0x00090107, 0x005e0008, 0x001e0008, 0x009c0009, 0x00630147, 0x007e0008, 0x003e0008, 0x00dc0009,
+	0x001b0127, 0x006e0008, 0x002e0008, 0x00bc0009, 0x000e0008, 0x008e0008, 0x004e0008, 0x00fc0009,
+	0x00000307, 0x00510008, 0x00110008, 0x00830158, 0x001f0127, 0x00710008, 0x00310008, 0x00c20009,
+	0x000a0107, 0x00610008, 0x00210008, 0x00a20009, 0x00010008, 0x00810008, 0x00410008, 0x00e20009,
+	0x00060107, 0x00590008, 0x00190008, 0x00920009, 0x003b0137, 0x00790008, 0x00390008, 0x00d20009,
+	0x00110117, 0x00690008, 0x00290008, 0x00b20009, 0x00090008, 0x00890008, 0x00490008, 0x00f20009,
+	0x00040107, 0x00550008, 0x00150008, 0x01020108, 0x002b0137, 0x00750008, 0x00350008, 0x00ca0009,
+	0x000d0117, 0x00650008, 0x00250008, 0x00aa0009, 0x00050008, 0x00850008, 0x00450008, 0x00ea0009,
+	0x00080107, 0x005d0008, 0x001d0008, 0x009a0009, 0x00530147, 0x007d0008, 0x003d0008, 0x00da0009,
+	0x00170127, 0x006d0008, 0x002d0008, 0x00ba0009, 0x000d0008, 0x008d0008, 0x004d0008, 0x00fa0009,
+	0x00030107, 0x00530008, 0x00130008, 0x00c30158, 0x00230137, 0x00730008, 0x00330008, 0x00c60009,
+	0x000b0117, 0x00630008, 0x00230008, 0x00a60009, 0x00030008, 0x00830008, 0x00430008, 0x00e60009,
+	0x00070107, 0x005b0008, 0x001b0008, 0x00960009, 0x00430147, 0x007b0008, 0x003b0008, 0x00d60009,
+	0x00130127, 0x006b0008, 0x002b0008, 0x00b60009, 0x000b0008, 0x008b0008, 0x004b0008, 0x00f60009,
+	0x00050107, 0x00570008, 0x00170008, 0x00000408, 0x00330137, 0x00770008, 0x00370008, 0x00ce0009,
+	0x000f0117, 0x00670008, 0x00270008, 0x00ae0009, 0x00070008, 0x00870008, 0x00470008, 0x00ee0009,
+	0x00090107, 0x005f0008, 0x001f0008, 0x009e0009, 0x00630147, 0x007f0008, 0x003f0008, 0x00de0009,
+	0x001b0127, 0x006f0008, 0x002f0008, 0x00be0009, 0x000f0008, 0x008f0008, 0x004f0008, 0x00fe0009,
+	0x00000307, 0x00500008, 0x00100008, 0x00730148, 0x001f0127, 0x00700008, 0x00300008, 0x00c10009,
+	0x000a0107, 0x00600008, 0x00200008, 0x00a10009, 0x00000008, 0x00800008, 0x00400008, 0x00e10009,
+	0x00060107, 0x00580008, 0x00180008, 0x00910009, 0x003b0137, 0x00780008, 0x00380008, 0x00d10009,
+	0x00110117, 0x00680008, 0x00280008, 0x00b10009, 0x00080008, 0x00880008, 0x00480008, 0x00f10009,
+	0x00040107, 0x00540008, 0x00140008, 0x00e30158, 0x002b0137, 0x00740008, 0x00340008, 0x00c90009,
+	0x000d0117, 0x00640008, 0x00240008, 0x00a90009, 0x00040008, 0x00840008, 0x00440008, 0x00e90009,
+	0x00080107, 0x005c0008, 0x001c0008, 0x00990009, 0x00530147, 0x007c0008, 0x003c0008, 0x00d90009,
+	0x00170127, 0x006c0008, 0x002c0008, 0x00b90009, 0x000c0008, 0x008c0008, 0x004c0008, 0x00f90009,
+	0x00030107, 0x00520008, 0x00120008, 0x00a30158, 0x00230137, 0x00720008, 0x00320008, 0x00c50009,
+	0x000b0117, 0x00620008, 0x00220008, 0x00a50009, 0x00020008, 0x00820008, 0x00420008, 0x00e50009,
+	0x00070107, 0x005a0008, 0x001a0008, 0x00950009, 0x00430147, 0x007a0008, 0x003a0008, 0x00d50009,
+	0x00130127, 0x006a0008, 0x002a0008, 0x00b50009, 0x000a0008, 0x008a0008, 0x004a0008, 0x00f50009,
+	0x00050107, 0x00560008, 0x00160008, 0x00000408, 0x00330137, 0x00760008, 0x00360008, 0x00cd0009,
+	0x000f0117, 0x00660008, 0x00260008, 0x00ad0009, 0x00060008, 0x00860008, 0x00460008, 0x00ed0009,
+	0x00090107, 0x005e0008, 0x001e0008, 0x009d0009, 0x00630147, 0x007e0008, 0x003e0008, 0x00dd0009,
+	0x001b0127, 0x006e0008, 0x002e0008, 0x00bd0009, 0x000e0008, 0x008e0008, 0x004e0008, 0x00fd0009,
+	0x00000307, 0x00510008, 0x00110008, 0x00830158, 0x001f0127, 0x00710008, 0x00310008, 0x00c30009,
+	0x000a0107, 0x00610008, 0x00210008, 0x00a30009, 0x00010008, 0x00810008, 0x00410008, 0x00e30009,
+	0x00060107, 0x00590008, 0x00190008, 0x00930009, 0x003b0137, 0x00790008, 0x00390008, 0x00d30009,
+	0x00110117, 0x00690008, 0x00290008, 0x00b30009, 0x00090008, 0x00890008, 0x00490008, 0x00f30009,
+	0x00040107, 0x00550008, 0x00150008, 0x01020108, 0x002b0137, 0x00750008, 0x00350008, 0x00cb0009,
+	0x000d0117, 0x00650008, 0x00250008, 0x00ab0009, 0x00050008, 0x00850008, 0x00450008, 0x00eb0009,
+	0x00080107, 0x005d0008, 0x001d0008, 0x009b0009, 0x00530147, 0x007d0008, 0x003d0008, 0x00db0009,
+	0x00170127, 0x006d0008, 0x002d0008, 0x00bb0009, 0x000d0008, 0x008d0008, 0x004d0008, 0x00fb0009,
+	0x00030107, 0x00530008, 0x00130008, 0x00c30158, 0x00230137, 0x00730008, 0x00330008, 0x00c70009,
+	0x000b0117, 0x00630008, 0x00230008, 0x00a70009, 0x00030008, 0x00830008, 0x00430008, 0x00e70009,
+	0x00070107, 0x005b0008, 0x001b0008, 0x00970009, 0x00430147, 0x007b0008, 0x003b0008, 0x00d70009,
+	0x00130127, 0x006b0008, 0x002b0008, 0x00b70009, 0x000b0008, 0x008b0008, 0x004b0008, 0x00f70009,
+	0x00050107, 0x00570008, 0x00170008, 0x00000408, 0x00330137, 0x00770008, 0x00370008, 0x00cf0009,
+	0x000f0117, 0x00670008, 0x00270008, 0x00af0009, 0x00070008, 0x00870008, 0x00470008, 0x00ef0009,
+	0x00090107, 0x005f0008, 0x001f0008, 0x009f0009, 0x00630147, 0x007f0008, 0x003f0008, 0x00df0009,
+	0x001b0127, 0x006f0008, 0x002f0008, 0x00bf0009, 0x000f0008, 0x008f0008, 0x004f0008, 0x00ff0009
+};
+
+static const uint32_t fixedDist[ 32 ] = {
+	0x00010105, 0x01010175, 0x00110135, 0x100101b5, 0x00050115, 0x04010195, 0x00410155, 0x400101d5,
+	0x00030105, 0x02010185, 0x00210145, 0x200101c5, 0x00090125, 0x080101a5, 0x00810165, 0x00000405,
+	0x00020105, 0x01810175, 0x00190135, 0x180101b5, 0x00070115, 0x06010195, 0x00610155, 0x600101d5,
+	0x00040105, 0x03010185, 0x00310145, 0x300101c5, 0x000d0125, 0x0c0101a5, 0x00c10165, 0x00000405
+};
+
+
+/*
+=================
+SymbolEntry
+=================
+*/
+static uint32_t SymbolEntry( tableType_t type, int sym ) {
+	switch ( type ) {
+	case T_LITLEN:
+		if ( sym < 256 )
+			return ENTRY( E_LITERAL, 0, sym );
+		if ( sym == 256 )
+			return ENTRY( E_END, 0, 0 );
+		sym -= 257;
+		if ( sym < 29 )
+			return ENTRY( E_BASE, lengthExtra[ sym ], lengthBase[ sym ] );
+		break;
+	case T_DIST:
+		if ( sym < 30 )
+			return ENTRY( E_BASE, distExtra[ sym ], distBase[ sym ] );
+		break;
+	default:
+		return ENTRY( E_LITERAL, 0, sym );
+	}
+	return ENTRY( E_INVALID, 0, 0 );
+}
+
+
+/*
+=================
+ReverseBits
+=================
+*/
+static ID_INLINE int ReverseBits( int code, int len ) {
+	code = ( ( code & 0x5555 ) << 1 ) | ( ( code >> 1 ) & 0x5555 );
+	code = ( ( code & 0x3333 ) << 2 ) | ( ( code >> 2 ) & 0x3333 );
+	code = ( ( code & 0x0F0F ) << 4 ) | ( ( code >> 4 ) & 0x0F0F );
+	code = ( ( code & 0x00FF ) << 8 ) | ( ( code >> 8 ) & 0x00FF );
+	return code >> ( 16 - len );
+}
+
+
+/*
+=================
+BuildTable
+
+Fills a lookup table for the canonical code described by lens[].  Codes
+longer than tableBits get a subtable sized for the longest code sharing
+their primary slot.  Returns false for over-subscribed codes and for
+incomplete ones other than a single one-bit code, like zlib
+=================
+*/
+static bool BuildTable( tableType_t type, uint32_t *table, int tableBits, int tableSize, const uint8_t *lens, int numSyms ) {
+	uint16_t	count[ MAX_CODE_BITS + 1 ];
+	uint16_t	next[ MAX_CODE_BITS + 1 ];
+	uint16_t	codes[ NUM_LITLEN_SYMS ];
+	uint8_t		subLen[ 1 << LITLEN_BITS ];
+	uint16_t	subOffset[ 1 << LITLEN_BITS ];
+	int			primary, used, left, maxLen;
+	int			sym, len, code, rev, i;
+	uint32_t	entry;
+
+	primary = 1 << tableBits;
+
+	Com_Memset( count, 0, sizeof( count ) );
+	for ( sym = 0; sym < numSyms; sym++ ) {
+		count[ lens[ sym ] ]++;
+	}
+	count[ 0 ] = 0;
+
+	maxLen = 0;
+	left = 1;
+	for ( len = 1; len <= MAX_CODE_BITS; len++ ) {
+		left <<= 1;
+		left -= count[ len ];
+		if ( left < 0 ) {
+			return false;
+		}
+		if ( count[ len ] ) {
+			maxLen = len;
+		}
+	}
+	if ( left > 0 && ( type == T_PRECODE || maxLen > 1 ) ) {
+		return false;
+	}
+
+	// a complete code covers every slot
+	if ( left > 0 ) {
+		for ( i = 0; i < primary; i++ ) {
+			table[ i ] = ENTRY( E_INVALID, 0, 0 );
+		}
+	}
+
+	code = 0;
+	next[ 0 ] = 0;
+	for ( len = 1; len <= MAX_CODE_BITS; len++ ) {
+		code = ( code + count[ len - 1 ] ) << 1;
+		next[ len ] = code;
+	}
+
+	// deflate sends codes starting from the most significant bit,
+	// store them reversed so they can be matched against the bit buffer
+	if ( maxLen > tableBits ) {
+		Com_Memset( subLen, 0, primary );
+	}
+	for ( sym = 0; sym < numSyms; sym++ ) {
+		len = lens[ sym ];
+		if ( !len ) {
+			continue;
+		}
+		rev = ReverseBits( next[ len ]++, len );
+		codes[ sym ] = rev;
+		if ( len > tableBits && len > subLen[ rev & ( primary - 1 ) ] ) {
+			subLen[ rev & ( primary - 1 ) ] = len;
+		}
+	}
+
+	// allocate subtables behind the primary table
+	if ( maxLen > tableBits ) {
+		used = primary;
+		for ( i = 0; i < primary; i++ ) {
+			if ( !subLen[ i ] ) {
+				continue;
+			}
+			len = subLen[ i ] - tableBits;
+			if ( used + ( 1 << len ) > tableSize ) {
+				return false;
+			}
+			subOffset[ i ] = used;
+			table[ i ] = ENTRY( E_SUBTABLE, len, used ) | tableBits;
+			if ( left > 0 ) {
+				for ( code = 0; code < ( 1 << len ); code++ ) {
+					table[ used + code ] = ENTRY( E_INVALID, 0, 0 );
+				}
+			}
+			used += 1 << len;
+		}
+	}
+
+	for ( sym = 0; sym < numSyms; sym++ ) {
+		len = lens[ sym ];
+		if ( !len ) {
+			continue;
+		}
+		rev = codes[ sym ];
+		entry = SymbolEntry( type, sym );
+		if ( len <= tableBits ) {
+			entry |= len;
+			for ( i = rev; i < primary; i += 1 << len ) {
+				table[ i ] = entry;
+			}
+		} else {
+			uint32_t *sub = table + subOffset[ rev & ( primary - 1 ) ];
+			int subBits = subLen[ rev & ( primary - 1 ) ] - tableBits;
+			len -= tableBits;
+			entry |= len;
+			for ( i = rev >> tableBits; i < ( 1 << subBits ); i += 1 << len ) {
+				sub[ i ] = entry;
+			}
+		}
+	}
+
+	return true;
+}
+
+
+/*
+=================
+LoadLE64
+=================
+*/
+static ID_INLINE uint64_t LoadLE64( const uint8_t *p ) {
+#ifdef Q3_LITTLE_ENDIAN
+	uint64_t v;
+	memcpy( &v, p, sizeof( v ) );
+	return v;
+#else
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+		(uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+#endif
+}
+
+
+// tops the bit buffer up to at least 56 bits; bits above bitcount are either
+// zero or already hold the following input, so the word load may overlap them
+#define REFILL() \
+	if ( inEnd - in >= 8 ) { \
+		bitbuf |= LoadLE64( in ) << bitcount; \
+		in += ( 63 - bitcount ) >> 3; \
+		bitcount |= 56; \
+	} else { \
+		while ( bitcount <= 56 ) { \
+			if ( in < inEnd ) \
+				bitbuf |= (uint64_t)*in++ << bitcount; \
+			else if ( ++overread > MAX_OVERREAD ) \
+				return -1; \
+			bitcount += 8; \
+		} \
+	}
+
+#define CONSUME( n ) { bitbuf >>= (n); bitcount -= (n); }
+
+
+/*
+=================
+inflate_buffer
+=================
+*/
+int inflate_buffer( uint8_t *dest, uint32_t destlen, const uint8_t *source, uint32_t sourcelen ) {
+	inflateTables_t	t;
+	const uint8_t	*in, *inEnd;
+	uint8_t			*out, *outEnd;
+	const uint8_t	*src;
+	const uint32_t	*litlen, *dist;
+	uint64_t		litlenMask, distMask;
+	uint64_t		bitbuf;
+	int				bitcount, overread;
+	uint32_t		entry, length, distance;
+	int				final, blockType;
+
+	in = source;
+	inEnd = source + sourcelen;
+	out = dest;
+	outEnd = dest + destlen;
+
+	bitbuf = 0;
+	bitcount = 0;
+	overread = 0;
+
+	do {
+		REFILL();
+		final = bitbuf & 1;
+		blockType = ( bitbuf >> 1 ) & 3;
+		CONSUME( 3 );
+
+		if ( blockType == 0 ) {
+			// stored block: drop to a byte boundary and hand the
+			// whole bytes still sitting in the bit buffer back
+			CONSUME( bitcount & 7 );
+			if ( overread > ( bitcount >> 3 ) ) {
+				return -1;
+			}
+			in -= ( bitcount >> 3 ) - overread;
+			bitbuf = 0;
+			bitcount = 0;
+			overread = 0;
+
+			if ( inEnd - in < 4 ) {
+				return -1;
+			}
+			length = in[0] | in[1] << 8;
+			if ( ( length ^ 0xFFFF ) != (uint32_t)( in[2] | in[3] << 8 ) ) {
+				return -1;
+			}
+			in += 4;
+			if ( length > (uint32_t)( inEnd - in ) || length > (uint32_t)( outEnd - out ) ) {
+				return -1;
+			}
+			memcpy( out, in, length );
+			in += length;
+			out += length;
+			continue;
+		}
+
+		if ( blockType == 1 ) {
+			litlen = fixedLitlen;
+			litlenMask = BITMASK( FIXED_LITLEN_BITS );
+			dist = fixedDist;
+			distMask = BITMASK( FIXED_DIST_BITS );
+		} else if ( blockType == 2 ) {
+			// dynamic codes
+			int numLitLen, numDist, numPrecode, i, n;
+
+			numLitLen = ( bitbuf & 31 ) + 257;
+			numDist = ( ( bitbuf >> 5 ) & 31 ) + 1;
+			numPrecode = ( ( bitbuf >> 10 ) & 15 ) + 4;
+			CONSUME( 14 );
+			if ( numLitLen > 286 || numDist > 30 ) {
+				return -1;
+			}
+
+			Com_Memset( t.lens, 0, NUM_PRECODE_SYMS );
+			for ( i = 0; i < numPrecode; i++ ) {
+				REFILL();
+				t.lens[ precodeOrder[ i ] ] = bitbuf & 7;
+				CONSUME( 3 );
+			}
+			if ( !BuildTable( T_PRECODE, t.precode, PRECODE_BITS, 1 << PRECODE_BITS, t.lens, NUM_PRECODE_SYMS ) ) {
+				return -1;
+			}
+
+			for ( i = 0; i < numLitLen + numDist; ) {
+				REFILL();
+				entry = t.precode[ bitbuf & BITMASK( PRECODE_BITS ) ];
+				if ( ENTRY_TYPE( entry ) != E_LITERAL ) {
+					return -1;
+				}
+				CONSUME( ENTRY_BITS( entry ) );
+				entry = ENTRY_VALUE( entry );
+				if ( entry < 16 ) {
+					t.lens[ i++ ] = entry;
+					continue;
+				}
+				if ( entry == 16 ) {
+					if ( i == 0 ) {
+						return -1;
+					}
+					n = 3 + ( bitbuf & 3 );
+					CONSUME( 2 );
+					length = t.lens[ i - 1 ];
+				} else if ( entry == 17 ) {
+					n = 3 + ( bitbuf & 7 );
+					CONSUME( 3 );
+					length = 0;
+				} else {
+					n = 11 + ( bitbuf & 127 );
+					CONSUME( 7 );
+					length = 0;
+				}
+				if ( i + n > numLitLen + numDist ) {
+					return -1;
+				}
+				Com_Memset( t.lens + i, length, n );
+				i += n;
+			}
+
+			// the block must be able to end
+			if ( t.lens[ 256 ] == 0 ) {
+				return -1;
+			}
+
+			if ( !BuildTable( T_LITLEN, t.litlen, LITLEN_BITS, LITLEN_TABLE_SIZE, t.lens, numLitLen ) ||
+				!BuildTable( T_DIST, t.dist, DIST_BITS, DIST_TABLE_SIZE, t.lens + numLitLen, numDist ) ) {
+				return -1;
+			}
+			litlen = t.litlen;
+			litlenMask = BITMASK( LITLEN_BITS );
+			dist = t.dist;
+			distMask = BITMASK( DIST_BITS );
+		} else {
+			return -1;
+		}
+
+		for ( ;; ) {
+			// 56 bits cover the longest length code, its extra bits,
+			// the longest distance code and its extra bits (15+5+15+13)
+			REFILL();
+			entry = litlen[ bitbuf & litlenMask ];
+			if ( ENTRY_TYPE( entry ) == E_SUBTABLE ) {
+				CONSUME( LITLEN_BITS );
+				entry = litlen[ ENTRY_VALUE( entry ) + ( bitbuf & BITMASK( ENTRY_EXTRA( entry ) ) ) ];
+			}
+			CONSUME( ENTRY_BITS( entry ) );
+
+			if ( ENTRY_TYPE( entry ) == E_LITERAL ) {
+				if ( out >= outEnd ) {
+					return -1;
+				}
+				*out++ = ENTRY_VALUE( entry );
+				continue;
+			}
+
+			if ( ENTRY_TYPE( entry ) != E_BASE ) {
+				if ( ENTRY_TYPE( entry ) == E_END ) {
+					break;
+				}
+				return -1;
+			}
+
+			length = ENTRY_VALUE( entry ) + ( bitbuf & BITMASK( ENTRY_EXTRA( entry ) ) );
+			CONSUME( ENTRY_EXTRA( entry ) );
+
+			entry = dist[ bitbuf & distMask ];
+			if ( ENTRY_TYPE( entry ) == E_SUBTABLE ) {
+				CONSUME( DIST_BITS );
+				entry = dist[ ENTRY_VALUE( entry ) + ( bitbuf & BITMASK( ENTRY_EXTRA( entry ) ) ) ];
+			}
+			CONSUME( ENTRY_BITS( entry ) );
+			if ( ENTRY_TYPE( entry ) != E_BASE ) {
+				return -1;
+			}
+
+			distance = ENTRY_VALUE( entry ) + ( bitbuf & BITMASK( ENTRY_EXTRA( entry ) ) );
+			CONSUME( ENTRY_EXTRA( entry ) );
+
+			if ( distance > (uint32_t)( out - dest ) || length > (uint32_t)( outEnd - out ) ) {
+				return -1;
+			}
+
+			src = out - distance;
+			if ( distance >= 8 && length + 8 <= (uint32_t)( outEnd - out ) ) {
+				// word copies may run up to 7 bytes past the match,
+				// those are overwritten by the following output
+				uint8_t *end = out + length;
+				do {
+					memcpy( out, src, 8 );
+					out += 8;
+					src += 8;
+				} while ( out < end );
+				out = end;
+			} else if ( distance == 1 ) {
+				Com_Memset( out, *src, length );
+				out += length;
+			} else {
+				do {
+					*out++ = *src++;
+				} while ( --length );
+			}
+		}
+	} while ( !final );
+
+	// zero bytes shifted in past the end of input must not have been used
+	if ( overread > ( bitcount >> 3 ) ) {
+		return -1;
+	}
+
+	return ( out == outEnd ) ? 0 : -1;
+}
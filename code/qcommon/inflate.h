@@ -0,0 +1,31 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+#ifndef __INFLATE_H
+#define __INFLATE_H
+
+#include "q_shared.h"
+
+// decodes a complete raw deflate stream (RFC 1951) held in memory,
+// returns 0 only if it ends exactly after destlen bytes of output
+int inflate_buffer( uint8_t *dest, uint32_t destlen, const uint8_t *source, uint32_t sourcelen );
+
+#endif // __INFLATE_H
@@ -39,9 +39,10 @@ struct mdfour {
 /* NOTE: This code makes no attempt to be fast!
 
    It assumes that an int is at least 32 bits long
-*/
 
-static struct mdfour *m;
+   All state lives in the caller's context so that checksums may be
+   computed on several threads at once
+*/
 
 #define F(X,Y,Z) (((X)&(Y)) | ((~(X))&(Z)))
 #define G(X,Y,Z) (((X)&(Y)) | ((X)&(Z)) | ((Y)&(Z)))
@@ -53,16 +54,11 @@ static struct mdfour *m;
 #define ROUND3(a,b,c,d,k,s) a = lshift(a + H(b,c,d) + X[k] + 0x6ED9EBA1,s)
 
 /* this applies md4 to 64 byte chunks */
-static void mdfour64(uint32_t *M)
+static void mdfour64(struct mdfour *m, const uint32_t *X)
 {
-	int j;
 	uint32_t AA, BB, CC, DD;
-	uint32_t X[16];
 	uint32_t A,B,C,D;
 
-	for (j=0;j<16;j++)
-		X[j] = M[j];
-
 	A = m->A; B = m->B; C = m->C; D = m->D;
 	AA = A; BB = B; CC = C; DD = D;
 
@@ -95,14 +91,14 @@ static void mdfour64(uint32_t *M)
 
 	A += AA; B += BB; C += CC; D += DD;
 
-	for (j=0;j<16;j++)
-		X[j] = 0;
-
 	m->A = A; m->B = B; m->C = C; m->D = D;
 }
 
 static void copy64(uint32_t *M, const byte *in)
 {
+#ifdef Q3_LITTLE_ENDIAN
+	Com_Memcpy(M, in, 64);
+#else
 	int i;
 
 	for (i=0;i<16;i++)
@@ -111,6 +107,7 @@ static void copy64(uint32_t *M, const byte *in)
 			((uint32_t)in[i*4+2] << 16) |
 			((uint32_t)in[i*4+1] <<	 8) |
 			((uint32_t)in[i*4+0] <<	 0) ;
+#endif
 }
 
 static void copy4(byte *out,uint32_t x)
@@ -131,7 +128,7 @@ void mdfour_begin(struct mdfour *md)
 }
 
 
-static void mdfour_tail(const byte *in, int n)
+static void mdfour_tail(struct mdfour *m, const byte *in, int n)
 {
 	byte buf[128];
 	uint32_t M[16];
@@ -148,13 +145,13 @@ static void mdfour_tail(const byte *in, int n)
 	if (n <= 55) {
 		copy4(buf+56, b);
 		copy64(M, buf);
-		mdfour64(M);
+		mdfour64(m, M);
 	} else {
 		copy4(buf+120, b);
 		copy64(M, buf);
-		mdfour64(M);
+		mdfour64(m, M);
 		copy64(M, buf+64);
-		mdfour64(M);
+		mdfour64(m, M);
 	}
 }
 
@@ -162,19 +159,17 @@ static void mdfour_update(struct mdfour *md, const byte *in, int n)
 {
 	uint32_t M[16];
 
-	m = md;
-
-	if (n == 0) mdfour_tail(in, n);
+	if (n == 0) mdfour_tail(md, in, n);
 
 	while (n >= 64) {
 		copy64(M, in);
-		mdfour64(M);
+		mdfour64(md, M);
 		in += 64;
 		n -= 64;
-		m->totalN += 64;
+		md->totalN += 64;
 	}
 
-	mdfour_tail(in, n);
+	mdfour_tail(md, in, n);
 }
 
 
@@ -139,7 +139,7 @@ void Netchan_TransmitNextFragment( netchan_t *chan ) {
 	NET_SendPacket( chan->sock, send.cursize, send.data, &chan->remoteAddress );
 
 	// Store send time and size of this packet for rate control
-	chan->lastSentTime = Sys_Milliseconds();
+	chan->lastSentTime = NET_Milliseconds();
 	chan->lastSentSize = send.cursize;
 
 	if ( showpackets->integer ) {
@@ -211,7 +211,7 @@ void Netchan_Transmit( netchan_t *chan, int length, const byte *data ) {
 	NET_SendPacket( chan->sock, send.cursize, send.data, &chan->remoteAddress );
 
 	// Store send time and size of this packet for rate control
-	chan->lastSentTime = Sys_Milliseconds();
+	chan->lastSentTime = NET_Milliseconds();
 	chan->lastSentSize = send.cursize;
 
 	if ( showpackets->integer ) {
@@ -507,6 +507,23 @@ static void NET_QueuePacket( int length, const void *data, const netadr_t *to, i
 }
 
 
+/*
+====================
+NET_Milliseconds
+
+Clock for network rate control, runs on recorded
+time while server journal is replayed
+====================
+*/
+int NET_Milliseconds( void )
+{
+	if ( com_serverReplay ) {
+		return Com_ServerJournalMilliseconds();
+	}
+	return Sys_Milliseconds();
+}
+
+
 void NET_FlushPacketQueue( void )
 {
 	packetQueue_t *last;
@@ -532,6 +549,11 @@ void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t
 		Com_Printf ("send packet %4i\n", length);
 	}
 
+	// replayed server talks to recorded addresses
+	if ( com_serverReplay ) {
+		return;
+	}
+
 	if ( to->type == NA_LOOPBACK ) {
 		NET_SendLoopPacket( sock, length, data );
 		return;
@@ -245,13 +245,16 @@ int Com_Split( char *in, char **out, int outsz, int delim )
 /*
 ==================
 crc32_buffer
+
+Slice-by-8: eight bytes per step through eight 256-entry tables
 ==================
 */
 unsigned int crc32_buffer( const byte *buf, unsigned int len ) {
-	static unsigned int crc32_table[256];
+	static unsigned int crc32_table[8][256];
 	static bool crc32_inited = false;
 
 	unsigned int crc = 0xFFFFFFFFUL;
+	unsigned int lo, hi;
 
 	if ( !crc32_inited )
 	{
@@ -263,14 +266,35 @@ unsigned int crc32_buffer( const byte *buf, unsigned int len ) {
 			c = i;
 			for ( j = 0; j < 8; j++ )
 				c = (c & 1) ? (c >> 1) ^ 0xEDB88320UL : c >> 1;
-			crc32_table[i] = c;
+			crc32_table[0][i] = c;
+		}
+		for (i = 0; i < 256; i++)
+		{
+			c = crc32_table[0][i];
+			for ( j = 1; j < 8; j++ )
+			{
+				c = crc32_table[0][c & 0xFF] ^ (c >> 8);
+				crc32_table[j][i] = c;
+			}
 		}
 		crc32_inited = true;
 	}
 
+	while ( len >= 8 )
+	{
+		lo = ( buf[0] | buf[1] << 8 | buf[2] << 16 | (unsigned int)buf[3] << 24 ) ^ crc;
+		hi = buf[4] | buf[5] << 8 | buf[6] << 16 | (unsigned int)buf[7] << 24;
+		crc = crc32_table[7][lo & 0xFF] ^ crc32_table[6][(lo >> 8) & 0xFF] ^
+			crc32_table[5][(lo >> 16) & 0xFF] ^ crc32_table[4][lo >> 24] ^
+			crc32_table[3][hi & 0xFF] ^ crc32_table[2][(hi >> 8) & 0xFF] ^
+			crc32_table[1][(hi >> 16) & 0xFF] ^ crc32_table[0][hi >> 24];
+		buf += 8;
+		len -= 8;
+	}
+
 	while ( len-- )
 	{
-		crc = crc32_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+		crc = crc32_table[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
 	}
 
 	return crc ^ 0xFFFFFFFFUL;
@@ -1864,12 +1888,6 @@ const char *Info_ValueForKey( const char *s, const char *key )
 }
 
 
-#define MAX_INFO_TOKENS ((MAX_INFO_STRING/3)+2)
-
-static const char *info_keys[ MAX_INFO_TOKENS ];
-static const char *info_values[ MAX_INFO_TOKENS ];
-static int info_tokens;
-
 /*
 ===================
 Info_Tokenize
@@ -1878,12 +1896,11 @@ Tokenizes all key/value pairs from specified infostring
 NOT suitable for big infostrings
 ===================
 */
-void Info_Tokenize( const char *s )
+void Info_Tokenize( infoTokens_t *info, const char *s )
 {
-	static char tokenBuffer[ MAX_INFO_STRING ];
-	char *o = tokenBuffer;
+	char *o = info->buffer;
 
-	info_tokens = 0;
+	info->count = 0;
 	*o = '\0';
 
 	for ( ;; )
@@ -1894,13 +1911,13 @@ void Info_Tokenize( const char *s )
 		if ( *s == '\0' )
 			break;
 
-		info_keys[ info_tokens ] = o;
+		info->keys[ info->count ] = (unsigned short)( o - info->buffer );
 		while ( *s != '\\' )
 		{
 			if ( *s == '\0' )
 			{
 				*o = '\0'; // terminate key
-				info_values[ info_tokens++ ] = o;
+				info->values[ info->count++ ] = (unsigned short)( o - info->buffer );
 				return;
 			}
 			*o++ = *s++;
@@ -1908,7 +1925,7 @@ void Info_Tokenize( const char *s )
 		*o++ = '\0'; // terminate key
 		s++; // skip '\\'
 
-		info_values[ info_tokens++ ] = o;
+		info->values[ info->count++ ] = (unsigned short)( o - info->buffer );
 		while ( *s != '\\' && *s != '\0' )
 		{
 			*o++ = *s++;
@@ -1925,15 +1942,15 @@ Info_ValueForKeyToken
 Fast lookup from tokenized infostring
 ===================
 */
-const char *Info_ValueForKeyToken( const char *key )
+const char *Info_ValueForKeyToken( const infoTokens_t *info, const char *key )
 {
 	int i;
 
-	for ( i = 0; i < info_tokens; i++ ) 
+	for ( i = 0; i < info->count; i++ ) 
 	{
-		if ( Q_stricmp( info_keys[ i ], key ) == 0 )
+		if ( Q_stricmp( info->buffer + info->keys[ i ], key ) == 0 )
 		{
-			return info_values[ i ];
+			return info->buffer + info->values[ i ];
 		}
 	}
 
@@ -894,9 +894,18 @@ void Com_TruncateLongString( char *buffer, const char *s );
 //
 // key / value info strings
 //
+#define MAX_INFO_TOKENS ((MAX_INFO_STRING/3)+2)
+
+typedef struct {
+	int				count;
+	unsigned short	keys[ MAX_INFO_TOKENS ];	// offsets in buffer so it stays valid when copied
+	unsigned short	values[ MAX_INFO_TOKENS ];
+	char			buffer[ MAX_INFO_STRING ];
+} infoTokens_t;
+
 const char *Info_ValueForKey( const char *s, const char *key );
-void Info_Tokenize( const char *s );
-const char *Info_ValueForKeyToken( const char *key );
+void Info_Tokenize( infoTokens_t *info, const char *s );
+const char *Info_ValueForKeyToken( const infoTokens_t *info, const char *key );
 #define Info_SetValueForKey( buf, key, value ) Info_SetValueForKey_s( (buf), MAX_INFO_STRING, (key), (value) )
 bool Info_SetValueForKey_s( char *s, int slen, const char *key, const char *value );
 bool Info_Validate( const char *s );
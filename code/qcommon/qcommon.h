@@ -197,6 +197,7 @@ void		NET_Init( void );
 void		NET_Shutdown( void );
 void		NET_FlushPacketQueue(void);
 void		NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t *to );
+int			NET_Milliseconds( void );
 void		QDECL NET_OutOfBandPrint( netsrc_t net_socket, const netadr_t *adr, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
 void		NET_OutOfBandCompress( netsrc_t sock, const netadr_t *adr, const byte *data, int len );
 
@@ -621,6 +622,9 @@ void 	Cvar_WriteVariables( fileHandle_t f );
 // writes lines containing "set variable value" for all variables
 // with the archive flag set to true.
 
+void	Cvar_ForEachModified( void (*callback)( const char *name, const char *value ) );
+// enumerates user-set and non-default variables that can be changed at runtime
+
 void	Cvar_Init( void );
 
 const char *Cvar_InfoString( int bit, bool *truncated );
@@ -735,6 +739,9 @@ fileHandle_t	FS_FOpenFileWrite( const char *qpath );
 fileHandle_t	FS_FOpenFileAppend( const char *filename );
 // will properly create any needed paths and deal with separator character issues
 
+FILE	*FS_OpenHomeFile( const char *filename, bool append );
+// raw file in homepath for use by other threads, close with fclose()
+
 bool 	FS_ResetReadOnlyAttribute( const char *filename );
 
 bool 	FS_SV_FileExists( const char *file );
@@ -788,6 +795,44 @@ void	FS_ForceFlush( fileHandle_t f );
 void	FS_FreeFile( void *buffer );
 // frees the memory returned by FS_ReadFile
 
+int		FS_MapFile( const char *qpath, void **buffer );
+// maps a loose file or a pk3 entry stored without compression read-only
+// into memory, returns -1 and a null buffer if that is not possible
+// so the caller can fall back to FS_ReadFile. The buffer is not
+// zero-terminated and must be released with FS_UnmapFile
+
+void	FS_UnmapFile( void *buffer, int length );
+// releases the mapping returned by FS_MapFile
+
+typedef void (*fsReadCallback_t)( const char *qpath, void *buffer, int length, void *arg );
+
+void	FS_ReadFileAsync( const char *qpath, fsReadCallback_t callback, void *arg );
+// queues the file to be read and inflated on the I/O thread. The callback is
+// called exactly once on the main thread, from FS_RunAsyncReads or
+// FS_FinishAsyncReads, with the zero-terminated contents or with NULL and -1
+// if the file is not present. The callback owns the buffer and releases it
+// with FS_FreeFile, like one returned by FS_ReadFile
+
+void	FS_RunAsyncReads( void );
+// delivers completed reads, called every frame
+
+void	FS_FinishAsyncReads( void );
+// blocks until all queued reads are delivered
+
+void	FS_CheckPakChanges( void );
+// applies pk3 files added, replaced or removed in the game directories
+// to the search path without restart, called every frame, see fs_watch
+
+void	FS_ApplyDeferredPakChanges( void );
+// removes and replaces paks which were in use by the running server,
+// called on map load
+
+void	FS_BeginMapLoad( const char *mapname );
+void	FS_EndMapLoad( void );
+void	FS_CancelMapLoad( void );
+// pak files opened between begin and end are recorded per map and read ahead
+// on the I/O thread next time the map is loaded, see fs_readahead
+
 void	FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
 
@@ -950,6 +995,7 @@ void		Com_BeginRedirect (char *buffer, int buffersize, void (*flush)(const char
 void		Com_EndRedirect( void );
 void 		QDECL Com_Printf( const char *fmt, ... ) __attribute__ ((format (printf, 1, 2)));
 void 		QDECL Com_DPrintf( const char *fmt, ... ) __attribute__ ((format (printf, 1, 2)));
+void		Com_LogFlush( void );		// writes out queued qconsole.log text, for exit paths
 void 		Com_Quit_f( void );
 void		Com_GameRestart( int checksumFeed, bool clientRestart );
 
@@ -1039,6 +1085,20 @@ extern	int		time_game;
 extern	int		time_frontend;
 extern	int		time_backend;		// renderer backend time
 
+// timeline zones, recorded only while "trace" is running
+extern	int		com_traceActive;
+void	Com_TraceBegin( const char *name, const char *detail );
+void	Com_TraceEnd( void );
+#define TRACE_BEGIN( name ) do { if ( com_traceActive ) Com_TraceBegin( (name), NULL ); } while ( 0 )
+#define TRACE_BEGIN_DETAIL( name, detail ) do { if ( com_traceActive ) Com_TraceBegin( (name), (detail) ); } while ( 0 )
+#define TRACE_END() do { if ( com_traceActive ) Com_TraceEnd(); } while ( 0 )
+
+// server journal, see "svjournal" command
+extern	bool	com_serverReplay;		// no real network while set
+void	Com_ServerJournalSpawn( const char *mapname, bool killBots );
+int		Com_ServerJournalSeed( int seed );
+int		Com_ServerJournalMilliseconds( void );
+
 extern	int		com_frameTime;
 
 #ifndef DEDICATED
@@ -1098,9 +1158,13 @@ void *Z_TagMallocDebug( int size, memtag_t tag, char *label, char *file, int lin
 void *Z_MallocDebug( int size, char *label, char *file, int line );			// returns 0 filled memory
 void *S_MallocDebug( int size, char *label, char *file, int line );			// returns 0 filled memory
 #else
-void *Z_TagMalloc( int size, memtag_t tag );	// NOT 0 filled memory
-void *Z_Malloc( int size );			// returns 0 filled memory
-void *S_Malloc( int size );			// NOT 0 filled memory only for small allocations
+// call site is passed for memprofile
+#define Z_TagMalloc(size, tag)			Z_TagMallocSite(size, tag, __FILE__, __LINE__)
+#define Z_Malloc(size)					Z_MallocSite(size, __FILE__, __LINE__)
+#define S_Malloc(size)					S_MallocSite(size, __FILE__, __LINE__)
+void *Z_TagMallocSite( int size, memtag_t tag, const char *file, int line );	// NOT 0 filled memory
+void *Z_MallocSite( int size, const char *file, int line );			// returns 0 filled memory
+void *S_MallocSite( int size, const char *file, int line );			// NOT 0 filled memory only for small allocations
 #endif
 void Z_Free( void *ptr );
 int Z_FreeTags( memtag_t tag );
@@ -1117,6 +1181,32 @@ void Hunk_FreeTempMemory( void *buf );
 int	Hunk_MemoryRemaining( void );
 void Hunk_Log( void);
 
+typedef struct memArena_s {
+	const char	*name;
+	void		*mem;
+	byte		*base;
+	int			size;
+	int			used;
+	int			peak;		// since last reset
+	int			lastPeak;	// before last reset
+	int			highwater;
+	int			overflows;
+	struct arenaOverflow_s *overflow;
+	struct memArena_s *next;
+} memArena_t;
+
+void Arena_Init( memArena_t *arena, const char *name, int size );
+void Arena_Shutdown( memArena_t *arena );
+void *Arena_Alloc( memArena_t *arena, int size, int align );
+int Arena_Mark( const memArena_t *arena );
+void Arena_Release( memArena_t *arena, int mark );
+void Arena_Reset( memArena_t *arena );
+
+// main thread scratch memory, released at the end of each frame
+void *Com_FrameAlloc( int size );
+int Com_FrameMark( void );
+void Com_FrameRelease( int mark );
+
 unsigned int Com_TouchMemory( void );
 
 // commandLine should not include the executable name (argv[0])
@@ -1202,6 +1292,7 @@ bool CL_GameSwitch( void );
 //
 void SV_Init( void );
 void SV_Shutdown( const char *finalmsg );
+void SV_SpawnServer( const char *mapname, bool killBots );
 void SV_Frame( int msec );
 void SV_TrackCvarChanges( void );
 void SV_PacketEvent( const netadr_t *from, msg_t *msg );
@@ -1257,6 +1348,8 @@ typedef struct {
 } sysEvent_t;
 
 void	Sys_Init( void );
+// may be called from any thread, but evPtr is zone memory so only
+// the main thread can post events that carry data
 void	Sys_QueEvent( int evTime, sysEventType_t evType, int value, int value2, int ptrLength, void *ptr );
 void	Sys_SendKeyEvents( void );
 void	Sys_Sleep( int msec );
@@ -1281,6 +1374,7 @@ bool 		Sys_SetAffinityMask( const uint64_t mask );
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds( void );
 int64_t	Sys_Microseconds( void );
+int64_t	Sys_Nanoseconds( void );
 
 void	Sys_SnapVector( float *vector );
 
@@ -1302,6 +1396,75 @@ void		Sys_ShowIP(void);
 
 bool	Sys_Mkdir( const char *path );
 FILE	*Sys_FOpen( const char *ospath, const char *mode );
+void	*Sys_MapFile( FILE *f, fileOffset_t offset, int length );
+void	Sys_UnmapFile( void *data, int length );
+bool	Sys_DetachMappedFile( void *data, int length );
+bool	Sys_ReadAhead( FILE *f, fileOffset_t offset, fileOffset_t length );
+
+// Sys_AllocPages flags
+#define PAGES_HUGE		1	// transparent huge pages where supported
+#define PAGES_HUGETLB	2	// explicit huge pages, falls back to PAGES_HUGE
+#define PAGES_PREFAULT	4	// fault in all pages by the calling thread, i.e. on its NUMA node
+#define PAGES_LOCK		8	// prefault and keep resident
+
+// zero-filled memory that is never released, returns NULL on failure
+void	*Sys_AllocPages( size_t size, int flags, int *result );
+
+// atomic operations for data shared with worker threads,
+// loads have acquire and stores have release semantics
+#ifdef _MSC_VER
+#include <intrin.h>
+static ID_INLINE int Sys_AtomicLoad( volatile int *ptr ) {
+	return _InterlockedOr( (volatile long *)ptr, 0 );
+}
+static ID_INLINE void Sys_AtomicStore( volatile int *ptr, int value ) {
+	_InterlockedExchange( (volatile long *)ptr, value );
+}
+static ID_INLINE bool Sys_AtomicCompareSwap( volatile int *ptr, int expected, int value ) {
+	return _InterlockedCompareExchange( (volatile long *)ptr, value, expected ) == expected;
+}
+static ID_INLINE int Sys_AtomicIncrement( volatile int *ptr ) {
+	return _InterlockedIncrement( (volatile long *)ptr );
+}
+static ID_INLINE int64_t Sys_AtomicLoad64( volatile int64_t *ptr ) {
+	return _InterlockedCompareExchange64( ptr, 0, 0 );
+}
+static ID_INLINE bool Sys_AtomicCompareSwap64( volatile int64_t *ptr, int64_t expected, int64_t value ) {
+	return _InterlockedCompareExchange64( ptr, value, expected ) == expected;
+}
+#else
+static ID_INLINE int Sys_AtomicLoad( volatile int *ptr ) {
+	return __atomic_load_n( ptr, __ATOMIC_ACQUIRE );
+}
+static ID_INLINE void Sys_AtomicStore( volatile int *ptr, int value ) {
+	__atomic_store_n( ptr, value, __ATOMIC_RELEASE );
+}
+static ID_INLINE bool Sys_AtomicCompareSwap( volatile int *ptr, int expected, int value ) {
+	return __atomic_compare_exchange_n( ptr, &expected, value, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+}
+static ID_INLINE int Sys_AtomicIncrement( volatile int *ptr ) {
+	return __atomic_add_fetch( ptr, 1, __ATOMIC_ACQ_REL );
+}
+static ID_INLINE int64_t Sys_AtomicLoad64( volatile int64_t *ptr ) {
+	return __atomic_load_n( ptr, __ATOMIC_ACQUIRE );
+}
+static ID_INLINE bool Sys_AtomicCompareSwap64( volatile int64_t *ptr, int64_t expected, int64_t value ) {
+	return __atomic_compare_exchange_n( ptr, &expected, value, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE );
+}
+#endif
+
+// worker threads must not touch the zone, hunk, cvars or console
+void	*Sys_CreateThread( void (*func)( void *arg ), void *arg );
+void	Sys_JoinThread( void *thread );
+int		Sys_NumCPUs( void );
+void	*Sys_CreateMutex( void );
+void	Sys_DestroyMutex( void *mutex );
+void	Sys_LockMutex( void *mutex );
+void	Sys_UnlockMutex( void *mutex );
+void	*Sys_CreateSemaphore( void );
+void	Sys_DestroySemaphore( void *sem );
+void	Sys_PostSemaphore( void *sem );
+void	Sys_WaitSemaphore( void *sem );
 bool 	Sys_ResetReadOnlyAttribute( const char *ospath );
 
 const char *Sys_Pwd( void );
@@ -1318,6 +1481,11 @@ void Sys_FreeFileList( char **list );
 
 bool Sys_GetFileStats( const char *filename, fileOffset_t *size, fileTime_t *mtime, fileTime_t *ctime );
 
+// pk3 directory change notification, see fs_watch
+int Sys_WatchDirectory( const char *path );
+void Sys_UnwatchDirectories( void );
+const char *Sys_NextDirectoryChange( int *watch );
+
 void Sys_BeginProfiling( void );
 void Sys_EndProfiling( void );
 
@@ -10,6 +10,7 @@
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 #include "unzip.h"
+#include "inflate.h"
 
 /* unzip.h -- IO for uncompress .zip files using zlib 
    Version 0.15 beta, Mar 19th, 1998,
@@ -1332,6 +1333,25 @@ extern unzFile unzOpen (const char* path)
 {
 	unz_s us;
 	unz_s *s;
+
+	if (unzOpenInto(path,&us)!=UNZ_OK)
+		return NULL;
+
+	s=(unz_s*)ALLOC(sizeof(unz_s));
+	*s=us;
+//	unzGoToFirstFile((unzFile)s);	
+	return (unzFile)s;	
+}
+
+
+/*
+  Same as unzOpen, but fills the caller provided structure instead of
+    allocating the handle, so it can be used from worker threads.
+	 Pass (unzFile)s to other functions, but do not unzClose it.
+*/
+extern int unzOpenInto (const char* path, unz_s *s)
+{
+	unz_s us;
 	uLong central_pos,uL;
 	FILE * fin ;
 
@@ -1347,7 +1367,7 @@ extern unzFile unzOpen (const char* path)
 
     fin=F_OPEN(path,"rb");
 	if (fin==NULL)
-		return NULL;
+		return UNZ_ERRNO;
 
 	central_pos = unzlocal_SearchCentralDir(fin);
 	if (central_pos==0)
@@ -1401,7 +1421,7 @@ extern unzFile unzOpen (const char* path)
 	if (err!=UNZ_OK)
 	{
 		fclose(fin);
-		return NULL;
+		return err;
 	}
 
 	us.file=fin;
@@ -1410,10 +1430,8 @@ extern unzFile unzOpen (const char* path)
 	us.central_pos = central_pos;
     us.pfile_in_zip_read = NULL;
 	
-	s=(unz_s*)ALLOC(sizeof(unz_s));
 	*s=us;
-//	unzGoToFirstFile((unzFile)s);	
-	return (unzFile)s;	
+	return UNZ_OK;
 }
 
 
@@ -2127,6 +2145,185 @@ extern int unzReadCurrentFile  (unzFile file, void *buf, unsigned len)
 }
 
 
+/*
+  Give the absolute position of the data of the current file (opened by
+  unzOpenCurrentFile) in the zip file and whether it is stored without compression
+*/
+extern int unzGetCurrentFileDataPosition (unzFile file, unsigned long *pos, int *stored)
+{
+	unz_s* s;
+	file_in_zip_read_info_s* pfile_in_zip_read_info;
+	if (file==NULL)
+		return UNZ_PARAMERROR;
+	s=(unz_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+	if (pfile_in_zip_read_info==NULL)
+		return UNZ_PARAMERROR;
+
+	*pos = pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->byte_before_the_zipfile;
+	*stored = (pfile_in_zip_read_info->compression_method==0);
+	return UNZ_OK;
+}
+
+
+/*
+  Whole entry access: the compressed data is read with a single fread and
+  decoded by inflate_buffer.  Allocations use malloc() instead of the zone,
+  so the functions working on a plain FILE may run on any thread
+*/
+#define UNZ_LE16(p) ((uLong)(p)[0] | ((uLong)(p)[1]<<8))
+#define UNZ_LE32(p) (UNZ_LE16(p) | (UNZ_LE16((p)+2)<<16))
+
+/*
+  Read entry data at the current position of fin: stored data goes straight
+  into buf, deflated data is read in one go and decoded by inflate_buffer
+*/
+static int unzlocal_ReadEntryData (FILE *fin, uLong method, uLong compressed_size, void *buf, uLong len)
+{
+	Byte *source;
+	int err;
+
+	if (method==0)
+	{
+		if (compressed_size!=len)
+			return UNZ_BADZIPFILE;
+		if (len && fread(buf,len,1,fin)!=1)
+			return UNZ_ERRNO;
+		return UNZ_OK;
+	}
+
+	source = (Byte*)malloc(compressed_size ? compressed_size : 1);
+	if (source==NULL)
+		return UNZ_INTERNALERROR;
+
+	if (compressed_size && fread(source,compressed_size,1,fin)!=1)
+		err = UNZ_ERRNO;
+	else if (inflate_buffer((Byte*)buf,len,source,compressed_size)!=0)
+		err = UNZ_BADZIPFILE;
+	else
+		err = UNZ_OK;
+
+	free(source);
+	return err;
+}
+
+/*
+  Get the number of bytes preceding the zip data (self-extractors etc.)
+*/
+extern int unzGetByteBeforeZipfile (FILE *fin, unsigned long *byte_before)
+{
+	unsigned char buf[22];
+	uLong central_pos, size_central_dir, offset_central_dir;
+
+	central_pos = unzlocal_SearchCentralDir(fin);
+	if (central_pos==0)
+		return UNZ_BADZIPFILE;
+
+	if (fseek(fin,central_pos,SEEK_SET)!=0 || fread(buf,sizeof(buf),1,fin)!=1)
+		return UNZ_ERRNO;
+
+	size_central_dir = UNZ_LE32(buf+12);
+	offset_central_dir = UNZ_LE32(buf+16);
+
+	if (central_pos<offset_central_dir+size_central_dir)
+		return UNZ_BADZIPFILE;
+
+	*byte_before = central_pos - (offset_central_dir+size_central_dir);
+	return UNZ_OK;
+}
+
+/*
+  Read the whole entry whose central directory record is at pos_in_central_dir
+  (as returned by unzGetCurrentFileInfoPosition) into buf, len must be its
+  uncompressed size
+*/
+extern int unzReadEntry (FILE *fin, unsigned long byte_before, unsigned long pos_in_central_dir, void *buf, unsigned long len)
+{
+	unsigned char header[SIZECENTRALDIRITEM];
+	uLong method, compressed_size, uncompressed_size, offset_local;
+
+	if (fseek(fin,pos_in_central_dir+byte_before,SEEK_SET)!=0 ||
+		fread(header,SIZECENTRALDIRITEM,1,fin)!=1)
+		return UNZ_ERRNO;
+
+	if (UNZ_LE32(header)!=0x02014b50)
+		return UNZ_BADZIPFILE;
+
+	method = UNZ_LE16(header+10);
+	compressed_size = UNZ_LE32(header+20);
+	uncompressed_size = UNZ_LE32(header+24);
+	offset_local = UNZ_LE32(header+42);
+
+	if (uncompressed_size!=len || (method!=0 && method!=Z_DEFLATED))
+		return UNZ_BADZIPFILE;
+
+	if (fseek(fin,offset_local+byte_before,SEEK_SET)!=0 ||
+		fread(header,SIZEZIPLOCALHEADER,1,fin)!=1)
+		return UNZ_ERRNO;
+
+	if (UNZ_LE32(header)!=0x04034b50)
+		return UNZ_BADZIPFILE;
+
+	// skip local filename and extra field
+	if (fseek(fin,UNZ_LE16(header+26)+UNZ_LE16(header+28),SEEK_CUR)!=0)
+		return UNZ_ERRNO;
+
+	return unzlocal_ReadEntryData(fin,method,compressed_size,buf,len);
+}
+
+/*
+  Get the range of the zip file occupied by the local header and compressed
+  data of the entry whose central directory record is at pos_in_central_dir,
+  local extra field is assumed to be as long as the central one
+*/
+extern int unzGetEntryRange (FILE *fin, unsigned long byte_before, unsigned long pos_in_central_dir, unsigned long *offset, unsigned long *length)
+{
+	unsigned char header[SIZECENTRALDIRITEM];
+
+	if (fseek(fin,pos_in_central_dir+byte_before,SEEK_SET)!=0 ||
+		fread(header,SIZECENTRALDIRITEM,1,fin)!=1)
+		return UNZ_ERRNO;
+
+	if (UNZ_LE32(header)!=0x02014b50)
+		return UNZ_BADZIPFILE;
+
+	*offset = UNZ_LE32(header+42) + byte_before;
+	*length = SIZEZIPLOCALHEADER + UNZ_LE16(header+28) + UNZ_LE16(header+30) + UNZ_LE32(header+20);
+
+	return UNZ_OK;
+}
+
+/*
+  Read the whole current file (opened by unzOpenCurrentFile, nothing read
+  yet) into buf with a single read of its compressed data
+*/
+extern int unzReadCurrentFileEntire (unzFile file, void *buf, unsigned len)
+{
+	unz_s* s;
+	file_in_zip_read_info_s* pfile_in_zip_read_info;
+	if (file==NULL)
+		return UNZ_PARAMERROR;
+	s=(unz_s*)file;
+    pfile_in_zip_read_info=s->pfile_in_zip_read;
+
+	if (pfile_in_zip_read_info==NULL)
+		return UNZ_PARAMERROR;
+
+	if (len!=s->cur_file_info.uncompressed_size ||
+		pfile_in_zip_read_info->rest_read_compressed!=s->cur_file_info.compressed_size)
+		return UNZ_PARAMERROR;
+
+	if (fseek(pfile_in_zip_read_info->file,
+			  pfile_in_zip_read_info->pos_in_zipfile +
+				pfile_in_zip_read_info->byte_before_the_zipfile,SEEK_SET)!=0)
+		return UNZ_ERRNO;
+
+	return unzlocal_ReadEntryData(pfile_in_zip_read_info->file,
+				pfile_in_zip_read_info->compression_method,
+				s->cur_file_info.compressed_size,buf,len);
+}
+
 /*
   Give the current position in uncompressed data
 */
@@ -180,6 +180,7 @@ extern int unzStringFileNameCompare (const char* fileName1, const char* fileName
 
 extern unzFile unzOpen (const char *path);
 extern unzFile unzReOpen (const char* path, unzFile file);
+extern int unzOpenInto (const char* path, unz_s *s);
 
 /*
   Open a Zip file. path contain the full pathname (by example,
@@ -308,6 +309,31 @@ extern int unzReadCurrentFile (unzFile file, void* buf, unsigned len);
     (UNZ_ERRNO for IO error, or zLib error for uncompress error)
 */
 
+extern int unzGetCurrentFileDataPosition (unzFile file, unsigned long *pos, int *stored);
+
+/*
+  Give the absolute position of the data of the current file in the zip file
+  and whether it is stored without compression
+*/
+
+extern int unzReadCurrentFileEntire (unzFile file, void *buf, unsigned len);
+
+/*
+  Read the whole current file (opened by unzOpenCurrentFile, nothing read yet)
+  with a single read of its compressed data, len must be its uncompressed size
+*/
+
+extern int unzGetByteBeforeZipfile (FILE *fin, unsigned long *byte_before);
+extern int unzReadEntry (FILE *fin, unsigned long byte_before, unsigned long pos_in_central_dir, void *buf, unsigned long len);
+extern int unzGetEntryRange (FILE *fin, unsigned long byte_before, unsigned long pos_in_central_dir, unsigned long *offset, unsigned long *length);
+
+/*
+  Locate zip data in an opened file, read a whole entry or get the file range
+  holding its local header and compressed data by its central directory
+  position, without unzFile handles or zone allocations so they may be used
+  from other threads
+*/
+
 extern long unztell(unzFile file);
 
 /*
@@ -1941,6 +1941,12 @@ intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 	}
 #endif
 
+	if ( com_traceActive ) {
+		char call[ 16 ];
+		Com_sprintf( call, sizeof( call ), "%i", callnum );
+		Com_TraceBegin( vm->name, call );
+	}
+
 	++vm->callLevel;
 	// if we have a dll loaded, call it directly
 	if ( vm->entryPoint )
@@ -1984,6 +1990,8 @@ intptr_t QDECL VM_Call( vm_t *vm, int nargs, int callnum, ... )
 	}
 	--vm->callLevel;
 
+	TRACE_END();
+
 	return r;
 }
 
@@ -25,7 +25,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "tr_types.h"
 #include "vulkan/vulkan.h"
 
-#define	REF_API_VERSION		8
+#define	REF_API_VERSION		11
 
 //
 // these are the functions exported by the refresh module
@@ -140,6 +140,12 @@ typedef struct {
 
 	int64_t	(*Microseconds)( void );
 
+	// timeline zones for the "trace" command, must be nested,
+	// only call them while *traceActive is set
+	const int	*traceActive;
+	void	(*TraceBegin)( const char *name, const char *detail );
+	void	(*TraceEnd)( void );
+
 	// stack based memory allocation for per-level things that
 	// won't be freed
 #ifdef HUNK_DEBUG
@@ -192,6 +198,11 @@ typedef struct {
 	void	(*FS_WriteFile)( const char *qpath, const void *buffer, int size );
 	bool 	(*FS_FileExists)( const char *file );
 
+	// queued reads are delivered by FS_FinishAsyncReads at the latest,
+	// the callback releases the buffer with FS_FreeFile
+	void	(*FS_ReadFileAsync)( const char *name, void (*callback)( const char *name, void *buf, int length, void *arg ), void *arg );
+	void	(*FS_FinishAsyncReads)( void );
+
 	// cinematic stuff
 	void	(*CIN_UploadCinematic)( int handle );
 	int		(*CIN_PlayCinematic)( const char *arg0, int xpos, int ypos, int width, int height, int bits );
@@ -101,7 +101,11 @@ static void R_IssueRenderCommands( void ) {
 	// actually start the commands going
 	if ( !r_skipBackEnd->integer ) {
 		// let it start on the new batch
+		if ( *ri.traceActive )
+			ri.TraceBegin( "RB_ExecuteRenderCommands", NULL );
 		RB_ExecuteRenderCommands( cmdList->cmds );
+		if ( *ri.traceActive )
+			ri.TraceEnd();
 	}
 }
 
@@ -390,6 +390,9 @@ void RE_RenderScene( const refdef_t *fd ) {
 
 	startTime = ri.Milliseconds();
 
+	if ( *ri.traceActive )
+		ri.TraceBegin( "RE_RenderScene", NULL );
+
 	if (!tr.world && !( fd->rdflags & RDF_NOWORLDMODEL ) ) {
 		ri.Error (ERR_DROP, "R_RenderScene: NULL worldmodel");
 	}
@@ -553,5 +556,8 @@ void RE_RenderScene( const refdef_t *fd ) {
 	r_firstSceneDlight = r_numdlights;
 	r_firstScenePoly = r_numpolys;
 
+	if ( *ri.traceActive )
+		ri.TraceEnd();
+
 	tr.frontEndMsec += ri.Milliseconds() - startTime;
 }
@@ -4007,6 +4007,12 @@ void	R_ShaderList_f (void) {
 
 #define	MAX_SHADER_FILES 16384
 
+static void loadShaderFile( const char *name, void *buf, int length, void *arg )
+{
+	*(char **)arg = buf;
+}
+
+
 static int loadShaderBuffers( char **shaderFiles, const int numShaderFiles, char **buffers )
 {
 	char filename[MAX_QPATH+8];
@@ -4018,16 +4024,26 @@ static int loadShaderBuffers( char **shaderFiles, const int numShaderFiles, char
 	const char *shaderStart;
 	bool denyErrors;
 
-	// load and parse shader files
+	// queue all shader files for the I/O thread
 	for ( i = 0; i < numShaderFiles; i++ )
 	{
 		Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[i] );
 		//ri.Printf( PRINT_DEVELOPER, "...loading '%s'\n", filename );
-		summand = ri.FS_ReadFile( filename, (void **)&buffers[i] );
+		ri.FS_ReadFileAsync( filename, loadShaderFile, &buffers[i] );
+	}
+
+	ri.FS_FinishAsyncReads();
+
+	// parse shader files
+	for ( i = 0; i < numShaderFiles; i++ )
+	{
+		Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[i] );
 
 		if ( !buffers[i] )
 			ri.Error( ERR_DROP, "Couldn't load %s", filename );
 
+		summand = (long)strlen( buffers[i] );
+
 		// comment some buggy shaders from pak0
 		if ( summand == 35910 && strcmp( shaderFiles[i], "sky.shader" ) == 0 )
 		{
@@ -33,15 +33,20 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 										// GAME BOTH REFERENCE !!!
 
 #define	MAX_ENT_CLUSTERS	16
+#define	MAX_ENT_CLUSTER_WORDS	2	// clusters within 128 consecutive numbers use a bitmask
 
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
 	struct svEntity_s *nextEntityInWorldSector;
 
 	entityState_t	baseline;		// for delta compression of initial sighting
-	int			numClusters;		// if -1, use headnode instead
+	int			numClusterWords;	// if 0, use clusternums or cluster span instead
+	int			clusterWord;		// first 64-bit pvs word covered by clusterBits
+	uint64_t	clusterBits[MAX_ENT_CLUSTER_WORDS];
+	int			numClusters;
 	int			clusternums[MAX_ENT_CLUSTERS];
-	int			lastCluster;		// if all the clusters don't fit in clusternums
+	int			firstCluster;		// if all the clusters don't fit in clusternums
+	int			numSpanClusters;	// test every cluster in [firstCluster, firstCluster+numSpanClusters)
 	int			areanum, areanum2;
 	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
@@ -154,6 +159,8 @@ struct leakyBucket_s {
 typedef struct client_s {
 	clientState_t	state;
 	char			userinfo[MAX_INFO_STRING];		// name, etc
+	infoTokens_t	userinfoTokens;			// parsed userinfo, see SV_UserinfoValue()
+	bool			userinfoTokenized;		// cleared whenever userinfo string changes
 
 	char			reliableCommands[MAX_RELIABLE_COMMANDS][MAX_STRING_CHARS];
 	int				reliableSequence;		// last added reliable message, not necessarily sent or acknowledged yet
@@ -354,6 +361,7 @@ void SV_DirectConnect( const netadr_t *from );
 
 void SV_ExecuteClientMessage( client_t *cl, msg_t *msg );
 void SV_UserinfoChanged( client_t *cl, bool updateUserinfo, bool runFilter );
+const char *SV_UserinfoValue( client_t *cl, const char *key );
 
 void SV_ClientEnterWorld( client_t *client, usercmd_t *cmd );
 void SV_FreeClient( client_t *client );
@@ -486,6 +494,6 @@ void SV_Netchan_FreeQueue( client_t *client );
 // sv_filter.c
 //
 void SV_LoadFilters( const char *filename );
-const char *SV_RunFilters( const char *userinfo, const netadr_t *addr );
+const char *SV_RunFilters( const infoTokens_t *userinfo, const netadr_t *addr );
 void SV_AddFilter_f( void );
 void SV_AddFilterCmd_f( void );
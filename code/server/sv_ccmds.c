@@ -1474,6 +1474,130 @@ static void SV_DumpUser_f( void ) {
 }
 
 
+/*
+===========
+SV_UserinfoBench_f
+
+Time the userinfo command against scanning userinfo string for every key
+===========
+*/
+static void SV_UserinfoBench_f( void ) {
+	static const char *sample = "\\name\\UnnamedPlayer\\rate\\25000\\snaps\\40\\model\\sarge\\headmodel\\sarge"
+		"\\team_model\\james\\team_headmodel\\*james\\color1\\4\\color2\\5\\handicap\\100\\sex\\male"
+		"\\cl_anonymous\\0\\cg_predictItems\\1\\teamtask\\0\\cl_guid\\0123456789ABCDEF0123456789ABCDEF";
+	static const char *keys[] = { "rate", "snaps", "ip", "tld" };
+	char		(*infos)[ MAX_INFO_STRING ];
+	char		old[ MAX_INFO_STRING ];
+	client_t	*cl, *scratch;
+	infoTokens_t *tokens;
+	const char	*ip;
+	int64_t		t0, tScan, tUpdate;
+	int			count, numInfos, i, j, k;
+	bool		mismatch;
+
+	// make sure server is running
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	count = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 100000;
+	if ( count <= 0 )
+		count = 1;
+
+	numInfos = 0;
+	for ( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ ) {
+		if ( cl->state >= CS_CONNECTED && cl->netchan.remoteAddress.type != NA_BOT )
+			numInfos++;
+	}
+
+	// clients are copied and marked as zombies so that SV_DropClient() leaves them alone
+	scratch = Hunk_AllocateTempMemory( MAX( numInfos, 1 ) * sizeof( scratch[0] ) );
+	infos = Hunk_AllocateTempMemory( MAX( numInfos, 1 ) * sizeof( infos[0] ) );
+	tokens = Hunk_AllocateTempMemory( sizeof( *tokens ) );
+
+	numInfos = 0;
+	for ( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ ) {
+		if ( cl->state < CS_CONNECTED || cl->netchan.remoteAddress.type == NA_BOT )
+			continue;
+		scratch[ numInfos ] = *cl;
+		// as sent by the client
+		Q_strncpyz( infos[ numInfos ], cl->userinfo, sizeof( infos[0] ) );
+		Info_RemoveKey( infos[ numInfos ], "ip" );
+		Info_RemoveKey( infos[ numInfos ], "tld" );
+		numInfos++;
+	}
+	if ( numInfos == 0 ) {
+		Com_Memset( &scratch[0], 0, sizeof( scratch[0] ) );
+		NET_StringToAdr( "192.168.1.10:27960", &scratch[0].netchan.remoteAddress, NA_IP );
+		strcpy( scratch[0].tld, "--" );
+		Q_strncpyz( infos[0], sample, sizeof( infos[0] ) );
+		numInfos = 1;
+	}
+	for ( j = 0; j < numInfos; j++ ) {
+		scratch[j].state = CS_ZOMBIE;
+	}
+
+	// what SV_UserinfoChanged() did: scan the string for each key, set ip and tld, tokenize it for filters
+	t0 = Sys_Microseconds();
+	for ( i = 0; i < count; i++ ) {
+		for ( j = 0; j < numInfos; j++ ) {
+			cl = &scratch[j];
+			Q_strncpyz( old, infos[j], sizeof( old ) );
+			cl->rate = atoi( Info_ValueForKey( old, "rate" ) );
+			cl->snapshotMsec = atoi( Info_ValueForKey( old, "snaps" ) );
+			Q_strncpyz( cl->name, Info_ValueForKey( old, "name" ), sizeof( cl->name ) );
+			k = atoi( Info_ValueForKey( old, "handicap" ) );
+			if ( NET_IsLocalAddress( &cl->netchan.remoteAddress ) )
+				ip = "localhost";
+			else
+				ip = NET_AdrToString( &cl->netchan.remoteAddress );
+			Info_SetValueForKey( old, "ip", ip );
+			Info_SetValueForKey( old, "tld", cl->tld );
+			Info_Tokenize( tokens, old );
+			SV_RunFilters( tokens, &cl->netchan.remoteAddress );
+		}
+	}
+	tScan = Sys_Microseconds() - t0;
+
+	// what SV_UpdateUserinfo_f() does, except calling the game module
+	t0 = Sys_Microseconds();
+	for ( i = 0; i < count; i++ ) {
+		for ( j = 0; j < numInfos; j++ ) {
+			cl = &scratch[j];
+			Q_strncpyz( cl->userinfo, infos[j], sizeof( cl->userinfo ) );
+			cl->userinfoTokenized = false;
+			SV_UserinfoChanged( cl, true, true );
+		}
+	}
+	tUpdate = Sys_Microseconds() - t0;
+
+	// both paths must end up with the same values
+	mismatch = false;
+	for ( j = 0; j < numInfos; j++ ) {
+		cl = &scratch[j];
+		Q_strncpyz( old, infos[j], sizeof( old ) );
+		Info_SetValueForKey( old, "ip", Info_ValueForKey( cl->userinfo, "ip" ) );
+		Info_SetValueForKey( old, "tld", cl->tld );
+		for ( k = 0; k < (int)ARRAY_LEN( keys ); k++ ) {
+			if ( strcmp( Info_ValueForKey( old, keys[k] ), SV_UserinfoValue( cl, keys[k] ) ) != 0 )
+				mismatch = true;
+		}
+	}
+
+	Hunk_FreeTempMemory( tokens );
+	Hunk_FreeTempMemory( infos );
+	Hunk_FreeTempMemory( scratch );
+
+	Com_Printf( "%i userinfo string%s, %i passes:\n", numInfos, numInfos != 1 ? "s" : "", count );
+	Com_Printf( "  scan:   %7.1f ns per userinfo command\n", tScan * 1000.0 / ( (double)count * numInfos ) );
+	Com_Printf( "  update: %7.1f ns per userinfo command\n", tUpdate * 1000.0 / ( (double)count * numInfos ) );
+	if ( mismatch ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: updated userinfo does not match scanned userinfo\n" );
+	}
+}
+
+
 /*
 =================
 SV_KillServer
@@ -1553,6 +1677,7 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("clientkick", SV_KickNum_f); // Legacy command
 	Cmd_AddCommand ("status", SV_Status_f);
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
+	Cmd_AddCommand ("userinfobench", SV_UserinfoBench_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
 	Cmd_AddCommand ("map", SV_Map_f);
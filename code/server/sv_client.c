@@ -75,6 +75,10 @@ static bool SV_VerifyChallenge( int receivedChallenge, const netadr_t *from )
 
 	int expectedChallenge = SV_CreateChallenge( challengeTimestamp, from );
 
+	// secret key is not in server journal
+	if ( com_serverReplay )
+		return true;
+
 	return (receivedChallenge == expectedChallenge) ? true : false;
 }
 
@@ -433,6 +437,7 @@ A "connect" OOB command has been received
 */
 void SV_DirectConnect( const netadr_t *from ) {
 	static		rateLimit_t bucket;
+	static		infoTokens_t tokens;
 	char		userinfo[MAX_INFO_STRING], tld[3];
 	int			i, n;
 	client_t	*cl, *newcl;
@@ -514,8 +519,9 @@ void SV_DirectConnect( const netadr_t *from ) {
 	}
 
 	Q_strncpyz( userinfo, info, sizeof( userinfo ) );
+	Info_Tokenize( &tokens, userinfo );
 
-	v = Info_ValueForKey( userinfo, "protocol" );
+	v = Info_ValueForKeyToken( &tokens, "protocol" );
 	if ( *v == '\0' )
 	{
 		if ( !SVC_RateLimit( &bucket, 10, 200 ) )
@@ -551,7 +557,7 @@ void SV_DirectConnect( const netadr_t *from ) {
 		compat = false;
 	}
 
-	v = Info_ValueForKey( userinfo, "qport" );
+	v = Info_ValueForKeyToken( &tokens, "qport" );
 	if ( *v == '\0' )
 	{
 		if ( !SVC_RateLimit( &bucket, 10, 200 ) )
@@ -560,11 +566,11 @@ void SV_DirectConnect( const netadr_t *from ) {
 		}
 		return;
 	}
-	qport = atoi( Info_ValueForKey( userinfo, "qport" ) );
+	qport = atoi( v );
 
 	// if "client" is present in userinfo and it is a modern client
 	// then assume it can properly decode long strings and protocol extensions
-	if ( !compat && *Info_ValueForKey( userinfo, "client" ) != '\0' ) {
+	if ( !compat && *Info_ValueForKeyToken( &tokens, "client" ) != '\0' ) {
 		longstr = true;
 	} else {
 		longstr = false;
@@ -598,7 +604,8 @@ void SV_DirectConnect( const netadr_t *from ) {
 	// run userinfo filter
 	SV_SetTLD( tld, from, Sys_IsLANAddress( from ) );
 	Info_SetValueForKey( userinfo, "tld", tld );
-	v = SV_RunFilters( userinfo, from );
+	Info_Tokenize( &tokens, userinfo );
+	v = SV_RunFilters( &tokens, from );
 	if ( *v != '\0' ) {
 		NET_OutOfBandPrint( NS_SERVER, from, "print\n%s\n", v );
 		Com_DPrintf( "Engine rejected a connection: %s.\n", v );
@@ -661,7 +668,7 @@ void SV_DirectConnect( const netadr_t *from ) {
 	// servers so we can play without having to kick people.
 
 	// check for privateClient password
-	password = Info_ValueForKey( userinfo, "password" );
+	password = Info_ValueForKeyToken( &tokens, "password" );
 	if ( *password && !strcmp( password, sv_privatePassword->string ) ) {
 		startIndex = 0;
 	} else {
@@ -735,6 +742,8 @@ gotnewcl:
 
 	// save the userinfo
 	Q_strncpyz( newcl->userinfo, userinfo, sizeof(newcl->userinfo) );
+	newcl->userinfoTokens = tokens;
+	newcl->userinfoTokenized = true;
 
 	newcl->longstr = longstr;
 
@@ -1657,6 +1666,50 @@ static void SV_ResetPureClient_f( client_t *cl ) {
 }
 
 
+/*
+=================
+SV_UserinfoTokens
+
+Parses client userinfo only once after each change
+=================
+*/
+static const infoTokens_t *SV_UserinfoTokens( client_t *cl ) {
+	if ( !cl->userinfoTokenized ) {
+		Info_Tokenize( &cl->userinfoTokens, cl->userinfo );
+		cl->userinfoTokenized = true;
+	}
+	return &cl->userinfoTokens;
+}
+
+
+/*
+=================
+SV_UserinfoValue
+
+Returns value for the key from parsed client userinfo, or an empty string.
+Result stays valid until next userinfo change
+=================
+*/
+const char *SV_UserinfoValue( client_t *cl, const char *key ) {
+	return Info_ValueForKeyToken( SV_UserinfoTokens( cl ), key );
+}
+
+
+/*
+=================
+SV_SetUserinfoValue
+
+Sets the key in client userinfo, parsed userinfo is kept if the value is unchanged
+=================
+*/
+static bool SV_SetUserinfoValue( client_t *cl, const char *key, const char *value ) {
+	if ( cl->userinfoTokenized && strcmp( Info_ValueForKeyToken( &cl->userinfoTokens, key ), value ) == 0 )
+		return true;
+	cl->userinfoTokenized = false;
+	return Info_SetValueForKey( cl->userinfo, key, value );
+}
+
+
 /*
 =================
 SV_UserinfoChanged
@@ -1678,6 +1731,22 @@ void SV_UserinfoChanged( client_t *cl, bool updateUserinfo, bool runFilter ) {
 		return;
 	}
 
+	if ( updateUserinfo ) {
+		// TTimo
+		// maintain the IP information
+		// the banning code relies on this being consistently present
+		// set it before any lookup so that userinfo is parsed only once
+		if ( NET_IsLocalAddress( &cl->netchan.remoteAddress ) )
+			ip = "localhost";
+		else
+			ip = NET_AdrToString( &cl->netchan.remoteAddress );
+
+		if ( !SV_SetUserinfoValue( cl, "ip", ip ) )
+			SV_DropClient( cl, "userinfo string length exceeded" );
+
+		SV_SetUserinfoValue( cl, "tld", cl->tld );
+	}
+
 	// rate command
 
 	// if the client is on the same subnet as the server and we aren't running an
@@ -1685,7 +1754,7 @@ void SV_UserinfoChanged( client_t *cl, bool updateUserinfo, bool runFilter ) {
 	if ( cl->netchan.remoteAddress.type == NA_LOOPBACK || ( cl->netchan.isLANAddress && com_dedicated->integer != 2 && sv_lanForceRate->integer ) ) {
 		cl->rate = 0; // lans should not rate limit
 	} else {
-		val = Info_ValueForKey( cl->userinfo, "rate" );
+		val = SV_UserinfoValue( cl, "rate" );
 		if ( val[0] )
 			cl->rate = atoi( val );
 		else
@@ -1703,7 +1772,7 @@ void SV_UserinfoChanged( client_t *cl, bool updateUserinfo, bool runFilter ) {
 	}
 
 	// snaps command
-	val = Info_ValueForKey( cl->userinfo, "snaps" );
+	val = SV_UserinfoValue( cl, "snaps" );
 	if ( val[0] && !NET_IsLocalAddress( &cl->netchan.remoteAddress ) )
 		i = atoi( val );
 	else
@@ -1728,39 +1797,26 @@ void SV_UserinfoChanged( client_t *cl, bool updateUserinfo, bool runFilter ) {
 		return;
 
 	// name for C code
-	val = Info_ValueForKey( cl->userinfo, "name" );
+	val = SV_UserinfoValue( cl, "name" );
 	// truncate if it is too long as it may cause memory corruption in OSP mod
 	if ( gvm->forceDataMask && strlen( val ) >= sizeof( buf ) ) {
 		Q_strncpyz( buf, val, sizeof( buf ) );
-		Info_SetValueForKey( cl->userinfo, "name", buf );
+		SV_SetUserinfoValue( cl, "name", buf );
 		val = buf;
 	}
 	Q_strncpyz( cl->name, val, sizeof( cl->name ) );
 
-	val = Info_ValueForKey( cl->userinfo, "handicap" );
+	val = SV_UserinfoValue( cl, "handicap" );
 	if ( val[0] ) {
 		i = atoi( val );
 		if ( i <= 0 || i > 100 || strlen( val ) > 4 ) {
-			Info_SetValueForKey( cl->userinfo, "handicap", "100" );
+			SV_SetUserinfoValue( cl, "handicap", "100" );
 		}
 	}
 
-	// TTimo
-	// maintain the IP information
-	// the banning code relies on this being consistently present
-	if ( NET_IsLocalAddress( &cl->netchan.remoteAddress ) )
-		ip = "localhost";
-	else
-		ip = NET_AdrToString( &cl->netchan.remoteAddress );
-
-	if ( !Info_SetValueForKey( cl->userinfo, "ip", ip ) )
-		SV_DropClient( cl, "userinfo string length exceeded" );
-
-	Info_SetValueForKey( cl->userinfo, "tld", cl->tld );
-
 	if ( runFilter )
 	{
-		val = SV_RunFilters( cl->userinfo, &cl->netchan.remoteAddress );
+		val = SV_RunFilters( SV_UserinfoTokens( cl ), &cl->netchan.remoteAddress );
 		if ( *val != '\0' )
 		{
 			SV_DropClient( cl, val );
@@ -1785,6 +1841,7 @@ static void SV_UpdateUserinfo_f( client_t *cl ) {
 	}
 
 	Q_strncpyz( cl->userinfo, info, sizeof( cl->userinfo ) );
+	cl->userinfoTokenized = false;
 
 	SV_UserinfoChanged( cl, true, true ); // update userinfo, run filter
 	// call prog code to allow overrides
@@ -2078,7 +2135,7 @@ static void SV_UserMove( client_t *cl, msg_t *msg, bool delta ) {
 
 	// save time for ping calculation
 	if ( cl->frames[ cl->messageAcknowledge & PACKET_MASK ].messageAcked == 0 ) {
-		cl->frames[ cl->messageAcknowledge & PACKET_MASK ].messageAcked = Sys_Milliseconds();
+		cl->frames[ cl->messageAcknowledge & PACKET_MASK ].messageAcked = NET_Milliseconds();
 	}
 
 	// if this is the first usercmd we have received
@@ -59,6 +59,7 @@ static filter_node_t *nodes;
 static char filterMessage[ MAX_FILTER_MESSAGE ];
 static char filterDate[ 64 ];  // current date string in "YYYY-MM-DD HH:mm" format
 static char filterName[ 256 ]; // filtered "name" userinfo key
+static const infoTokens_t *filterInfo; // userinfo being filtered
 static int  filterDateMsec;
 static int  filterCurrMsec;
 static int	nodeCount; // total count
@@ -143,14 +144,14 @@ static int eval_node( const filter_node_t *node )
 		{
 			if ( filterName[0] == '\0' )
 			{
-				CleanStr( filterName, sizeof( filterName ), Info_ValueForKeyToken( "name" ) );
+				CleanStr( filterName, sizeof( filterName ), Info_ValueForKeyToken( filterInfo, "name" ) );
 			}
 			//value = node->p1; // p1 points on filterName
 			value = filterName;
 		}
 		else
 		{
-			value = Info_ValueForKeyToken( node->p1 ); 
+			value = Info_ValueForKeyToken( filterInfo, node->p1 ); 
 		}
 
 		if ( node->is_string )
@@ -832,12 +833,12 @@ void SV_LoadFilters( const char *filename )
 }
 
 
-const char *SV_RunFilters( const char *userinfo, const netadr_t *addr )
+const char *SV_RunFilters( const infoTokens_t *userinfo, const netadr_t *addr )
 {
 	if ( addr->type <= NA_LOOPBACK ) // cannot kick host player/bot
 		return "";
 
-	Info_Tokenize( userinfo );
+	filterInfo = userinfo;
 
 	filterName[0] = '\0';
 	filterMessage[0] = '\0';
@@ -991,8 +992,6 @@ void SV_AddFilter_f( void )
 	keys = 0;
 	reason = "";
 
-	Info_Tokenize( cl->userinfo );
-
 	// attach userinfo keys
 	for ( i = 2; i < Cmd_Argc(); i++ )
 	{
@@ -1052,7 +1051,7 @@ void SV_AddFilter_f( void )
 			continue;
 		}
 
-		s = Info_ValueForKeyToken( v );
+		s = SV_UserinfoValue( cl, v );
 		if ( *s == '\0' ) // skip empty keys
 			continue;
 
@@ -1063,7 +1062,7 @@ void SV_AddFilter_f( void )
 
 	if ( !keys ) // add default key(s)
 	{
-		Com_sprintf( buf, sizeof( cmd ), " ip \"%s\"", Info_ValueForKeyToken( "ip" ) );
+		Com_sprintf( buf, sizeof( cmd ), " ip \"%s\"", SV_UserinfoValue( cl, "ip" ) );
 		Q_strcat( cmd, sizeof( cmd ), buf );
 	}
 
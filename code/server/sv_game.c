@@ -1026,7 +1026,7 @@ static void SV_InitGameVM( bool restart ) {
 	
 	// use the current msec count for a random seed
 	// init for this gamestate
-	VM_Call( gvm, 3, GAME_INIT, sv.time, Com_Milliseconds(), restart );
+	VM_Call( gvm, 3, GAME_INIT, sv.time, Com_ServerJournalSeed( Com_Milliseconds() ), restart );
 }
 
 
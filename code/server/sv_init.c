@@ -183,7 +183,8 @@ void SV_SetUserinfo( int index, const char *val ) {
 	}
 
 	Q_strncpyz( svs.clients[index].userinfo, val, sizeof( svs.clients[ index ].userinfo ) );
-	Q_strncpyz( svs.clients[index].name, Info_ValueForKey( val, "name" ), sizeof(svs.clients[index].name) );
+	svs.clients[index].userinfoTokenized = false;
+	Q_strncpyz( svs.clients[index].name, SV_UserinfoValue( &svs.clients[index], "name" ), sizeof(svs.clients[index].name) );
 }
 
 
@@ -404,6 +405,8 @@ void SV_SpawnServer( const char *mapname, bool killBots ) {
 	Com_Printf( "------ Server Initialization ------\n" );
 	Com_Printf( "Server: %s\n", mapname );
 
+	Com_ServerJournalSpawn( mapname, killBots );
+
 	Sys_SetStatus( "Initializing server..." );
 
 #ifndef DEDICATED
@@ -443,6 +446,9 @@ void SV_SpawnServer( const char *mapname, bool killBots ) {
 	FS_PureServerSetReferencedPaks( "", "" );
 #endif
 
+	// pk3 files removed or replaced while they were in use
+	FS_ApplyDeferredPakChanges();
+
 	// clear pak references
 	FS_ClearPakReferences( 0 );
 
@@ -497,10 +503,14 @@ void SV_SpawnServer( const char *mapname, bool killBots ) {
 	Cvar_Get( "sv_pure", "1", CVAR_SYSTEMINFO | CVAR_LATCH );
 
 	// get a new checksum feed and restart the file system
-	srand( Com_Milliseconds() );
+	srand( Com_ServerJournalSeed( Com_Milliseconds() ) );
 	Com_RandomBytes( (byte*)&sv.checksumFeed, sizeof( sv.checksumFeed ) );
+	sv.checksumFeed = Com_ServerJournalSeed( sv.checksumFeed );
 	FS_Restart( sv.checksumFeed );
 
+	// start recording pak file accesses for this map
+	FS_BeginMapLoad( mapname );
+
 	Sys_SetStatus( "Loading map %s", mapname );
 	CM_LoadMap( va( "maps/%s.bsp", mapname ), false, &checksum );
 
@@ -669,6 +679,11 @@ void SV_SpawnServer( const char *mapname, bool killBots ) {
 
 	Hunk_SetMark();
 
+	// a local client keeps recording until its cgame is loaded
+	if ( com_dedicated->integer ) {
+		FS_EndMapLoad();
+	}
+
 	Com_Printf ("-----------------------------------\n");
 
 	Sys_SetStatus( "Running map %s", mapname );
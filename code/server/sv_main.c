@@ -249,6 +249,9 @@ static void SV_MasterHeartbeat( const char *message )
 	if (!com_dedicated || com_dedicated->integer != 2 || !(netenabled & (NET_ENABLEV4 | NET_ENABLEV6)))
 		return;		// only dedicated servers send heartbeats
 
+	if ( com_serverReplay )
+		return;
+
 	// if not time yet, don't send anything
 	if ( svs.nextHeartbeatTime - svs.time > 0 )
 		return;
@@ -429,7 +432,7 @@ static leakyBucket_t *SVC_BucketForAddress( const netadr_t *address, int burst,
 	static leakyBucket_t dummy = { 0 };
 	static int		start = 0;
 	const int		hash = SVC_HashForAddress( address );
-	const int		now = Sys_Milliseconds();
+	const int		now = NET_Milliseconds();
 	leakyBucket_t	*bucket;
 	int				i, n;
 
@@ -520,7 +523,7 @@ SVC_RateLimit
 ================
 */
 bool SVC_RateLimit( rateLimit_t *bucket, int burst, int period ) {
-	int now = Sys_Milliseconds();
+	int now = NET_Milliseconds();
 	int interval = now - bucket->lastTime;
 	int expired = interval / period;
 	int expiredRemainder = interval % period;
@@ -552,7 +555,7 @@ static void SVC_RateDrop( leakyBucket_t *bucket, int burst ) {
 		if ( bucket->toxic < 10000 )
 			++bucket->toxic;
 		bucket->rate.burst = burst * bucket->toxic;
-		bucket->rate.lastTime = Sys_Milliseconds();
+		bucket->rate.lastTime = NET_Milliseconds();
 	}
 }
 
@@ -1299,7 +1302,7 @@ void SV_Frame( int msec ) {
 
 	if ( !com_sv_running->integer )
 	{
-		if ( com_dedicated->integer )
+		if ( com_dedicated->integer && !com_serverReplay )
 		{
 			// Block indefinitely until something interesting happens
 			// on STDIN.
@@ -1377,11 +1380,18 @@ void SV_Frame( int msec ) {
 	}
 
 	// update ping based on the all received frames
+	TRACE_BEGIN( "SV_CalcPings" );
 	SV_CalcPings();
+	TRACE_END();
 
-	if (com_dedicated->integer) SV_BotFrame (sv.time);
+	if (com_dedicated->integer) {
+		TRACE_BEGIN( "SV_BotFrame" );
+		SV_BotFrame (sv.time);
+		TRACE_END();
+	}
 
 	// run the game simulation in chunks
+	TRACE_BEGIN( "GAME_RUN_FRAME" );
 	while ( sv.timeResidual >= frameMsec ) {
 		sv.timeResidual -= frameMsec;
 		svs.time += frameMsec;
@@ -1390,6 +1400,7 @@ void SV_Frame( int msec ) {
 		// let everything in the world think and move
 		VM_Call( gvm, 1, GAME_RUN_FRAME, sv.time );
 	}
+	TRACE_END();
 
 	if ( com_speeds->integer ) {
 		time_game = Sys_Milliseconds () - startTime;
@@ -1402,7 +1413,9 @@ void SV_Frame( int msec ) {
 	SV_IssueNewSnapshot();
 
 	// send messages back to the clients
+	TRACE_BEGIN( "SV_SendClientMessages" );
 	SV_SendClientMessages();
+	TRACE_END();
 
 	// send a heartbeat to the master if needed
 	SV_MasterHeartbeat(HEARTBEAT_FOR_MASTER);
@@ -1439,7 +1452,7 @@ int SV_RateMsec( const client_t *client )
 		messageSize += UDPIP_HEADER_SIZE;
 		
 	rateMsec = messageSize * 1000 / ((int) (client->rate * com_timescale->value));
-	rate = Sys_Milliseconds() - client->netchan.lastSentTime;
+	rate = NET_Milliseconds() - client->netchan.lastSentTime;
 	
 	if ( rate > rateMsec )
 		return 0;
@@ -1473,7 +1486,7 @@ int SV_SendQueuedPackets( void )
 	{
 		// Rate limiting. This is very imprecise for high
 		// download rates due to millisecond timedelta resolution
-		dlStart = Sys_Milliseconds();
+		dlStart = NET_Milliseconds();
 		deltaT = dlNextRound - dlStart;
 
 		if(deltaT > 0)
@@ -1488,7 +1501,7 @@ int SV_SendQueuedPackets( void )
 			if(numBlocks)
 			{
 				// There are active downloads
-				deltaT = Sys_Milliseconds() - dlStart;
+				deltaT = NET_Milliseconds() - dlStart;
 
 				delayT = 1000 * numBlocks * MAX_DOWNLOAD_BLKSIZE;
 				delayT /= sv_dlRate->integer * 1024;
@@ -307,6 +307,59 @@ static void SV_AddIndexToSnapshot( svEntity_t *svEnt, int index, snapshotEntityN
 }
 
 
+/*
+===============
+SV_AreaConnected
+
+Tests area against the bits returned by CM_ConnectedAreas
+===============
+*/
+static ID_INLINE bool SV_AreaConnected( const byte *areas, int area ) {
+	if ( area < 0 ) {
+		return false;
+	}
+	return ( areas[ area >> 3 ] & ( 1 << ( area & 7 ) ) ) != 0;
+}
+
+
+/*
+===============
+SV_ClustersVisible
+
+Checks if any of the entity clusters is set in the pvs row
+===============
+*/
+static bool SV_ClustersVisible( const svEntity_t *svEnt, const byte *pvs ) {
+	const uint64_t *words;
+	int		i, l;
+
+	if ( svEnt->numClusterWords ) {
+		words = (const uint64_t *)pvs + svEnt->clusterWord;
+		for ( i = 0; i < svEnt->numClusterWords; i++ ) {
+			if ( words[i] & svEnt->clusterBits[i] ) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// check overflow clusters that couldn't be stored
+	if ( svEnt->numSpanClusters ) {
+		return CM_ClusterRangeVisible( pvs, svEnt->firstCluster, svEnt->firstCluster + svEnt->numSpanClusters - 1 );
+	}
+
+	// check individual leafs
+	for ( i = 0; i < svEnt->numClusters; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( pvs[l >> 3] & (1 << (l&7) ) ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /*
 ===============
 SV_AddEntitiesVisibleFromPoint
@@ -314,15 +367,14 @@ SV_AddEntitiesVisibleFromPoint
 */
 static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientSnapshot_t *frame,
 									snapshotEntityNumbers_t *eNums, bool portal ) {
-	int		e, i;
+	int		e;
 	sharedEntity_t *ent;
 	svEntity_t	*svEnt;
 	entityState_t  *es;
-	int		l;
 	int		clientarea, clientcluster;
 	int		leafnum;
 	byte	*clientpvs;
-	byte	*bitvector;
+	const byte *clientareas;
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -340,6 +392,9 @@ static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientSnapshot_
 
 	clientpvs = CM_ClusterPVS (clientcluster);
 
+	// areas connected to the client area, NULL if all are connected
+	clientareas = CM_ConnectedAreas( clientarea );
+
 	for ( e = 0 ; e < svs.currFrame->count; e++ ) {
 		es = svs.currFrame->ents[ e ];
 		ent = SV_GentityNum( es->number );
@@ -379,43 +434,16 @@ static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientSnapshot_
 
 		// ignore if not touching a PV leaf
 		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
+		if ( clientareas && !SV_AreaConnected( clientareas, svEnt->areanum ) ) {
 			// doors can legally straddle two areas, so
 			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
+			if ( !SV_AreaConnected( clientareas, svEnt->areanum2 ) ) {
 				continue;		// blocked by a door
 			}
 		}
 
-		bitvector = clientpvs;
-
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
-			continue;
-		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
-			}
-		}
-
-		// if we haven't found it to be visible,
-		// check overflow clusters that couldn't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
-				}
-			} else {
-				continue;
-			}
+		if ( !SV_ClustersVisible( svEnt, clientpvs ) ) {
+			continue;	// not visible
 		}
 
 		// add it
@@ -490,7 +518,7 @@ This always allocates new common snapshot frame
 */
 static void SV_BuildCommonSnapshot( void ) 
 {
-	sharedEntity_t	*list[ MAX_GENTITIES ];
+	sharedEntity_t	**list;
 	sharedEntity_t	*ent;
 	
 	snapshotFrame_t	*tmp;
@@ -500,6 +528,10 @@ static void SV_BuildCommonSnapshot( void )
 	int index;
 	int	num;
 	int i;
+	int mark;
+
+	mark = Com_FrameMark();
+	list = Com_FrameAlloc( MAX_GENTITIES * sizeof( *list ) );
 
 	count = 0;
 
@@ -573,6 +605,8 @@ static void SV_BuildCommonSnapshot( void )
 		svs.snapshotEntities[ index ] = list[ i ]->s;
 		sf->ents[ i ] = &svs.snapshotEntities[ index ];
 	}
+
+	Com_FrameRelease( mark );
 }
 
 
@@ -707,11 +741,14 @@ Also called by SV_FinalMessage
 =======================
 */
 void SV_SendClientSnapshot( client_t *client ) {
-	byte		msg_buf[ MAX_MSGLEN_BUF ];
+	byte		*msg_buf;
 	msg_t		msg;
+	int			mark;
 
 	// build the snapshot
+	TRACE_BEGIN_DETAIL( "SV_BuildClientSnapshot", client->name );
 	SV_BuildClientSnapshot( client );
+	TRACE_END();
 
 	// bots need to have their snapshots build, but
 	// the query them directly without needing to be sent
@@ -719,6 +756,9 @@ void SV_SendClientSnapshot( client_t *client ) {
 		return;
 	}
 
+	mark = Com_FrameMark();
+	msg_buf = Com_FrameAlloc( MAX_MSGLEN_BUF );
+
 	MSG_Init( &msg, msg_buf, MAX_MSGLEN );
 	msg.allowoverflow = true;
 
@@ -731,7 +771,9 @@ void SV_SendClientSnapshot( client_t *client ) {
 
 	// send over all the relevant entityState_t
 	// and the playerState_t
+	TRACE_BEGIN_DETAIL( "SV_WriteSnapshotToClient", client->name );
 	SV_WriteSnapshotToClient( client, &msg );
+	TRACE_END();
 
 	// check for overflow
 	if ( msg.overflowed ) {
@@ -740,6 +782,8 @@ void SV_SendClientSnapshot( client_t *client ) {
 	}
 
 	SV_SendMessageToClient( &msg, client );
+
+	Com_FrameRelease( mark );
 }
 
 
@@ -753,7 +797,7 @@ void SV_SendClientMessages( void )
 	int		i;
 	client_t	*c;
 
-	svs.msgTime = Sys_Milliseconds();
+	svs.msgTime = NET_Milliseconds();
 
 	// send a message to each connected client
 	for( i = 0; i < sv_maxclients->integer; i++ )
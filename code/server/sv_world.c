@@ -206,6 +206,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	worldSector_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
+	int			firstCluster, lastCluster;
+	bool		listOverflowed, leafsOverflowed;
+	byte		*bits;
 	int			num_leafs;
 	int			i, j, k;
 	int			area;
@@ -279,8 +282,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	gEnt->r.absmax[2] += 1;
 
 	// link to PVS leafs
+	ent->numClusterWords = 0;
 	ent->numClusters = 0;
-	ent->lastCluster = 0;
+	ent->numSpanClusters = 0;
 	ent->areanum = -1;
 	ent->areanum2 = -1;
 
@@ -314,20 +318,62 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	}
 
 	// store as many explicit clusters as we can
-	ent->numClusters = 0;
+	// and find the span of all touched clusters
+	firstCluster = MAX_QINT;
+	lastCluster = -1;
+	listOverflowed = false;
 	for (i=0 ; i < num_leafs ; i++) {
 		cluster = CM_LeafCluster( leafs[i] );
-		if ( cluster != -1 ) {
+		if ( cluster == -1 ) {
+			continue;
+		}
+		if ( cluster < firstCluster ) {
+			firstCluster = cluster;
+		}
+		if ( cluster > lastCluster ) {
+			lastCluster = cluster;
+		}
+		if ( ent->numClusters < MAX_ENT_CLUSTERS ) {
 			ent->clusternums[ent->numClusters++] = cluster;
-			if ( ent->numClusters == MAX_ENT_CLUSTERS ) {
-				break;
+		} else {
+			listOverflowed = true;
+		}
+	}
+
+	// clusters of the leafs that couldn't be stored are unknown,
+	// so extend the span up to the last one
+	leafsOverflowed = ( num_leafs == MAX_TOTAL_ENT_LEAFS && lastLeaf != leafs[num_leafs-1] );
+	if ( leafsOverflowed ) {
+		cluster = CM_LeafCluster( lastLeaf );
+		if ( cluster != -1 ) {
+			if ( cluster < firstCluster ) {
+				firstCluster = cluster;
+			}
+			if ( cluster > lastCluster ) {
+				lastCluster = cluster;
 			}
 		}
 	}
 
-	// store off a last cluster if we need to
-	if ( i != num_leafs ) {
-		ent->lastCluster = CM_LeafCluster( lastLeaf );
+	if ( lastCluster != -1 ) {
+		if ( !leafsOverflowed && lastCluster < CM_NumClusters()
+			&& ( lastCluster >> 6 ) - ( firstCluster >> 6 ) < MAX_ENT_CLUSTER_WORDS ) {
+			// exact bitmask aligned with the pvs words
+			ent->clusterWord = firstCluster >> 6;
+			ent->numClusterWords = ( lastCluster >> 6 ) - ent->clusterWord + 1;
+			Com_Memset( ent->clusterBits, 0, sizeof( ent->clusterBits ) );
+			bits = (byte *)ent->clusterBits;
+			for ( i = 0; i < num_leafs; i++ ) {
+				cluster = CM_LeafCluster( leafs[i] );
+				if ( cluster != -1 ) {
+					cluster -= ent->clusterWord << 6;
+					bits[ cluster >> 3 ] |= 1 << ( cluster & 7 );
+				}
+			}
+		} else if ( listOverflowed || leafsOverflowed ) {
+			ent->firstCluster = firstCluster;
+			ent->numSpanClusters = lastCluster - firstCluster + 1;
+		}
 	}
 
 	gEnt->r.linkcount++;
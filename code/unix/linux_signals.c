@@ -68,6 +68,8 @@ static void signal_handler( int sig )
 #endif
 	SV_Shutdown( msg );
 	VM_Forced_Unload_Done();
+	// the console log writer is still running, let it finish
+	Com_LogFlush();
 	Sys_Exit( 0 ); // send a 0 to avoid DOUBLE SIGNAL FAULT
 }
 
@@ -334,6 +334,8 @@ void NORETURN FORMAT_PRINTF(1, 2) QDECL Sys_Error( const char *format, ... )
 
 	fprintf( stderr, "Sys_Error: %s\n", text );
 
+	Com_LogFlush();
+
 	Sys_Exit( 1 ); // bk010104 - use single exit point.
 }
 
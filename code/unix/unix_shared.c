@@ -28,10 +28,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <dirent.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <fcntl.h>
 #include <sys/time.h>
 #include <pwd.h>
 #include <dlfcn.h>
 #include <libgen.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
@@ -316,6 +321,102 @@ bool Sys_GetFileStats( const char *filename, fileOffset_t *size, fileTime_t *mti
 }
 
 
+#ifdef __linux__
+static int	watchFd = -1;
+static int	watchLen;
+static int	watchPos;
+static byte	watchBuf[ 4096 ] __attribute__(( aligned( __alignof__( struct inotify_event ) ) ));
+#endif
+
+/*
+=================
+Sys_WatchDirectory
+
+Starts reporting files created, written, renamed or removed in the directory,
+returns watch number or -1 if change notification is not available
+=================
+*/
+int Sys_WatchDirectory( const char *path )
+{
+#ifdef __linux__
+	if ( watchFd == -1 ) {
+		watchFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+		if ( watchFd == -1 )
+			return -1;
+		watchLen = watchPos = 0;
+	}
+
+	return inotify_add_watch( watchFd, path, IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR );
+#else
+	return -1;
+#endif
+}
+
+
+/*
+=================
+Sys_UnwatchDirectories
+=================
+*/
+void Sys_UnwatchDirectories( void )
+{
+#ifdef __linux__
+	if ( watchFd != -1 ) {
+		close( watchFd );
+		watchFd = -1;
+	}
+	watchLen = watchPos = 0;
+#endif
+}
+
+
+/*
+=================
+Sys_NextDirectoryChange
+
+Returns name of the next changed file and its watch number without blocking,
+NULL if there are no more notifications. Empty name with watch -1 means
+that notifications were lost and every watched directory should be rescanned
+=================
+*/
+const char *Sys_NextDirectoryChange( int *watch )
+{
+#ifdef __linux__
+	const struct inotify_event *ev;
+	ssize_t n;
+
+	if ( watchFd == -1 )
+		return NULL;
+
+	for ( ;; ) {
+		if ( watchPos >= watchLen ) {
+			n = read( watchFd, watchBuf, sizeof( watchBuf ) );
+			if ( n <= 0 )
+				return NULL;
+			watchLen = (int)n;
+			watchPos = 0;
+		}
+
+		ev = (const struct inotify_event *)( watchBuf + watchPos );
+		watchPos += sizeof( *ev ) + ev->len;
+
+		if ( ev->mask & IN_Q_OVERFLOW ) {
+			*watch = -1;
+			return "";
+		}
+
+		// skip events of the directory itself
+		if ( ev->len && ev->name[0] != '\0' ) {
+			*watch = ev->wd;
+			return ev->name;
+		}
+	}
+#else
+	return NULL;
+#endif
+}
+
+
 /*
 =================
 Sys_Mkdir
@@ -353,6 +454,358 @@ FILE *Sys_FOpen( const char *ospath, const char *mode )
 }
 
 
+/*
+=================
+Sys_MapFile
+
+Maps length bytes of the file starting at offset copy-on-write into memory,
+writes through the returned pointer never reach the file.
+Returns pointer to the data at offset or NULL on failure
+=================
+*/
+void *Sys_MapFile( FILE *f, fileOffset_t offset, int length )
+{
+	fileOffset_t base;
+	size_t page;
+	void *ptr;
+
+	if ( length <= 0 || offset < 0 )
+		return NULL;
+
+	page = (size_t)sysconf( _SC_PAGESIZE );
+	base = offset & ~(fileOffset_t)( page - 1 );
+
+	ptr = mmap( NULL, (size_t)( offset - base ) + length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno( f ), base );
+	if ( ptr == MAP_FAILED )
+		return NULL;
+
+	return (byte *)ptr + ( offset - base );
+}
+
+
+/*
+=================
+Sys_ReadAhead
+
+Asks the kernel to start reading the given range of the file into the page cache,
+returns false if there is no way to do it without reading the data ourselves
+=================
+*/
+bool Sys_ReadAhead( FILE *f, fileOffset_t offset, fileOffset_t length )
+{
+#if defined( POSIX_FADV_WILLNEED )
+	return posix_fadvise( fileno( f ), offset, length, POSIX_FADV_WILLNEED ) == 0;
+#elif defined( F_RDADVISE )
+	struct radvisory ra;
+
+	ra.ra_offset = offset;
+	ra.ra_count = (int)length;
+	return fcntl( fileno( f ), F_RDADVISE, &ra ) != -1;
+#else
+	return false;
+#endif
+}
+
+
+/*
+=================
+Sys_UnmapFile
+=================
+*/
+void Sys_UnmapFile( void *data, int length )
+{
+	size_t page;
+	byte *base;
+
+	page = (size_t)sysconf( _SC_PAGESIZE );
+	base = (byte *)( (intptr_t)data & ~(intptr_t)( page - 1 ) );
+
+	munmap( base, ( (byte *)data - base ) + length );
+}
+
+
+/*
+=================
+Sys_DetachMappedFile
+
+Moves data of a view returned by Sys_MapFile into anonymous memory at the same
+address, so truncating or rewriting the file can't change the view or fault
+on it. Sys_UnmapFile still releases it
+=================
+*/
+bool Sys_DetachMappedFile( void *data, int length )
+{
+	size_t page, size;
+	byte *base, *copy;
+
+	page = (size_t)sysconf( _SC_PAGESIZE );
+	base = (byte *)( (intptr_t)data & ~(intptr_t)( page - 1 ) );
+	size = ( (byte *)data - base ) + length;
+
+	copy = malloc( size );
+	if ( copy == NULL )
+		return false;
+
+	memcpy( copy, base, size );
+	if ( mmap( base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0 ) == MAP_FAILED ) {
+		free( copy );
+		return false;
+	}
+	memcpy( base, copy, size );
+	free( copy );
+
+	return true;
+}
+
+
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+/*
+=================
+Sys_AllocPages
+
+Result gets flags that actually took effect
+=================
+*/
+void *Sys_AllocPages( size_t size, int flags, int *result )
+{
+	size_t page, i;
+	byte *ptr;
+
+	*result = 0;
+	ptr = MAP_FAILED;
+	page = (size_t)sysconf( _SC_PAGESIZE );
+
+#ifdef MAP_HUGETLB
+	if ( flags & PAGES_HUGETLB ) {
+		ptr = mmap( NULL, PAD( size, HUGE_PAGE_SIZE ), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+		if ( ptr != MAP_FAILED ) {
+			*result |= PAGES_HUGETLB;
+			size = PAD( size, HUGE_PAGE_SIZE );
+			page = HUGE_PAGE_SIZE;
+		}
+	}
+#endif
+
+	if ( ptr == MAP_FAILED ) {
+		if ( flags & ( PAGES_HUGE | PAGES_HUGETLB ) ) {
+			byte *base;
+			size_t len;
+			// over-allocate to align on huge page boundary
+			len = PAD( size, HUGE_PAGE_SIZE ) + HUGE_PAGE_SIZE;
+			base = mmap( NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+			if ( base == MAP_FAILED ) {
+				return NULL;
+			}
+			ptr = PADP( base, HUGE_PAGE_SIZE );
+			size = PAD( size, HUGE_PAGE_SIZE );
+			if ( ptr > base ) {
+				munmap( base, ptr - base );
+			}
+			if ( base + len > ptr + size ) {
+				munmap( ptr + size, ( base + len ) - ( ptr + size ) );
+			}
+#ifdef MADV_HUGEPAGE
+			if ( madvise( ptr, size, MADV_HUGEPAGE ) == 0 ) {
+				*result |= PAGES_HUGE;
+			}
+#endif
+		} else {
+			ptr = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+			if ( ptr == MAP_FAILED ) {
+				return NULL;
+			}
+		}
+	}
+
+	if ( flags & ( PAGES_PREFAULT | PAGES_LOCK ) ) {
+		// first touch places pages on the NUMA node of this thread
+		for ( i = 0; i < size; i += page ) {
+			ptr[ i ] = 0;
+		}
+		*result |= PAGES_PREFAULT;
+	}
+
+	if ( flags & PAGES_LOCK ) {
+		if ( mlock( ptr, size ) == 0 ) {
+			*result |= PAGES_LOCK;
+		} else {
+			Com_Printf( S_COLOR_YELLOW "WARNING: mlock() failed on %i bytes: %s\n", (int)size, strerror( errno ) );
+		}
+	}
+
+	return ptr;
+}
+
+
+typedef struct {
+	pthread_t	thread;
+	void		(*func)( void *arg );
+	void		*arg;
+} sysThread_t;
+
+
+static void *Sys_ThreadMain( void *arg )
+{
+	sysThread_t *t = (sysThread_t *)arg;
+	t->func( t->arg );
+	return NULL;
+}
+
+
+/*
+=================
+Sys_CreateThread
+
+Starts func( arg ) on a new thread, returns NULL on failure
+=================
+*/
+void *Sys_CreateThread( void (*func)( void *arg ), void *arg )
+{
+	sysThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if ( t == NULL )
+		return NULL;
+
+	t->func = func;
+	t->arg = arg;
+
+	if ( pthread_create( &t->thread, NULL, Sys_ThreadMain, t ) != 0 )
+	{
+		free( t );
+		return NULL;
+	}
+
+	return t;
+}
+
+
+/*
+=================
+Sys_JoinThread
+
+Waits for the thread to finish and releases it
+=================
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = (sysThread_t *)thread;
+
+	pthread_join( t->thread, NULL );
+	free( t );
+}
+
+
+/*
+=================
+Sys_NumCPUs
+=================
+*/
+int Sys_NumCPUs( void )
+{
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+	return ( n > 0 ) ? (int)n : 1;
+}
+
+
+/*
+=================
+Sys_CreateMutex
+=================
+*/
+void *Sys_CreateMutex( void )
+{
+	pthread_mutex_t *m;
+
+	m = malloc( sizeof( *m ) );
+	if ( m == NULL || pthread_mutex_init( m, NULL ) != 0 )
+		Sys_Error( "Sys_CreateMutex: failed" );
+
+	return m;
+}
+
+
+void Sys_DestroyMutex( void *mutex )
+{
+	pthread_mutex_destroy( (pthread_mutex_t *)mutex );
+	free( mutex );
+}
+
+
+void Sys_LockMutex( void *mutex )
+{
+	pthread_mutex_lock( (pthread_mutex_t *)mutex );
+}
+
+
+void Sys_UnlockMutex( void *mutex )
+{
+	pthread_mutex_unlock( (pthread_mutex_t *)mutex );
+}
+
+
+/*
+=================
+Sys_CreateSemaphore
+
+Counting semaphore starting at zero, built on a condition variable
+because unnamed POSIX semaphores are not available everywhere
+=================
+*/
+typedef struct {
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	int				count;
+} sysSemaphore_t;
+
+void *Sys_CreateSemaphore( void )
+{
+	sysSemaphore_t *s;
+
+	s = malloc( sizeof( *s ) );
+	if ( s == NULL || pthread_mutex_init( &s->mutex, NULL ) != 0 || pthread_cond_init( &s->cond, NULL ) != 0 )
+		Sys_Error( "Sys_CreateSemaphore: failed" );
+
+	s->count = 0;
+
+	return s;
+}
+
+
+void Sys_DestroySemaphore( void *sem )
+{
+	sysSemaphore_t *s = (sysSemaphore_t *)sem;
+
+	pthread_cond_destroy( &s->cond );
+	pthread_mutex_destroy( &s->mutex );
+	free( s );
+}
+
+
+void Sys_PostSemaphore( void *sem )
+{
+	sysSemaphore_t *s = (sysSemaphore_t *)sem;
+
+	pthread_mutex_lock( &s->mutex );
+	s->count++;
+	pthread_cond_signal( &s->cond );
+	pthread_mutex_unlock( &s->mutex );
+}
+
+
+void Sys_WaitSemaphore( void *sem )
+{
+	sysSemaphore_t *s = (sysSemaphore_t *)sem;
+
+	pthread_mutex_lock( &s->mutex );
+	while ( s->count == 0 )
+		pthread_cond_wait( &s->cond, &s->mutex );
+	s->count--;
+	pthread_mutex_unlock( &s->mutex );
+}
+
+
 /*
 ==============
 Sys_ResetReadOnlyAttribute
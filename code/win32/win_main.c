@@ -87,6 +87,8 @@ void NORETURN FORMAT_PRINTF(1, 2) QDECL Sys_Error( const char *error, ... ) {
 	Sys_SetErrorText( text );
 	Sys_ShowConsole( 1, true );
 
+	Com_LogFlush();
+
 	timeEndPeriod( 1 );
 
 	// wait for the user to quit
@@ -168,6 +170,333 @@ FILE *Sys_FOpen( const char *ospath, const char *mode )
 }
 
 
+/*
+==============
+Sys_MapFile
+
+Maps length bytes of the file starting at offset copy-on-write into memory,
+writes through the returned pointer never reach the file.
+Returns pointer to the data at offset or NULL on failure
+==============
+*/
+void *Sys_MapFile( FILE *f, fileOffset_t offset, int length )
+{
+	SYSTEM_INFO info;
+	HANDLE hFile, hMap;
+	fileOffset_t base;
+	void *ptr;
+
+	if ( length <= 0 || offset < 0 )
+		return NULL;
+
+	hFile = (HANDLE)_get_osfhandle( _fileno( f ) );
+	if ( hFile == INVALID_HANDLE_VALUE )
+		return NULL;
+
+	hMap = CreateFileMappingA( hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+	if ( hMap == NULL )
+		return NULL;
+
+	// view offset must be a multiple of the allocation granularity
+	GetSystemInfo( &info );
+	base = offset & ~(fileOffset_t)( info.dwAllocationGranularity - 1 );
+
+	ptr = MapViewOfFile( hMap, FILE_MAP_COPY, (DWORD)( (uint64_t)base >> 32 ), (DWORD)base, (SIZE_T)( offset - base ) + length );
+
+	// view keeps a reference to the mapping object
+	CloseHandle( hMap );
+
+	if ( ptr == NULL )
+		return NULL;
+
+	return (byte *)ptr + ( offset - base );
+}
+
+
+/*
+==============
+Sys_ReadAhead
+
+There is no readahead hint for plain file handles,
+caller has to read the range itself to bring it into the cache
+==============
+*/
+bool Sys_ReadAhead( FILE *f, fileOffset_t offset, fileOffset_t length )
+{
+	return false;
+}
+
+
+/*
+=================
+Sys_AllocPages
+
+Large pages need SeLockMemoryPrivilege, there are no transparent ones
+=================
+*/
+void *Sys_AllocPages( size_t size, int flags, int *result )
+{
+	SYSTEM_INFO info;
+	SIZE_T large;
+	byte *ptr;
+	size_t i;
+
+	*result = 0;
+	ptr = NULL;
+
+	if ( flags & ( PAGES_HUGE | PAGES_HUGETLB ) ) {
+		large = GetLargePageMinimum();
+		if ( large ) {
+			ptr = VirtualAlloc( NULL, PAD( size, large ), MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+			if ( ptr ) {
+				// always resident
+				*result |= PAGES_HUGETLB | PAGES_PREFAULT | PAGES_LOCK;
+				return ptr;
+			}
+		}
+	}
+
+	ptr = VirtualAlloc( NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+	if ( ptr == NULL ) {
+		return NULL;
+	}
+
+	if ( flags & ( PAGES_PREFAULT | PAGES_LOCK ) ) {
+		GetSystemInfo( &info );
+		// first touch places pages on the NUMA node of this thread
+		for ( i = 0; i < size; i += info.dwPageSize ) {
+			ptr[ i ] = 0;
+		}
+		*result |= PAGES_PREFAULT;
+	}
+
+	if ( flags & PAGES_LOCK ) {
+		if ( VirtualLock( ptr, size ) ) {
+			*result |= PAGES_LOCK;
+		} else {
+			Com_Printf( S_COLOR_YELLOW "WARNING: VirtualLock() failed on %i bytes\n", (int)size );
+		}
+	}
+
+	return ptr;
+}
+
+
+/*
+==============
+Sys_WatchDirectory
+
+Directory change notification is not implemented,
+pk3 changes are picked up by \fs_rescan or \fs_restart
+==============
+*/
+int Sys_WatchDirectory( const char *path )
+{
+	return -1;
+}
+
+
+/*
+==============
+Sys_UnwatchDirectories
+==============
+*/
+void Sys_UnwatchDirectories( void )
+{
+}
+
+
+/*
+==============
+Sys_NextDirectoryChange
+==============
+*/
+const char *Sys_NextDirectoryChange( int *watch )
+{
+	return NULL;
+}
+
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( void *data, int length )
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+
+	UnmapViewOfFile( (void *)( (intptr_t)data & ~(intptr_t)( info.dwAllocationGranularity - 1 ) ) );
+}
+
+
+/*
+==============
+Sys_DetachMappedFile
+
+Windows refuses to truncate or replace a file while a view of it is mapped,
+so the view is kept as it is
+==============
+*/
+bool Sys_DetachMappedFile( void *data, int length )
+{
+	return true;
+}
+
+
+typedef struct {
+	HANDLE	thread;
+	void	(*func)( void *arg );
+	void	*arg;
+} sysThread_t;
+
+
+static DWORD WINAPI Sys_ThreadMain( LPVOID arg )
+{
+	sysThread_t *t = (sysThread_t *)arg;
+	t->func( t->arg );
+	return 0;
+}
+
+
+/*
+==============
+Sys_CreateThread
+
+Starts func( arg ) on a new thread, returns NULL on failure
+==============
+*/
+void *Sys_CreateThread( void (*func)( void *arg ), void *arg )
+{
+	sysThread_t *t;
+
+	t = malloc( sizeof( *t ) );
+	if ( t == NULL )
+		return NULL;
+
+	t->func = func;
+	t->arg = arg;
+
+	t->thread = CreateThread( NULL, 0, Sys_ThreadMain, t, 0, NULL );
+	if ( t->thread == NULL )
+	{
+		free( t );
+		return NULL;
+	}
+
+	return t;
+}
+
+
+/*
+==============
+Sys_JoinThread
+
+Waits for the thread to finish and releases it
+==============
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = (sysThread_t *)thread;
+
+	WaitForSingleObject( t->thread, INFINITE );
+	CloseHandle( t->thread );
+	free( t );
+}
+
+
+/*
+==============
+Sys_NumCPUs
+==============
+*/
+int Sys_NumCPUs( void )
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+
+	return ( info.dwNumberOfProcessors > 0 ) ? (int)info.dwNumberOfProcessors : 1;
+}
+
+
+/*
+==============
+Sys_CreateMutex
+==============
+*/
+void *Sys_CreateMutex( void )
+{
+	CRITICAL_SECTION *cs;
+
+	cs = malloc( sizeof( *cs ) );
+	if ( cs == NULL )
+		Sys_Error( "Sys_CreateMutex: failed" );
+
+	InitializeCriticalSection( cs );
+
+	return cs;
+}
+
+
+void Sys_DestroyMutex( void *mutex )
+{
+	DeleteCriticalSection( (CRITICAL_SECTION *)mutex );
+	free( mutex );
+}
+
+
+void Sys_LockMutex( void *mutex )
+{
+	EnterCriticalSection( (CRITICAL_SECTION *)mutex );
+}
+
+
+void Sys_UnlockMutex( void *mutex )
+{
+	LeaveCriticalSection( (CRITICAL_SECTION *)mutex );
+}
+
+
+/*
+==============
+Sys_CreateSemaphore
+
+Counting semaphore starting at zero
+==============
+*/
+void *Sys_CreateSemaphore( void )
+{
+	HANDLE h;
+
+	h = CreateSemaphoreA( NULL, 0, 0x7FFFFFFF, NULL );
+	if ( h == NULL )
+		Sys_Error( "Sys_CreateSemaphore: failed" );
+
+	return h;
+}
+
+
+void Sys_DestroySemaphore( void *sem )
+{
+	CloseHandle( (HANDLE)sem );
+}
+
+
+void Sys_PostSemaphore( void *sem )
+{
+	ReleaseSemaphore( (HANDLE)sem, 1, NULL );
+}
+
+
+void Sys_WaitSemaphore( void *sem )
+{
+	WaitForSingleObject( (HANDLE)sem, INFINITE );
+}
+
+
 /*
 ==============
 Sys_ResetReadOnlyAttribute